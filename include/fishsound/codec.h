@@ -0,0 +1,214 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef __FISH_SOUND_CODEC_H__
+#define __FISH_SOUND_CODEC_H__
+
+/** \file
+ * Registration of codecs.
+ *
+ * FishSound finds the codec for each handle in a process-wide registry.
+ * The codecs built into the library are registered with priority 0;
+ * applications can add their own codecs, replace the built-in ones, and
+ * change the priority in which codecs are tried by fish_sound_identify().
+ *
+ * A codec is described by a FishSoundCodec, which must remain valid
+ * while it is registered. Its functions are called with the handle being
+ * decoded or encoded; they keep their state with
+ * fish_sound_codec_set_data(), report the audio format of a decoded
+ * stream with fish_sound_codec_set_info(), and pass output to the
+ * application with fish_sound_codec_decoded() and
+ * fish_sound_codec_encoded().
+ *
+ * The registry is not locked: codecs must be registered, and priorities
+ * changed, before any handles are created by other threads.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The codec can decode */
+#define FISH_SOUND_CODEC_DECODE 0x01
+
+/** The codec can encode */
+#define FISH_SOUND_CODEC_ENCODE 0x02
+
+/** The longest signature of a FishSoundCodec, in bytes */
+#define FISH_SOUND_CODEC_SIGNATURE_MAX 8
+
+/**
+ * A codec.
+ */
+typedef struct {
+  /** The format implemented. Codecs of applications should use formats
+   * from FISH_SOUND_CODEC_USER upwards */
+  FishSoundFormat format;
+
+  /** FISH_SOUND_CODEC_DECODE and/or FISH_SOUND_CODEC_ENCODE */
+  int flags;
+
+  /** The first bytes of the initial header of a stream, or NULL */
+  const char * signature;
+
+  /** The length of \a signature, at most FISH_SOUND_CODEC_SIGNATURE_MAX */
+  int signature_length;
+
+  /** Check a buffer whose signature matches, as for fish_sound_identify(),
+   * returning the format or FISH_SOUND_UNKNOWN; or NULL to accept any
+   * buffer matching \a signature */
+  int (*identify) (unsigned char * buf, long bytes);
+
+  /** Set up a handle for this codec, returning NULL on failure */
+  FishSound * (*init) (FishSound * fsound);
+
+  /** Free the codec state of a handle */
+  FishSound * (*del) (FishSound * fsound);
+
+  /** Discard buffered data, eg. on seeking */
+  int (*reset) (FishSound * fsound);
+
+  /** Called when a decoded callback is set, possibly before the stream
+   * header has been decoded, with the new interleave setting: 1 for
+   * fish_sound_set_decoded_float_ilv(), 0 for fish_sound_set_decoded_float().
+   * A negative return rejects the callback: it is returned to the caller,
+   * and neither the callback nor the interleave setting is changed. NULL
+   * if the codec needs no notification */
+  int (*update) (FishSound * fsound, int interleave);
+
+  /** Handle a fish_sound_command() not handled by FishSound, or NULL */
+  int (*command) (FishSound * fsound, int command, void * data,
+		  int datasize);
+
+  /** Decode a packet */
+  long (*decode) (FishSound * fsound, unsigned char * buf, long bytes);
+
+  /** Encode interleaved PCM */
+  long (*encode_f_ilv) (FishSound * fsound, float ** pcm, long frames);
+
+  /** Encode non-interleaved PCM */
+  long (*encode_f) (FishSound * fsound, float * pcm[], long frames);
+
+  /** Flush buffered data at the end of encoding, or NULL */
+  long (*flush) (FishSound * fsound);
+} FishSoundCodec;
+
+/**
+ * Register a codec, replacing any registered for the same format.
+ * \param codec The codec
+ * \param priority Codecs are tried in decreasing order of priority when
+ * identifying a stream, and in order of registration among codecs with
+ * equal priority
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD \a codec is NULL
+ * \retval FISH_SOUND_ERR_INVALID The format or signature of \a codec is
+ * invalid
+ * \retval FISH_SOUND_ERR_OUT_OF_MEMORY The registry is full
+ */
+int fish_sound_codec_register (const FishSoundCodec * codec, int priority);
+
+/**
+ * Remove a codec from the registry. Handles created with the codec may
+ * continue to use it.
+ * \param format The format of the codec
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_INVALID No codec is registered for \a format
+ */
+int fish_sound_codec_unregister (int format);
+
+/**
+ * Change the priority of a registered codec.
+ * \param format The format of the codec
+ * \param priority The new priority
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_INVALID No codec is registered for \a format
+ */
+int fish_sound_codec_set_priority (int format, int priority);
+
+/**
+ * Retrieve the codec state of a handle.
+ * \param fsound A FishSound* handle
+ * \returns The state set with fish_sound_codec_set_data(), or NULL
+ */
+void * fish_sound_codec_get_data (FishSound * fsound);
+
+/**
+ * Set the codec state of a handle, typically in the init() function of
+ * a FishSoundCodec. The codec is responsible for freeing it in del().
+ * \param fsound A FishSound* handle
+ * \param data The codec state
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD \a fsound is not a valid FishSound* handle
+ */
+int fish_sound_codec_set_data (FishSound * fsound, void * data);
+
+/**
+ * Set the sample rate and channels of a stream, as found by a decoder.
+ * \param fsound A FishSound* handle
+ * \param samplerate The sample rate in Hz
+ * \param channels The number of channels
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD \a fsound is not a valid FishSound* handle
+ */
+int fish_sound_codec_set_info (FishSound * fsound, int samplerate,
+			       int channels);
+
+/**
+ * Pass decoded audio to the application, advancing the frame number.
+ * \param fsound A FishSound* handle
+ * \param pcm The audio: an array of per-channel buffers, or if the handle
+ * is interleaved, a single interleaved buffer cast to (float **)
+ * \param frames The number of frames of audio
+ * \returns The return value of the decoded callback, or 0 if none is set
+ * \retval FISH_SOUND_ERR_BAD \a fsound is not a valid FishSound* handle
+ */
+int fish_sound_codec_decoded (FishSound * fsound, float ** pcm, long frames);
+
+/**
+ * Pass an encoded packet to the application.
+ * \param fsound A FishSound* handle
+ * \param buf The packet
+ * \param bytes The length of the packet
+ * \param frameno The frame number at the end of the packet, as returned by
+ * fish_sound_get_frameno() during the encoded callback
+ * \returns The return value of the encoded callback, or 0 if none is set
+ * \retval FISH_SOUND_ERR_BAD \a fsound is not a valid FishSound* handle
+ */
+int fish_sound_codec_encoded (FishSound * fsound, unsigned char * buf,
+			      long bytes, long frameno);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FISH_SOUND_CODEC_H__ */
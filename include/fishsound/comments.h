@@ -76,12 +76,27 @@
  * with the same \a name, you should not use
  * fish_sound_comment_first_byname() as a simple "get" function.
  *
+ * \section comments_filter Filtering decoded comments
+ *
+ * Some comments, such as METADATA_BLOCK_PICTURE, carry megabytes of
+ * data. A decoder can be given a size limit for stored values and a
+ * filter callback to choose which comments to keep, skip, or stream to
+ * the application in chunks; see fish_sound_comment_set_filter().
+ *
  * \section comments_set Encoding comments
  * 
  * For encoding, FishSound contains API methods for adding comments
  * (fish_sound_comment_add() and fish_sound_comment_add_byname()
  * and for removing comments
  * (fish_sound_comment_remove() and fish_sound_comment_remove_byname()).
+ *
+ * \section comments_shared Sharing comments between encoders
+ *
+ * When many encoders carry the same comments, build them once as a
+ * FishSoundCommentSet with fish_sound_comment_set_new() and attach it to
+ * each encoder with fish_sound_comment_attach_set(). Attached encoders
+ * share the comments and their serialized form; an encoder that adds or
+ * removes comments first takes its own copy, leaving the set unchanged.
  */
 
 #include <fishsound/fishsound.h>
@@ -97,6 +112,65 @@ typedef struct {
   char * value;
 } FishSoundComment;
 
+/**
+ * A cursor over the comments of a FishSound* handle, initialized with
+ * fish_sound_comment_iter_init(). The members are private to FishSound.
+ * An iterator is invalidated by removing comments from the handle;
+ * comments added during iteration are visited.
+ */
+typedef struct {
+  /** The handle whose comments are iterated */
+  FishSound * fsound;
+
+  /** The name to match, or NULL to match all comments */
+  const char * name;
+
+  /** Index of the next comment to examine */
+  int index;
+} FishSoundCommentIter;
+
+/**
+ * An immutable, reference counted set of comments, which can be attached
+ * to any number of encoders. The members are private to FishSound.
+ */
+typedef struct _FishSoundCommentSet FishSoundCommentSet;
+
+/** The maximum number of bytes passed in one call to a
+ * FishSoundCommentStream callback */
+#define FISH_SOUND_COMMENT_CHUNK_SIZE 65536
+
+/**
+ * Signature of a callback choosing what to do with a decoded comment.
+ * \param fsound The FishSound* handle
+ * \param name The name of the comment
+ * \param value_length The length of the value in bytes, or 0 if the
+ *   comment has no value
+ * \param user_data Arbitrary user data
+ * \returns A FishSoundCommentAction
+ */
+typedef int (*FishSoundCommentFilter) (FishSound * fsound, const char * name,
+				       long value_length, void * user_data);
+
+/**
+ * Signature of a callback receiving a streamed comment value. The value
+ * is passed in order, in chunks of at most FISH_SOUND_COMMENT_CHUNK_SIZE
+ * bytes, during the call to fish_sound_decode() which decodes the comment
+ * header. The chunks are not NUL-terminated.
+ * \param fsound The FishSound* handle
+ * \param name The name of the comment
+ * \param data A chunk of the value
+ * \param bytes The length of the chunk
+ * \param offset The offset of the chunk within the value
+ * \param value_length The length of the whole value
+ * \param user_data Arbitrary user data
+ * \retval FISH_SOUND_CONTINUE Continue streaming this value
+ * \retval FISH_SOUND_STOP_OK Skip the rest of this value
+ */
+typedef int (*FishSoundCommentStream) (FishSound * fsound, const char * name,
+				       const unsigned char * data, long bytes,
+				       long offset, long value_length,
+				       void * user_data);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -157,6 +231,51 @@ const FishSoundComment *
 fish_sound_comment_next_byname (FishSound * fsound,
 				const FishSoundComment * comment);
 
+/**
+ * Initialize a comment iterator.
+ * \param fsound A FishSound* handle
+ * \param iter The iterator to initialize
+ * \param name The name of comments to visit, or NULL to visit all comments.
+ *   The string is not copied and must remain valid while \a iter is used.
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD \a fsound or \a iter is NULL
+ * \retval FISH_SOUND_ERR_COMMENT_INVALID \a name is not a valid comment name
+ */
+int
+fish_sound_comment_iter_init (FishSound * fsound, FishSoundCommentIter * iter,
+			      const char * name);
+
+/**
+ * Retrieve the next comment from an iterator.
+ * \param iter An iterator initialized by fish_sound_comment_iter_init()
+ * \returns A read-only copy of the next matching comment
+ * \retval NULL No further comments match
+ */
+const FishSoundComment *
+fish_sound_comment_iter_next (FishSoundCommentIter * iter);
+
+/**
+ * Choose which comments a decoder stores. This must be set before the
+ * comment header is decoded.
+ * \param fsound A FishSound* handle (created with mode FISH_SOUND_DECODE)
+ * \param max_value_length The longest value to store, in bytes, or 0 for
+ *   no limit. Longer values are never stored: they are streamed if
+ *   \a stream is set and \a filter does not skip them, and are skipped
+ *   otherwise.
+ * \param filter A callback choosing the FishSoundCommentAction for each
+ *   comment, or NULL to keep all comments within \a max_value_length
+ * \param stream A callback receiving streamed values, or NULL
+ * \param user_data Arbitrary user data passed to \a filter and \a stream
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD \a fsound is not a valid FishSound* handle
+ * \retval FISH_SOUND_ERR_INVALID Operation not suitable for this FishSound,
+ *   or \a max_value_length is negative
+ */
+int
+fish_sound_comment_set_filter (FishSound * fsound, long max_value_length,
+			       FishSoundCommentFilter filter,
+			       FishSoundCommentStream stream, void * user_data);
+
 /**
  * Add a comment
  * \param fsound A FishSound* handle (created with mode FISH_SOUND_ENCODE)
@@ -204,6 +323,50 @@ fish_sound_comment_remove (FishSound * fsound, FishSoundComment * comment);
 int
 fish_sound_comment_remove_byname (FishSound * fsound, char * name);
 
+/**
+ * Create a comment set. The names and values are copied, and the set
+ * cannot be modified afterwards.
+ * \param comments An array of comments
+ * \param nr_comments The number of comments in \a comments
+ * \returns A new FishSoundCommentSet, with one reference
+ * \retval NULL A comment name is invalid, or out of memory
+ */
+FishSoundCommentSet *
+fish_sound_comment_set_new (const FishSoundComment * comments,
+			    int nr_comments);
+
+/**
+ * Take a reference to a comment set. A set may be referenced and released
+ * from several threads concurrently.
+ * \param set A FishSoundCommentSet
+ * \returns \a set
+ */
+FishSoundCommentSet *
+fish_sound_comment_set_ref (FishSoundCommentSet * set);
+
+/**
+ * Release a reference to a comment set, freeing it with the last.
+ * \param set A FishSoundCommentSet
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD \a set is NULL
+ */
+int
+fish_sound_comment_set_unref (FishSoundCommentSet * set);
+
+/**
+ * Replace the comments of an encoder with a comment set. The encoder
+ * takes its own reference to \a set. If comments are later added to or
+ * removed from \a fsound, it first copies them from the set; comments
+ * retrieved before then are invalidated.
+ * \param fsound A FishSound* handle (created with FISH_SOUND_ENCODE)
+ * \param set The FishSoundCommentSet to attach
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD \a fsound or \a set is NULL
+ * \retval FISH_SOUND_ERR_INVALID Operation not suitable for this FishSound
+ */
+int
+fish_sound_comment_attach_set (FishSound * fsound, FishSoundCommentSet * set);
+
 #ifdef __cplusplus
 }
 #endif
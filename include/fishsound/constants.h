@@ -58,7 +58,17 @@ typedef enum _FishSoundCodecID {
   FISH_SOUND_SPEEX   = 0x02,
 
   /** Flac */
-  FISH_SOUND_FLAC    = 0x03
+  FISH_SOUND_FLAC    = 0x03,
+
+  /** Uncompressed PCM, in the Ogg PCM mapping */
+  FISH_SOUND_PCM     = 0x04,
+
+  /** Flac, as a native stream rather than in the Ogg FLAC mapping */
+  FISH_SOUND_FLAC_NATIVE = 0x05,
+
+  /** The first identifier available for codecs registered by
+   * applications; see fish_sound_codec_register() */
+  FISH_SOUND_CODEC_USER = 0x100
 } FishSoundCodecID;
 
 /** Decode callback return values */
@@ -87,11 +97,149 @@ typedef enum _FishSoundCommand {
   /** Set to 1 to interleave, 0 to non-interleave */
   FISH_SOUND_SET_INTERLEAVE             = 0x2001,
 
+  /** Query if real-time mode is enabled */
+  FISH_SOUND_GET_REALTIME               = 0x3000,
+
+  /** Set to 1 to enable real-time mode, 0 to disable. In real-time mode,
+   * all working buffers are sized when the stream headers have been
+   * processed, and no further memory is allocated by libfishsound while
+   * decoding or encoding audio. */
+  FISH_SOUND_SET_REALTIME               = 0x3001,
+
   FISH_SOUND_SET_ENCODE_VBR             = 0x4000,
+
+  /** Retrieve the asynchronous encode configuration and counters into a
+   * FishSoundEncodeAsync */
+  FISH_SOUND_GET_ENCODE_ASYNC           = 0x4100,
+
+  /** Enable or disable asynchronous encoding, given a FishSoundEncodeAsync */
+  FISH_SOUND_SET_ENCODE_ASYNC           = 0x4101,
+
+  /** Retrieve the statistics of this handle into a FishSoundStats */
+  FISH_SOUND_GET_STATS                  = 0x5000,
+
+  /** Clear the statistics of this handle */
+  FISH_SOUND_RESET_STATS                = 0x5001,
+
+  /** Retrieve the memory usage of this handle, and of libfishsound as a
+   * whole, into a FishSoundMemory */
+  FISH_SOUND_GET_MEMORY                 = 0x5002,
+
+  /** Retrieve the algorithmic delay of the codec, in frames, into a long.
+   * When encoding, this is the number of frames the encoder may hold
+   * before the packet containing the first of them is emitted; when
+   * decoding, the number of frames of decoded audio which may be held back
+   * until later packets arrive. This is 0 if not yet known, eg. before a
+   * decoder has seen the stream headers. */
+  FISH_SOUND_GET_LATENCY                = 0x6000,
+
+  /** Retrieve the number of frames passed to an encoder which have not yet
+   * been emitted in an encoded packet, into a long. This is always 0 when
+   * decoding. */
+  FISH_SOUND_GET_PENDING_FRAMES         = 0x6001,
+
+  /** Query if decoded comments are parsed lazily */
+  FISH_SOUND_GET_COMMENTS_LAZY          = 0x7000,
+
+  /** Set to 1 to defer parsing decoded comments until they are first
+   * accessed, 0 to parse them as the comment header is decoded. Lazy
+   * parsing has no effect in real-time mode. */
+  FISH_SOUND_SET_COMMENTS_LAZY          = 0x7001,
+
+  /** Retrieve the sample format of a FISH_SOUND_PCM stream, as a
+   * FishSoundPCMFormat in an int. When decoding, this is known once the
+   * stream header has been decoded. */
+  FISH_SOUND_GET_PCM_FORMAT             = 0x8000,
+
+  /** Set the sample format written by a FISH_SOUND_PCM encoder, given a
+   * FishSoundPCMFormat in an int. This must be set before the first audio
+   * is encoded. The default is 32 bit float in native byte order, which
+   * is packetized without conversion. */
+  FISH_SOUND_SET_PCM_FORMAT             = 0x8001,
   
   FISH_SOUND_COMMAND_MAX
 } FishSoundCommand;
 
+/** Actions for a decoded comment, as returned by a FishSoundCommentFilter */
+typedef enum _FishSoundCommentAction {
+  /** Store the comment */
+  FISH_SOUND_COMMENT_KEEP   = 0,
+
+  /** Discard the comment */
+  FISH_SOUND_COMMENT_SKIP   = 1,
+
+  /** Pass the value to the FishSoundCommentStream callback in chunks,
+   * without storing the comment */
+  FISH_SOUND_COMMENT_STREAM = 2
+} FishSoundCommentAction;
+
+/** Sample formats of a FishSoundPCMRing */
+typedef enum _FishSoundRingFormat {
+  /** 32 bit float, nominally in the range [-1.0, 1.0] */
+  FISH_SOUND_RING_FLOAT = 0,
+
+  /** Signed 16 bit integer, in native byte order */
+  FISH_SOUND_RING_S16   = 1
+} FishSoundRingFormat;
+
+/** Sample formats of a FISH_SOUND_PCM stream, as numbered in the Ogg PCM
+ * mapping */
+typedef enum _FishSoundPCMFormat {
+  /** Signed 16 bit integer, little-endian */
+  FISH_SOUND_PCM_S16_LE     = 0x02,
+
+  /** Signed 16 bit integer, big-endian */
+  FISH_SOUND_PCM_S16_BE     = 0x03,
+
+  /** Signed 24 bit integer, little-endian */
+  FISH_SOUND_PCM_S24_LE     = 0x04,
+
+  /** Signed 24 bit integer, big-endian */
+  FISH_SOUND_PCM_S24_BE     = 0x05,
+
+  /** Signed 32 bit integer, little-endian */
+  FISH_SOUND_PCM_S32_LE     = 0x06,
+
+  /** Signed 32 bit integer, big-endian */
+  FISH_SOUND_PCM_S32_BE     = 0x07,
+
+  /** 32 bit IEEE float, little-endian */
+  FISH_SOUND_PCM_FLOAT32_LE = 0x20,
+
+  /** 32 bit IEEE float, big-endian */
+  FISH_SOUND_PCM_FLOAT32_BE = 0x21
+} FishSoundPCMFormat;
+
+/** Action to take when the asynchronous encode queue is full */
+typedef enum _FishSoundAsyncOverflow {
+  /** Wait until the encoder thread frees space in the queue */
+  FISH_SOUND_ASYNC_BLOCK = 0,
+
+  /** Discard the audio that does not fit, and count it as dropped */
+  FISH_SOUND_ASYNC_DROP  = 1
+} FishSoundAsyncOverflow;
+
+/** Severity of a message passed to a FishSoundLog callback */
+typedef enum _FishSoundLogLevel {
+  /** No messages */
+  FISH_SOUND_LOG_NONE    = 0,
+
+  /** An error, eg. corrupt data which the codec could not decode */
+  FISH_SOUND_LOG_ERROR   = 1,
+
+  /** A problem from which the codec recovered */
+  FISH_SOUND_LOG_WARNING = 2,
+
+  /** Information about the stream, eg. its parameters */
+  FISH_SOUND_LOG_INFO    = 3,
+
+  /** Debugging messages */
+  FISH_SOUND_LOG_DEBUG   = 4,
+
+  /** Verbose debugging messages, eg. for every packet */
+  FISH_SOUND_LOG_VERBOSE = 5
+} FishSoundLogLevel;
+
 /** Error values */
 typedef enum _FishSoundError {
   /** No error */
@@ -104,7 +104,12 @@ int fish_sound_set_decoded_float_ilv (FishSound * fsound,
 /**
  * Decode a block of compressed data.
  * No internal buffering is done, so a complete compressed audio packet
- * must be passed each time.
+ * must be passed each time. The exception is a native FLAC stream
+ * (FISH_SOUND_FLAC_NATIVE), which has no packets: it may be passed in
+ * pieces of any size, and is framed internally.
+ * \note Unless the format was given to fish_sound_new(), the codec is
+ * identified from the first call, which must then pass at least 8 bytes;
+ * see fish_sound_identify(). This also applies to a native FLAC stream.
  * \param fsound A FishSound* handle (created with mode FISH_SOUND_DECODE)
  * \param buf A buffer containing a compressed audio packet
  * \param bytes A count of bytes to decode (i.e. the length of buf)
@@ -122,6 +127,58 @@ int fish_sound_set_decoded_float_ilv (FishSound * fsound,
  */
 long fish_sound_decode (FishSound * fsound, unsigned char * buf, long bytes);
 
+/**
+ * A compressed packet of a complete stream, for decoding with
+ * fish_sound_decode_parallel()
+ */
+typedef struct {
+  /** The packet data */
+  unsigned char * packet;
+
+  /** Length of the packet data in bytes */
+  long bytes;
+
+  /** Granulepos of the packet, or -1 if unknown */
+  long granulepos;
+
+  /** Whether or not this is the last packet of the stream */
+  int eos;
+} FishSoundPacket;
+
+/**
+ * Decode all packets of a complete stream, using up to \a nthreads threads.
+ * The audio packets are split into contiguous ranges, each starting after
+ * a packet with a known granulepos (ie. at an Ogg page boundary). Each range
+ * is decoded by a separate decoder, which first decodes the stream headers
+ * and enough preceding packets to produce output identical to that of a
+ * sequential decode.
+ *
+ * PCM is delivered to \a decoded in stream order, from the calling thread.
+ * The FishSound* handle passed to \a decoded is owned by the decoder of
+ * the current range; fish_sound_get_frameno() on it reports the position
+ * in the whole stream.
+ *
+ * Speex streams, and all streams on systems without POSIX threads, are
+ * decoded sequentially.
+ * \param packets An array of all packets of the stream, including headers
+ * \param npackets The number of packets in \a packets
+ * \param nthreads The maximum number of threads to use
+ * \param decoded The callback to call with interleaved float PCM
+ * \param user_data Arbitrary user data to pass to the callback
+ * \returns The number of frames decoded. If \a decoded returns
+ * FISH_SOUND_STOP_OK, no further PCM is delivered, and the frames
+ * delivered before that call are counted.
+ * \retval FISH_SOUND_STOP_ERR \a decoded returned FISH_SOUND_STOP_ERR
+ * \retval FISH_SOUND_ERR_BAD Invalid arguments
+ * \retval FISH_SOUND_ERR_INVALID The first packet is not a recognised header
+ * \retval FISH_SOUND_ERR_OUT_OF_MEMORY Out of memory
+ * \retval FISH_SOUND_ERR_DISABLED Decoding is disabled in this build
+ */
+long fish_sound_decode_parallel (FishSoundPacket * packets, long npackets,
+                                 int nthreads,
+                                 FishSoundDecoded_FloatIlv decoded,
+                                 void * user_data);
+
 #ifdef __cplusplus
 }
 #endif
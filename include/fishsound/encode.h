@@ -72,7 +72,8 @@ int fish_sound_set_encoded_callback (FishSound * fsound,
  * \param fsound A FishSound* handle (created with mode FISH_SOUND_ENCODE)
  * \param pcm The audio data to encode
  * \param frames A count of frames to encode
- * \returns The number of frames encoded
+ * \returns The number of frames encoded, or queued for encoding if
+ * asynchronous encoding is enabled
  * \note For multichannel audio, the audio data is interpreted according
  * to the current PCM style
  */
@@ -83,13 +84,40 @@ long fish_sound_encode_float (FishSound * fsound, float * pcm[], long frames);
  * \param fsound A FishSound* handle (created with mode FISH_SOUND_ENCODE)
  * \param pcm The audio data to encode
  * \param frames A count of frames to encode
- * \returns The number of frames encoded
+ * \returns The number of frames encoded, or queued for encoding if
+ * asynchronous encoding is enabled
  * \note For multichannel audio, the audio data is interpreted according
  * to the current PCM style
  */
 long fish_sound_encode_float_ilv (FishSound * fsound, float ** pcm,
 				  long frames);
 
+/**
+ * Configuration of asynchronous encoding, used with the commands
+ * FISH_SOUND_SET_ENCODE_ASYNC and FISH_SOUND_GET_ENCODE_ASYNC.
+ *
+ * When asynchronous encoding is enabled, fish_sound_encode_float() and
+ * fish_sound_encode_float_ilv() copy the audio into a preallocated queue
+ * and return without encoding it. An encoder thread owned by the
+ * FishSound* handle performs the encoding, and calls the FishSoundEncoded
+ * callback from that thread. fish_sound_flush() waits until all queued
+ * audio has been encoded.
+ */
+typedef struct {
+  /** Number of blocks the queue can hold; 0 to disable asynchronous
+   * encoding */
+  int queue_depth;
+
+  /** Maximum number of frames in each queued block */
+  int block_frames;
+
+  /** A FishSoundAsyncOverflow value */
+  int overflow;
+
+  /** Count of frames dropped due to queue overflow (read only) */
+  long dropped_frames;
+} FishSoundEncodeAsync;
+
 #ifdef __cplusplus
 }
 #endif
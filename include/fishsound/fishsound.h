@@ -41,13 +41,16 @@
  *
  * This is the documentation for the FishSound C API. FishSound provides
  * a simple programming interface for decoding and encoding audio data
- * using Xiph.Org codecs (FLAC, Speex and Vorbis).
+ * using Xiph.Org codecs (FLAC, Speex and Vorbis), and for passing
+ * uncompressed PCM through the same interface.
  *
  * libfishsound by itself is designed to handle raw codec streams from
  * a lower level layer such as UDP datagrams.
  * When these codecs are used in files, they are commonly encapsulated in
  * <a href="http://www.xiph.org/ogg/">Ogg</a> to produce
  * <em>Ogg FLAC</em>, <em>Speex</em> and <em>Ogg Vorbis</em> files.
+ * FLAC is also decoded and encoded as a native <em>.flac</em> byte
+ * stream, without Ogg (FISH_SOUND_FLAC_NATIVE).
  * Example C programs using
  * <a href="http://www.annodex.net/software/liboggz/">liboggz</a> to
  * read and write these files are provided in the libfishsound sources.
@@ -432,6 +435,12 @@ typedef struct {
  */
 typedef void * FishSound;
 
+/**
+ * An opaque handle to a PCM ring buffer. This is returned by
+ * fish_sound_pcm_ring_new().
+ */
+typedef void * FishSoundPCMRing;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -440,18 +449,19 @@ extern "C" {
  * Identify a codec based on the first few bytes of data.
  * \param buf A pointer to the first few bytes of the data
  * \param bytes The count of bytes available at buf
- * \retval FISH_SOUND_xxxxxx FISH_SOUND_VORBIS, FISH_SOUND_SPEEX or
- * FISH_SOUND_FLAC if \a buf was identified as the initial bytes of a
- * supported codec
+ * \retval FISH_SOUND_xxxxxx FISH_SOUND_VORBIS, FISH_SOUND_SPEEX,
+ * FISH_SOUND_FLAC, FISH_SOUND_PCM or FISH_SOUND_FLAC_NATIVE if \a buf
+ * was identified as the initial bytes of a supported codec
  * \retval FISH_SOUND_UNKNOWN if the codec could not be identified
  * \retval FISH_SOUND_ERR_SHORT_IDENTIFY if \a bytes is less than 8
  * \note If \a bytes is exactly 8, then only a weak check is performed,
  * which is fast but may return a false positive.
  * \note If \a bytes is greater than 8, then a stronger check is performed
- * in which an attempt is made to decode \a buf as the initial header of
- * each supported codec. This is unlikely to return a false positive but
- * is only useful if \a buf is the entire payload of a packet derived from
- * a lower layer such as Ogg framing or UDP datagrams.
+ * in which \a buf is checked as the initial header of each registered
+ * codec whose signature it matches, in order of priority (see
+ * fish_sound_codec_register()). This is unlikely to return a false
+ * positive but is only useful if \a buf is the entire payload of a packet
+ * derived from a lower layer such as Ogg framing or UDP datagrams.
  */
 int
 fish_sound_identify (unsigned char * buf, long bytes);
@@ -468,6 +478,9 @@ FishSound * fish_sound_new (int mode, FishSoundInfo * fsinfo);
  * Flush any internally buffered data, forcing encode
  * \param fsound A FishSound* handle
  * \returns 0 on success, -1 on failure
+ * \note A FISH_SOUND_FLAC_NATIVE decoder only knows that a frame is
+ * complete once the next frame starts, so fish_sound_flush() must be
+ * called at the end of the stream to decode the last frame.
  */
 long fish_sound_flush (FishSound * fsound);
 
@@ -583,6 +596,11 @@ int fish_sound_prepare_truncation (FishSound * fsound, long next_granulepos,
 #include <fishsound/decode.h>
 #include <fishsound/encode.h>
 #include <fishsound/comments.h>
+#include <fishsound/ring.h>
+#include <fishsound/stats.h>
+#include <fishsound/trace.h>
+#include <fishsound/log.h>
+#include <fishsound/codec.h>
 
 #include <fishsound/deprecated.h>
 
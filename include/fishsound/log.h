@@ -0,0 +1,109 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __FISH_SOUND_LOG_H__
+#define __FISH_SOUND_LOG_H__
+
+/** \file
+ * Reporting of errors and diagnostic messages.
+ *
+ * Errors from which a codec recovers, such as the FLAC decoder losing
+ * synchronisation on corrupt input, do not cause a call to fail. They are
+ * counted in the FishSoundStats of the handle (see log_errors and
+ * log_warnings), and a message is passed to the handle's log callback,
+ * installed with fish_sound_set_log(). If no callback is installed, the
+ * message is written to stderr.
+ *
+ * Which messages are produced is controlled by a process-wide log level,
+ * set with fish_sound_set_log_level(); by default, only errors are
+ * reported. A message above the log level costs only a comparison.
+ * Messages from each handle are also limited to a number per second;
+ * any beyond that are counted in log_suppressed, and are not formatted.
+ *
+ * Debugging messages (FISH_SOUND_LOG_DEBUG and FISH_SOUND_LOG_VERBOSE)
+ * which are not associated with a handle are always written to stderr.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The default limit of messages per second from each handle */
+#define FISH_SOUND_LOG_RATE_DEFAULT 10
+
+/**
+ * Signature of a log callback.
+ * \param fsound The FishSound* handle
+ * \param level The FishSoundLogLevel of the message
+ * \param error The FishSoundError code associated with the message, or 0
+ * \param message The message, without a trailing newline. This is only
+ * valid during the call.
+ * \param user_data Arbitrary user data, as passed to fish_sound_set_log()
+ */
+typedef void (*FishSoundLog) (FishSound * fsound, int level, int error,
+			      const char * message, void * user_data);
+
+/**
+ * Set the callback to receive messages from a handle. If asynchronous
+ * encoding is enabled, the callback may be called from the encoder thread.
+ * \param fsound A FishSound* handle
+ * \param log The callback, or NULL to write messages to stderr
+ * \param max_per_second The largest number of messages to pass on in any
+ * second, or 0 for no limit
+ * \param user_data Arbitrary user data to pass to the callback
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD \a fsound is not a valid FishSound* handle
+ * \retval FISH_SOUND_ERR_INVALID \a max_per_second is negative
+ */
+int fish_sound_set_log (FishSound * fsound, FishSoundLog log,
+			int max_per_second, void * user_data);
+
+/**
+ * Set the process-wide log level. Messages of a lower severity (a higher
+ * FishSoundLogLevel) are not produced.
+ * \param level The new FishSoundLogLevel
+ * \returns The previous log level
+ * \retval FISH_SOUND_ERR_INVALID \a level is not a FishSoundLogLevel
+ */
+int fish_sound_set_log_level (int level);
+
+/**
+ * Query the process-wide log level.
+ * \returns The current FishSoundLogLevel
+ */
+int fish_sound_get_log_level (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FISH_SOUND_LOG_H__ */
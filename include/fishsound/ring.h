@@ -0,0 +1,160 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __FISH_SOUND_RING_H__
+#define __FISH_SOUND_RING_H__
+
+/** \file
+ * A ring buffer of decoded PCM, for passing audio from a decoding thread
+ * to a playback thread.
+ *
+ * A FishSoundPCMRing has a single producer, usually a decoder installed
+ * with fish_sound_set_decoded_pcm_ring(), and a single consumer, usually
+ * an audio device callback which calls fish_sound_pcm_ring_read(). The
+ * producer and consumer may run in different threads without any further
+ * locking. Neither side blocks or allocates memory. (If libfishsound was
+ * built without threads, on a compiler providing no atomic operations,
+ * both must run in the same thread.)
+ *
+ * Audio is stored interleaved, in the sample format given when the ring
+ * is created (FISH_SOUND_RING_FLOAT or FISH_SOUND_RING_S16). Conversion
+ * from float is done by the producer, so that reads are a copy.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Create a new PCM ring buffer.
+ * \param channels The number of audio channels
+ * \param frames The minimum number of frames the ring can hold. This is
+ * rounded up to a power of two.
+ * \param format FISH_SOUND_RING_FLOAT or FISH_SOUND_RING_S16
+ * \returns A new FishSoundPCMRing* handle, or NULL on error
+ */
+FishSoundPCMRing * fish_sound_pcm_ring_new (int channels, long frames,
+					    int format);
+
+/**
+ * Delete a PCM ring buffer. The ring must no longer be in use by any
+ * FishSound* handle, or by either thread.
+ * \param ring A FishSoundPCMRing* handle
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD Not a valid FishSoundPCMRing* handle
+ */
+int fish_sound_pcm_ring_delete (FishSoundPCMRing * ring);
+
+/**
+ * Write interleaved float PCM to a ring buffer. This may only be called
+ * by the producer. If there is not enough space for all \a frames, as
+ * many frames as fit are written, the remainder is discarded and an
+ * overrun is counted.
+ * \param ring A FishSoundPCMRing* handle
+ * \param pcm The audio data to write
+ * \param frames The count of frames to write
+ * \returns The number of frames written
+ * \retval FISH_SOUND_ERR_BAD Not a valid FishSoundPCMRing* handle
+ */
+long fish_sound_pcm_ring_write_float_ilv (FishSoundPCMRing * ring,
+					  float * pcm, long frames);
+
+/**
+ * Read interleaved PCM from a ring buffer, in the ring's sample format.
+ * This may only be called by the consumer. If fewer than \a frames are
+ * available, the remainder of \a buf is filled with silence and an
+ * underrun is counted.
+ * \param ring A FishSoundPCMRing* handle
+ * \param buf The buffer to read into, with space for \a frames frames
+ * \param frames The count of frames to read
+ * \returns The number of frames of audio read, excluding silence
+ * \retval FISH_SOUND_ERR_BAD Not a valid FishSoundPCMRing* handle
+ */
+long fish_sound_pcm_ring_read (FishSoundPCMRing * ring, void * buf,
+			       long frames);
+
+/**
+ * Query the number of frames available to read.
+ * \param ring A FishSoundPCMRing* handle
+ * \returns The number of frames which can be read without underrun
+ * \retval FISH_SOUND_ERR_BAD Not a valid FishSoundPCMRing* handle
+ */
+long fish_sound_pcm_ring_available (FishSoundPCMRing * ring);
+
+/**
+ * Query the number of frames which can be written.
+ * \param ring A FishSoundPCMRing* handle
+ * \returns The number of frames which can be written without overrun
+ * \retval FISH_SOUND_ERR_BAD Not a valid FishSoundPCMRing* handle
+ */
+long fish_sound_pcm_ring_space (FishSoundPCMRing * ring);
+
+/**
+ * Query the number of underruns, ie. reads for which too few frames were
+ * available.
+ * \param ring A FishSoundPCMRing* handle
+ * \returns The count of underruns
+ * \retval FISH_SOUND_ERR_BAD Not a valid FishSoundPCMRing* handle
+ */
+long fish_sound_pcm_ring_underruns (FishSoundPCMRing * ring);
+
+/**
+ * Query the number of overruns, ie. writes for which there was too little
+ * space, causing frames to be discarded.
+ * \param ring A FishSoundPCMRing* handle
+ * \returns The count of overruns
+ * \retval FISH_SOUND_ERR_BAD Not a valid FishSoundPCMRing* handle
+ */
+long fish_sound_pcm_ring_overruns (FishSoundPCMRing * ring);
+
+/**
+ * Decode directly into a PCM ring buffer. This sets the decoded callback
+ * of \a fsound to one which writes all decoded audio into \a ring,
+ * replacing any callback previously set. The thread calling
+ * fish_sound_decode() is the ring's producer. To avoid overruns, check
+ * fish_sound_pcm_ring_space() before decoding each packet.
+ * \param fsound A FishSound* handle (created with mode FISH_SOUND_DECODE)
+ * \param ring A FishSoundPCMRing* handle, with the same number of channels
+ * as the stream being decoded
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD Not a valid FishSound* or FishSoundPCMRing*
+ * handle
+ * \retval FISH_SOUND_ERR_DISABLED Decoding is disabled in this build
+ */
+int fish_sound_set_decoded_pcm_ring (FishSound * fsound,
+				     FishSoundPCMRing * ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FISH_SOUND_RING_H__ */
@@ -0,0 +1,162 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __FISH_SOUND_STATS_H__
+#define __FISH_SOUND_STATS_H__
+
+/** \file
+ * Per-handle statistics, retrieved with the FISH_SOUND_GET_STATS command.
+ *
+ * Every FishSound* handle keeps a set of counters describing the work it
+ * has done. The counters are always maintained; the cost is a few reads
+ * of a monotonic clock per packet and per callback. They can be read at
+ * any time with FISH_SOUND_GET_STATS, and cleared with
+ * FISH_SOUND_RESET_STATS:
+ *
+ * \code
+ * FishSoundStats stats;
+ *
+ * fish_sound_command (fsound, FISH_SOUND_GET_STATS, &stats,
+ *                     sizeof (FishSoundStats));
+ * \endcode
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of buckets in the processing time histogram */
+#define FISH_SOUND_STATS_HISTOGRAM_SIZE 32
+
+/** Number of error counters, indexed by the negated FishSoundError code */
+#define FISH_SOUND_STATS_ERRORS 32
+
+/**
+ * Statistics of a FishSound* handle.
+ */
+typedef struct {
+  /** Count of encoded packets passed to fish_sound_decode() */
+  long packets_in;
+
+  /** Count of bytes of encoded data passed to fish_sound_decode() */
+  long bytes_in;
+
+  /** Count of encoded packets passed to the FishSoundEncoded callback */
+  long packets_out;
+
+  /** Count of bytes of encoded data passed to the FishSoundEncoded
+   * callback */
+  long bytes_out;
+
+  /** Count of PCM frames delivered to the decoded callback, or passed
+   * to the encoder */
+  long frames;
+
+  /** Count of calls to the decoded or encoded callback */
+  long callbacks;
+
+  /** Seconds spent inside libfishsound and the codec libraries, not
+   * including time spent in callbacks */
+  double codec_seconds;
+
+  /** Seconds spent inside the decoded or encoded callback */
+  double callback_seconds;
+
+  /** Count of memory allocations made by libfishsound while decoding,
+   * encoding or flushing */
+  long allocations;
+
+  /** Total bytes requested by those allocations */
+  long allocated_bytes;
+
+  /** Count of errors returned by decode, encode and flush calls:
+   * errors[n] counts the error code -n, eg. errors[-FISH_SOUND_ERR_BAD].
+   * errors[0] counts any other negative return values. */
+  long errors[FISH_SOUND_STATS_ERRORS];
+
+  /** Histogram of the codec time of each call to fish_sound_decode(),
+   * fish_sound_encode_float*() or fish_sound_flush(). histogram[0] counts
+   * calls that took less than 1 microsecond, and histogram[n] counts calls
+   * that took at least 2^(n-1) and less than 2^n microseconds. The last
+   * bucket also counts all longer calls. */
+  long histogram[FISH_SOUND_STATS_HISTOGRAM_SIZE];
+
+  /** Count of errors reported by the codec, whether or not they were
+   * logged (see <fishsound/log.h>) */
+  long log_errors;
+
+  /** Count of warnings reported by the codec, whether or not they were
+   * logged */
+  long log_warnings;
+
+  /** Count of messages not logged because the handle's limit of messages
+   * per second was reached */
+  long log_suppressed;
+} FishSoundStats;
+
+/**
+ * Memory usage, retrieved with the FISH_SOUND_GET_MEMORY command:
+ *
+ * \code
+ * FishSoundMemory memory;
+ *
+ * fish_sound_command (fsound, FISH_SOUND_GET_MEMORY, &memory,
+ *                     sizeof (FishSoundMemory));
+ * \endcode
+ *
+ * Only memory allocated by libfishsound itself is counted, including the
+ * handle, its buffers and its comments. Memory allocated internally by
+ * libvorbis, libspeex and libFLAC is not included.
+ */
+typedef struct {
+  /** Bytes currently allocated for this handle */
+  long bytes;
+
+  /** The largest value of bytes since the handle was created */
+  long peak_bytes;
+
+  /** Count of blocks currently allocated for this handle */
+  long blocks;
+
+  /** Bytes currently allocated by libfishsound in this process, for all
+   * handles */
+  long process_bytes;
+
+  /** The largest value of process_bytes since the process started */
+  long process_peak_bytes;
+} FishSoundMemory;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FISH_SOUND_STATS_H__ */
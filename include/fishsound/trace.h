@@ -0,0 +1,131 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __FISH_SOUND_TRACE_H__
+#define __FISH_SOUND_TRACE_H__
+
+/** \file
+ * Tracing hooks, for attributing latency within an application's
+ * processing pipeline.
+ *
+ * A table of hooks installed with fish_sound_set_trace_hooks() is called
+ * at the boundaries of the work done by a FishSound* handle: around each
+ * call to fish_sound_decode(), fish_sound_encode_float*() and
+ * fish_sound_flush(), around each call of the decoded or encoded callback,
+ * when the stream headers are complete, and when an error occurs. Any
+ * hook may be NULL.
+ *
+ * When no hooks are installed, each of these points costs a single test
+ * of a pointer in the handle.
+ *
+ * If asynchronous encoding is enabled, the hooks for encode calls and
+ * encoded callbacks are called from the encoder thread.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Signature of a trace hook.
+ * \param fsound The FishSound* handle
+ * \param codec The FishSoundCodecID of the stream, or FISH_SOUND_UNKNOWN
+ * if it is not yet known
+ * \param packetno When decoding, the number of the packet being decoded.
+ * When encoding, the number of the next packet to be passed to the encoded
+ * callback. Packets are counted from 0 since the handle was created, or
+ * since its statistics were last cleared with FISH_SOUND_RESET_STATS.
+ * \param timestamp A monotonic timestamp in seconds. Only differences
+ * between timestamps are meaningful.
+ * \param value A value depending on the hook, as described in
+ * FishSoundTraceHooks
+ * \param user_data The user_data of the FishSoundTraceHooks table
+ */
+typedef void (*FishSoundTraceHook) (FishSound * fsound, int codec,
+				    long packetno, double timestamp,
+				    long value, void * user_data);
+
+/**
+ * A table of trace hooks.
+ */
+typedef struct {
+  /** Start of fish_sound_decode(); \a value is the packet length in
+   * bytes */
+  FishSoundTraceHook decode_begin;
+
+  /** End of fish_sound_decode(); \a value is its return value */
+  FishSoundTraceHook decode_end;
+
+  /** Start of fish_sound_encode_float*() or fish_sound_flush(); \a value
+   * is the number of frames to encode, or 0 for a flush */
+  FishSoundTraceHook encode_begin;
+
+  /** End of fish_sound_encode_float*() or fish_sound_flush(); \a value
+   * is its return value */
+  FishSoundTraceHook encode_end;
+
+  /** Before calling the decoded or encoded callback; \a value is the
+   * number of frames decoded, or the length of the encoded packet in
+   * bytes */
+  FishSoundTraceHook callback_begin;
+
+  /** After calling the decoded or encoded callback; \a value is the
+   * callback's return value */
+  FishSoundTraceHook callback_end;
+
+  /** All stream headers have been decoded or encoded; \a value is 0 */
+  FishSoundTraceHook headers;
+
+  /** An error occurred; \a value is the FishSoundError code */
+  FishSoundTraceHook error;
+
+  /** Arbitrary user data passed to each hook */
+  void * user_data;
+} FishSoundTraceHooks;
+
+/**
+ * Install a table of trace hooks.
+ * \param fsound A FishSound* handle
+ * \param hooks The hooks to install, which are copied; or NULL to remove
+ * all hooks
+ * \retval 0 Success
+ * \retval FISH_SOUND_ERR_BAD \a fsound is not a valid FishSound* handle
+ * \retval FISH_SOUND_ERR_OUT_OF_MEMORY Out of memory
+ */
+int fish_sound_set_trace_hooks (FishSound * fsound,
+				const FishSoundTraceHooks * hooks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FISH_SOUND_TRACE_H__ */
@@ -0,0 +1,639 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_bench.h"
+
+/*
+ * fishsound-bench: encode and decode throughput for each codec.
+ *
+ * This sweeps the same matrix of blocksizes, samplerates, channels, codecs
+ * and interleave as the encdec-audio test, for each of a few synthetic
+ * signals. Each case is encoded into memory and the resulting packets are
+ * decoded, after some warm-up runs; the median of the timed repetitions is
+ * reported. With --counters, hardware performance counters are read around
+ * each run and reported per frame.
+ */
+
+#define DEFAULT_REPS 5
+#define DEFAULT_WARMUP 1
+#define DEFAULT_SECONDS 2.0
+#define DEFAULT_THRESHOLD 10.0
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+
+static void
+usage (char * progname)
+{
+  printf ("Usage: %s [options]\n\n", progname);
+  printf ("Measure encode and decode throughput of each codec\n\n");
+  printf ("Options:\n");
+  printf ("  --reps n                  Timed repetitions per case (default %d)\n", DEFAULT_REPS);
+  printf ("  --warmup n                Untimed runs before each case (default %d)\n", DEFAULT_WARMUP);
+  printf ("  --seconds s               Seconds of audio per run (default %.1f)\n", DEFAULT_SECONDS);
+  printf ("  --quick                   Run a small set of common cases\n");
+  printf ("  --nasty                   Run with large test parameters\n");
+  printf ("  --signal name             Only use one signal: silence, sweep, noise\n");
+  printf ("                            or square\n");
+  printf ("  --disable-vorbis          Disable benchmarking of Vorbis codec\n");
+  printf ("  --disable-speex           Disable benchmarking of Speex codec\n");
+  printf ("  --disable-flac            Disable benchmarking of Flac codec\n");
+  printf ("  --disable-interleave      Disable benchmarking of interleave\n");
+  printf ("  --disable-non-interleave  Disable benchmarking of non-interleave\n");
+  printf ("  --counters                Report hardware performance counters per frame\n");
+  printf ("  --json file               Write results as JSON to file ('-' for stdout)\n");
+  printf ("  --baseline file           Compare results with a previous JSON file\n");
+  printf ("  --threshold pct           Allowed slowdown against the baseline,\n");
+  printf ("                            in percent (default %.0f)\n", DEFAULT_THRESHOLD);
+  printf ("\nExits with status 1 if any case is slower than the baseline by more\n");
+  printf ("than the threshold.\n");
+  exit (1);
+}
+
+/* Configured by commandline args */
+static int * bench_blocksizes, * bench_samplerates, * bench_channels;
+static int reps = DEFAULT_REPS, warmup = DEFAULT_WARMUP;
+static double seconds = DEFAULT_SECONDS, threshold = DEFAULT_THRESHOLD;
+static int bench_vorbis = HAVE_VORBIS, bench_speex = HAVE_SPEEX;
+static int bench_flac = HAVE_FLAC;
+static int bench_interleave = 1, bench_non_interleave = 1;
+static int bench_signal = -1;
+static int bench_counters = 0;
+static char * json_path = NULL, * baseline_path = NULL;
+
+/* Where the table of results goes */
+static FILE * out;
+
+/* Hardware performance counters, if requested and available */
+static FSBenchCounters * counters = NULL;
+
+static int nasty_blocksizes[] = {128, 256, 512, 1024, 2048, 4096, 0};
+static int nasty_samplerates[] = {8000, 16000, 32000, 48000, 0};
+static int nasty_channels[] = {1, 2, 4, 5, 6, 8, 10, 16, 32, 0};
+
+static int default_blocksizes[] = {128, 1024, 0};
+static int default_samplerates[] = {8000, 48000, 0};
+static int default_channels[] = {1, 2, 6, 16, 0};
+
+static int quick_blocksizes[] = {1024, 0};
+static int quick_samplerates[] = {48000, 0};
+static int quick_channels[] = {2, 0};
+
+/* Encoded packets, kept in memory for decoding */
+typedef struct {
+  unsigned char * data;
+  long length;
+  long alloc;
+  long * offsets; /* start of each packet, plus the end of the last */
+  long npackets;
+  long max_packets;
+} FS_Packets;
+
+typedef struct {
+  int format;
+  int samplerate;
+  int channels;
+  int interleave;
+  int blocksize;
+  long frames;
+  float * ipcm;     /* interleaved signal */
+  float ** pcm;     /* non-interleaved signal */
+  float ** cursor;  /* per-channel pointers into pcm, for each block */
+  FS_Packets packets;
+  long frames_out;
+} FS_Bench;
+
+static const char *
+format_name (int format)
+{
+  switch (format) {
+  case FISH_SOUND_VORBIS: return "vorbis";
+  case FISH_SOUND_SPEEX: return "speex";
+  case FISH_SOUND_FLAC: return "flac";
+  default: return "unknown";
+  }
+}
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  FS_Packets * p = (FS_Packets *) user_data;
+  unsigned char * data;
+  long * offsets;
+
+  if (p->length + bytes > p->alloc) {
+    if ((data = realloc (p->data, (p->length + bytes) * 2)) == NULL)
+      return FISH_SOUND_STOP_ERR;
+    p->data = data;
+    p->alloc = (p->length + bytes) * 2;
+  }
+
+  if (p->npackets + 2 > p->max_packets) {
+    if ((offsets = realloc (p->offsets,
+			    sizeof (long) * (p->npackets + 2) * 2)) == NULL)
+      return FISH_SOUND_STOP_ERR;
+    p->offsets = offsets;
+    p->max_packets = (p->npackets + 2) * 2;
+  }
+
+  memcpy (&p->data[p->length], buf, bytes);
+  p->offsets[p->npackets++] = p->length;
+  p->length += bytes;
+  p->offsets[p->npackets] = p->length;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static int
+decoded_float (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  FS_Bench * b = (FS_Bench *) user_data;
+
+  b->frames_out += frames;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static FS_Bench *
+fs_bench_new (int samplerate, int channels, int format, int interleave,
+	      int blocksize, int signal)
+{
+  FS_Bench * b;
+  int i;
+
+  if ((b = calloc (1, sizeof (FS_Bench))) == NULL)
+    return NULL;
+
+  b->format = format;
+  b->samplerate = samplerate;
+  b->channels = channels;
+  b->interleave = interleave;
+  b->blocksize = blocksize;
+  b->frames = (long)(seconds * samplerate);
+
+  if (interleave) {
+    b->ipcm = malloc (sizeof (float) * channels * b->frames);
+    for (i = 0; i < channels; i++)
+      fs_bench_signal_fill (signal, b->ipcm + i, b->frames, channels, i,
+			    samplerate);
+  } else {
+    b->pcm = malloc (sizeof (float *) * channels);
+    b->cursor = malloc (sizeof (float *) * channels);
+    for (i = 0; i < channels; i++) {
+      b->pcm[i] = malloc (sizeof (float) * b->frames);
+      fs_bench_signal_fill (signal, b->pcm[i], b->frames, 1, i, samplerate);
+    }
+  }
+
+  return b;
+}
+
+static void
+fs_bench_delete (FS_Bench * b)
+{
+  int i;
+
+  if (b->pcm) {
+    for (i = 0; i < b->channels; i++)
+      free (b->pcm[i]);
+    free (b->pcm);
+    free (b->cursor);
+  }
+  free (b->ipcm);
+  free (b->packets.data);
+  free (b->packets.offsets);
+  free (b);
+}
+
+static FishSound *
+fs_bench_open (FS_Bench * b, int mode)
+{
+  FishSoundInfo fsinfo;
+  FishSound * fsound;
+
+  fsinfo.samplerate = b->samplerate;
+  fsinfo.channels = b->channels;
+  fsinfo.format = b->format;
+
+  fsound = fish_sound_new (mode, &fsinfo);
+  fish_sound_set_interleave (fsound, b->interleave);
+
+  return fsound;
+}
+
+/* Encode the whole signal into b->packets, returning the elapsed time.
+ * If counts is not NULL, it is filled with the hardware counts. */
+static double
+fs_bench_encode (FS_Bench * b, double * counts)
+{
+  FishSound * fsound;
+  double t0, t1;
+  long offset, n;
+  int i;
+
+  fsound = fs_bench_open (b, FISH_SOUND_ENCODE);
+  fish_sound_set_encoded_callback (fsound, encoded, &b->packets);
+
+  /* Keep the buffers from previous runs, so that they are not grown
+   * while timing */
+  b->packets.length = 0;
+  b->packets.npackets = 0;
+
+  fs_bench_counters_start (counters);
+  t0 = fs_bench_now ();
+
+  for (offset = 0; offset < b->frames; offset += n) {
+    n = MIN (b->blocksize, b->frames - offset);
+
+    fish_sound_prepare_truncation (fsound, offset + n,
+				   (offset + n >= b->frames));
+
+    if (b->interleave) {
+      fish_sound_encode_float_ilv (fsound,
+				   (float **)&b->ipcm[offset * b->channels],
+				   n);
+    } else {
+      for (i = 0; i < b->channels; i++)
+	b->cursor[i] = &b->pcm[i][offset];
+      fish_sound_encode_float (fsound, b->cursor, n);
+    }
+  }
+
+  fish_sound_flush (fsound);
+
+  t1 = fs_bench_now ();
+  if (counts) fs_bench_counters_stop (counters, counts);
+
+  fish_sound_delete (fsound);
+
+  return t1 - t0;
+}
+
+/* Decode all of b->packets, returning the elapsed time.
+ * If counts is not NULL, it is filled with the hardware counts. */
+static double
+fs_bench_decode (FS_Bench * b, double * counts)
+{
+  FS_Packets * p = &b->packets;
+  FishSound * fsound;
+  double t0, t1;
+  long i;
+
+  fsound = fs_bench_open (b, FISH_SOUND_DECODE);
+
+  if (b->interleave) {
+    fish_sound_set_decoded_float_ilv (fsound, decoded_float, b);
+  } else {
+    fish_sound_set_decoded_float (fsound, decoded_float, b);
+  }
+
+  b->frames_out = 0;
+
+  fs_bench_counters_start (counters);
+  t0 = fs_bench_now ();
+
+  for (i = 0; i < p->npackets; i++) {
+    fish_sound_decode (fsound, &p->data[p->offsets[i]],
+		       p->offsets[i+1] - p->offsets[i]);
+  }
+
+  t1 = fs_bench_now ();
+  if (counts) fs_bench_counters_stop (counters, counts);
+
+  fish_sound_delete (fsound);
+
+  return t1 - t0;
+}
+
+static void
+report (FSBenchJSON * json, const char * what,
+	double elapsed, long frames, int samplerate)
+{
+  char key[64];
+
+  snprintf (key, sizeof (key), "%s_frames_per_sec", what);
+  fs_bench_json_number (json, key, frames / elapsed);
+  snprintf (key, sizeof (key), "%s_realtime", what);
+  fs_bench_json_number (json, key, (double)frames / samplerate / elapsed);
+  snprintf (key, sizeof (key), "%s_ns_per_frame", what);
+  fs_bench_json_number (json, key, elapsed * 1e9 / frames);
+}
+
+/*
+ * Find the median of each hardware counter over the repetitions, per
+ * frame. counts holds FS_BENCH_NR_COUNTERS values for each repetition;
+ * a counter is -1 in per_frame if it was unavailable in any of them.
+ */
+static void
+median_counts (double * counts, long frames, double * per_frame)
+{
+  double * values;
+  int c, i;
+
+  values = malloc (sizeof (double) * reps);
+
+  for (c = 0; c < FS_BENCH_NR_COUNTERS; c++) {
+    for (i = 0; i < reps; i++) {
+      if ((values[i] = counts[i * FS_BENCH_NR_COUNTERS + c]) < 0) break;
+    }
+
+    per_frame[c] = (i == reps) ? fs_bench_median (values, reps) / frames : -1;
+  }
+
+  free (values);
+}
+
+static void
+report_counters (FSBenchJSON * json, const char * what, double * per_frame)
+{
+  char key[64];
+  int c;
+
+  fprintf (out, "  %-8s", what);
+
+  for (c = 0; c < FS_BENCH_NR_COUNTERS; c++) {
+    if (per_frame[c] < 0) continue;
+
+    fprintf (out, " %s %.3f", fs_bench_counter_name (c), per_frame[c]);
+    snprintf (key, sizeof (key), "%s_%s_per_frame", what,
+	      fs_bench_counter_name (c));
+    fs_bench_json_number (json, key, per_frame[c]);
+  }
+
+  if (per_frame[FS_BENCH_CYCLES] > 0 && per_frame[FS_BENCH_INSTRUCTIONS] >= 0) {
+    fprintf (out, " ipc %.2f",
+	     per_frame[FS_BENCH_INSTRUCTIONS] / per_frame[FS_BENCH_CYCLES]);
+    snprintf (key, sizeof (key), "%s_ipc", what);
+    fs_bench_json_number (json, key, per_frame[FS_BENCH_INSTRUCTIONS] /
+			  per_frame[FS_BENCH_CYCLES]);
+  }
+
+  fprintf (out, " (per frame)\n");
+}
+
+static int
+fs_bench_run (FSBenchJSON * json, FSBenchBaseline * baseline,
+	      int samplerate, int channels, int format, int interleave,
+	      int blocksize, int signal)
+{
+  FS_Bench * b;
+  double * enc, * dec, enc_time, dec_time;
+  double * enc_counts, * dec_counts;
+  double enc_per_frame[FS_BENCH_NR_COUNTERS];
+  double dec_per_frame[FS_BENCH_NR_COUNTERS];
+  char name[128];
+  int i, regressed = 0;
+
+  snprintf (name, sizeof (name), "%s/%d/%d/%s/%d/%s",
+	    format_name (format), samplerate, channels,
+	    interleave ? "ilv" : "non-ilv", blocksize,
+	    fs_bench_signal_name (signal));
+
+  if ((b = fs_bench_new (samplerate, channels, format, interleave,
+			 blocksize, signal)) == NULL) {
+    fprintf (stderr, "%s: out of memory\n", name);
+    return 0;
+  }
+
+  enc = malloc (sizeof (double) * reps);
+  dec = malloc (sizeof (double) * reps);
+  enc_counts = malloc (sizeof (double) * reps * FS_BENCH_NR_COUNTERS);
+  dec_counts = malloc (sizeof (double) * reps * FS_BENCH_NR_COUNTERS);
+
+  for (i = 0; i < warmup; i++) {
+    fs_bench_encode (b, NULL);
+    fs_bench_decode (b, NULL);
+  }
+
+  for (i = 0; i < reps; i++) {
+    enc[i] = fs_bench_encode (b, &enc_counts[i * FS_BENCH_NR_COUNTERS]);
+    dec[i] = fs_bench_decode (b, &dec_counts[i * FS_BENCH_NR_COUNTERS]);
+  }
+
+  median_counts (enc_counts, b->frames, enc_per_frame);
+  median_counts (dec_counts, b->frames, dec_per_frame);
+
+  enc_time = fs_bench_median (enc, reps);
+  dec_time = fs_bench_median (dec, reps);
+
+  fprintf (out,
+	   "%-36s  enc %8.1fx %7.1f ns/frame  dec %8.1fx %7.1f ns/frame\n",
+	   name,
+	   b->frames / (double)samplerate / enc_time,
+	   enc_time * 1e9 / b->frames,
+	   b->frames / (double)samplerate / dec_time,
+	   dec_time * 1e9 / b->frames);
+
+  if (b->frames_out < b->frames) {
+    fprintf (out, "WARNING %s: %ld frames encoded, %ld frames decoded\n",
+	     name, b->frames, b->frames_out);
+  }
+
+  fs_bench_json_begin (json, name);
+  fs_bench_json_string (json, "codec", format_name (format));
+  fs_bench_json_number (json, "samplerate", samplerate);
+  fs_bench_json_number (json, "channels", channels);
+  fs_bench_json_string (json, "interleave", interleave ? "true" : "false");
+  fs_bench_json_number (json, "blocksize", blocksize);
+  fs_bench_json_string (json, "signal", fs_bench_signal_name (signal));
+  fs_bench_json_number (json, "frames", b->frames);
+  fs_bench_json_number (json, "bytes", b->packets.length);
+  report (json, "encode", enc_time, b->frames, samplerate);
+  report (json, "decode", dec_time, b->frames, samplerate);
+  if (counters) {
+    report_counters (json, "encode", enc_per_frame);
+    report_counters (json, "decode", dec_per_frame);
+  }
+  fs_bench_json_end (json);
+
+  if (baseline) {
+    regressed |= fs_bench_baseline_check (baseline, name,
+					  "encode_ns_per_frame",
+					  enc_time * 1e9 / b->frames,
+					  threshold);
+    regressed |= fs_bench_baseline_check (baseline, name,
+					  "decode_ns_per_frame",
+					  dec_time * 1e9 / b->frames,
+					  threshold);
+  }
+
+  free (enc);
+  free (dec);
+  free (enc_counts);
+  free (dec_counts);
+  fs_bench_delete (b);
+
+  return regressed;
+}
+
+static void
+parse_args (int argc, char * argv[])
+{
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "--nasty")) {
+      bench_blocksizes = nasty_blocksizes;
+      bench_samplerates = nasty_samplerates;
+      bench_channels = nasty_channels;
+    } else if (!strcmp (argv[i], "--quick")) {
+      bench_blocksizes = quick_blocksizes;
+      bench_samplerates = quick_samplerates;
+      bench_channels = quick_channels;
+    } else if (!strcmp (argv[i], "--reps")) {
+      i++; if (i >= argc) usage(argv[0]);
+      reps = atoi (argv[i]);
+      if (reps < 1) usage (argv[0]);
+    } else if (!strcmp (argv[i], "--warmup")) {
+      i++; if (i >= argc) usage(argv[0]);
+      warmup = atoi (argv[i]);
+    } else if (!strcmp (argv[i], "--seconds")) {
+      i++; if (i >= argc) usage(argv[0]);
+      seconds = atof (argv[i]);
+      if (seconds <= 0.0) usage (argv[0]);
+    } else if (!strcmp (argv[i], "--signal")) {
+      i++; if (i >= argc) usage(argv[0]);
+      if ((bench_signal = fs_bench_signal_parse (argv[i])) == -1)
+	usage (argv[0]);
+    } else if (!strcmp (argv[i], "--counters")) {
+      bench_counters = 1;
+    } else if (!strcmp (argv[i], "--json")) {
+      i++; if (i >= argc) usage(argv[0]);
+      json_path = argv[i];
+    } else if (!strcmp (argv[i], "--baseline")) {
+      i++; if (i >= argc) usage(argv[0]);
+      baseline_path = argv[i];
+    } else if (!strcmp (argv[i], "--threshold")) {
+      i++; if (i >= argc) usage(argv[0]);
+      threshold = atof (argv[i]);
+    } else if (!strcmp (argv[i], "--disable-vorbis")) {
+      bench_vorbis = 0;
+    } else if (!strcmp (argv[i], "--disable-speex")) {
+      bench_speex = 0;
+    } else if (!strcmp (argv[i], "--disable-flac")) {
+      bench_flac = 0;
+    } else if (!strcmp (argv[i], "--disable-interleave")) {
+      bench_interleave = 0;
+    } else if (!strcmp (argv[i], "--disable-non-interleave")) {
+      bench_non_interleave = 0;
+    } else {
+      usage(argv[0]);
+    }
+  }
+}
+
+int
+main (int argc, char * argv[])
+{
+  FSBenchJSON * json = NULL;
+  FSBenchBaseline * baseline = NULL;
+  int formats[3], nformats = 0;
+  int b, s, c, f, i, sig, regressed = 0;
+
+  bench_blocksizes = default_blocksizes;
+  bench_samplerates = default_samplerates;
+  bench_channels = default_channels;
+
+  parse_args (argc, argv);
+
+  if (bench_vorbis) formats[nformats++] = FISH_SOUND_VORBIS;
+  if (bench_speex) formats[nformats++] = FISH_SOUND_SPEEX;
+  if (bench_flac) formats[nformats++] = FISH_SOUND_FLAC;
+
+  if (nformats == 0) {
+    fprintf (stderr, "%s: no codecs to benchmark\n", argv[0]);
+    exit (1);
+  }
+
+  if (baseline_path &&
+      (baseline = fs_bench_baseline_load (baseline_path)) == NULL) {
+    fprintf (stderr, "%s: unable to read baseline %s\n", argv[0],
+	     baseline_path);
+    exit (1);
+  }
+
+  if (json_path &&
+      (json = fs_bench_json_open (json_path, "fishsound-bench")) == NULL) {
+    fprintf (stderr, "%s: unable to open %s\n", argv[0], json_path);
+    exit (1);
+  }
+
+  /* Keep the table off stdout when the JSON is going there */
+  out = (json_path && !strcmp (json_path, "-")) ? stderr : stdout;
+
+  if (bench_counters && (counters = fs_bench_counters_open ()) == NULL) {
+    fprintf (stderr, "%s: hardware performance counters unavailable, "
+	     "continuing without them\n", argv[0]);
+  }
+
+  for (b = 0; bench_blocksizes[b]; b++) {
+    for (s = 0; bench_samplerates[s]; s++) {
+      for (c = 0; bench_channels[c]; c++) {
+	for (f = 0; f < nformats; f++) {
+	  if (formats[f] == FISH_SOUND_SPEEX && bench_channels[c] > 2)
+	    continue;
+	  if (formats[f] == FISH_SOUND_FLAC && bench_channels[c] > 8)
+	    continue;
+
+	  for (i = 0; i < 2; i++) {
+	    if (i == 0 && !bench_non_interleave) continue;
+	    if (i == 1 && !bench_interleave) continue;
+
+	    for (sig = 0; sig < FS_BENCH_NR_SIGNALS; sig++) {
+	      if (bench_signal != -1 && sig != bench_signal) continue;
+
+	      regressed |= fs_bench_run (json, baseline,
+					 bench_samplerates[s],
+					 bench_channels[c], formats[f], i,
+					 bench_blocksizes[b], sig);
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  fs_bench_counters_close (counters);
+  fs_bench_json_close (json);
+  fs_bench_baseline_free (baseline);
+
+  exit (regressed ? 1 : 0);
+}
@@ -0,0 +1,419 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_bench.h"
+
+/*
+ * fishsound-latbench: delay through encoders and decoders.
+ *
+ * A test signal is passed to an encoder one block at a time. When each
+ * packet is emitted, the delay of the oldest frame it completes is the
+ * number of frames that had been passed in since that frame; the largest
+ * such delay is the input-to-packet delay. The packets are then decoded
+ * one at a time, and the packet-to-PCM delay is the largest number of
+ * frames completed by the packets passed in which had not yet been
+ * decoded. Both are reported alongside FISH_SOUND_GET_LATENCY and the
+ * largest FISH_SOUND_GET_PENDING_FRAMES seen between blocks.
+ */
+
+#define DEFAULT_SECONDS 2.0
+#define DEFAULT_THRESHOLD 10.0
+
+#define SAMPLERATE 48000
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+static void
+usage (char * progname)
+{
+  printf ("Usage: %s [options]\n\n", progname);
+  printf ("Measure the delay through encoders and decoders of each codec\n\n");
+  printf ("Options:\n");
+  printf ("  --seconds s               Seconds of audio per case (default %.1f)\n", DEFAULT_SECONDS);
+  printf ("  --quick                   Run a small set of common cases\n");
+  printf ("  --nasty                   Run with large test parameters\n");
+  printf ("  --disable-vorbis          Disable benchmarking of Vorbis codec\n");
+  printf ("  --disable-speex           Disable benchmarking of Speex codec\n");
+  printf ("  --disable-flac            Disable benchmarking of Flac codec\n");
+  printf ("  --json file               Write results as JSON to file ('-' for stdout)\n");
+  printf ("  --baseline file           Compare results with a previous JSON file\n");
+  printf ("  --threshold pct           Allowed growth against the baseline,\n");
+  printf ("                            in percent (default %.0f)\n", DEFAULT_THRESHOLD);
+  printf ("\nExits with status 1 if any delay is longer than the baseline by more\n");
+  printf ("than the threshold.\n");
+  exit (1);
+}
+
+/* Configured by commandline args */
+static int * bench_blocksizes, * bench_channels;
+static double seconds = DEFAULT_SECONDS, threshold = DEFAULT_THRESHOLD;
+static int bench_vorbis = HAVE_VORBIS, bench_speex = HAVE_SPEEX;
+static int bench_flac = HAVE_FLAC;
+static char * json_path = NULL, * baseline_path = NULL;
+
+/* Where the table of results goes */
+static FILE * out;
+
+static int nasty_blocksizes[] = {32, 64, 128, 256, 512, 1024, 2048, 4096, 0};
+static int nasty_channels[] = {1, 2, 6, 0};
+
+static int default_blocksizes[] = {64, 256, 1024, 4096, 0};
+static int default_channels[] = {1, 2, 0};
+
+static int quick_blocksizes[] = {256, 0};
+static int quick_channels[] = {2, 0};
+
+/* Encoded packets, kept in memory for decoding */
+typedef struct {
+  unsigned char * data;
+  long length;
+  long alloc;
+  long * offsets; /* start of each packet, plus the end of the last */
+  long * frameno; /* frames completed by the end of each packet */
+  long npackets;
+  long max_packets;
+
+  long frames_in; /* frames passed to the encoder so far */
+  long frames_done; /* frames completed by the packets so far */
+  long encode_delay; /* largest input-to-packet delay */
+} FS_Latency;
+
+static const char *
+format_name (int format)
+{
+  switch (format) {
+  case FISH_SOUND_VORBIS: return "vorbis";
+  case FISH_SOUND_SPEEX: return "speex";
+  case FISH_SOUND_FLAC: return "flac";
+  default: return "unknown";
+  }
+}
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  FS_Latency * l = (FS_Latency *) user_data;
+  unsigned char * data;
+  long * offsets, * frameno, done;
+
+  if (l->length + bytes > l->alloc) {
+    if ((data = realloc (l->data, (l->length + bytes) * 2)) == NULL)
+      return FISH_SOUND_STOP_ERR;
+    l->data = data;
+    l->alloc = (l->length + bytes) * 2;
+  }
+
+  if (l->npackets + 2 > l->max_packets) {
+    if ((offsets = realloc (l->offsets,
+			    sizeof (long) * (l->npackets + 2) * 2)) == NULL)
+      return FISH_SOUND_STOP_ERR;
+    l->offsets = offsets;
+    if ((frameno = realloc (l->frameno,
+			    sizeof (long) * (l->npackets + 2) * 2)) == NULL)
+      return FISH_SOUND_STOP_ERR;
+    l->frameno = frameno;
+    l->max_packets = (l->npackets + 2) * 2;
+  }
+
+  /* The oldest frame completed by this packet was passed in at
+   * l->frames_done, and has waited for all the frames since */
+  done = fish_sound_get_frameno (fsound);
+  if (done > l->frames_done) {
+    l->encode_delay = MAX (l->encode_delay, l->frames_in - l->frames_done);
+    l->frames_done = done;
+  }
+
+  memcpy (&l->data[l->length], buf, bytes);
+  l->frameno[l->npackets] = l->frames_done;
+  l->offsets[l->npackets++] = l->length;
+  l->length += bytes;
+  l->offsets[l->npackets] = l->length;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static int
+decoded_float (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  long * frames_out = (long *) user_data;
+
+  *frames_out += frames;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static long
+get_long (FishSound * fsound, int command)
+{
+  long value = 0;
+
+  fish_sound_command (fsound, command, &value, sizeof (long));
+
+  return value;
+}
+
+/* Encode a signal into l, one block at a time, returning the largest
+ * number of pending frames reported between blocks */
+static long
+fs_latbench_encode (FS_Latency * l, int format, int channels, int blocksize,
+		    long * latency)
+{
+  FishSoundInfo fsinfo;
+  FishSound * fsound;
+  float * ipcm;
+  long frames, offset, n, max_pending = 0;
+  int i;
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = channels;
+  fsinfo.format = format;
+
+  frames = (long)(seconds * SAMPLERATE);
+
+  ipcm = malloc (sizeof (float) * channels * frames);
+  for (i = 0; i < channels; i++)
+    fs_bench_signal_fill (FS_BENCH_SWEEP, ipcm + i, frames, channels, i,
+			  SAMPLERATE);
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_encoded_callback (fsound, encoded, l);
+
+  for (offset = 0; offset < frames; offset += n) {
+    n = MIN (blocksize, frames - offset);
+    l->frames_in += n;
+    fish_sound_prepare_truncation (fsound, offset + n, (offset + n >= frames));
+    fish_sound_encode_float_ilv (fsound, (float **)&ipcm[offset * channels],
+				 n);
+
+    /* The end of stream flushes everything; don't count it */
+    if (offset + n < frames)
+      max_pending = MAX (max_pending,
+			 get_long (fsound, FISH_SOUND_GET_PENDING_FRAMES));
+  }
+
+  *latency = get_long (fsound, FISH_SOUND_GET_LATENCY);
+
+  fish_sound_flush (fsound);
+  fish_sound_delete (fsound);
+
+  free (ipcm);
+
+  return max_pending;
+}
+
+/* Decode the packets in l one at a time, returning the largest
+ * packet-to-PCM delay */
+static long
+fs_latbench_decode (FS_Latency * l, long * latency)
+{
+  FishSound * fsound;
+  long i, frames_out = 0, delay = 0;
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_decoded_float_ilv (fsound, decoded_float, &frames_out);
+
+  for (i = 0; i < l->npackets; i++) {
+    fish_sound_decode (fsound, &l->data[l->offsets[i]],
+		       l->offsets[i+1] - l->offsets[i]);
+    delay = MAX (delay, l->frameno[i] - frames_out);
+  }
+
+  *latency = get_long (fsound, FISH_SOUND_GET_LATENCY);
+
+  fish_sound_delete (fsound);
+
+  return delay;
+}
+
+static int
+fs_latbench_run (FSBenchJSON * json, FSBenchBaseline * baseline,
+		 int format, int channels, int blocksize)
+{
+  FS_Latency l;
+  long enc_latency, dec_latency, max_pending, decode_delay;
+  char name[128];
+  int regressed = 0;
+
+  snprintf (name, sizeof (name), "%s/%d/%d/%d", format_name (format),
+	    SAMPLERATE, channels, blocksize);
+
+  memset (&l, 0, sizeof (l));
+
+  max_pending = fs_latbench_encode (&l, format, channels, blocksize,
+				    &enc_latency);
+  decode_delay = fs_latbench_decode (&l, &dec_latency);
+
+  fprintf (out,
+	   "%-22s  enc %6ld frames %7.2f ms (latency %6ld, pending %6ld)"
+	   "  dec %6ld frames %7.2f ms (latency %6ld)\n",
+	   name, l.encode_delay, l.encode_delay * 1000.0 / SAMPLERATE,
+	   enc_latency, max_pending,
+	   decode_delay, decode_delay * 1000.0 / SAMPLERATE, dec_latency);
+
+  fs_bench_json_begin (json, name);
+  fs_bench_json_string (json, "codec", format_name (format));
+  fs_bench_json_number (json, "samplerate", SAMPLERATE);
+  fs_bench_json_number (json, "channels", channels);
+  fs_bench_json_number (json, "blocksize", blocksize);
+  fs_bench_json_number (json, "encode_delay_frames", l.encode_delay);
+  fs_bench_json_number (json, "encode_latency_frames", enc_latency);
+  fs_bench_json_number (json, "encode_max_pending_frames", max_pending);
+  fs_bench_json_number (json, "decode_delay_frames", decode_delay);
+  fs_bench_json_number (json, "decode_latency_frames", dec_latency);
+  fs_bench_json_end (json);
+
+  if (baseline) {
+    regressed |= fs_bench_baseline_check (baseline, name,
+					  "encode_delay_frames",
+					  l.encode_delay, threshold);
+    regressed |= fs_bench_baseline_check (baseline, name,
+					  "decode_delay_frames",
+					  decode_delay, threshold);
+  }
+
+  free (l.data);
+  free (l.offsets);
+  free (l.frameno);
+
+  return regressed;
+}
+
+static void
+parse_args (int argc, char * argv[])
+{
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "--nasty")) {
+      bench_blocksizes = nasty_blocksizes;
+      bench_channels = nasty_channels;
+    } else if (!strcmp (argv[i], "--quick")) {
+      bench_blocksizes = quick_blocksizes;
+      bench_channels = quick_channels;
+    } else if (!strcmp (argv[i], "--seconds")) {
+      i++; if (i >= argc) usage(argv[0]);
+      seconds = atof (argv[i]);
+      if (seconds <= 0.0) usage (argv[0]);
+    } else if (!strcmp (argv[i], "--json")) {
+      i++; if (i >= argc) usage(argv[0]);
+      json_path = argv[i];
+    } else if (!strcmp (argv[i], "--baseline")) {
+      i++; if (i >= argc) usage(argv[0]);
+      baseline_path = argv[i];
+    } else if (!strcmp (argv[i], "--threshold")) {
+      i++; if (i >= argc) usage(argv[0]);
+      threshold = atof (argv[i]);
+    } else if (!strcmp (argv[i], "--disable-vorbis")) {
+      bench_vorbis = 0;
+    } else if (!strcmp (argv[i], "--disable-speex")) {
+      bench_speex = 0;
+    } else if (!strcmp (argv[i], "--disable-flac")) {
+      bench_flac = 0;
+    } else {
+      usage(argv[0]);
+    }
+  }
+}
+
+int
+main (int argc, char * argv[])
+{
+  FSBenchJSON * json = NULL;
+  FSBenchBaseline * baseline = NULL;
+  int formats[3], nformats = 0;
+  int b, c, f, regressed = 0;
+
+  bench_blocksizes = default_blocksizes;
+  bench_channels = default_channels;
+
+  parse_args (argc, argv);
+
+  if (bench_vorbis) formats[nformats++] = FISH_SOUND_VORBIS;
+  if (bench_speex) formats[nformats++] = FISH_SOUND_SPEEX;
+  if (bench_flac) formats[nformats++] = FISH_SOUND_FLAC;
+
+  if (nformats == 0) {
+    fprintf (stderr, "%s: no codecs to benchmark\n", argv[0]);
+    exit (1);
+  }
+
+  if (baseline_path &&
+      (baseline = fs_bench_baseline_load (baseline_path)) == NULL) {
+    fprintf (stderr, "%s: unable to read baseline %s\n", argv[0],
+	     baseline_path);
+    exit (1);
+  }
+
+  if (json_path &&
+      (json = fs_bench_json_open (json_path, "fishsound-latbench")) == NULL) {
+    fprintf (stderr, "%s: unable to open %s\n", argv[0], json_path);
+    exit (1);
+  }
+
+  /* Keep the table off stdout when the JSON is going there */
+  out = (json_path && !strcmp (json_path, "-")) ? stderr : stdout;
+
+  for (b = 0; bench_blocksizes[b]; b++) {
+    for (c = 0; bench_channels[c]; c++) {
+      for (f = 0; f < nformats; f++) {
+	if (formats[f] == FISH_SOUND_SPEEX && bench_channels[c] > 2)
+	  continue;
+	if (formats[f] == FISH_SOUND_FLAC && bench_channels[c] > 8)
+	  continue;
+
+	regressed |= fs_latbench_run (json, baseline, formats[f],
+				      bench_channels[c], bench_blocksizes[b]);
+      }
+    }
+  }
+
+  fs_bench_json_close (json);
+  fs_bench_baseline_free (baseline);
+
+  exit (regressed ? 1 : 0);
+}
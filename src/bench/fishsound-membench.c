@@ -0,0 +1,415 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_bench.h"
+
+/*
+ * fishsound-membench: memory used by idle and active handles.
+ *
+ * For each codec and channel count this reports the memory held by an
+ * encoder and a decoder just after creation (idle), and after a few
+ * seconds of a test signal has been passed through (active), as counted
+ * by FISH_SOUND_GET_MEMORY. Memory allocated internally by the codec
+ * libraries is not included.
+ */
+
+#define DEFAULT_SECONDS 2.0
+#define DEFAULT_THRESHOLD 10.0
+
+#define SAMPLERATE 48000
+#define BLOCKSIZE 1024
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+
+static void
+usage (char * progname)
+{
+  printf ("Usage: %s [options]\n\n", progname);
+  printf ("Measure memory used by encoders and decoders of each codec\n\n");
+  printf ("Options:\n");
+  printf ("  --seconds s               Seconds of audio per handle (default %.1f)\n", DEFAULT_SECONDS);
+  printf ("  --quick                   Run a small set of common cases\n");
+  printf ("  --nasty                   Run with large test parameters\n");
+  printf ("  --disable-vorbis          Disable benchmarking of Vorbis codec\n");
+  printf ("  --disable-speex           Disable benchmarking of Speex codec\n");
+  printf ("  --disable-flac            Disable benchmarking of Flac codec\n");
+  printf ("  --json file               Write results as JSON to file ('-' for stdout)\n");
+  printf ("  --baseline file           Compare results with a previous JSON file\n");
+  printf ("  --threshold pct           Allowed growth against the baseline,\n");
+  printf ("                            in percent (default %.0f)\n", DEFAULT_THRESHOLD);
+  printf ("\nExits with status 1 if any handle uses more memory than the baseline\n");
+  printf ("by more than the threshold.\n");
+  exit (1);
+}
+
+/* Configured by commandline args */
+static int * bench_channels;
+static double seconds = DEFAULT_SECONDS, threshold = DEFAULT_THRESHOLD;
+static int bench_vorbis = HAVE_VORBIS, bench_speex = HAVE_SPEEX;
+static int bench_flac = HAVE_FLAC;
+static char * json_path = NULL, * baseline_path = NULL;
+
+/* Where the table of results goes */
+static FILE * out;
+
+static int nasty_channels[] = {1, 2, 4, 5, 6, 8, 10, 16, 32, 0};
+static int default_channels[] = {1, 2, 6, 16, 0};
+static int quick_channels[] = {2, 0};
+
+/* Encoded packets, kept in memory for decoding */
+typedef struct {
+  unsigned char * data;
+  long length;
+  long alloc;
+  long * offsets; /* start of each packet, plus the end of the last */
+  long npackets;
+  long max_packets;
+} FS_Packets;
+
+/* Memory used by one handle */
+typedef struct {
+  long idle;
+  long active;
+  long peak;
+  long blocks;
+} FS_Usage;
+
+static const char *
+format_name (int format)
+{
+  switch (format) {
+  case FISH_SOUND_VORBIS: return "vorbis";
+  case FISH_SOUND_SPEEX: return "speex";
+  case FISH_SOUND_FLAC: return "flac";
+  default: return "unknown";
+  }
+}
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  FS_Packets * p = (FS_Packets *) user_data;
+  unsigned char * data;
+  long * offsets;
+
+  if (p->length + bytes > p->alloc) {
+    if ((data = realloc (p->data, (p->length + bytes) * 2)) == NULL)
+      return FISH_SOUND_STOP_ERR;
+    p->data = data;
+    p->alloc = (p->length + bytes) * 2;
+  }
+
+  if (p->npackets + 2 > p->max_packets) {
+    if ((offsets = realloc (p->offsets,
+			    sizeof (long) * (p->npackets + 2) * 2)) == NULL)
+      return FISH_SOUND_STOP_ERR;
+    p->offsets = offsets;
+    p->max_packets = (p->npackets + 2) * 2;
+  }
+
+  memcpy (&p->data[p->length], buf, bytes);
+  p->offsets[p->npackets++] = p->length;
+  p->length += bytes;
+  p->offsets[p->npackets] = p->length;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static int
+decoded_float (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  return FISH_SOUND_CONTINUE;
+}
+
+static long
+get_memory (FishSound * fsound, FS_Usage * usage)
+{
+  FishSoundMemory memory;
+
+  if (fish_sound_command (fsound, FISH_SOUND_GET_MEMORY, &memory,
+			  sizeof (memory)) != 0) {
+    if (usage) {
+      usage->peak = -1;
+      usage->blocks = -1;
+    }
+    return -1;
+  }
+
+  if (usage) {
+    usage->peak = memory.peak_bytes;
+    usage->blocks = memory.blocks;
+  }
+
+  return memory.bytes;
+}
+
+/* Encode a signal into p, measuring the encoder before and after. The
+ * active usage is measured before flushing, while the encoder is still
+ * holding any buffered audio. */
+static void
+fs_membench_encode (int format, int channels, FS_Packets * p,
+		    FS_Usage * usage)
+{
+  FishSoundInfo fsinfo;
+  FishSound * fsound;
+  float * ipcm;
+  long frames, offset, n;
+  int i;
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = channels;
+  fsinfo.format = format;
+
+  frames = (long)(seconds * SAMPLERATE);
+
+  ipcm = malloc (sizeof (float) * channels * frames);
+  for (i = 0; i < channels; i++)
+    fs_bench_signal_fill (FS_BENCH_SWEEP, ipcm + i, frames, channels, i,
+			  SAMPLERATE);
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_encoded_callback (fsound, encoded, p);
+
+  usage->idle = get_memory (fsound, NULL);
+
+  for (offset = 0; offset < frames; offset += n) {
+    n = MIN (BLOCKSIZE, frames - offset);
+    fish_sound_prepare_truncation (fsound, offset + n, (offset + n >= frames));
+    fish_sound_encode_float_ilv (fsound, (float **)&ipcm[offset * channels],
+				 n);
+  }
+
+  usage->active = get_memory (fsound, usage);
+
+  fish_sound_flush (fsound);
+  fish_sound_delete (fsound);
+
+  free (ipcm);
+}
+
+/* Decode the packets in p, measuring the decoder before and after */
+static void
+fs_membench_decode (int channels, FS_Packets * p, FS_Usage * usage)
+{
+  FishSound * fsound;
+  long i;
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_decoded_float_ilv (fsound, decoded_float, NULL);
+
+  usage->idle = get_memory (fsound, NULL);
+
+  for (i = 0; i < p->npackets; i++) {
+    fish_sound_decode (fsound, &p->data[p->offsets[i]],
+		       p->offsets[i+1] - p->offsets[i]);
+  }
+
+  usage->active = get_memory (fsound, usage);
+
+  fish_sound_delete (fsound);
+}
+
+static void
+report (FSBenchJSON * json, const char * what, FS_Usage * usage)
+{
+  char key[64];
+
+  snprintf (key, sizeof (key), "%s_idle_bytes", what);
+  fs_bench_json_number (json, key, usage->idle);
+  snprintf (key, sizeof (key), "%s_active_bytes", what);
+  fs_bench_json_number (json, key, usage->active);
+  snprintf (key, sizeof (key), "%s_peak_bytes", what);
+  fs_bench_json_number (json, key, usage->peak);
+  snprintf (key, sizeof (key), "%s_blocks", what);
+  fs_bench_json_number (json, key, usage->blocks);
+}
+
+static int
+check (FSBenchBaseline * baseline, const char * name, const char * what,
+       FS_Usage * usage)
+{
+  char key[64];
+  int regressed = 0;
+
+  snprintf (key, sizeof (key), "%s_idle_bytes", what);
+  regressed |= fs_bench_baseline_check (baseline, name, key, usage->idle,
+					threshold);
+  snprintf (key, sizeof (key), "%s_peak_bytes", what);
+  regressed |= fs_bench_baseline_check (baseline, name, key, usage->peak,
+					threshold);
+
+  return regressed;
+}
+
+static int
+fs_membench_run (FSBenchJSON * json, FSBenchBaseline * baseline,
+		 int format, int channels)
+{
+  FS_Packets packets;
+  FS_Usage enc, dec;
+  char name[128];
+  int regressed = 0;
+
+  snprintf (name, sizeof (name), "%s/%d/%d", format_name (format),
+	    SAMPLERATE, channels);
+
+  memset (&packets, 0, sizeof (packets));
+
+  fs_membench_encode (format, channels, &packets, &enc);
+  fs_membench_decode (channels, &packets, &dec);
+
+  fprintf (out,
+	   "%-20s  enc %8ld idle %8ld active %8ld peak"
+	   "  dec %8ld idle %8ld active %8ld peak\n",
+	   name, enc.idle, enc.active, enc.peak,
+	   dec.idle, dec.active, dec.peak);
+
+  fs_bench_json_begin (json, name);
+  fs_bench_json_string (json, "codec", format_name (format));
+  fs_bench_json_number (json, "samplerate", SAMPLERATE);
+  fs_bench_json_number (json, "channels", channels);
+  report (json, "encode", &enc);
+  report (json, "decode", &dec);
+  fs_bench_json_end (json);
+
+  if (baseline) {
+    regressed |= check (baseline, name, "encode", &enc);
+    regressed |= check (baseline, name, "decode", &dec);
+  }
+
+  free (packets.data);
+  free (packets.offsets);
+
+  return regressed;
+}
+
+static void
+parse_args (int argc, char * argv[])
+{
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "--nasty")) {
+      bench_channels = nasty_channels;
+    } else if (!strcmp (argv[i], "--quick")) {
+      bench_channels = quick_channels;
+    } else if (!strcmp (argv[i], "--seconds")) {
+      i++; if (i >= argc) usage(argv[0]);
+      seconds = atof (argv[i]);
+      if (seconds <= 0.0) usage (argv[0]);
+    } else if (!strcmp (argv[i], "--json")) {
+      i++; if (i >= argc) usage(argv[0]);
+      json_path = argv[i];
+    } else if (!strcmp (argv[i], "--baseline")) {
+      i++; if (i >= argc) usage(argv[0]);
+      baseline_path = argv[i];
+    } else if (!strcmp (argv[i], "--threshold")) {
+      i++; if (i >= argc) usage(argv[0]);
+      threshold = atof (argv[i]);
+    } else if (!strcmp (argv[i], "--disable-vorbis")) {
+      bench_vorbis = 0;
+    } else if (!strcmp (argv[i], "--disable-speex")) {
+      bench_speex = 0;
+    } else if (!strcmp (argv[i], "--disable-flac")) {
+      bench_flac = 0;
+    } else {
+      usage(argv[0]);
+    }
+  }
+}
+
+int
+main (int argc, char * argv[])
+{
+  FSBenchJSON * json = NULL;
+  FSBenchBaseline * baseline = NULL;
+  int formats[3], nformats = 0;
+  int c, f, regressed = 0;
+
+  bench_channels = default_channels;
+
+  parse_args (argc, argv);
+
+  if (bench_vorbis) formats[nformats++] = FISH_SOUND_VORBIS;
+  if (bench_speex) formats[nformats++] = FISH_SOUND_SPEEX;
+  if (bench_flac) formats[nformats++] = FISH_SOUND_FLAC;
+
+  if (nformats == 0) {
+    fprintf (stderr, "%s: no codecs to benchmark\n", argv[0]);
+    exit (1);
+  }
+
+  if (baseline_path &&
+      (baseline = fs_bench_baseline_load (baseline_path)) == NULL) {
+    fprintf (stderr, "%s: unable to read baseline %s\n", argv[0],
+	     baseline_path);
+    exit (1);
+  }
+
+  if (json_path &&
+      (json = fs_bench_json_open (json_path, "fishsound-membench")) == NULL) {
+    fprintf (stderr, "%s: unable to open %s\n", argv[0], json_path);
+    exit (1);
+  }
+
+  /* Keep the table off stdout when the JSON is going there */
+  out = (json_path && !strcmp (json_path, "-")) ? stderr : stdout;
+
+  for (c = 0; bench_channels[c]; c++) {
+    for (f = 0; f < nformats; f++) {
+      if (formats[f] == FISH_SOUND_SPEEX && bench_channels[c] > 2)
+	continue;
+      if (formats[f] == FISH_SOUND_FLAC && bench_channels[c] > 8)
+	continue;
+
+      regressed |= fs_membench_run (json, baseline, formats[f],
+				    bench_channels[c]);
+    }
+  }
+
+  fs_bench_json_close (json);
+  fs_bench_baseline_free (baseline);
+
+  exit (regressed ? 1 : 0);
+}
@@ -0,0 +1,548 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+/* Library internals under test; the conversion kernels are inline, and
+ * the comment functions are declared as in private.h */
+#include "convert.h"
+
+int fish_sound_comments_init (FishSound * fsound);
+int fish_sound_comments_free (FishSound * fsound);
+int fish_sound_comments_decode (FishSound * fsound, unsigned char * buf,
+				long bytes);
+long fish_sound_comments_encode (FishSound * fsound, unsigned char * buf,
+				 long length);
+const unsigned char *
+fish_sound_comments_packet (FishSound * fsound, long * length);
+
+#include "fs_bench.h"
+
+/*
+ * fishsound-microbench: time the library's own code in isolation from
+ * libvorbis, libspeex and libFLAC, ie. the sample conversion kernels and
+ * the Vorbis comment codec. Comparing these costs with fishsound-bench
+ * shows how much of a profile is wrapper overhead rather than codec.
+ *
+ * This links against the static library, as it calls functions which
+ * are not exported.
+ */
+
+#define DEFAULT_REPS 5
+#define DEFAULT_THRESHOLD 10.0
+
+/* Samples processed per timed run of a conversion kernel */
+#define SAMPLES_PER_RUN (1L << 22)
+
+static void
+usage (char * progname)
+{
+  printf ("Usage: %s [options]\n\n", progname);
+  printf ("Time sample conversion and comment handling, excluding the codecs\n\n");
+  printf ("Options:\n");
+  printf ("  --reps n                  Timed repetitions per case (default %d)\n", DEFAULT_REPS);
+  printf ("  --only prefix             Only run cases whose name starts with prefix,\n");
+  printf ("                            eg. 'interleave' or 'comments'\n");
+  printf ("  --json file               Write results as JSON to file ('-' for stdout)\n");
+  printf ("  --baseline file           Compare results with a previous JSON file\n");
+  printf ("  --threshold pct           Allowed slowdown against the baseline,\n");
+  printf ("                            in percent (default %.0f)\n", DEFAULT_THRESHOLD);
+  printf ("\nCycle counts are reported where perf_event_open() is permitted.\n");
+  exit (1);
+}
+
+static int reps = DEFAULT_REPS;
+static double threshold = DEFAULT_THRESHOLD;
+static char * only = NULL;
+static char * json_path = NULL, * baseline_path = NULL;
+
+static FSBenchJSON * json = NULL;
+static FSBenchBaseline * baseline = NULL;
+static int cycles_fd = -1;
+static int regressed = 0;
+
+/* Where the table of results goes */
+static FILE * out;
+
+static int bench_channels[] = {1, 2, 6, 8, 16, 0};
+static long bench_frames[] = {64, 1024, 8192, 0};
+
+static int flac_channels[] = {1, 2, 6, 8, 0};
+static long flac_frames[] = {1152, 4608, 0};
+
+static int speex_channels[] = {1, 2, 0};
+static long speex_frames[] = {160, 320, 640, 0};
+
+static int bench_ncomments[] = {0, 1, 10, 100, 1000, 10000, -1};
+
+typedef struct _MB MB;
+
+struct _MB {
+  void (*kernel) (MB * mb);
+  int channels;
+  long frames;
+  float * ilv;      /* interleaved float */
+  float ** pcm;     /* non-interleaved float */
+  int * s32;        /* interleaved FLAC__int32 */
+  int ** s32_pcm;   /* non-interleaved FLAC__int32 */
+  FishSound * fsound;
+  unsigned char * packet;
+  long length;
+  FishSoundComment * comments;
+  int ncomments;
+  FishSoundCommentSet * set;
+};
+
+/* Kernels */
+
+static void
+k_interleave (MB * mb)
+{
+  _fs_interleave (mb->pcm, (float **)mb->ilv, mb->frames, mb->channels, 1.0);
+}
+
+static void
+k_deinterleave (MB * mb)
+{
+  _fs_deinterleave ((float **)mb->ilv, mb->pcm, mb->frames, mb->channels,
+		    1.0);
+}
+
+static void
+k_flac_decode_ilv (MB * mb)
+{
+  _fs_interleave_from_s32 ((const int * const *)mb->s32_pcm, mb->ilv,
+			   mb->frames, mb->channels, 1.0 / (1 << 23));
+}
+
+static void
+k_flac_decode (MB * mb)
+{
+  _fs_convert_from_s32 ((const int * const *)mb->s32_pcm, mb->pcm,
+			mb->frames, mb->channels, 1.0 / (1 << 23));
+}
+
+static void
+k_flac_encode_ilv (MB * mb)
+{
+  _fs_convert_to_s32 (mb->ilv, mb->s32, mb->frames * mb->channels,
+		      (float)(1 << 23));
+}
+
+static void
+k_flac_encode (MB * mb)
+{
+  _fs_interleave_to_s32 (mb->pcm, 0, mb->s32, mb->frames, mb->channels,
+			 (float)(1 << 23));
+}
+
+static void
+k_speex_scale (MB * mb)
+{
+  _fs_scale (mb->ilv, mb->ilv, mb->frames * mb->channels,
+	     (float)(1/32767.0));
+}
+
+static void
+k_comments_encode (MB * mb)
+{
+  fish_sound_comments_encode (mb->fsound, mb->packet, mb->length);
+}
+
+/* Decode into a decoder handle, then free the comments again so that
+ * each run starts from an empty comment list */
+static void
+k_comments_decode (MB * mb)
+{
+  fish_sound_comments_decode (mb->fsound, mb->packet, mb->length);
+  fish_sound_comments_free (mb->fsound);
+  fish_sound_comments_init (mb->fsound);
+}
+
+/* Set up the comment packet of a fresh encoder, one comment at a time */
+static void
+k_comments_setup (MB * mb)
+{
+  long length;
+  int i;
+
+  fish_sound_comments_free (mb->fsound);
+  fish_sound_comments_init (mb->fsound);
+
+  for (i = 0; i < mb->ncomments; i++)
+    fish_sound_comment_add (mb->fsound, &mb->comments[i]);
+  fish_sound_comments_packet (mb->fsound, &length);
+}
+
+/* As k_comments_setup, but from a shared comment set */
+static void
+k_comments_attach (MB * mb)
+{
+  long length;
+
+  fish_sound_comments_free (mb->fsound);
+  fish_sound_comments_init (mb->fsound);
+
+  fish_sound_comment_attach_set (mb->fsound, mb->set);
+  fish_sound_comments_packet (mb->fsound, &length);
+}
+
+static int
+selected (const char * name)
+{
+  return (only == NULL || !strncmp (name, only, strlen (only)));
+}
+
+/*
+ * Time a kernel: each timed run calls it loops times, and the median of
+ * reps runs is reported per unit (sample or comment).
+ */
+static void
+run (MB * mb, const char * name, long loops, long units, const char * unit)
+{
+  double * times, * cycles, t, c;
+  double ns_per_unit, cycles_per_unit = -1;
+  char key[64];
+  long l;
+  int i;
+
+  times = malloc (sizeof (double) * reps);
+  cycles = malloc (sizeof (double) * reps);
+
+  /* Warm up caches and branch predictors */
+  mb->kernel (mb);
+
+  for (i = 0; i < reps; i++) {
+    fs_bench_cycles_start (cycles_fd);
+    t = fs_bench_now ();
+    for (l = 0; l < loops; l++)
+      mb->kernel (mb);
+    times[i] = fs_bench_now () - t;
+    cycles[i] = fs_bench_cycles_stop (cycles_fd);
+  }
+
+  ns_per_unit = fs_bench_median (times, reps) * 1e9 / (loops * units);
+  c = fs_bench_median (cycles, reps);
+  if (c >= 0) cycles_per_unit = c / (loops * units);
+
+  if (cycles_per_unit >= 0) {
+    fprintf (out, "%-36s %9.3f ns/%s %9.3f cycles/%s\n", name,
+	     ns_per_unit, unit, cycles_per_unit, unit);
+  } else {
+    fprintf (out, "%-36s %9.3f ns/%s\n", name, ns_per_unit, unit);
+  }
+
+  fs_bench_json_begin (json, name);
+  fs_bench_json_string (json, "unit", unit);
+  snprintf (key, sizeof (key), "ns_per_%s", unit);
+  fs_bench_json_number (json, key, ns_per_unit);
+  if (cycles_per_unit >= 0) {
+    snprintf (key, sizeof (key), "cycles_per_%s", unit);
+    fs_bench_json_number (json, key, cycles_per_unit);
+  }
+  fs_bench_json_end (json);
+
+  if (baseline) {
+    snprintf (key, sizeof (key), "ns_per_%s", unit);
+    regressed |= fs_bench_baseline_check (baseline, name, key, ns_per_unit,
+					  threshold);
+  }
+
+  free (times);
+  free (cycles);
+}
+
+static void
+mb_alloc (MB * mb, int channels, long frames)
+{
+  long i, n = frames * channels;
+  int j;
+
+  mb->channels = channels;
+  mb->frames = frames;
+
+  mb->ilv = malloc (sizeof (float) * n);
+  mb->s32 = malloc (sizeof (int) * n);
+  mb->pcm = malloc (sizeof (float *) * channels);
+  mb->s32_pcm = malloc (sizeof (int *) * channels);
+
+  fs_bench_signal_fill (FS_BENCH_NOISE, mb->ilv, n, 1, 0, 48000);
+  for (i = 0; i < n; i++)
+    mb->s32[i] = (int) (mb->ilv[i] * (1 << 23));
+
+  for (j = 0; j < channels; j++) {
+    mb->pcm[j] = malloc (sizeof (float) * frames);
+    mb->s32_pcm[j] = malloc (sizeof (int) * frames);
+    fs_bench_signal_fill (FS_BENCH_NOISE, mb->pcm[j], frames, 1, j, 48000);
+    for (i = 0; i < frames; i++)
+      mb->s32_pcm[j][i] = (int) (mb->pcm[j][i] * (1 << 23));
+  }
+}
+
+static void
+mb_free (MB * mb)
+{
+  int j;
+
+  for (j = 0; j < mb->channels; j++) {
+    free (mb->pcm[j]);
+    free (mb->s32_pcm[j]);
+  }
+  free (mb->pcm);
+  free (mb->s32_pcm);
+  free (mb->ilv);
+  free (mb->s32);
+}
+
+static void
+bench_kernel (const char * prefix, void (*kernel) (MB * mb),
+	      int * channels, long * frames)
+{
+  MB mb;
+  char name[128];
+  long n;
+  int c, f;
+
+  for (c = 0; channels[c]; c++) {
+    for (f = 0; frames[f]; f++) {
+      snprintf (name, sizeof (name), "%s/%dch/%ld", prefix, channels[c],
+		frames[f]);
+      if (!selected (name)) continue;
+
+      mb_alloc (&mb, channels[c], frames[f]);
+      mb.kernel = kernel;
+
+      n = frames[f] * channels[c];
+      run (&mb, name, SAMPLES_PER_RUN / n + 1, n, "sample");
+
+      mb_free (&mb);
+    }
+  }
+}
+
+static int
+comment_format (void)
+{
+  if (HAVE_FLAC) return FISH_SOUND_FLAC;
+  if (HAVE_SPEEX) return FISH_SOUND_SPEEX;
+  if (HAVE_VORBIS && HAVE_VORBISENC) return FISH_SOUND_VORBIS;
+  return FISH_SOUND_UNKNOWN;
+}
+
+static void
+bench_comments (int ncomments)
+{
+  static const char * names[] = {"TITLE", "ARTIST", "ALBUM", "COMMENT"};
+  FishSoundInfo fsinfo;
+  FishSound * encoder, * decoder;
+  MB mb;
+  char name[128], value[64];
+  long loops;
+  int i, lazy;
+
+  snprintf (name, sizeof (name), "comments_encode/%d", ncomments);
+  i = selected (name);
+  snprintf (name, sizeof (name), "comments_decode/%d", ncomments);
+  i = i || selected (name);
+  snprintf (name, sizeof (name), "comments_decode_lazy/%d", ncomments);
+  i = i || selected (name);
+  snprintf (name, sizeof (name), "comments_setup/%d", ncomments);
+  i = i || selected (name);
+  snprintf (name, sizeof (name), "comments_attach/%d", ncomments);
+  if (!i && !selected (name)) return;
+
+  memset (&mb, 0, sizeof (MB));
+
+  fsinfo.samplerate = 16000;
+  fsinfo.channels = 1;
+  fsinfo.format = comment_format ();
+
+  if ((encoder = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo)) == NULL)
+    return;
+  decoder = fish_sound_new (FISH_SOUND_DECODE, &fsinfo);
+
+  for (i = 0; i < ncomments; i++) {
+    snprintf (value, sizeof (value), "Value of comment number %d", i);
+    fish_sound_comment_add_byname (encoder, names[i % 4], value);
+  }
+
+  mb.length = fish_sound_comments_encode (encoder, NULL, 0);
+  mb.packet = malloc (mb.length);
+  fish_sound_comments_encode (encoder, mb.packet, mb.length);
+
+  /* Aim for about 100000 comments per timed run */
+  loops = 100000 / (ncomments + 1) + 1;
+
+  snprintf (name, sizeof (name), "comments_encode/%d", ncomments);
+  if (selected (name)) {
+    mb.kernel = k_comments_encode;
+    mb.fsound = encoder;
+    run (&mb, name, loops, ncomments > 0 ? ncomments : 1, "comment");
+  }
+
+  snprintf (name, sizeof (name), "comments_decode/%d", ncomments);
+  if (selected (name)) {
+    mb.kernel = k_comments_decode;
+    mb.fsound = decoder;
+    run (&mb, name, loops, ncomments > 0 ? ncomments : 1, "comment");
+  }
+
+  /* Decoding without accessing the comments, as most decoders do */
+  snprintf (name, sizeof (name), "comments_decode_lazy/%d", ncomments);
+  if (selected (name)) {
+    lazy = 1;
+    fish_sound_command (decoder, FISH_SOUND_SET_COMMENTS_LAZY, &lazy,
+			sizeof (int));
+    mb.kernel = k_comments_decode;
+    mb.fsound = decoder;
+    run (&mb, name, loops, ncomments > 0 ? ncomments : 1, "comment");
+  }
+
+  /* Starting an encoder with the same comments as many others */
+  mb.comments = malloc ((ncomments + 1) * sizeof (FishSoundComment));
+  mb.ncomments = ncomments;
+  for (i = 0; i < ncomments; i++) {
+    snprintf (value, sizeof (value), "Value of comment number %d", i);
+    mb.comments[i].name = (char *)names[i % 4];
+    mb.comments[i].value = strdup (value);
+  }
+
+  snprintf (name, sizeof (name), "comments_setup/%d", ncomments);
+  if (selected (name)) {
+    mb.kernel = k_comments_setup;
+    mb.fsound = encoder;
+    run (&mb, name, loops, ncomments > 0 ? ncomments : 1, "comment");
+  }
+
+  snprintf (name, sizeof (name), "comments_attach/%d", ncomments);
+  if (selected (name) &&
+      (mb.set = fish_sound_comment_set_new (mb.comments, ncomments)) != NULL) {
+    mb.kernel = k_comments_attach;
+    mb.fsound = encoder;
+    run (&mb, name, loops, ncomments > 0 ? ncomments : 1, "comment");
+    fish_sound_comment_set_unref (mb.set);
+  }
+
+  for (i = 0; i < ncomments; i++)
+    free (mb.comments[i].value);
+  free (mb.comments);
+
+  free (mb.packet);
+  fish_sound_delete (encoder);
+  fish_sound_delete (decoder);
+}
+
+static void
+parse_args (int argc, char * argv[])
+{
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "--reps")) {
+      i++; if (i >= argc) usage(argv[0]);
+      reps = atoi (argv[i]);
+      if (reps < 1) usage (argv[0]);
+    } else if (!strcmp (argv[i], "--only")) {
+      i++; if (i >= argc) usage(argv[0]);
+      only = argv[i];
+    } else if (!strcmp (argv[i], "--json")) {
+      i++; if (i >= argc) usage(argv[0]);
+      json_path = argv[i];
+    } else if (!strcmp (argv[i], "--baseline")) {
+      i++; if (i >= argc) usage(argv[0]);
+      baseline_path = argv[i];
+    } else if (!strcmp (argv[i], "--threshold")) {
+      i++; if (i >= argc) usage(argv[0]);
+      threshold = atof (argv[i]);
+    } else {
+      usage(argv[0]);
+    }
+  }
+}
+
+int
+main (int argc, char * argv[])
+{
+  int i;
+
+  parse_args (argc, argv);
+
+  if (baseline_path &&
+      (baseline = fs_bench_baseline_load (baseline_path)) == NULL) {
+    fprintf (stderr, "%s: unable to read baseline %s\n", argv[0],
+	     baseline_path);
+    exit (1);
+  }
+
+  if (json_path &&
+      (json = fs_bench_json_open (json_path, "fishsound-microbench")) == NULL) {
+    fprintf (stderr, "%s: unable to open %s\n", argv[0], json_path);
+    exit (1);
+  }
+
+  /* Keep the table off stdout when the JSON is going there */
+  out = (json_path && !strcmp (json_path, "-")) ? stderr : stdout;
+
+  if ((cycles_fd = fs_bench_cycles_open ()) == -1)
+    fprintf (out, "CPU cycle counter unavailable; reporting time only\n");
+
+  bench_kernel ("interleave", k_interleave, bench_channels, bench_frames);
+  bench_kernel ("deinterleave", k_deinterleave, bench_channels, bench_frames);
+
+  bench_kernel ("flac_decode_ilv", k_flac_decode_ilv,
+		flac_channels, flac_frames);
+  bench_kernel ("flac_decode", k_flac_decode, flac_channels, flac_frames);
+  bench_kernel ("flac_encode_ilv", k_flac_encode_ilv,
+		flac_channels, flac_frames);
+  bench_kernel ("flac_encode", k_flac_encode, flac_channels, flac_frames);
+
+  bench_kernel ("speex_scale", k_speex_scale, speex_channels, speex_frames);
+
+  if (comment_format () == FISH_SOUND_UNKNOWN) {
+    fprintf (out, "No codec available for encoding; skipping comments\n");
+  } else {
+    for (i = 0; bench_ncomments[i] != -1; i++)
+      bench_comments (bench_ncomments[i]);
+  }
+
+  fs_bench_cycles_close (cycles_fd);
+  fs_bench_json_close (json);
+  fs_bench_baseline_free (baseline);
+
+  exit (regressed ? 1 : 0);
+}
@@ -0,0 +1,570 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef HAVE_CLOCK_GETTIME
+#if HAVE_CLOCK_GETTIME
+#define FS_BENCH_CLOCK_GETTIME
+#endif
+#endif
+
+#ifndef FS_BENCH_CLOCK_GETTIME
+#include <sys/time.h>
+#endif
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "fs_bench.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct _FSBenchJSON {
+  FILE * f;
+  int nresults;
+};
+
+struct _FSBenchCounters {
+  int fd[FS_BENCH_NR_COUNTERS]; /* -1 for each counter not available */
+};
+
+struct _FSBenchBaseline {
+  char * text;
+  char ** lines;
+  int nlines;
+};
+
+static const char * signal_names[FS_BENCH_NR_SIGNALS] = {
+  "silence", "sweep", "noise", "square"
+};
+
+static const char * counter_names[FS_BENCH_NR_COUNTERS] = {
+  "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+double
+fs_bench_now (void)
+{
+#ifdef FS_BENCH_CLOCK_GETTIME
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#else
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+#endif
+}
+
+double
+fs_bench_cpu (void)
+{
+  return (double)clock () / CLOCKS_PER_SEC;
+}
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+/*
+ * Open a counter of user-space events in this thread. The counter starts
+ * disabled.
+ */
+static int
+fs_bench_perf_open (unsigned int type, unsigned long long config)
+{
+  struct perf_event_attr attr;
+
+  memset (&attr, 0, sizeof (attr));
+  attr.type = type;
+  attr.size = sizeof (attr);
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+    PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  /* This fails in many containers and VMs, and when
+   * /proc/sys/kernel/perf_event_paranoid forbids it */
+  return (int) syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * Read a counter opened by fs_bench_perf_open(), scaling the count up if
+ * the counter was only running for part of the time it was enabled.
+ */
+static double
+fs_bench_perf_read (int fd)
+{
+  unsigned long long data[3]; /* value, time enabled, time running */
+
+  if (read (fd, data, sizeof (data)) != sizeof (data))
+    return -1;
+
+  if (data[2] == 0)
+    return -1;
+
+  if (data[2] < data[1])
+    return (double)data[0] * data[1] / data[2];
+
+  return (double)data[0];
+}
+#endif
+
+int
+fs_bench_cycles_open (void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  return fs_bench_perf_open (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+#else
+  return -1;
+#endif
+}
+
+void
+fs_bench_cycles_start (int fd)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  if (fd == -1) return;
+
+  ioctl (fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl (fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+double
+fs_bench_cycles_stop (int fd)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  if (fd == -1) return -1;
+
+  ioctl (fd, PERF_EVENT_IOC_DISABLE, 0);
+
+  return fs_bench_perf_read (fd);
+#else
+  return -1;
+#endif
+}
+
+void
+fs_bench_cycles_close (int fd)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  if (fd != -1) close (fd);
+#endif
+}
+
+const char *
+fs_bench_counter_name (int counter)
+{
+  if (counter < 0 || counter >= FS_BENCH_NR_COUNTERS) return NULL;
+
+  return counter_names[counter];
+}
+
+FSBenchCounters *
+fs_bench_counters_open (void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  static const struct {
+    unsigned int type;
+    unsigned long long config;
+  } events[FS_BENCH_NR_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+  };
+  FSBenchCounters * counters;
+  int i, n = 0;
+
+  if ((counters = malloc (sizeof (FSBenchCounters))) == NULL)
+    return NULL;
+
+  /* The counters are not opened as a group: a group is only scheduled if
+   * all of its counters fit on the PMU at once, whereas separate counters
+   * are multiplexed, and scaled when read */
+  for (i = 0; i < FS_BENCH_NR_COUNTERS; i++) {
+    counters->fd[i] = fs_bench_perf_open (events[i].type, events[i].config);
+    if (counters->fd[i] != -1) n++;
+  }
+
+  if (n == 0) {
+    free (counters);
+    return NULL;
+  }
+
+  return counters;
+#else
+  return NULL;
+#endif
+}
+
+void
+fs_bench_counters_start (FSBenchCounters * counters)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  int i;
+
+  if (counters == NULL) return;
+
+  for (i = 0; i < FS_BENCH_NR_COUNTERS; i++)
+    fs_bench_cycles_start (counters->fd[i]);
+#endif
+}
+
+void
+fs_bench_counters_stop (FSBenchCounters * counters, double * values)
+{
+  int i;
+
+  for (i = 0; i < FS_BENCH_NR_COUNTERS; i++) {
+    values[i] = counters ? fs_bench_cycles_stop (counters->fd[i]) : -1;
+  }
+}
+
+void
+fs_bench_counters_close (FSBenchCounters * counters)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  int i;
+
+  if (counters == NULL) return;
+
+  for (i = 0; i < FS_BENCH_NR_COUNTERS; i++)
+    fs_bench_cycles_close (counters->fd[i]);
+
+  free (counters);
+#endif
+}
+
+const char *
+fs_bench_signal_name (int signal)
+{
+  if (signal < 0 || signal >= FS_BENCH_NR_SIGNALS) return NULL;
+
+  return signal_names[signal];
+}
+
+int
+fs_bench_signal_parse (const char * name)
+{
+  int i;
+
+  for (i = 0; i < FS_BENCH_NR_SIGNALS; i++) {
+    if (!strcmp (name, signal_names[i])) return i;
+  }
+
+  return -1;
+}
+
+void
+fs_bench_signal_fill (int signal, float * pcm, long frames, int stride,
+		      int channel, int samplerate)
+{
+  double phase, f0, f1, t;
+  unsigned long seed;
+  float value;
+  long i;
+
+  switch (signal) {
+  case FS_BENCH_SWEEP:
+    /* A logarithmic sine sweep from 20Hz to just below Nyquist, repeating
+     * every second */
+    f0 = 20.0;
+    f1 = samplerate * 0.45;
+    phase = channel * 0.1;
+    for (i = 0; i < frames; i++) {
+      t = (double)(i % samplerate) / samplerate;
+      pcm[i * stride] = (float)(0.5 * sin (phase));
+      phase += 2.0 * M_PI * f0 * pow (f1 / f0, t) / samplerate;
+      if (phase > 2.0 * M_PI) phase -= 2.0 * M_PI;
+    }
+    break;
+  case FS_BENCH_NOISE:
+    /* White noise from a linear congruential generator, so that runs are
+     * repeatable */
+    seed = 12345 + channel;
+    for (i = 0; i < frames; i++) {
+      seed = (seed * 1664525UL + 1013904223UL) & 0xffffffffUL;
+      pcm[i * stride] = (float)(((double)(seed >> 8) / (1 << 24)) - 0.5);
+    }
+    break;
+  case FS_BENCH_SQUARE:
+    /* The squarish wave used by the encdec tests */
+    value = 0.5;
+    for (i = 0; i < frames; i++) {
+      pcm[i * stride] = value;
+      if (((i + channel * 7) % 100) == 0) {
+	value = -value;
+      }
+    }
+    break;
+  case FS_BENCH_SILENCE:
+  default:
+    for (i = 0; i < frames; i++) {
+      pcm[i * stride] = 0.0;
+    }
+    break;
+  }
+}
+
+static int
+cmp_double (const void * a, const void * b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x < y) ? -1 : (x > y);
+}
+
+double
+fs_bench_median (double * values, int n)
+{
+  if (n <= 0) return 0.0;
+
+  qsort (values, n, sizeof (double), cmp_double);
+
+  if (n % 2) return values[n/2];
+
+  return (values[n/2 - 1] + values[n/2]) / 2.0;
+}
+
+FSBenchJSON *
+fs_bench_json_open (const char * path, const char * benchmark)
+{
+  FSBenchJSON * json;
+  FILE * f;
+
+  if (!strcmp (path, "-")) {
+    f = stdout;
+  } else if ((f = fopen (path, "w")) == NULL) {
+    return NULL;
+  }
+
+  if ((json = malloc (sizeof (FSBenchJSON))) == NULL) {
+    if (f != stdout) fclose (f);
+    return NULL;
+  }
+
+  json->f = f;
+  json->nresults = 0;
+
+  fprintf (f, "{\n");
+  fprintf (f, "  \"benchmark\": \"%s\",\n", benchmark);
+  fprintf (f, "  \"version\": \"%s\",\n", VERSION);
+  fprintf (f, "  \"results\": [");
+
+  return json;
+}
+
+void
+fs_bench_json_begin (FSBenchJSON * json, const char * name)
+{
+  if (json == NULL) return;
+
+  fprintf (json->f, "%s\n    {\"name\": \"%s\"",
+	   json->nresults > 0 ? "," : "", name);
+
+  json->nresults++;
+}
+
+void
+fs_bench_json_string (FSBenchJSON * json, const char * key,
+		      const char * value)
+{
+  if (json == NULL) return;
+
+  fprintf (json->f, ", \"%s\": \"%s\"", key, value);
+}
+
+void
+fs_bench_json_number (FSBenchJSON * json, const char * key, double value)
+{
+  if (json == NULL) return;
+
+  fprintf (json->f, ", \"%s\": %.6g", key, value);
+}
+
+void
+fs_bench_json_end (FSBenchJSON * json)
+{
+  if (json == NULL) return;
+
+  fprintf (json->f, "}");
+}
+
+void
+fs_bench_json_close (FSBenchJSON * json)
+{
+  if (json == NULL) return;
+
+  fprintf (json->f, "\n  ]\n}\n");
+
+  if (json->f != stdout)
+    fclose (json->f);
+  else
+    fflush (stdout);
+
+  free (json);
+}
+
+FSBenchBaseline *
+fs_bench_baseline_load (const char * path)
+{
+  FSBenchBaseline * baseline;
+  FILE * f;
+  char * text, * line, * next, ** lines;
+  long length, n;
+
+  if ((f = fopen (path, "rb")) == NULL)
+    return NULL;
+
+  fseek (f, 0, SEEK_END);
+  length = ftell (f);
+  fseek (f, 0, SEEK_SET);
+
+  if (length < 0 || (text = malloc (length + 1)) == NULL) {
+    fclose (f);
+    return NULL;
+  }
+
+  n = (long)fread (text, 1, length, f);
+  text[n] = '\0';
+  fclose (f);
+
+  if ((baseline = malloc (sizeof (FSBenchBaseline))) == NULL) {
+    free (text);
+    return NULL;
+  }
+
+  baseline->text = text;
+  baseline->lines = NULL;
+  baseline->nlines = 0;
+
+  /* Keep only the lines holding a result */
+  for (line = text; line && *line; line = next) {
+    if ((next = strchr (line, '\n')) != NULL)
+      *next++ = '\0';
+
+    if (strstr (line, "{\"name\": \"") == NULL)
+      continue;
+
+    lines = realloc (baseline->lines,
+		     sizeof (char *) * (baseline->nlines + 1));
+    if (lines == NULL) {
+      fs_bench_baseline_free (baseline);
+      return NULL;
+    }
+    baseline->lines = lines;
+    baseline->lines[baseline->nlines++] = line;
+  }
+
+  return baseline;
+}
+
+int
+fs_bench_baseline_get (FSBenchBaseline * baseline, const char * name,
+		       const char * key, double * value)
+{
+  char pattern[256];
+  char * p;
+  int i;
+
+  if (baseline == NULL) return -1;
+
+  snprintf (pattern, sizeof (pattern), "{\"name\": \"%s\"", name);
+
+  for (i = 0; i < baseline->nlines; i++) {
+    if (strstr (baseline->lines[i], pattern) == NULL)
+      continue;
+
+    snprintf (pattern, sizeof (pattern), "\"%s\": ", key);
+    if ((p = strstr (baseline->lines[i], pattern)) == NULL)
+      return -1;
+
+    *value = strtod (p + strlen (pattern), NULL);
+    return 0;
+  }
+
+  return -1;
+}
+
+int
+fs_bench_baseline_check (FSBenchBaseline * baseline, const char * name,
+			 const char * key, double value, double threshold)
+{
+  double base, change;
+
+  if (fs_bench_baseline_get (baseline, name, key, &base) == -1 || base <= 0)
+    return 0;
+
+  change = (value - base) * 100.0 / base;
+
+  if (change > threshold) {
+    fprintf (stderr, "REGRESSION %s %s: %.6g -> %.6g (%+.1f%%)\n",
+	    name, key, base, value, change);
+    return 1;
+  } else if (change < -threshold) {
+    fprintf (stderr, "improved   %s %s: %.6g -> %.6g (%+.1f%%)\n",
+	    name, key, base, value, change);
+  }
+
+  return 0;
+}
+
+void
+fs_bench_baseline_free (FSBenchBaseline * baseline)
+{
+  if (baseline == NULL) return;
+
+  free (baseline->lines);
+  free (baseline->text);
+  free (baseline);
+}
@@ -0,0 +1,212 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __FS_BENCH_H__
+#define __FS_BENCH_H__
+
+/*
+ * Helpers shared by the benchmark programs: a monotonic clock, hardware
+ * performance counters, synthetic test signals, JSON output and
+ * comparison against a stored baseline.
+ */
+
+#include <stdio.h>
+
+/* Synthetic test signals */
+#define FS_BENCH_SILENCE 0
+#define FS_BENCH_SWEEP   1
+#define FS_BENCH_NOISE   2
+#define FS_BENCH_SQUARE  3
+
+#define FS_BENCH_NR_SIGNALS 4
+
+/**
+ * Retrieve the time, in seconds, from a monotonic clock
+ */
+double fs_bench_now (void);
+
+/**
+ * Retrieve the CPU time used by this process, in seconds
+ */
+double fs_bench_cpu (void);
+
+/**
+ * Open a counter of CPU cycles spent in this thread, using
+ * perf_event_open() where available.
+ * \returns a file descriptor for the counter, or -1 if CPU cycles cannot
+ * be counted
+ */
+int fs_bench_cycles_open (void);
+
+/**
+ * Reset and start a cycle counter. Does nothing if fd is -1.
+ */
+void fs_bench_cycles_start (int fd);
+
+/**
+ * Stop a cycle counter.
+ * \returns the number of cycles counted since fs_bench_cycles_start(),
+ * or -1 if unavailable
+ */
+double fs_bench_cycles_stop (int fd);
+
+void fs_bench_cycles_close (int fd);
+
+/* Hardware performance counters */
+#define FS_BENCH_CYCLES        0
+#define FS_BENCH_INSTRUCTIONS  1
+#define FS_BENCH_L1D_MISSES    2
+#define FS_BENCH_LLC_MISSES    3
+#define FS_BENCH_BRANCH_MISSES 4
+
+#define FS_BENCH_NR_COUNTERS 5
+
+typedef struct _FSBenchCounters FSBenchCounters;
+
+/**
+ * Retrieve the name of a hardware counter, eg. "cycles"
+ * \returns the name, or NULL if counter is out of range
+ */
+const char * fs_bench_counter_name (int counter);
+
+/**
+ * Open a set of hardware performance counters for this thread, using
+ * perf_event_open() where available. Each counter is opened separately,
+ * so that those the CPU or kernel does not support are simply missing.
+ * \returns the counters, or NULL if none are available
+ */
+FSBenchCounters * fs_bench_counters_open (void);
+
+/**
+ * Reset and start a set of counters. Does nothing if counters is NULL.
+ */
+void fs_bench_counters_start (FSBenchCounters * counters);
+
+/**
+ * Stop a set of counters and read them. Counts are scaled up if the
+ * kernel had to multiplex the counters.
+ * \param values Filled with FS_BENCH_NR_COUNTERS counts, each -1 if that
+ * counter is unavailable
+ */
+void fs_bench_counters_stop (FSBenchCounters * counters, double * values);
+
+void fs_bench_counters_close (FSBenchCounters * counters);
+
+/**
+ * Retrieve the name of a signal, eg. "sweep"
+ * \returns the name, or NULL if signal is out of range
+ */
+const char * fs_bench_signal_name (int signal);
+
+/**
+ * Look up a signal by name
+ * \returns the signal, or -1 if the name is unknown
+ */
+int fs_bench_signal_parse (const char * name);
+
+/**
+ * Fill one channel of a buffer with a signal.
+ * \param signal The signal to generate
+ * \param pcm The buffer to write to
+ * \param frames The number of frames to write
+ * \param stride The distance between consecutive samples, ie. 1 for
+ * non-interleaved buffers or the number of channels for interleaved ones
+ * \param channel The channel being filled; each channel is given a
+ * slightly different signal
+ * \param samplerate The samplerate of the signal
+ */
+void fs_bench_signal_fill (int signal, float * pcm, long frames, int stride,
+			   int channel, int samplerate);
+
+/**
+ * Find the median of some measurements. The array is sorted in place.
+ */
+double fs_bench_median (double * values, int n);
+
+typedef struct _FSBenchJSON FSBenchJSON;
+
+/**
+ * Start writing results as JSON.
+ * \param path The file to write, or "-" for stdout
+ * \param benchmark The name of the benchmark program
+ * \returns a new JSON writer, or NULL if path could not be opened
+ */
+FSBenchJSON * fs_bench_json_open (const char * path, const char * benchmark);
+
+/**
+ * Start a result. Each result is written as one object on one line.
+ */
+void fs_bench_json_begin (FSBenchJSON * json, const char * name);
+
+void fs_bench_json_string (FSBenchJSON * json, const char * key,
+			   const char * value);
+
+void fs_bench_json_number (FSBenchJSON * json, const char * key,
+			   double value);
+
+void fs_bench_json_end (FSBenchJSON * json);
+
+/**
+ * Finish writing results and close the file.
+ */
+void fs_bench_json_close (FSBenchJSON * json);
+
+typedef struct _FSBenchBaseline FSBenchBaseline;
+
+/**
+ * Load a baseline previously written by fs_bench_json_open() and friends.
+ * This is not a general JSON parser: it relies on each result being
+ * written on a line of its own.
+ * \returns the baseline, or NULL if path could not be read
+ */
+FSBenchBaseline * fs_bench_baseline_load (const char * path);
+
+/**
+ * Look up a number in a baseline.
+ * \returns 0 on success, -1 if there is no such result or key
+ */
+int fs_bench_baseline_get (FSBenchBaseline * baseline, const char * name,
+			   const char * key, double * value);
+
+/**
+ * Compare a cost (lower is better) with its baseline and report any
+ * change larger than the threshold.
+ * \param threshold The allowed slowdown, in percent
+ * \returns 1 if the cost has regressed by more than threshold, else 0
+ */
+int fs_bench_baseline_check (FSBenchBaseline * baseline, const char * name,
+			     const char * key, double value,
+			     double threshold);
+
+void fs_bench_baseline_free (FSBenchBaseline * baseline);
+
+#endif /* __FS_BENCH_H__ */
@@ -0,0 +1,660 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * fishsound-batch: decode or transcode many Ogg audio files in parallel.
+ *
+ * Input files are given on the command line, read from a list file, or
+ * found by scanning directories. A fixed pool of worker threads takes
+ * files from the list one at a time. Each worker streams its file through
+ * its own decoder (and encoder, if transcoding) in small chunks, so memory
+ * use is bounded by the number of threads rather than by the size or
+ * number of input files.
+ *
+ * For each file, and in aggregate, the realtime factor (seconds of audio
+ * processed per second of wall time), input throughput in MB/s, and CPU
+ * utilisation are reported.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include <oggz/oggz.h>
+#include <fishsound/fishsound.h>
+#include <sndfile.h>
+
+#define DEFAULT_NTHREADS 4
+
+/* Number of bytes of input to read from a file at a time */
+#define READ_CHUNK_SIZE 4096
+
+#define FORMAT_DECODE (-1)
+
+/* The files to process, and the totals over all of them */
+typedef struct {
+  char ** files;
+  int nfiles;
+  int max_files;
+  int next;
+  int format;
+  char * outdir;
+  int nfailed;
+  double audio_seconds;
+  double bytes_in;
+  pthread_mutex_t lock;
+} FS_Batch;
+
+/* The state of one file while it is being processed */
+typedef struct {
+  FS_Batch * batch;
+  char * infilename;
+  char * outfilename;
+  FishSound * decoder;
+  FishSound * encoder;
+  FishSoundInfo fsinfo;
+  SNDFILE * sndfile;
+  OGGZ * oggz_out;
+  long decode_serialno;
+  long encode_serialno;
+  int begun;
+  int err;
+  long frames;
+  long bytes_in;
+  long bytes_out;
+  /* The most recent encoded packet is held back, so that the final
+   * packet of the output can be marked as the end of stream */
+  unsigned char * pending;
+  long pending_bytes;
+  long pending_max;
+  long pending_granulepos;
+  long packetno;
+} FS_Job;
+
+static void
+usage (char * progname)
+{
+  printf ("*** FishSound example program. ***\n");
+  printf ("Decodes or transcodes many Ogg FLAC, Speex or Ogg Vorbis files, using\n");
+  printf ("several threads, and reports the speed of processing.\n");
+  printf ("Usage: %s [options] file|directory ...\n\n", progname);
+  printf ("Options:\n");
+  printf ("  --threads n               Number of worker threads (default: number of CPUs)\n");
+  printf ("  --list filename           Read input filenames from a file, one per line\n");
+  printf ("                            (use - for standard input)\n");
+  printf ("  --outdir directory        Write output files to a directory; otherwise\n");
+  printf ("                            output is discarded\n");
+  printf ("  --vorbis                  Transcode to Vorbis\n");
+  printf ("  --speex                   Transcode to Speex\n");
+  printf ("  --flac                    Transcode to Flac\n");
+  printf ("\nWithout a transcoding option, files are decoded to PCM wav.\n");
+  exit (1);
+}
+
+static double
+wall_seconds (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+
+/* CPU time used by the calling thread, or -1.0 if this is not known */
+static double
+thread_cpu_seconds (void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+
+  if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+#endif
+
+  return -1.0;
+}
+
+/* CPU time used by all threads of the process */
+static double
+process_cpu_seconds (void)
+{
+  struct rusage ru;
+
+  if (getrusage (RUSAGE_SELF, &ru) != 0) return -1.0;
+
+  return (double)ru.ru_utime.tv_sec + (double)ru.ru_utime.tv_usec / 1000000.0 +
+    (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec / 1000000.0;
+}
+
+static int
+batch_add_file (FS_Batch * batch, const char * filename)
+{
+  char ** files;
+
+  if (batch->nfiles == batch->max_files) {
+    batch->max_files = batch->max_files ? batch->max_files * 2 : 64;
+    files = realloc (batch->files, sizeof (char *) * batch->max_files);
+    if (files == NULL) return -1;
+    batch->files = files;
+  }
+
+  if ((batch->files[batch->nfiles] = strdup (filename)) == NULL)
+    return -1;
+
+  batch->nfiles++;
+
+  return 0;
+}
+
+static int
+has_audio_extension (const char * filename)
+{
+  const char * ext = strrchr (filename, '.');
+
+  if (ext == NULL) return 0;
+
+  return (!strcmp (ext, ".ogg") || !strcmp (ext, ".oga") ||
+          !strcmp (ext, ".spx"));
+}
+
+static int
+cmpstringp (const void * p1, const void * p2)
+{
+  return strcmp (*(char * const *)p1, *(char * const *)p2);
+}
+
+/* Add the Ogg audio files in a directory, in sorted order */
+static int
+batch_add_directory (FS_Batch * batch, const char * dirname)
+{
+  DIR * dir;
+  struct dirent * entry;
+  struct stat statbuf;
+  char * path;
+  int first = batch->nfiles;
+
+  if ((dir = opendir (dirname)) == NULL) {
+    printf ("unable to open directory %s\n", dirname);
+    return -1;
+  }
+
+  while ((entry = readdir (dir)) != NULL) {
+    if (!has_audio_extension (entry->d_name)) continue;
+
+    path = malloc (strlen (dirname) + strlen (entry->d_name) + 2);
+    if (path == NULL) break;
+    sprintf (path, "%s/%s", dirname, entry->d_name);
+
+    if (stat (path, &statbuf) == 0 && S_ISREG (statbuf.st_mode))
+      batch_add_file (batch, path);
+
+    free (path);
+  }
+
+  closedir (dir);
+
+  qsort (&batch->files[first], batch->nfiles - first, sizeof (char *),
+         cmpstringp);
+
+  return 0;
+}
+
+static int
+batch_add_list (FS_Batch * batch, const char * listname)
+{
+  FILE * list;
+  char line[4096];
+  size_t len;
+
+  if (!strcmp (listname, "-")) {
+    list = stdin;
+  } else if ((list = fopen (listname, "r")) == NULL) {
+    printf ("unable to open file %s\n", listname);
+    return -1;
+  }
+
+  while (fgets (line, sizeof (line), list) != NULL) {
+    len = strlen (line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+      line[--len] = '\0';
+    if (len > 0) batch_add_file (batch, line);
+  }
+
+  if (list != stdin) fclose (list);
+
+  return 0;
+}
+
+static char *
+output_filename (FS_Batch * batch, const char * infilename)
+{
+  const char * base, * ext, * suffix;
+  char * outfilename;
+  size_t len;
+
+  switch (batch->format) {
+  case FISH_SOUND_VORBIS: suffix = ".ogg"; break;
+  case FISH_SOUND_SPEEX: suffix = ".spx"; break;
+  case FISH_SOUND_FLAC: suffix = ".oga"; break;
+  default: suffix = ".wav"; break;
+  }
+
+  base = strrchr (infilename, '/');
+  base = base ? base + 1 : infilename;
+
+  ext = strrchr (base, '.');
+  len = ext ? (size_t)(ext - base) : strlen (base);
+
+  outfilename = malloc (strlen (batch->outdir) + len + strlen (suffix) + 2);
+  if (outfilename == NULL) return NULL;
+
+  sprintf (outfilename, "%s/%.*s%s", batch->outdir, (int)len, base, suffix);
+
+  return outfilename;
+}
+
+static void
+write_pending (FS_Job * job, int e_o_s)
+{
+  ogg_packet op;
+  int flush;
+
+  if (job->pending_bytes == 0) return;
+
+  if (job->oggz_out) {
+    op.packet = job->pending;
+    op.bytes = job->pending_bytes;
+    op.b_o_s = (job->packetno == 0);
+    op.e_o_s = e_o_s;
+    op.granulepos = job->pending_granulepos;
+    op.packetno = -1;
+
+    /* The first packet of a stream must be alone on its page */
+    flush = (job->packetno == 0) ? OGGZ_FLUSH_AFTER : 0;
+
+    if (oggz_write_feed (job->oggz_out, &op, job->encode_serialno, flush,
+                         NULL) != 0)
+      job->err = 1;
+  }
+
+  job->packetno++;
+  job->pending_bytes = 0;
+}
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  FS_Job * job = (FS_Job *)user_data;
+  unsigned char * pending;
+
+  job->bytes_out += bytes;
+
+  /* Only keep packets if they are going to be written out */
+  if (job->oggz_out == NULL) return 0;
+
+  write_pending (job, 0);
+
+  if (bytes > job->pending_max) {
+    if ((pending = realloc (job->pending, bytes)) == NULL) {
+      job->err = 1;
+      return -1;
+    }
+    job->pending = pending;
+    job->pending_max = bytes;
+  }
+
+  memcpy (job->pending, buf, bytes);
+  job->pending_bytes = bytes;
+  job->pending_granulepos = fish_sound_get_frameno (fsound);
+
+  return 0;
+}
+
+static int
+job_begin (FS_Job * job, FishSound * fsound)
+{
+  FS_Batch * batch = job->batch;
+  FishSoundInfo fsinfo;
+  SF_INFO sfinfo;
+
+  fish_sound_command (fsound, FISH_SOUND_GET_INFO, &job->fsinfo,
+                      sizeof (FishSoundInfo));
+
+  if (batch->format == FORMAT_DECODE) {
+    if (job->outfilename) {
+      memset (&sfinfo, 0, sizeof (SF_INFO));
+      sfinfo.samplerate = job->fsinfo.samplerate;
+      sfinfo.channels = job->fsinfo.channels;
+      sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+
+      if ((job->sndfile = sf_open (job->outfilename, SFM_WRITE, &sfinfo)) == NULL)
+        return -1;
+    }
+  } else {
+    fsinfo = job->fsinfo;
+    fsinfo.format = batch->format;
+
+    if ((job->encoder = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo)) == NULL)
+      return -1;
+
+    fish_sound_set_interleave (job->encoder, 1);
+    fish_sound_set_encoded_callback (job->encoder, encoded, job);
+
+    if (job->outfilename) {
+      if ((job->oggz_out = oggz_open (job->outfilename, OGGZ_WRITE)) == NULL)
+        return -1;
+      job->encode_serialno = oggz_serialno_new (job->oggz_out);
+    }
+  }
+
+  return 0;
+}
+
+static int
+decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  FS_Job * job = (FS_Job *)user_data;
+
+  if (job->err) return FISH_SOUND_STOP_ERR;
+
+  if (!job->begun) {
+    job->begun = 1;
+    if (job_begin (job, fsound) != 0) {
+      job->err = 1;
+      return FISH_SOUND_STOP_ERR;
+    }
+  }
+
+  job->frames += frames;
+
+  if (job->sndfile)
+    sf_writef_float (job->sndfile, (float *)pcm, frames);
+
+  if (job->encoder)
+    fish_sound_encode_float_ilv (job->encoder, pcm, frames);
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static int
+read_packet (OGGZ * oggz, ogg_packet * op, long serialno, void * user_data)
+{
+  FS_Job * job = (FS_Job *)user_data;
+
+  /* Decode only the first audio track found in each file */
+  if (job->decode_serialno == -1 && op->b_o_s && op->bytes >= 8) {
+    if (fish_sound_identify (op->packet, op->bytes) != FISH_SOUND_UNKNOWN)
+      job->decode_serialno = serialno;
+  }
+
+  if (serialno == job->decode_serialno) {
+    fish_sound_prepare_truncation (job->decoder, op->granulepos, op->e_o_s);
+    fish_sound_decode (job->decoder, op->packet, op->bytes);
+  }
+
+  return job->err ? OGGZ_STOP_ERR : OGGZ_CONTINUE;
+}
+
+static int
+job_run (FS_Job * job)
+{
+  OGGZ * oggz_in;
+  long n;
+
+  if ((oggz_in = oggz_open (job->infilename, OGGZ_READ)) == NULL)
+    return -1;
+
+  job->decoder = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  fish_sound_set_interleave (job->decoder, 1);
+  fish_sound_set_decoded_float_ilv (job->decoder, decoded, job);
+
+  oggz_set_read_callback (oggz_in, -1, read_packet, job);
+
+  while (!job->err && (n = oggz_read (oggz_in, READ_CHUNK_SIZE)) > 0) {
+    job->bytes_in += n;
+
+    /* Write out encoded pages as they become available */
+    if (job->oggz_out)
+      while (oggz_write (job->oggz_out, READ_CHUNK_SIZE) > 0);
+  }
+
+  if (job->encoder) {
+    fish_sound_flush (job->encoder);
+    write_pending (job, 1);
+    if (job->oggz_out)
+      while (oggz_write (job->oggz_out, READ_CHUNK_SIZE) > 0);
+  }
+
+  oggz_close (oggz_in);
+
+  if (job->decode_serialno == -1) return -1;
+
+  return job->err ? -1 : 0;
+}
+
+static void
+job_clear (FS_Job * job)
+{
+  if (job->decoder) fish_sound_delete (job->decoder);
+  if (job->encoder) fish_sound_delete (job->encoder);
+  if (job->sndfile) sf_close (job->sndfile);
+  if (job->oggz_out) oggz_close (job->oggz_out);
+
+  free (job->outfilename);
+  free (job->pending);
+}
+
+static void
+process_file (FS_Batch * batch, char * infilename)
+{
+  FS_Job job;
+  double wall_start, wall, cpu_start, cpu, audio = 0.0;
+  int ret;
+
+  memset (&job, 0, sizeof (FS_Job));
+  job.batch = batch;
+  job.infilename = infilename;
+  job.decode_serialno = -1;
+
+  if (batch->outdir) {
+    job.outfilename = output_filename (batch, infilename);
+  }
+
+  wall_start = wall_seconds ();
+  cpu_start = thread_cpu_seconds ();
+
+  ret = job_run (&job);
+
+  wall = wall_seconds () - wall_start;
+  cpu = thread_cpu_seconds ();
+  if (cpu >= 0.0) cpu -= cpu_start;
+
+  if (job.fsinfo.samplerate > 0)
+    audio = (double)job.frames / job.fsinfo.samplerate;
+
+  if (wall <= 0.0) wall = 1e-6;
+
+  pthread_mutex_lock (&batch->lock);
+
+  if (ret != 0) {
+    batch->nfailed++;
+    printf ("%s: FAILED\n", infilename);
+  } else {
+    batch->audio_seconds += audio;
+    batch->bytes_in += job.bytes_in;
+
+    printf ("%s: %.1f s audio in %.2f s, %.1fx realtime, %.2f MB/s",
+            infilename, audio, wall, audio / wall,
+            job.bytes_in / wall / 1000000.0);
+    if (cpu >= 0.0)
+      printf (", %.0f%% CPU", cpu / wall * 100.0);
+    printf ("\n");
+  }
+
+  fflush (stdout);
+
+  pthread_mutex_unlock (&batch->lock);
+
+  job_clear (&job);
+}
+
+static void *
+worker (void * data)
+{
+  FS_Batch * batch = (FS_Batch *)data;
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock (&batch->lock);
+    i = batch->next++;
+    pthread_mutex_unlock (&batch->lock);
+
+    if (i >= batch->nfiles) break;
+
+    process_file (batch, batch->files[i]);
+  }
+
+  return NULL;
+}
+
+static int
+default_nthreads (void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (n > 0) return (int)n;
+#endif
+
+  return DEFAULT_NTHREADS;
+}
+
+int
+main (int argc, char ** argv)
+{
+  FS_Batch batch;
+  pthread_t * threads;
+  struct stat statbuf;
+  double wall_start, wall, cpu_start, cpu;
+  int i, nthreads = 0;
+
+  memset (&batch, 0, sizeof (FS_Batch));
+  batch.format = FORMAT_DECODE;
+  pthread_mutex_init (&batch.lock, NULL);
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "--threads")) {
+      i++; if (i >= argc) usage (argv[0]);
+      nthreads = atoi (argv[i]);
+      if (nthreads < 1) usage (argv[0]);
+    } else if (!strcmp (argv[i], "--list")) {
+      i++; if (i >= argc) usage (argv[0]);
+      if (batch_add_list (&batch, argv[i]) != 0) exit (1);
+    } else if (!strcmp (argv[i], "--outdir")) {
+      i++; if (i >= argc) usage (argv[0]);
+      batch.outdir = argv[i];
+    } else if (!strcmp (argv[i], "--vorbis")) {
+      batch.format = FISH_SOUND_VORBIS;
+    } else if (!strcmp (argv[i], "--speex")) {
+      batch.format = FISH_SOUND_SPEEX;
+    } else if (!strcmp (argv[i], "--flac")) {
+      batch.format = FISH_SOUND_FLAC;
+    } else if (!strcmp (argv[i], "--help") || !strcmp (argv[i], "-h")) {
+      usage (argv[0]);
+    } else if (argv[i][0] != '-') {
+      if (stat (argv[i], &statbuf) == 0 && S_ISDIR (statbuf.st_mode)) {
+        if (batch_add_directory (&batch, argv[i]) != 0) exit (1);
+      } else {
+        batch_add_file (&batch, argv[i]);
+      }
+    } else {
+      usage (argv[0]);
+    }
+  }
+
+  if (batch.nfiles == 0) usage (argv[0]);
+
+  if (nthreads == 0) nthreads = default_nthreads ();
+  if (nthreads > batch.nfiles) nthreads = batch.nfiles;
+
+  if ((threads = malloc (sizeof (pthread_t) * nthreads)) == NULL) {
+    printf ("out of memory\n");
+    exit (1);
+  }
+
+  printf ("Processing %d files with %d threads\n", batch.nfiles, nthreads);
+
+  wall_start = wall_seconds ();
+  cpu_start = process_cpu_seconds ();
+
+  for (i = 0; i < nthreads; i++) {
+    if (pthread_create (&threads[i], NULL, worker, &batch) != 0) {
+      printf ("unable to create worker thread\n");
+      exit (1);
+    }
+  }
+
+  for (i = 0; i < nthreads; i++)
+    pthread_join (threads[i], NULL);
+
+  wall = wall_seconds () - wall_start;
+  cpu = process_cpu_seconds () - cpu_start;
+  if (wall <= 0.0) wall = 1e-6;
+
+  printf ("Total: %d files, %d failed: %.1f s audio in %.2f s, "
+          "%.1fx realtime, %.2f MB/s, %.0f%% CPU (%.1f of %d threads busy)\n",
+          batch.nfiles, batch.nfailed, batch.audio_seconds, wall,
+          batch.audio_seconds / wall, batch.bytes_in / wall / 1000000.0,
+          cpu / (wall * nthreads) * 100.0, cpu / wall, nthreads);
+
+  for (i = 0; i < batch.nfiles; i++)
+    free (batch.files[i]);
+  free (batch.files);
+  free (threads);
+
+  pthread_mutex_destroy (&batch.lock);
+
+  exit (batch.nfailed ? 1 : 0);
+}
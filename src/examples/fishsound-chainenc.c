@@ -0,0 +1,347 @@
+/**
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * fishsound-chainenc: encode a PCM audio file to a chained Ogg Vorbis file,
+ * using several threads.
+ *
+ * A single Vorbis stream must be encoded serially, so this example splits
+ * the input into contiguous segments and encodes each segment on its own
+ * thread, with its own FishSound encoder. Each segment becomes one link
+ * of a chained Ogg Vorbis file.
+ *
+ * The final packet of each link carries a granulepos of exactly the number
+ * of frames in that segment, which libvorbis uses to trim the padding from
+ * the last block. Hence the decoded output of the chain contains exactly
+ * the frames of the input, with no gaps or padding at the link boundaries.
+ */
+
+#include "config.h"
+#include "fs_compat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include <oggz/oggz.h>
+#include <fishsound/fishsound.h>
+#include <sndfile.h>
+
+#define ENCODE_BLOCK_SIZE (1152)
+
+#define DEFAULT_NTHREADS 4
+
+/* Don't bother splitting the input into segments shorter than this */
+#define MIN_SEGMENT_SECONDS 10
+
+#undef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+/* An encoded packet, held in memory until its link is written out */
+typedef struct _FS_Packet FS_Packet;
+
+struct _FS_Packet {
+  unsigned char * data;
+  long bytes;
+  long granulepos;
+  FS_Packet * next;
+};
+
+/* One link of the output chain */
+typedef struct {
+  char * infilename;
+  int channels;
+  int samplerate;
+  sf_count_t start;  /* first frame of this segment in the input */
+  sf_count_t frames; /* number of frames in this segment */
+  FS_Packet * head;
+  FS_Packet * tail;
+  int err;
+  pthread_t thread;
+} FS_Segment;
+
+static void
+usage (char * progname)
+{
+  printf ("*** FishSound example program. ***\n");
+  printf ("Opens a PCM audio file and encodes it to a chained Ogg Vorbis file,\n");
+  printf ("encoding one link per thread.\n");
+  printf ("Usage: %s [options] infile outfile\n\n", progname);
+  printf ("Options:\n");
+  printf ("  --threads n               Number of encoder threads (default %d)\n",
+          DEFAULT_NTHREADS);
+  exit (1);
+}
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  FS_Segment * seg = (FS_Segment *)user_data;
+  FS_Packet * packet;
+
+  if ((packet = malloc (sizeof (FS_Packet))) == NULL) {
+    seg->err = 1;
+    return -1;
+  }
+
+  if ((packet->data = malloc (bytes)) == NULL) {
+    free (packet);
+    seg->err = 1;
+    return -1;
+  }
+
+  memcpy (packet->data, buf, bytes);
+  packet->bytes = bytes;
+  packet->granulepos = fish_sound_get_frameno (fsound);
+  packet->next = NULL;
+
+  if (seg->tail)
+    seg->tail->next = packet;
+  else
+    seg->head = packet;
+  seg->tail = packet;
+
+  return 0;
+}
+
+static void *
+encode_segment (void * data)
+{
+  FS_Segment * seg = (FS_Segment *)data;
+  SNDFILE * sndfile;
+  SF_INFO sfinfo;
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  float * pcm;
+  sf_count_t remaining = seg->frames, n;
+
+  memset (&sfinfo, 0, sizeof (SF_INFO));
+
+  /* Each thread reads through its own SNDFILE handle */
+  if ((sndfile = sf_open (seg->infilename, SFM_READ, &sfinfo)) == NULL) {
+    seg->err = 1;
+    return NULL;
+  }
+
+  if (sf_seek (sndfile, seg->start, SEEK_SET) != seg->start) {
+    sf_close (sndfile);
+    seg->err = 1;
+    return NULL;
+  }
+
+  if ((pcm = malloc (sizeof (float) * ENCODE_BLOCK_SIZE * seg->channels)) == NULL) {
+    sf_close (sndfile);
+    seg->err = 1;
+    return NULL;
+  }
+
+  fsinfo.channels = seg->channels;
+  fsinfo.samplerate = seg->samplerate;
+  fsinfo.format = FISH_SOUND_VORBIS;
+
+  if ((fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo)) == NULL) {
+    free (pcm);
+    sf_close (sndfile);
+    seg->err = 1;
+    return NULL;
+  }
+
+  fish_sound_set_encoded_callback (fsound, encoded, seg);
+
+  fish_sound_set_interleave (fsound, 1);
+
+  fish_sound_comment_add_byname (fsound, "Encoder", "fishsound-chainenc");
+
+  while (remaining > 0 && !seg->err) {
+    n = sf_readf_float (sndfile, pcm, MIN (ENCODE_BLOCK_SIZE, remaining));
+    if (n <= 0) break;
+
+    remaining -= n;
+
+    /* Mark the last block of the segment as the end of stream, so that
+     * the final packet of this link is truncated to exactly seg->frames */
+    fish_sound_prepare_truncation (fsound, seg->frames - remaining,
+                                   remaining == 0);
+    fish_sound_encode_float_ilv (fsound, (float **)pcm, n);
+  }
+
+  if (remaining > 0) {
+    /* Short read: end the link at the last frame actually read */
+    seg->frames -= remaining;
+    fish_sound_prepare_truncation (fsound, seg->frames, 1);
+    fish_sound_encode_float_ilv (fsound, (float **)pcm, 0);
+  }
+
+  fish_sound_flush (fsound);
+  fish_sound_delete (fsound);
+
+  free (pcm);
+  sf_close (sndfile);
+
+  return NULL;
+}
+
+static int
+write_segment (OGGZ * oggz, FS_Segment * seg, int index)
+{
+  FS_Packet * packet, * next;
+  ogg_packet op;
+  long serialno, packetno = 0;
+  int flush, err, ret = 0;
+
+  serialno = oggz_serialno_new (oggz);
+
+  for (packet = seg->head; packet; packet = next) {
+    next = packet->next;
+
+    op.packet = packet->data;
+    op.bytes = packet->bytes;
+    op.b_o_s = (packetno == 0);
+    op.e_o_s = (next == NULL);
+    op.granulepos = packet->granulepos;
+    op.packetno = -1;
+
+    /* The identification header must be alone on the first page of the
+     * link, and audio data must start on a fresh page after the headers */
+    flush = (packetno == 0 || packetno == 2) ? OGGZ_FLUSH_AFTER : 0;
+
+    err = oggz_write_feed (oggz, &op, serialno, flush, NULL);
+    if (err && ret == 0) {
+      fprintf (stderr, "error writing segment %d: %d\n", index, err);
+      ret = -1;
+    }
+
+    oggz_run (oggz);
+
+    free (packet->data);
+    free (packet);
+    packetno++;
+  }
+
+  seg->head = seg->tail = NULL;
+
+  return ret;
+}
+
+int
+main (int argc, char ** argv)
+{
+  OGGZ * oggz;
+  SNDFILE * sndfile;
+  SF_INFO sfinfo;
+  FS_Segment * segments;
+  char * infilename = NULL, * outfilename = NULL;
+  int i, nthreads = DEFAULT_NTHREADS, nsegments, ret = 0;
+  sf_count_t max_segments, start = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp (argv[i], "--threads")) {
+      i++; if (i >= argc) usage (argv[0]);
+      nthreads = atoi (argv[i]);
+    } else if (!strcmp (argv[i], "--help") || !strcmp (argv[i], "-h")) {
+      usage (argv[0]);
+    } else if (argv[i] && argv[i][0] != '-') {
+      if (infilename == NULL) {
+	infilename = argv[i];
+      } else {
+	outfilename = argv[i];
+      }
+    }
+  }
+
+  if (infilename == NULL || outfilename == NULL || nthreads < 1)
+    usage (argv[0]);
+
+  memset (&sfinfo, 0, sizeof (SF_INFO));
+
+  if ((sndfile = sf_open (infilename, SFM_READ, &sfinfo)) == NULL) {
+    printf ("unable to open file %s\n", infilename);
+    exit (1);
+  }
+  sf_close (sndfile);
+
+  if (!sfinfo.seekable || sfinfo.frames <= 0) {
+    printf ("%s: input must be a seekable file of known length\n", infilename);
+    exit (1);
+  }
+
+  /* Split the input into at most nthreads segments of equal length */
+  max_segments = sfinfo.frames /
+    ((sf_count_t)sfinfo.samplerate * MIN_SEGMENT_SECONDS) + 1;
+  nsegments = (int) MIN ((sf_count_t)nthreads, max_segments);
+
+  if ((segments = calloc (nsegments, sizeof (FS_Segment))) == NULL) {
+    printf ("out of memory\n");
+    exit (1);
+  }
+
+  for (i = 0; i < nsegments; i++) {
+    segments[i].infilename = infilename;
+    segments[i].channels = sfinfo.channels;
+    segments[i].samplerate = sfinfo.samplerate;
+    segments[i].start = start;
+    segments[i].frames = sfinfo.frames * (i + 1) / nsegments - start;
+    start += segments[i].frames;
+
+    if (pthread_create (&segments[i].thread, NULL, encode_segment,
+                        &segments[i]) != 0) {
+      printf ("unable to create encoder thread\n");
+      exit (1);
+    }
+  }
+
+  if ((oggz = oggz_open (outfilename, OGGZ_WRITE)) == NULL) {
+    printf ("unable to open file %s\n", outfilename);
+    exit (1);
+  }
+
+  /* Write out each link in order, as soon as its encoder has finished */
+  for (i = 0; i < nsegments; i++) {
+    pthread_join (segments[i].thread, NULL);
+
+    if (segments[i].err) {
+      fprintf (stderr, "error encoding segment %d\n", i);
+      ret = 1;
+    }
+
+    if (write_segment (oggz, &segments[i], i) != 0)
+      ret = 1;
+  }
+
+  oggz_close (oggz);
+
+  free (segments);
+
+  exit (ret);
+}
@@ -53,6 +53,8 @@ dump_identity (unsigned char * buf, long bytes)
   case FISH_SOUND_VORBIS: printf ("Vorbis\n"); break;
   case FISH_SOUND_SPEEX: printf ("Speex\n"); break;
   case FISH_SOUND_FLAC: printf ("FLAC\n"); break;
+  case FISH_SOUND_PCM: printf ("PCM\n"); break;
+  case FISH_SOUND_FLAC_NATIVE: printf ("FLAC (native)\n"); break;
   default: printf ("Unknown\n");
   }
 
@@ -0,0 +1,462 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * async.c
+ *
+ * Asynchronous encoding. Audio passed to fish_sound_encode_float*() is
+ * copied into a preallocated single-producer, single-consumer ring, and
+ * encoded by a worker thread owned by the FishSound handle. The calling
+ * thread neither allocates memory nor takes locks, other than waiting for
+ * space in the ring with the FISH_SOUND_ASYNC_BLOCK overflow policy.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if FS_ASYNC
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
+#include "private.h"
+#include "fs_ring.h"
+
+#include "debug.h"
+
+#if FS_ENCODE && FS_ASYNC
+
+/* Default number of frames per queued block */
+#define FS_ASYNC_BLOCK_FRAMES 1024
+
+typedef enum {
+  FS_ASYNC_DATA,
+  FS_ASYNC_FLUSH,
+  FS_ASYNC_SYNC,
+  FS_ASYNC_STOP
+} FishSoundAsyncType;
+
+/* Header of each element in the ring, followed by block_frames * channels
+ * interleaved floats */
+typedef struct {
+  FishSoundAsyncType type;
+  int eos;
+  long frames;
+  long granulepos;
+} FishSoundAsyncBlock;
+
+struct _FishSoundAsync {
+  FishSoundRing * ring;
+  FishSoundEncodeAsync config;
+
+  /* Truncation for the next block passed to encode, as set by
+   * fish_sound_prepare_truncation() in the calling thread */
+  long next_granulepos;
+  int next_eos;
+
+  /* Count of frames accepted for encoding */
+  long frameno;
+
+  /* Count of frames dropped, updated by the calling thread only */
+  long dropped_frames;
+
+  long flush_ret;
+
+  pthread_t thread;
+  sem_t items; /* posted by the caller for each block written */
+  sem_t space; /* posted by the worker for each block read */
+  sem_t done;  /* posted by the worker on completing FLUSH or SYNC */
+};
+
+#define fs_async_pcm(b) ((float *)((FishSoundAsyncBlock *)(b) + 1))
+
+/* Wait on a semaphore, retrying only if interrupted by a signal */
+static void
+fs_async_wait (sem_t * sem)
+{
+  while (sem_wait (sem) != 0 && errno == EINTR);
+}
+
+static void *
+fs_async_worker (void * data)
+{
+  FishSound * fsound = (FishSound *)data;
+  FishSoundAsync * async = fsound->async;
+  FishSoundAsyncBlock * block;
+  FishSoundAsyncType type;
+  FishSoundStatsCall call;
+
+  for (;;) {
+    fs_async_wait (&async->items);
+
+    block = fs_ring_read_ptr (async->ring);
+    if (block == NULL) continue;
+
+    type = block->type;
+
+    switch (type) {
+    case FS_ASYNC_DATA:
+      fsound->next_granulepos = block->granulepos;
+      fsound->next_eos = block->eos;
+      fish_sound_encode_direct (fsound, (float **)fs_async_pcm (block),
+                                block->frames, 1);
+      break;
+    case FS_ASYNC_FLUSH:
+      async->flush_ret = 0;
+      if (fsound->codec && fsound->codec->flush) {
+        fish_sound_stats_begin (fsound, &call, 0);
+        async->flush_ret =
+          fish_sound_stats_end (fsound, &call, fsound->codec->flush (fsound));
+      }
+      break;
+    default:
+      break;
+    }
+
+    fs_ring_read_commit (async->ring);
+    sem_post (&async->space);
+
+    if (type == FS_ASYNC_FLUSH || type == FS_ASYNC_SYNC)
+      sem_post (&async->done);
+
+    if (type == FS_ASYNC_STOP) break;
+  }
+
+  return NULL;
+}
+
+/*
+ * Get a free block in the ring, waiting for one if 'wait' is set.
+ */
+static FishSoundAsyncBlock *
+fs_async_get_block (FishSoundAsync * async, int wait)
+{
+  FishSoundAsyncBlock * block;
+
+  while ((block = fs_ring_write_ptr (async->ring)) == NULL) {
+    if (!wait) return NULL;
+    fs_async_wait (&async->space);
+  }
+
+  return block;
+}
+
+static void
+fs_async_put_block (FishSoundAsync * async)
+{
+  fs_ring_write_commit (async->ring);
+  sem_post (&async->items);
+}
+
+/*
+ * Queue a control block and wait for the worker to process it.
+ */
+static void
+fs_async_control (FishSoundAsync * async, FishSoundAsyncType type)
+{
+  FishSoundAsyncBlock * block;
+
+  block = fs_async_get_block (async, 1);
+  block->type = type;
+  block->frames = 0;
+  fs_async_put_block (async);
+
+  if (type == FS_ASYNC_STOP) {
+    pthread_join (async->thread, NULL);
+  } else {
+    fs_async_wait (&async->done);
+  }
+}
+
+static int
+fs_async_start (FishSound * fsound, FishSoundEncodeAsync * config)
+{
+  FishSoundAsync * async;
+  size_t elem_size;
+  int block_frames;
+
+  block_frames = config->block_frames;
+  if (block_frames <= 0) block_frames = FS_ASYNC_BLOCK_FRAMES;
+
+  if (config->queue_depth < 0 || fsound->info.channels <= 0)
+    return FISH_SOUND_ERR_INVALID;
+
+  if ((size_t)block_frames > ((size_t)-1 - sizeof (FishSoundAsyncBlock)) /
+      (sizeof (float) * fsound->info.channels))
+    return FISH_SOUND_ERR_INVALID;
+
+  async = fs_malloc (sizeof (FishSoundAsync));
+  if (async == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  elem_size = sizeof (FishSoundAsyncBlock) +
+    sizeof (float) * fsound->info.channels * block_frames;
+
+  async->ring = fs_ring_new (elem_size, config->queue_depth);
+  if (async->ring == NULL) {
+    fs_free (async);
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  }
+
+  async->config.queue_depth = config->queue_depth;
+  async->config.block_frames = block_frames;
+  async->config.overflow = config->overflow;
+  async->config.dropped_frames = 0;
+  async->next_granulepos = -1;
+  async->next_eos = 0;
+  async->frameno = fsound->frameno;
+  async->dropped_frames = 0;
+  async->flush_ret = 0;
+
+  if (sem_init (&async->items, 0, 0) != 0)
+    goto err_items;
+  if (sem_init (&async->space, 0, 0) != 0)
+    goto err_space;
+  if (sem_init (&async->done, 0, 0) != 0)
+    goto err_done;
+
+  fsound->async = async;
+
+  if (pthread_create (&async->thread, NULL, fs_async_worker, fsound) != 0) {
+    fsound->async = NULL;
+    goto err_thread;
+  }
+
+  debug_printf (1, "started, %d blocks of %d frames", config->queue_depth,
+                block_frames);
+
+  return 0;
+
+err_thread:
+  sem_destroy (&async->done);
+err_done:
+  sem_destroy (&async->space);
+err_space:
+  sem_destroy (&async->items);
+err_items:
+  fs_ring_delete (async->ring);
+  fs_free (async);
+  return FISH_SOUND_ERR_GENERIC;
+}
+
+int
+fish_sound_async_stop (FishSound * fsound)
+{
+  FishSoundAsync * async = fsound->async;
+
+  if (async == NULL) return 0;
+
+  fs_async_control (async, FS_ASYNC_STOP);
+
+  fsound->async = NULL;
+
+  sem_destroy (&async->items);
+  sem_destroy (&async->space);
+  sem_destroy (&async->done);
+  fs_ring_delete (async->ring);
+  fs_free (async);
+
+  return 0;
+}
+
+int
+fish_sound_async_command (FishSound * fsound, int command, void * data,
+                          int datasize)
+{
+  FishSoundEncodeAsync * config = (FishSoundEncodeAsync *)data;
+
+  if (fsound->mode != FISH_SOUND_ENCODE) return FISH_SOUND_ERR_INVALID;
+
+  if (config == NULL || datasize < (int)sizeof (FishSoundEncodeAsync))
+    return FISH_SOUND_ERR_INVALID;
+
+  switch (command) {
+  case FISH_SOUND_GET_ENCODE_ASYNC:
+    if (fsound->async) {
+      *config = fsound->async->config;
+      config->dropped_frames = fsound->async->dropped_frames;
+    } else {
+      memset (config, 0, sizeof (FishSoundEncodeAsync));
+    }
+    break;
+  case FISH_SOUND_SET_ENCODE_ASYNC:
+    fish_sound_async_stop (fsound);
+    if (config->queue_depth > 0)
+      return fs_async_start (fsound, config);
+    break;
+  default:
+    return FISH_SOUND_ERR_INVALID;
+  }
+
+  return 0;
+}
+
+long
+fish_sound_async_encode (FishSound * fsound, float ** pcm, long frames,
+                         int interleave)
+{
+  FishSoundAsync * async = fsound->async;
+  FishSoundAsyncBlock * block;
+  int channels = fsound->info.channels, wait, c;
+  long offset, n, i;
+  float * dest;
+
+  wait = (async->config.overflow == FISH_SOUND_ASYNC_BLOCK);
+
+  for (offset = 0; offset < frames; offset += n) {
+    n = MIN (async->config.block_frames, frames - offset);
+
+    block = fs_async_get_block (async, wait);
+    if (block == NULL) {
+      async->dropped_frames += frames - offset;
+      break;
+    }
+
+    block->type = FS_ASYNC_DATA;
+    block->frames = n;
+
+    /* Truncation applies to the last block of this call */
+    if (offset + n == frames) {
+      block->granulepos = async->next_granulepos;
+      block->eos = async->next_eos;
+    } else {
+      block->granulepos = -1;
+      block->eos = 0;
+    }
+
+    dest = fs_async_pcm (block);
+    if (interleave) {
+      memcpy (dest, (float *)pcm + offset * channels,
+              sizeof (float) * n * channels);
+    } else {
+      for (i = 0; i < n; i++)
+        for (c = 0; c < channels; c++)
+          *dest++ = pcm[c][offset + i];
+    }
+
+    fs_async_put_block (async);
+  }
+
+  async->next_granulepos = -1;
+  async->next_eos = 0;
+
+  async->frameno += offset;
+
+  return offset;
+}
+
+long
+fish_sound_async_flush (FishSound * fsound)
+{
+  fs_async_control (fsound->async, FS_ASYNC_FLUSH);
+
+  return fsound->async->flush_ret;
+}
+
+int
+fish_sound_async_sync (FishSound * fsound)
+{
+  fs_async_control (fsound->async, FS_ASYNC_SYNC);
+
+  return 0;
+}
+
+int
+fish_sound_async_prepare_truncation (FishSound * fsound, long next_granulepos,
+                                     int next_eos)
+{
+  fsound->async->next_granulepos = next_granulepos;
+  fsound->async->next_eos = next_eos;
+
+  return 0;
+}
+
+long
+fish_sound_async_get_frameno (FishSound * fsound)
+{
+  /* Within the FishSoundEncoded callback, report the encoder's position */
+  if (pthread_equal (pthread_self (), fsound->async->thread))
+    return fsound->frameno;
+
+  return fsound->async->frameno;
+}
+
+#else /* FS_ENCODE && FS_ASYNC */
+
+int
+fish_sound_async_stop (FishSound * fsound)
+{
+  return 0;
+}
+
+int
+fish_sound_async_command (FishSound * fsound, int command, void * data,
+                          int datasize)
+{
+  return FISH_SOUND_ERR_DISABLED;
+}
+
+long
+fish_sound_async_encode (FishSound * fsound, float ** pcm, long frames,
+                         int interleave)
+{
+  return FISH_SOUND_ERR_DISABLED;
+}
+
+long
+fish_sound_async_flush (FishSound * fsound)
+{
+  return FISH_SOUND_ERR_DISABLED;
+}
+
+int
+fish_sound_async_sync (FishSound * fsound)
+{
+  return FISH_SOUND_ERR_DISABLED;
+}
+
+int
+fish_sound_async_prepare_truncation (FishSound * fsound, long next_granulepos,
+                                     int next_eos)
+{
+  return FISH_SOUND_ERR_DISABLED;
+}
+
+long
+fish_sound_async_get_frameno (FishSound * fsound)
+{
+  return fsound->frameno;
+}
+
+#endif /* FS_ENCODE && FS_ASYNC */
@@ -0,0 +1,325 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "private.h"
+
+/*
+ * The codec registry: registered codecs in decreasing order of priority,
+ * and for each possible first byte of a stream, the set of codecs whose
+ * signature begins with that byte (or which have no signature), as a
+ * bitmask of positions in the registry. fish_sound_identify() only tries
+ * the codecs in the set for the first byte of the buffer.
+ */
+
+#define FS_CODECS_MAX 32
+
+typedef struct {
+  const FishSoundCodec * codec;
+  int priority;
+} FishSoundCodecEntry;
+
+static FishSoundCodecEntry fs_codecs[FS_CODECS_MAX];
+static int fs_nr_codecs = 0;
+static unsigned long fs_codecs_by_byte[256];
+
+static void
+fs_codecs_index (void)
+{
+  const FishSoundCodec * codec;
+  unsigned long bit;
+  int i, b;
+
+  memset (fs_codecs_by_byte, 0, sizeof (fs_codecs_by_byte));
+
+  for (i = 0; i < fs_nr_codecs; i++) {
+    codec = fs_codecs[i].codec;
+    bit = 1UL << i;
+
+    if (codec->signature_length > 0) {
+      fs_codecs_by_byte[(unsigned char)codec->signature[0]] |= bit;
+    } else {
+      for (b = 0; b < 256; b++)
+	fs_codecs_by_byte[b] |= bit;
+    }
+  }
+}
+
+static int
+fs_codecs_find (int format)
+{
+  int i;
+
+  for (i = 0; i < fs_nr_codecs; i++) {
+    if (fs_codecs[i].codec->format.format == format) return i;
+  }
+
+  return -1;
+}
+
+/* Remove the entry at position i, without reindexing */
+static void
+fs_codecs_remove (int i)
+{
+  memmove (&fs_codecs[i], &fs_codecs[i+1],
+	   (fs_nr_codecs - i - 1) * sizeof (FishSoundCodecEntry));
+  fs_nr_codecs--;
+}
+
+/* Insert a codec after all others of the same or higher priority */
+static void
+fs_codecs_insert (const FishSoundCodec * codec, int priority)
+{
+  int i;
+
+  for (i = fs_nr_codecs; i > 0 && fs_codecs[i-1].priority < priority; i--)
+    fs_codecs[i] = fs_codecs[i-1];
+
+  fs_codecs[i].codec = codec;
+  fs_codecs[i].priority = priority;
+  fs_nr_codecs++;
+
+  fs_codecs_index ();
+}
+
+static void
+fs_codecs_register_builtin (void)
+{
+  const FishSoundCodec * builtin[5];
+  int i;
+
+  builtin[0] = fish_sound_vorbis_codec ();
+  builtin[1] = fish_sound_speex_codec ();
+  builtin[2] = fish_sound_flac_codec ();
+  builtin[3] = fish_sound_pcm_codec ();
+  builtin[4] = fish_sound_flac_native_codec ();
+
+  for (i = 0; i < 5; i++) {
+    if (builtin[i] != NULL) fs_codecs_insert (builtin[i], 0);
+  }
+}
+
+#if HAVE_PTHREAD
+static pthread_once_t fs_codecs_once = PTHREAD_ONCE_INIT;
+
+static void
+fs_codecs_init (void)
+{
+  pthread_once (&fs_codecs_once, fs_codecs_register_builtin);
+}
+#else
+static int fs_codecs_initialized = 0;
+
+static void
+fs_codecs_init (void)
+{
+  if (!fs_codecs_initialized) {
+    fs_codecs_register_builtin ();
+    fs_codecs_initialized = 1;
+  }
+}
+#endif
+
+int
+fish_sound_codec_register (const FishSoundCodec * codec, int priority)
+{
+  int i;
+
+  if (codec == NULL) return FISH_SOUND_ERR_BAD;
+
+  if (codec->format.format <= FISH_SOUND_UNKNOWN ||
+      codec->signature_length < 0 ||
+      codec->signature_length > FISH_SOUND_CODEC_SIGNATURE_MAX ||
+      (codec->signature_length > 0 && codec->signature == NULL))
+    return FISH_SOUND_ERR_INVALID;
+
+  fs_codecs_init ();
+
+  if ((i = fs_codecs_find (codec->format.format)) >= 0)
+    fs_codecs_remove (i);
+  else if (fs_nr_codecs == FS_CODECS_MAX)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  fs_codecs_insert (codec, priority);
+
+  return 0;
+}
+
+int
+fish_sound_codec_unregister (int format)
+{
+  int i;
+
+  fs_codecs_init ();
+
+  if ((i = fs_codecs_find (format)) < 0) return FISH_SOUND_ERR_INVALID;
+
+  fs_codecs_remove (i);
+  fs_codecs_index ();
+
+  return 0;
+}
+
+int
+fish_sound_codec_set_priority (int format, int priority)
+{
+  const FishSoundCodec * codec;
+  int i;
+
+  fs_codecs_init ();
+
+  if ((i = fs_codecs_find (format)) < 0) return FISH_SOUND_ERR_INVALID;
+
+  codec = fs_codecs[i].codec;
+  fs_codecs_remove (i);
+  fs_codecs_insert (codec, priority);
+
+  return 0;
+}
+
+const FishSoundCodec *
+fish_sound_codec_lookup (int format, int flags)
+{
+  int i;
+
+  fs_codecs_init ();
+
+  if ((i = fs_codecs_find (format)) < 0) return NULL;
+
+  if ((fs_codecs[i].codec->flags & flags) != flags) return NULL;
+
+  return fs_codecs[i].codec;
+}
+
+int
+fish_sound_identify (unsigned char * buf, long bytes)
+{
+  const FishSoundCodec * codec;
+  unsigned long candidates;
+  int i;
+
+  if (bytes < 8) return FISH_SOUND_ERR_SHORT_IDENTIFY;
+
+  fs_codecs_init ();
+
+  candidates = fs_codecs_by_byte[buf[0]];
+
+  for (i = 0; candidates != 0; i++, candidates >>= 1) {
+    if ((candidates & 1) == 0) continue;
+
+    codec = fs_codecs[i].codec;
+
+    if (!(codec->flags & FISH_SOUND_CODEC_DECODE)) continue;
+
+    if (codec->signature_length > 0 &&
+	memcmp (buf, codec->signature, codec->signature_length) != 0)
+      continue;
+
+    if (codec->identify == NULL)
+      return codec->format.format;
+
+    if (codec->identify (buf, bytes) != FISH_SOUND_UNKNOWN)
+      return codec->format.format;
+  }
+
+  return FISH_SOUND_UNKNOWN;
+}
+
+/* Interface for codecs */
+
+void *
+fish_sound_codec_get_data (FishSound * fsound)
+{
+  if (fsound == NULL) return NULL;
+
+  return fsound->codec_data;
+}
+
+int
+fish_sound_codec_set_data (FishSound * fsound, void * data)
+{
+  if (fsound == NULL) return FISH_SOUND_ERR_BAD;
+
+  fsound->codec_data = data;
+
+  return 0;
+}
+
+int
+fish_sound_codec_set_info (FishSound * fsound, int samplerate, int channels)
+{
+  if (fsound == NULL) return FISH_SOUND_ERR_BAD;
+
+  fsound->info.samplerate = samplerate;
+  fsound->info.channels = channels;
+
+  return 0;
+}
+
+int
+fish_sound_codec_decoded (FishSound * fsound, float ** pcm, long frames)
+{
+  if (fsound == NULL) return FISH_SOUND_ERR_BAD;
+
+  if (fsound->frameno != -1)
+    fsound->frameno += frames;
+
+  if (fsound->interleave) {
+    if (fsound->callback.decoded_float_ilv == NULL) return 0;
+    return fish_sound_dispatch_decoded_float_ilv (fsound, pcm, frames);
+  } else {
+    if (fsound->callback.decoded_float == NULL) return 0;
+    return fish_sound_dispatch_decoded_float (fsound, pcm, frames);
+  }
+}
+
+int
+fish_sound_codec_encoded (FishSound * fsound, unsigned char * buf,
+			  long bytes, long frameno)
+{
+  if (fsound == NULL) return FISH_SOUND_ERR_BAD;
+
+  fsound->frameno = frameno;
+
+  if (fsound->callback.encoded == NULL) return 0;
+
+  return fish_sound_dispatch_encoded (fsound, buf, bytes);
+}
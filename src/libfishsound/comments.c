@@ -41,8 +41,8 @@
 #endif
 
 #include "private.h"
+#include "fs_atomic.h"
 
-/*#define DEBUG*/
 #include "debug.h"
 
 /* Ensure comment vector length can be expressed in 32 bits
@@ -89,20 +89,6 @@ fs_strdup_len (const char * s, size_t len)
   return ret;
 }
 
-static char *
-fs_index_len (const char * s, char c, int len)
-{
-  int i;
-
-  for (i = 0; *s && i < len; i++, s++) {
-    if (*s == c) return (char *)s;
-  }
-
-  if (i < len) return (char *)s;
-
-  return NULL;
-}
-
 /*                 
  Comments will be stored in the Vorbis style.            
  It is describled in the "Structure" section of
@@ -152,6 +138,7 @@ fs_comment_validate_byname (const char * name)
   return 1;
 }
 
+#if FS_ENCODE
 static FishSoundComment *
 fs_comment_new (const char * name, const char * value)
 {
@@ -182,6 +169,7 @@ fs_comment_new (const char * name, const char * value)
 
   return comment;
 }
+#endif
 
 static void
 fs_comment_free (FishSoundComment * comment)
@@ -204,11 +192,276 @@ fs_comment_cmp (const FishSoundComment * comment1, const FishSoundComment * comm
   return 1;
 }
 
+/*
+ * Comment name index. Lookup by name is case-insensitive, so names are
+ * hashed after folding ASCII case; valid names are restricted to ASCII
+ * by fs_comment_validate_byname().
+ */
+
+static unsigned int
+fs_comment_hash (const char * name)
+{
+  unsigned int hash = 2166136261U; /* FNV-1a */
+  unsigned char c;
+
+  for (; *name; name++) {
+    c = (unsigned char)*name;
+    if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+    hash = (hash ^ c) * 16777619U;
+  }
+
+  return hash;
+}
+
+static FishSoundCommentBucket *
+fs_comment_index_lookup (FishSoundCommentIndex * index, const char * name,
+			 unsigned int hash)
+{
+  FishSoundCommentBucket * bucket;
+  unsigned int mask, i;
+
+  if (index->nr_buckets == 0) return NULL;
+
+  mask = (unsigned int)index->nr_buckets - 1;
+
+  for (i = hash & mask; ; i = (i + 1) & mask) {
+    bucket = &index->buckets[i];
+    if (bucket->name == NULL ||
+	(bucket->hash == hash && !strcasecmp (bucket->name, name)))
+      return bucket;
+  }
+}
+
+static FishSoundCommentBucket *
+fs_comment_index_find (FishSound * fsound, const char * name)
+{
+  FishSoundCommentBucket * bucket;
+
+  bucket = fs_comment_index_lookup (&fsound->comment_index, name,
+				    fs_comment_hash (name));
+
+  if (bucket == NULL || bucket->name == NULL) return NULL;
+
+  return bucket;
+}
+
+static int
+fs_comment_index_resize (FishSoundCommentIndex * index, int nr_buckets)
+{
+  FishSoundCommentBucket * buckets, * old_buckets, * bucket;
+  int i, old_nr_buckets;
+
+  buckets = fs_malloc ((size_t)nr_buckets * sizeof (FishSoundCommentBucket));
+  if (buckets == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  for (i = 0; i < nr_buckets; i++)
+    buckets[i].name = NULL;
+
+  old_buckets = index->buckets;
+  old_nr_buckets = index->nr_buckets;
+
+  index->buckets = buckets;
+  index->nr_buckets = nr_buckets;
+
+  for (i = 0; i < old_nr_buckets; i++) {
+    if (old_buckets[i].name == NULL) continue;
+    bucket = fs_comment_index_lookup (index, old_buckets[i].name,
+				      old_buckets[i].hash);
+    *bucket = old_buckets[i];
+  }
+
+  fs_free (old_buckets);
+
+  return 0;
+}
+
+/* Index the comment at position i, which must follow all indexed comments */
+static int
+fs_comment_index_add (FishSoundCommentIndex * index,
+		      FishSoundVector * comments, int i)
+{
+  FishSoundCommentBucket * bucket;
+  FishSoundComment * comment;
+  unsigned int hash;
+  int * next, max_next;
+
+  if (i >= index->max_next) {
+    max_next = index->max_next ? index->max_next * 2 : 8;
+    next = fs_realloc (index->next, (size_t)max_next * sizeof (int));
+    if (next == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
+    index->next = next;
+    index->max_next = max_next;
+  }
+
+  /* Keep the load factor at or below one half */
+  if ((index->nr_names + 1) * 2 > index->nr_buckets) {
+    if (fs_comment_index_resize (index, index->nr_buckets ?
+				 index->nr_buckets * 2 : 8) != 0)
+      return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  }
+
+  comment = (FishSoundComment *) fs_vector_nth (comments, i);
+  hash = fs_comment_hash (comment->name);
+  bucket = fs_comment_index_lookup (index, comment->name, hash);
+
+  if (bucket->name == NULL) {
+    bucket->name = comment->name;
+    bucket->hash = hash;
+    bucket->first = i;
+    index->nr_names++;
+  } else {
+    index->next[bucket->last] = i;
+  }
+
+  bucket->last = i;
+  index->next[i] = -1;
+
+  return 0;
+}
+
+/*
+ * Rebuild the index after comments have been removed. The existing
+ * allocations are large enough, so this cannot fail.
+ */
+static void
+fs_comment_index_rebuild (FishSound * fsound)
+{
+  FishSoundCommentIndex * index = &fsound->comment_index;
+  int i, n;
+
+  for (i = 0; i < index->nr_buckets; i++)
+    index->buckets[i].name = NULL;
+  index->nr_names = 0;
+
+  n = fs_vector_size (fsound->comments);
+  for (i = 0; i < n; i++)
+    fs_comment_index_add (index, fsound->comments, i);
+}
+
+static void
+fs_comment_index_free (FishSoundCommentIndex * index)
+{
+  fs_free (index->buckets);
+  fs_free (index->next);
+  index->buckets = NULL;
+  index->nr_buckets = 0;
+  index->nr_names = 0;
+  index->next = NULL;
+  index->max_next = 0;
+}
+
+/* Discard the cached vorbiscomment packet */
+static void
+fs_comment_packet_invalidate (FishSound * fsound)
+{
+  if (fsound->comment_packet) fs_free (fsound->comment_packet);
+  fsound->comment_packet = NULL;
+  fsound->comment_packet_length = 0;
+}
+
+/* Append a comment to fsound and index it */
+static FishSoundComment *
+fs_comment_insert (FishSound * fsound, FishSoundComment * comment)
+{
+  fs_comment_packet_invalidate (fsound);
+
+  if (fs_vector_insert (fsound->comments, comment) == NULL)
+    return NULL;
+
+  if (fs_comment_index_add (&fsound->comment_index, fsound->comments,
+			    fs_vector_size (fsound->comments) - 1) != 0) {
+    fs_vector_remove (fsound->comments, comment);
+    return NULL;
+  }
+
+  return comment;
+}
+
+#if FS_ENCODE
+/* Remove all comments marked as tombstones by fs_vector_set_nth() */
+static void
+fs_comment_compact (FishSound * fsound)
+{
+  fs_vector_compact (fsound->comments);
+  fs_comment_index_rebuild (fsound);
+  fs_comment_packet_invalidate (fsound);
+  fsound->comment_cursor = 0;
+}
+#endif
+
+/*
+ * Decoded comment packets are held in arenas: a single allocation per
+ * packet containing the FishSoundComment array, followed by a copy of
+ * the valid fields of the packet, each NUL-terminated. Comments point
+ * into this copy. Fields are split into name and value, and indexed, by
+ * fs_comment_arena_parse(); in lazy mode that is deferred until the
+ * comments are first accessed.
+ */
+
+static int
+fs_comment_arena_parse (FishSound * fsound, FishSoundCommentArena * arena)
+{
+  FishSoundComment * comment;
+  char * c, * value;
+
+  while (arena->nr_parsed < arena->nr_comments) {
+    c = arena->cursor;
+    comment = &arena->comments[arena->nr_parsed];
+
+    comment->name = c;
+    if ((value = strchr (c, '=')) != NULL) {
+      *value++ = '\0';
+      comment->value = (*value != '\0') ? value : NULL;
+    } else {
+      comment->value = NULL;
+    }
+
+    if (fs_comment_insert (fsound, comment) == NULL) {
+      /* Restore the field so that parsing can be retried */
+      if (value != NULL) value[-1] = '=';
+      return FISH_SOUND_ERR_OUT_OF_MEMORY;
+    }
+
+    debug_printf (1, "[%d] %s -> %s", arena->nr_parsed, comment->name,
+		  comment->value ? comment->value : "(no value)");
+
+    arena->cursor = (value ? value : c) + strlen (value ? value : c) + 1;
+    arena->nr_parsed++;
+  }
+
+  return 0;
+}
+
+static int
+fs_comments_materialize (FishSound * fsound)
+{
+  FishSoundCommentArena * arena;
+  FishSound * outer;
+  int ret = 0;
+
+  if (!fsound->comments_pending) return 0;
+
+  outer = fish_sound_memory_enter (fsound);
+
+  for (arena = fsound->comment_arenas; arena != NULL; arena = arena->next) {
+    if ((ret = fs_comment_arena_parse (fsound, arena)) != 0)
+      break;
+  }
+
+  fish_sound_memory_leave (outer);
+
+  if (ret == 0) fsound->comments_pending = 0;
+
+  return ret;
+}
+
 int
 fish_sound_comment_set_vendor (FishSound * fsound, const char * vendor_string)
 {
   if (fsound == NULL) return FISH_SOUND_ERR_BAD;
 
+  fs_comment_packet_invalidate (fsound);
+
   if (fsound->vendor) fs_free (fsound->vendor);
 
   if ((fsound->vendor = fs_strdup (vendor_string)) == NULL)
@@ -227,34 +480,62 @@ fish_sound_comment_get_vendor (FishSound * fsound)
   return fsound->vendor;
 }
 
+/*
+ * Find the index of a comment previously returned to the application.
+ * The last returned position is remembered, so sequential iteration
+ * does not need to search. Comments are matched by identity first so
+ * that duplicate name/value pairs are distinguished; a copy of a stored
+ * comment is matched by value.
+ */
+static int
+fs_comment_locate (FishSound * fsound, const FishSoundComment * comment)
+{
+  int i, n;
+
+  if (fs_vector_nth (fsound->comments, fsound->comment_cursor) == comment)
+    return fsound->comment_cursor;
+
+  n = fs_vector_size (fsound->comments);
+  for (i = 0; i < n; i++) {
+    if (fs_vector_nth (fsound->comments, i) == comment)
+      return i;
+  }
+
+  return fs_vector_find_index (fsound->comments, comment);
+}
+
 const FishSoundComment *
 fish_sound_comment_first (FishSound * fsound)
 {
   if (fsound == NULL) return NULL;
 
+  fs_comments_materialize (fsound);
+
+  fsound->comment_cursor = 0;
+
   return fs_vector_nth (fsound->comments, 0);
 }
 
 const FishSoundComment *
 fish_sound_comment_first_byname (FishSound * fsound, char * name)
 {
-  FishSoundComment * comment;
-  int i;
+  FishSoundCommentBucket * bucket;
 
   if (fsound == NULL) return NULL;
 
-  if (name == NULL) return fs_vector_nth (fsound->comments, 0);
+  if (name == NULL) return fish_sound_comment_first (fsound);
 
   if (!fs_comment_validate_byname (name))
     return NULL;
-  
-  for (i = 0; i < fs_vector_size (fsound->comments); i++) {
-    comment = (FishSoundComment *) fs_vector_nth (fsound->comments, i);
-    if (comment->name && !strcasecmp (name, comment->name))
-      return comment;
-  }
 
-  return NULL;
+  fs_comments_materialize (fsound);
+
+  if ((bucket = fs_comment_index_find (fsound, name)) == NULL)
+    return NULL;
+
+  fsound->comment_cursor = bucket->first;
+
+  return fs_vector_nth (fsound->comments, bucket->first);
 }
 
 const FishSoundComment *
@@ -264,7 +545,12 @@ fish_sound_comment_next (FishSound * fsound, const FishSoundComment * comment)
 
   if (fsound == NULL || comment == NULL) return NULL;
 
-  i = fs_vector_find_index (fsound->comments, comment);
+  fs_comments_materialize (fsound);
+
+  if ((i = fs_comment_locate (fsound, comment)) < 0)
+    return NULL;
+
+  fsound->comment_cursor = i+1;
 
   return fs_vector_nth (fsound->comments, i+1);
 }
@@ -273,31 +559,164 @@ const FishSoundComment *
 fish_sound_comment_next_byname (FishSound * fsound,
 				const FishSoundComment * comment)
 {
-  FishSoundComment * v_comment;
   int i;
 
   if (fsound == NULL || comment == NULL) return NULL;
 
-  i = fs_vector_find_index (fsound->comments, comment);
+  fs_comments_materialize (fsound);
 
-  for (i++; i < fs_vector_size (fsound->comments); i++) {
-    v_comment = (FishSoundComment *) fs_vector_nth (fsound->comments, i);
-    if (v_comment->name && !strcasecmp (comment->name, v_comment->name))
-      return v_comment;
-  }
+  if ((i = fs_comment_locate (fsound, comment)) < 0)
+    return NULL;
 
-  return NULL;
-}
+  if ((i = fsound->comment_index.next[i]) < 0)
+    return NULL;
 
-#define _fs_comment_add(f,c) fs_vector_insert ((f)->comments, (c))
+  fsound->comment_cursor = i;
+
+  return fs_vector_nth (fsound->comments, i);
+}
 
 int
-fish_sound_comment_add (FishSound * fsound, FishSoundComment * comment)
+fish_sound_comment_iter_init (FishSound * fsound, FishSoundCommentIter * iter,
+			      const char * name)
+{
+  if (fsound == NULL || iter == NULL) return FISH_SOUND_ERR_BAD;
+
+  if (name != NULL && !fs_comment_validate_byname (name))
+    return FISH_SOUND_ERR_COMMENT_INVALID;
+
+  iter->fsound = fsound;
+  iter->name = name;
+  iter->index = 0;
+
+  return 0;
+}
+
+const FishSoundComment *
+fish_sound_comment_iter_next (FishSoundCommentIter * iter)
 {
+  FishSound * fsound;
+  FishSoundCommentBucket * bucket;
+  int i;
+
+  if (iter == NULL || (fsound = iter->fsound) == NULL) return NULL;
+
+  fs_comments_materialize (fsound);
+
+  if (iter->name == NULL) {
+    i = iter->index;
+  } else if (iter->index == 0) {
+    /* Not yet started */
+    if ((bucket = fs_comment_index_find (fsound, iter->name)) == NULL)
+      return NULL;
+    i = bucket->first;
+  } else {
+    /* Follow the chain from the comment last returned */
+    i = fsound->comment_index.next[iter->index - 1];
+  }
+
+  if (i < 0 || i >= fs_vector_size (fsound->comments))
+    return NULL;
+
+  iter->index = i + 1;
+
+  return fs_vector_nth (fsound->comments, i);
+}
+
 #if FS_ENCODE
-  FishSoundComment * new_comment;
+/* Add a copy of a comment, accounting its memory to fsound */
+static int
+fs_comment_add_new (FishSound * fsound, const char * name, const char * value)
+{
+  FishSoundComment * comment;
+  FishSound * outer;
+  int ret = FISH_SOUND_OK;
+
+  outer = fish_sound_memory_enter (fsound);
+
+  if ((comment = fs_comment_new (name, value)) == NULL) {
+    ret = FISH_SOUND_ERR_OUT_OF_MEMORY;
+  } else if (fs_comment_insert (fsound, comment) == NULL) {
+    fs_comment_free (comment);
+    ret = FISH_SOUND_ERR_OUT_OF_MEMORY;
+  }
+
+  fish_sound_memory_leave (outer);
+
+  return ret;
+}
+
+/*
+ * Give fsound its own copy of the comments of an attached set, so that
+ * they can be modified. Positions of comments are unchanged. On failure
+ * the set remains attached.
+ */
+static int
+fs_comment_unshare (FishSound * fsound)
+{
+  FishSoundCommentSet * set = fsound->comment_set;
+  FishSoundComment * comment;
+  FishSound * outer;
+  int i, n, ret = 0;
+
+  if (set == NULL) return 0;
+
+  outer = fish_sound_memory_enter (fsound);
+  fsound->comments = fs_vector_new ((FishSoundCmpFunc) fs_comment_cmp);
+  fish_sound_memory_leave (outer);
+
+  if (fsound->comments == NULL) {
+    fsound->comments = set->comments;
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  }
+
+  fsound->comment_set = NULL;
+  memset (&fsound->comment_index, 0, sizeof (FishSoundCommentIndex));
+
+  n = fs_vector_size (set->comments);
+  for (i = 0; i < n && ret == 0; i++) {
+    comment = (FishSoundComment *) fs_vector_nth (set->comments, i);
+    ret = fs_comment_add_new (fsound, comment->name, comment->value);
+  }
+
+  if (ret != 0) {
+    fs_vector_foreach (fsound->comments, (FishSoundFunc)fs_comment_free);
+    fs_vector_delete (fsound->comments);
+    fs_comment_index_free (&fsound->comment_index);
+
+    fsound->comment_set = set;
+    fsound->comments = set->comments;
+    fsound->comment_index = set->index;
+    return ret;
+  }
+
+  fish_sound_comment_set_unref (set);
+
+  return 0;
+}
 #endif
 
+int
+fish_sound_comment_set_filter (FishSound * fsound, long max_value_length,
+			       FishSoundCommentFilter filter,
+			       FishSoundCommentStream stream, void * user_data)
+{
+  if (fsound == NULL) return FISH_SOUND_ERR_BAD;
+
+  if (fsound->mode != FISH_SOUND_DECODE || max_value_length < 0)
+    return FISH_SOUND_ERR_INVALID;
+
+  fsound->comment_filter.max_value_length = max_value_length;
+  fsound->comment_filter.filter = filter;
+  fsound->comment_filter.stream = stream;
+  fsound->comment_filter.user_data = user_data;
+
+  return 0;
+}
+
+int
+fish_sound_comment_add (FishSound * fsound, FishSoundComment * comment)
+{
   if (fsound == NULL) return FISH_SOUND_ERR_BAD;
 
   if (fsound->mode != FISH_SOUND_ENCODE)
@@ -307,13 +726,10 @@ fish_sound_comment_add (FishSound * fsound, FishSoundComment * comment)
   if (!fs_comment_validate_byname (comment->name))
     return FISH_SOUND_ERR_COMMENT_INVALID;
 
-  if ((new_comment = fs_comment_new (comment->name, comment->value)) == NULL)
+  if (fs_comment_unshare (fsound) != 0)
     return FISH_SOUND_ERR_OUT_OF_MEMORY;
 
-  if (_fs_comment_add (fsound, new_comment) == NULL)
-    return FISH_SOUND_ERR_OUT_OF_MEMORY;
-
-  return FISH_SOUND_OK;
+  return fs_comment_add_new (fsound, comment->name, comment->value);
 #else
   return FISH_SOUND_ERR_DISABLED;
 #endif
@@ -323,10 +739,6 @@ int
 fish_sound_comment_add_byname (FishSound * fsound, const char * name,
 			       const char * value)
 {
-#if FS_ENCODE
-  FishSoundComment * comment;
-#endif
-
   if (fsound == NULL) return FISH_SOUND_ERR_BAD;
 
   if (fsound->mode != FISH_SOUND_ENCODE)
@@ -336,16 +748,10 @@ fish_sound_comment_add_byname (FishSound * fsound, const char * name,
   if (!fs_comment_validate_byname (name))
     return FISH_SOUND_ERR_COMMENT_INVALID;
 
-  if ((comment = fs_comment_new (name, value)) == NULL)
+  if (fs_comment_unshare (fsound) != 0)
     return FISH_SOUND_ERR_OUT_OF_MEMORY;
 
-  if (_fs_comment_add (fsound, comment) == NULL)
-    return FISH_SOUND_ERR_OUT_OF_MEMORY;
-
-  return FISH_SOUND_OK;
-
-  return 0;
-
+  return fs_comment_add_new (fsound, name, value);
 #else
   return FISH_SOUND_ERR_DISABLED;
 #endif
@@ -355,7 +761,7 @@ int
 fish_sound_comment_remove (FishSound * fsound, FishSoundComment * comment)
 {
 #if FS_ENCODE
-  FishSoundComment * v_comment;
+  int i;
 #endif
 
   if (fsound == NULL) return FISH_SOUND_ERR_BAD;
@@ -365,12 +771,14 @@ fish_sound_comment_remove (FishSound * fsound, FishSoundComment * comment)
 
 #if FS_ENCODE
 
-  v_comment = fs_vector_find (fsound->comments, comment);
+  if ((i = fs_comment_locate (fsound, comment)) < 0) return 0;
 
-  if (v_comment == NULL) return 0;
+  if (fs_comment_unshare (fsound) != 0)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
 
-  fs_vector_remove (fsound->comments, v_comment);
-  fs_comment_free (v_comment);
+  fs_comment_free (fs_vector_nth (fsound->comments, i));
+  fs_vector_set_nth (fsound->comments, i, NULL);
+  fs_comment_compact (fsound);
 
   return 1;
 
@@ -383,7 +791,7 @@ int
 fish_sound_comment_remove_byname (FishSound * fsound, char * name)
 {
 #if FS_ENCODE
-  FishSoundComment * comment;
+  FishSoundCommentBucket * bucket;
   int i;
 #endif
   int ret = 0;
@@ -394,15 +802,24 @@ fish_sound_comment_remove_byname (FishSound * fsound, char * name)
     return FISH_SOUND_ERR_INVALID;
 
 #if FS_ENCODE
-  for (i = 0; i < fs_vector_size (fsound->comments); i++) {
-    comment = (FishSoundComment *) fs_vector_nth (fsound->comments, i);
-    if (!strcasecmp (name, comment->name)) {
-      fish_sound_comment_remove (fsound, comment);
-      i--;
-      ret++;
-    }
+  if (name == NULL || (bucket = fs_comment_index_find (fsound, name)) == NULL)
+    return 0;
+
+  if (fs_comment_unshare (fsound) != 0)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  /* The copy has its own index, at the same positions */
+  bucket = fs_comment_index_find (fsound, name);
+
+  /* Leave tombstones along the chain, then compact once */
+  for (i = bucket->first; i >= 0; i = fsound->comment_index.next[i]) {
+    fs_comment_free (fs_vector_nth (fsound->comments, i));
+    fs_vector_set_nth (fsound->comments, i, NULL);
+    ret++;
   }
 
+  fs_comment_compact (fsound);
+
   return ret;
 
 #else
@@ -410,22 +827,238 @@ fish_sound_comment_remove_byname (FishSound * fsound, char * name)
 #endif
 }
 
+/*
+ * Comment sets. A set is built once, with its vorbiscomment fields
+ * serialized, and is then only read: encoders borrow its vector and
+ * index until they modify their comments. The comments, their names and
+ * values, and the serialized fields share one block with the set; the
+ * vector and the index tables are separate allocations, made as the
+ * comments are added, as for a handle's own comments.
+ */
+
+static FishSoundCommentSet *
+fs_comment_set_build (const FishSoundComment * comments, int nr_comments)
+{
+  FishSoundCommentSet * set;
+  FishSoundComment * comment;
+  unsigned char * f;
+  char * c;
+  size_t name_len, value_len, field_len, fields_length, strings_length;
+  size_t head;
+  int i;
+
+  if (nr_comments < 0 || (nr_comments > 0 && comments == NULL))
+    return NULL;
+
+  /* Comment count and framing bit */
+  fields_length = 4 + 1;
+  strings_length = 0;
+
+  for (i = 0; i < nr_comments; i++) {
+    if (!fs_comment_validate_byname (comments[i].name))
+      return NULL;
+
+    name_len = fs_comment_len (comments[i].name);
+    value_len = fs_comment_len (comments[i].value);
+
+    field_len = name_len;
+    if (comments[i].value) field_len += 1 + value_len;
+    if (field_len > MAX_COMMENT_LENGTH ||
+	4 + field_len > LONG_MAX - fields_length)
+      return NULL;
+
+    fields_length += 4 + field_len;
+    strings_length += name_len + value_len + 2;
+  }
+
+  head = sizeof (FishSoundCommentSet) +
+    (size_t)nr_comments * sizeof (FishSoundComment);
+  if (fields_length + strings_length > ((size_t)-1) - head)
+    return NULL;
+
+  if ((set = fs_malloc (head + fields_length + strings_length)) == NULL)
+    return NULL;
+
+  set->refcount = 1;
+  memset (&set->index, 0, sizeof (FishSoundCommentIndex));
+  set->fields = (unsigned char *)set + head;
+  set->fields_length = (long)fields_length;
+
+  if ((set->comments = fs_vector_new ((FishSoundCmpFunc) fs_comment_cmp))
+      == NULL) {
+    fs_free (set);
+    return NULL;
+  }
+
+  comment = (FishSoundComment *)&set[1];
+  f = set->fields;
+  c = (char *)f + fields_length;
+
+  writeint (f, 0, nr_comments);
+  f += 4;
+
+  for (i = 0; i < nr_comments; i++, comment++) {
+    name_len = fs_comment_len (comments[i].name);
+    value_len = fs_comment_len (comments[i].value);
+
+    comment->name = memcpy (c, comments[i].name, name_len);
+    c[name_len] = '\0';
+    c += name_len + 1;
+
+    if (comments[i].value) {
+      comment->value = memcpy (c, comments[i].value, value_len);
+      c[value_len] = '\0';
+      c += value_len + 1;
+    } else {
+      comment->value = NULL;
+    }
+
+    field_len = name_len;
+    if (comment->value) field_len += 1 + value_len;
+
+    writeint (f, 0, field_len);
+    memcpy (f + 4, comment->name, name_len);
+    if (comment->value) {
+      f[4 + name_len] = '=';
+      memcpy (f + 5 + name_len, comment->value, value_len);
+    }
+    f += 4 + field_len;
+
+    if (fs_vector_insert (set->comments, comment) == NULL ||
+	fs_comment_index_add (&set->index, set->comments, i) != 0) {
+      fish_sound_comment_set_unref (set);
+      return NULL;
+    }
+  }
+
+  *f = 0x01;
+
+  return set;
+}
+
+FishSoundCommentSet *
+fish_sound_comment_set_new (const FishSoundComment * comments,
+			    int nr_comments)
+{
+  FishSoundCommentSet * set;
+  FishSound * outer;
+
+  /* A set is not owned by any handle, even if created in a callback: it
+   * may outlive the handle, and be released from another thread */
+  outer = fish_sound_memory_enter (NULL);
+  set = fs_comment_set_build (comments, nr_comments);
+  fish_sound_memory_leave (outer);
+
+  return set;
+}
+
+FishSoundCommentSet *
+fish_sound_comment_set_ref (FishSoundCommentSet * set)
+{
+  if (set == NULL) return NULL;
+
+  fs_atomic_add (&set->refcount, 1);
+
+  return set;
+}
+
+int
+fish_sound_comment_set_unref (FishSoundCommentSet * set)
+{
+  if (set == NULL) return FISH_SOUND_ERR_BAD;
+
+  if (fs_atomic_unref (&set->refcount) > 0) return 0;
+
+  fs_vector_delete (set->comments);
+  fs_comment_index_free (&set->index);
+  fs_free (set);
+
+  return 0;
+}
+
+/* Free the comments of fsound, keeping its vendor string */
+static void
+fs_comments_clear (FishSound * fsound)
+{
+  FishSoundCommentArena * arena;
+
+  if (fsound->comment_set != NULL) {
+    /* Borrowed */
+    memset (&fsound->comment_index, 0, sizeof (FishSoundCommentIndex));
+    fish_sound_comment_set_unref (fsound->comment_set);
+    fsound->comment_set = NULL;
+  } else {
+    /* Decoded comments live in arenas; only added comments are freed singly */
+    if (fsound->comment_arenas == NULL)
+      fs_vector_foreach (fsound->comments, (FishSoundFunc)fs_comment_free);
+
+    while ((arena = fsound->comment_arenas) != NULL) {
+      fsound->comment_arenas = arena->next;
+      fs_free (arena);
+    }
+    fsound->comments_pending = 0;
+
+    fs_vector_delete (fsound->comments);
+    fs_comment_index_free (&fsound->comment_index);
+  }
+
+  fsound->comments = NULL;
+  fsound->comment_cursor = 0;
+
+  fs_comment_packet_invalidate (fsound);
+}
+
+int
+fish_sound_comment_attach_set (FishSound * fsound, FishSoundCommentSet * set)
+{
+  if (fsound == NULL || set == NULL) return FISH_SOUND_ERR_BAD;
+
+  if (fsound->mode != FISH_SOUND_ENCODE)
+    return FISH_SOUND_ERR_INVALID;
+
+#if FS_ENCODE
+  /* Take the new reference first, in case set is already attached */
+  fish_sound_comment_set_ref (set);
+  fs_comments_clear (fsound);
+
+  fsound->comment_set = set;
+  fsound->comments = set->comments;
+  fsound->comment_index = set->index;
+
+  return 0;
+#else
+  return FISH_SOUND_ERR_DISABLED;
+#endif
+}
+
 /* Internal API */
 int
 fish_sound_comments_init (FishSound * fsound)
 {
   fsound->vendor = NULL;
+  fsound->comment_cursor = 0;
   fsound->comments = fs_vector_new ((FishSoundCmpFunc) fs_comment_cmp);
 
+  fsound->comment_index.buckets = NULL;
+  fsound->comment_index.nr_buckets = 0;
+  fsound->comment_index.nr_names = 0;
+  fsound->comment_index.next = NULL;
+  fsound->comment_index.max_next = 0;
+
+  fsound->comment_set = NULL;
+  fsound->comment_arenas = NULL;
+  fsound->comments_pending = 0;
+
+  fsound->comment_packet = NULL;
+  fsound->comment_packet_length = 0;
+
   return 0;
 }
 
 int
 fish_sound_comments_free (FishSound * fsound)
 {
-  fs_vector_foreach (fsound->comments, (FishSoundFunc)fs_comment_free);
-  fs_vector_delete (fsound->comments);
-  fsound->comments = NULL;
+  fs_comments_clear (fsound);
 
   if (fsound->vendor) fs_free (fsound->vendor);
   fsound->vendor = NULL;
@@ -433,16 +1066,123 @@ fish_sound_comments_free (FishSound * fsound)
   return 0;
 }
 
+/*
+ * Choose what to do with a field of a comment packet, without consulting
+ * the filter callback, and find the length to copy. Fields are truncated
+ * at any embedded NUL, and are skipped unless they have a valid non-empty
+ * name. Values over max_value_length are never stored.
+ */
+static int
+fs_comment_field_action (FishSound * fsound, const char * c, size_t len,
+			 size_t * n, size_t * name_len, long * value_length)
+{
+  const char * p;
+  long max = fsound->comment_filter.max_value_length;
+  size_t i;
+
+  p = memchr (c, '\0', len);
+  *n = p ? (size_t)(p - c) : len;
+
+  p = memchr (c, '=', *n);
+  *name_len = p ? (size_t)(p - c) : *n;
+  *value_length = p ? (long)(*n - *name_len - 1) : 0;
+
+  if (*name_len == 0) return FISH_SOUND_COMMENT_SKIP;
+
+  for (i = 0; i < *name_len; i++) {
+    if (c[i] < 0x20 || c[i] > 0x7D) return FISH_SOUND_COMMENT_SKIP;
+  }
+
+  if (max > 0 && *value_length > max)
+    return FISH_SOUND_COMMENT_STREAM;
+
+  return FISH_SOUND_COMMENT_KEEP;
+}
+
+/* Pass a value to the stream callback in chunks */
+static void
+fs_comment_stream (FishSound * fsound, const char * name,
+		   const unsigned char * value, long length)
+{
+  long offset, bytes;
+
+  for (offset = 0; offset < length; offset += bytes) {
+    bytes = MIN (length - offset, FISH_SOUND_COMMENT_CHUNK_SIZE);
+    if (fsound->comment_filter.stream (fsound, name, value + offset, bytes,
+				       offset, length,
+				       fsound->comment_filter.user_data)
+	!= FISH_SOUND_CONTINUE)
+      break;
+  }
+}
+
+/*
+ * Apply the filter and stream callbacks to a field, given the action
+ * chosen by fs_comment_field_action().
+ */
+static int
+fs_comment_field_filter (FishSound * fsound, const char * c, size_t name_len,
+			 long value_length, int action)
+{
+  FishSoundCommentFilter filter = fsound->comment_filter.filter;
+  char name_buf[256], * name;
+
+  if (action == FISH_SOUND_COMMENT_SKIP) return action;
+
+  if (action == FISH_SOUND_COMMENT_STREAM &&
+      fsound->comment_filter.stream == NULL)
+    return FISH_SOUND_COMMENT_SKIP;
+
+  if (filter == NULL && action == FISH_SOUND_COMMENT_KEEP) return action;
+
+  /* The name is not NUL-terminated in the packet */
+  if (name_len < sizeof (name_buf)) {
+    name = name_buf;
+  } else if ((name = fs_malloc (name_len + 1)) == NULL) {
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  }
+  memcpy (name, c, name_len);
+  name[name_len] = '\0';
+
+  if (filter != NULL) {
+    switch (filter (fsound, name, value_length,
+		    fsound->comment_filter.user_data)) {
+    case FISH_SOUND_COMMENT_KEEP:
+      break;
+    case FISH_SOUND_COMMENT_STREAM:
+      action = FISH_SOUND_COMMENT_STREAM;
+      break;
+    default:
+      action = FISH_SOUND_COMMENT_SKIP;
+      break;
+    }
+
+    if (action == FISH_SOUND_COMMENT_STREAM &&
+	fsound->comment_filter.stream == NULL)
+      action = FISH_SOUND_COMMENT_SKIP;
+  }
+
+  if (action == FISH_SOUND_COMMENT_STREAM)
+    fs_comment_stream (fsound, name,
+		       (const unsigned char *)c + name_len + 1, value_length);
+
+  if (name != name_buf) fs_free (name);
+
+  return action;
+}
+
 int
 fish_sound_comments_decode (FishSound * fsound, unsigned char * comments,
 			    long length)
 {
+   FishSoundCommentArena * arena, ** tail;
    char *c= (char *)comments;
-   int i, nb_fields, n;
-   size_t len;
-   char *end;
-   char * name, * value, * nvalue = NULL;
-   FishSoundComment * comment;
+   char *end, *fields, *d;
+   char * nvalue;
+   unsigned char * actions = NULL;
+   int i, nb_fields, nr_comments = 0, action, ret = FISH_SOUND_OK;
+   size_t len, n, name_len, bytes = 0;
+   long value_length;
    
    if (length<8)
       return -1;
@@ -457,16 +1197,10 @@ fish_sound_comments_decode (FishSound * fsound, unsigned char * comments,
    if (len > 0) {
      if ((nvalue = fs_strdup_len (c, len)) == NULL)
        return FISH_SOUND_ERR_OUT_OF_MEMORY;
-     if (fish_sound_comment_set_vendor (fsound, nvalue) == FISH_SOUND_ERR_OUT_OF_MEMORY) {
-       fs_free (nvalue);
-       return FISH_SOUND_ERR_OUT_OF_MEMORY;
-     }
-
-     fs_free (nvalue);
+     if (fsound->vendor) fs_free (fsound->vendor);
+     fsound->vendor = nvalue;
    }
-#ifdef DEBUG
-   fwrite(c, 1, len, stderr); fputc ('\n', stderr);
-#endif
+   debug_printf (1, "vendor %.*s", (int)len, c);
    c+=len;
 
    if (c+4>end) return -1;
@@ -477,72 +1211,113 @@ fish_sound_comments_decode (FishSound * fsound, unsigned char * comments,
    debug_printf (1, "%d comments", nb_fields);
 
    c+=4;
+   fields = c;
+
+   /* Check the framing of the fields. A truncated packet keeps the
+    * fields preceding the damage. */
    for (i=0;i<nb_fields;i++)
    {
-      if (c+4>end) return -1;
+      if (c+4>end) break;
 
       len=readint(c, 0);
-      debug_printf (1, "[%d] len %d\n", i, len);
+      debug_printf (1, "[%d] len %ld", i, (long)len);
 
       c+=4;
-      if (len > (unsigned long) (end-c)) return -1;
-
-      n = 0;
-      name = c;
-      value = fs_index_len (c, '=', len);
-      if (value) {
-	*value = '\0';
-	value++;
-	n = c+len - value;
-      }
-
-      if (n != 0) {
-	if ((nvalue = fs_strdup_len (value, n)) == NULL)
-          return FISH_SOUND_ERR_OUT_OF_MEMORY;
-
-	debug_printf (1, "[%d] %s -> %s (length %d)", i, name, nvalue, n);
-
-	if ((comment = fs_comment_new (name, nvalue)) == NULL) {
-	  fs_free (nvalue);
-          return FISH_SOUND_ERR_OUT_OF_MEMORY;
-	}
-
-	if (_fs_comment_add (fsound, comment) == NULL) {
-	  fs_free (nvalue);
-          return FISH_SOUND_ERR_OUT_OF_MEMORY;
-	}
-
-	fs_free (nvalue);
-      } else {
-	/* For the case of a comment which is not in key=value form,
-	 * duplicate exactly the length of the comment, as it is
-	 * not NUL-terminated. In the case of the last comment of the
-	 * packet, it will be followed immediately by a framing bit.
-	 */
-	if ((nvalue = fs_strdup_len (name, len)) == NULL)
-          return FISH_SOUND_ERR_OUT_OF_MEMORY;
-
-        debug_printf (1, "[%d] %s (no value) (length %d)", i, nvalue, len);
-
-	if ((comment = fs_comment_new (nvalue, NULL)) == NULL) {
-	  fs_free (nvalue);
-          return FISH_SOUND_ERR_OUT_OF_MEMORY;
-	}
-
-	if (_fs_comment_add (fsound, comment) == NULL) {
-	  fs_free (nvalue);
-          return FISH_SOUND_ERR_OUT_OF_MEMORY;
-	}
-
-	fs_free (nvalue);
-      }
+      if (len > (unsigned long) (end-c)) break;
 
       c+=len;
    }
 
+   if (i < nb_fields) {
+     nb_fields = i;
+     ret = -1;
+   }
+
+   /* The filter callback is only called once per field, so remember
+    * its choices for the copy below */
+   if (fsound->comment_filter.filter && nb_fields > 0) {
+     if ((actions = fs_malloc ((size_t)nb_fields)) == NULL)
+       return FISH_SOUND_ERR_OUT_OF_MEMORY;
+   }
+
+   /* Choose and measure the fields to store */
+   for (c = fields, i = 0; i < nb_fields; i++) {
+     len=readint(c, 0);
+     c+=4;
+
+     action = fs_comment_field_action (fsound, c, len, &n, &name_len,
+				       &value_length);
+     action = fs_comment_field_filter (fsound, c, name_len, value_length,
+				       action);
+     if (action == FISH_SOUND_ERR_OUT_OF_MEMORY) {
+       if (actions) fs_free (actions);
+       return FISH_SOUND_ERR_OUT_OF_MEMORY;
+     }
+
+     if (actions) actions[i] = (unsigned char)action;
+
+     if (action == FISH_SOUND_COMMENT_KEEP) {
+       nr_comments++;
+       bytes += n + 1;
+     } else {
+       debug_printf (1, "[%d] comment not stored (action %d)", i, action);
+     }
+
+     c+=len;
+   }
+
+   if (nr_comments == 0) {
+     if (actions) fs_free (actions);
+     return ret;
+   }
+
+   arena = fs_malloc (sizeof (FishSoundCommentArena) +
+		      (size_t)nr_comments * sizeof (FishSoundComment) + bytes);
+   if (arena == NULL) {
+     if (actions) fs_free (actions);
+     return FISH_SOUND_ERR_OUT_OF_MEMORY;
+   }
+
+   arena->next = NULL;
+   arena->comments = (FishSoundComment *)(arena + 1);
+   arena->nr_comments = nr_comments;
+   arena->nr_parsed = 0;
+   arena->cursor = (char *)(arena->comments + nr_comments);
+
+   /* Copy the stored fields */
+   for (c = fields, d = arena->cursor, i = 0; i < nb_fields; i++) {
+     len=readint(c, 0);
+     c+=4;
+
+     action = fs_comment_field_action (fsound, c, len, &n, &name_len,
+				       &value_length);
+     if (actions) action = actions[i];
+
+     if (action == FISH_SOUND_COMMENT_KEEP) {
+       memcpy (d, c, n);
+       d[n] = '\0';
+       d += n + 1;
+     }
+
+     c+=len;
+   }
+
+   if (actions) fs_free (actions);
+
+   for (tail = &fsound->comment_arenas; *tail != NULL; tail = &(*tail)->next);
+   *tail = arena;
+
+   fsound->comments_pending = 1;
+
+   /* Comments may be accessed from a real-time decoded() callback */
+   if (!fsound->comments_lazy || fsound->realtime) {
+     if (fs_comments_materialize (fsound) != 0)
+       return FISH_SOUND_ERR_OUT_OF_MEMORY;
+   }
+
    debug_printf (1, "OUT");
 
-   return FISH_SOUND_OK;
+   return ret;
 }
 
 /*
@@ -661,3 +1436,47 @@ fish_sound_comments_encode (FishSound * fsound, unsigned char * buf,
 
   return actual_length;
 }
+
+const unsigned char *
+fish_sound_comments_packet (FishSound * fsound, long * length)
+{
+  FishSoundCommentSet * set;
+  unsigned char * packet;
+  size_t vendor_length;
+  long bytes;
+
+  if (fsound->comment_packet == NULL && fsound->comment_set != NULL) {
+    /* Only the vendor string is not already serialized */
+    set = fsound->comment_set;
+    vendor_length = fs_comment_len (fsound->vendor);
+    if (vendor_length > (size_t)(LONG_MAX - 4 - set->fields_length))
+      return NULL;
+    bytes = 4 + (long)vendor_length + set->fields_length;
+
+    if ((packet = fs_malloc (bytes)) == NULL)
+      return NULL;
+
+    writeint (packet, 0, vendor_length);
+    if (vendor_length > 0)
+      memcpy (packet + 4, fsound->vendor, vendor_length);
+    memcpy (packet + 4 + vendor_length, set->fields, set->fields_length);
+
+    fsound->comment_packet = packet;
+    fsound->comment_packet_length = bytes;
+  } else if (fsound->comment_packet == NULL) {
+    if ((bytes = fish_sound_comments_encode (fsound, NULL, 0)) <= 0)
+      return NULL;
+
+    if ((packet = fs_malloc (bytes)) == NULL)
+      return NULL;
+
+    fish_sound_comments_encode (fsound, packet, bytes);
+
+    fsound->comment_packet = packet;
+    fsound->comment_packet_length = bytes;
+  }
+
+  *length = fsound->comment_packet_length;
+
+  return fsound->comment_packet;
+}
@@ -65,4 +65,77 @@ _fs_interleave (float * src[], float ** dest,
   }
 }
 
+/* Scale samples, eg. between [-1.0, 1.0] and the 16 bit range used by
+ * Speex. src and dest may be the same buffer. */
+static inline void
+_fs_scale (const float * src, float * dest, long samples, float mult_factor)
+{
+  long i;
+
+  for (i = 0; i < samples; i++) {
+    dest[i] = src[i] * mult_factor;
+  }
+}
+
+/* Conversions between float and the 32 bit integer samples used by
+ * libFLAC; FLAC__int32 is an int on all supported platforms. */
+
+static inline void
+_fs_interleave_from_s32 (const int * const src[], float * dest,
+			 long frames, int channels, float mult_factor)
+{
+  long i;
+  int j;
+
+  for (i = 0; i < frames; i++) {
+    for (j = 0; j < channels; j++) {
+      dest[i*channels + j] = src[j][i] * mult_factor;
+    }
+  }
+}
+
+static inline void
+_fs_convert_from_s32 (const int * const src[], float * dest[],
+		      long frames, int channels, float mult_factor)
+{
+  const int * s;
+  float * d;
+  long i;
+  int j;
+
+  for (j = 0; j < channels; j++) {
+    s = src[j];
+    d = dest[j];
+    for (i = 0; i < frames; i++) {
+      d[i] = s[i] * mult_factor;
+    }
+  }
+}
+
+/* Interleave frames starting at offset in each channel of src */
+static inline void
+_fs_interleave_to_s32 (float * src[], long offset, int * dest,
+		       long frames, int channels, float mult_factor)
+{
+  long i;
+  int j;
+
+  for (i = 0; i < frames; i++) {
+    for (j = 0; j < channels; j++) {
+      dest[i*channels + j] = (int) (src[j][offset + i] * mult_factor);
+    }
+  }
+}
+
+static inline void
+_fs_convert_to_s32 (const float * src, int * dest, long samples,
+		    float mult_factor)
+{
+  long i;
+
+  for (i = 0; i < samples; i++) {
+    dest[i] = (int) (src[i] * mult_factor);
+  }
+}
+
 #endif /* __FISH_SOUND_CONVERT_H__ */
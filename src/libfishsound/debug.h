@@ -5,88 +5,51 @@
  *
  * Usage:
  *
- * #define DEBUG_LEVEL 3
  * #include "debug.h"
  *
  * ...
  *     debug_printf (2, "Something went wrong");
  * ...
  *
- * The macro print_debug(level, fmt) prints a formatted debugging message
- * of level 'level' to stderr. You should set the maximum tolerable debug
- * level before including debug.h. If it is 0, or if neither DEBUG_LEVEL
- * nor DEBUG are defined, then the debug_printf() macro is ignored, and
- * none of this file is included.
+ * The macro debug_printf(level, fmt) prints a formatted debugging message
+ * of level 'level' to stderr. Messages are compiled in, and enabled at run
+ * time with fish_sound_set_log_level().
  */
 #ifndef __DEBUG_H__
 #define __DEBUG_H__
 
-/* MSVC can't handle C99 */
-#if (defined (_MSCVER) || defined (_MSC_VER))
-#define debug_printf //
-#else
-
-#ifdef DEBUG
-#ifndef DEBUG_LEVEL
-#define DEBUG_LEVEL 1
-#endif
-#endif
-
-#if (DEBUG_LEVEL > 0)
-
-#define DEBUG_MAXLINE 4096
-
-#include <stdio.h>
-#include <stdarg.h>
-#include <string.h>
-#include <errno.h>
-
-/*
- * debug_print_err (func, line, fmt)
- *
- * Print a formatted error message to stderr.
- */
-static void
-debug_print_err (const char * func, int line, const char * fmt, ...)
-{
-  va_list ap;
-  int errno_save;
-  char buf[DEBUG_MAXLINE];
-  int n=0;
+#include <fishsound/constants.h>
 
-  errno_save = errno;
+/* The process-wide log level, set with fish_sound_set_log_level() */
+extern int fs_log_level;
 
-  va_start (ap, fmt);
-
-  if (func) {
-    snprintf (buf+n, DEBUG_MAXLINE-n, "%s():%d: ", func, line);
-    n = strlen (buf);
-  }
-
-  vsnprintf (buf+n, DEBUG_MAXLINE-n, fmt, ap);
-  n = strlen (buf);
+#ifdef __GNUC__
+#define FS_PRINTF_FORMAT(f,a) __attribute__ ((format (printf, f, a)))
+#else
+#define FS_PRINTF_FORMAT(f,a)
+#endif
 
-  fflush (stdout); /* in case stdout and stderr are the same */
-  fputs (buf, stderr);
-  fputc ('\n', stderr);
-  fflush (NULL);
+#if (defined (_MSCVER) || defined (_MSC_VER))
+#define FS_DEBUG_FUNC __FUNCTION__
+#else
+#define FS_DEBUG_FUNC __func__
+#endif
 
-  va_end (ap);
-}
+void fish_sound_log_debug (const char * func, int line, const char * fmt, ...)
+     FS_PRINTF_FORMAT (3, 4);
 
 /*
  * debug_printf (level, fmt)
  *
- * Print a formatted debugging message of level 'level' to stderr
+ * Print a formatted debugging message of level 'level' to stderr, if the
+ * log level is at least FISH_SOUND_LOG_DEBUG + level - 1; ie. level 1 is
+ * FISH_SOUND_LOG_DEBUG, and level 2 is FISH_SOUND_LOG_VERBOSE. The
+ * arguments are not evaluated unless the message is printed.
  */
-#define debug_printf(x,y...) {if (x <= DEBUG_LEVEL) debug_print_err (__func__, __LINE__, y);}
-
-#undef MAXLINE
-
-#else
-#define debug_printf(x,...)
-#endif
-
-#endif /* non-C99 */
+#define debug_printf(x,...)                                             \
+  do {                                                                  \
+    if (FISH_SOUND_LOG_DEBUG - 1 + (x) <= fs_log_level)                 \
+      fish_sound_log_debug (FS_DEBUG_FUNC, __LINE__, __VA_ARGS__);      \
+  } while (0)
 
 #endif /* __DEBUG_H__ */
@@ -99,14 +99,19 @@ int fish_sound_set_decoded_float_ilv (FishSound * fsound,
 long
 fish_sound_decode (FishSound * fsound, unsigned char * buf, long bytes)
 {
+  FishSoundStatsCall call;
+  long ret = 0;
   int format;
 
   if (fsound == NULL) return FISH_SOUND_ERR_BAD;
 
 #if FS_DECODE
+  fish_sound_stats_begin (fsound, &call, bytes);
+
   if (fsound->info.format == FISH_SOUND_UNKNOWN) {
     format = fish_sound_identify (buf, bytes);
-    if (format == FISH_SOUND_UNKNOWN) return -1;
+    if (format == FISH_SOUND_UNKNOWN)
+      return fish_sound_stats_end (fsound, &call, -1);
 
     fish_sound_set_format (fsound, format);
   }
@@ -114,7 +119,9 @@ fish_sound_decode (FishSound * fsound, unsigned char * buf, long bytes)
   /*printf ("format: %s\n", fsound->codec->format->name);*/
 
   if (fsound->codec && fsound->codec->decode)
-    return fsound->codec->decode (fsound, buf, bytes);
+    ret = fsound->codec->decode (fsound, buf, bytes);
+
+  return fish_sound_stats_end (fsound, &call, ret);
 #else
   return FISH_SOUND_ERR_DISABLED;
 #endif
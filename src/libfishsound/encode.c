@@ -37,6 +37,33 @@
 
 #include "private.h"
 
+#if FS_ENCODE
+/*
+ * Pass audio to the codec, recording statistics. This is called directly
+ * from the public encode functions, or from the encoder thread if
+ * encoding asynchronously.
+ */
+long
+fish_sound_encode_direct (FishSound * fsound, float ** pcm, long frames,
+			  int interleave)
+{
+  FishSoundStatsCall call;
+  long ret = 0;
+
+  fish_sound_stats_begin (fsound, &call, frames);
+
+  if (interleave) {
+    if (fsound->codec && fsound->codec->encode_f_ilv)
+      ret = fsound->codec->encode_f_ilv (fsound, pcm, frames);
+  } else {
+    if (fsound->codec && fsound->codec->encode_f)
+      ret = fsound->codec->encode_f (fsound, pcm, frames);
+  }
+
+  return fish_sound_stats_end (fsound, &call, ret);
+}
+#endif
+
 int
 fish_sound_set_encoded_callback (FishSound * fsound,
 				 FishSoundEncoded encoded,
@@ -59,8 +86,10 @@ long fish_sound_encode_float (FishSound * fsound, float * pcm[], long frames)
   if (fsound == NULL) return -1;
 
 #if FS_ENCODE
-  if (fsound->codec && fsound->codec->encode_f)
-    return fsound->codec->encode_f (fsound, pcm, frames);
+  if (fsound->async)
+    return fish_sound_async_encode (fsound, pcm, frames, 0);
+
+  return fish_sound_encode_direct (fsound, pcm, frames, 0);
 #else
   return FISH_SOUND_ERR_DISABLED;
 #endif
@@ -74,8 +103,10 @@ long fish_sound_encode_float_ilv (FishSound * fsound, float ** pcm,
   if (fsound == NULL) return -1;
 
 #if FS_ENCODE
-  if (fsound->codec && fsound->codec->encode_f_ilv)
-    return fsound->codec->encode_f_ilv (fsound, pcm, frames);
+  if (fsound->async)
+    return fish_sound_async_encode (fsound, pcm, frames, 1);
+
+  return fish_sound_encode_direct (fsound, pcm, frames, 1);
 #else
   return FISH_SOUND_ERR_DISABLED;
 #endif
@@ -90,13 +121,10 @@ fish_sound_encode (FishSound * fsound, float ** pcm, long frames)
   if (fsound == NULL) return -1;
 
 #if FS_ENCODE
-  if (fsound->interleave) {
-    if (fsound->codec && fsound->codec->encode_f_ilv)
-      return fsound->codec->encode_f_ilv (fsound, pcm, frames);
-  } else {
-    if (fsound->codec && fsound->codec->encode_f)
-      return fsound->codec->encode_f (fsound, pcm, frames);
-  }
+  if (fsound->async)
+    return fish_sound_async_encode (fsound, pcm, frames, fsound->interleave);
+
+  return fish_sound_encode_direct (fsound, pcm, frames, fsound->interleave);
 #else
   return FISH_SOUND_ERR_DISABLED;
 #endif
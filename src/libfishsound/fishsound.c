@@ -37,41 +37,68 @@
 
 #include "private.h"
 
+#if FS_REALTIME_CHECKS
+/* Depth of real-time code paths entered by this thread */
+static FS_THREAD_LOCAL int fs_realtime_depth = 0;
+
+void
+fs_realtime_begin (FishSound * fsound)
+{
+  if (fsound->realtime) fs_realtime_depth++;
+}
+
+void
+fs_realtime_end (FishSound * fsound)
+{
+  if (fsound->realtime) fs_realtime_depth--;
+}
+
+/* The user's callbacks are not part of the real-time code path: they may
+ * allocate, or drive other handles that are not in real-time mode */
 int
-fish_sound_identify (unsigned char * buf, long bytes)
+fs_realtime_suspend (void)
 {
-  if (bytes < 8) return FISH_SOUND_ERR_SHORT_IDENTIFY;
+  int depth = fs_realtime_depth;
 
-  if (HAVE_VORBIS &&
-      fish_sound_vorbis_identify (buf, bytes) != FISH_SOUND_UNKNOWN)
-    return FISH_SOUND_VORBIS;
+  fs_realtime_depth = 0;
 
-  if (HAVE_SPEEX &&
-      fish_sound_speex_identify (buf, bytes) != FISH_SOUND_UNKNOWN)
-    return FISH_SOUND_SPEEX;
+  return depth;
+}
 
-  if (fish_sound_flac_identify (buf, bytes) != FISH_SOUND_UNKNOWN)
-    return FISH_SOUND_FLAC;
+void
+fs_realtime_resume (int depth)
+{
+  fs_realtime_depth = depth;
+}
 
-  return FISH_SOUND_UNKNOWN;
+void
+fs_realtime_check (const char * func)
+{
+  if (fs_realtime_depth > 0) {
+    fprintf (stderr, "libfishsound: %s called in real-time code path\n",
+	     func);
+    abort ();
+  }
 }
+#endif /* FS_REALTIME_CHECKS */
 
 int
 fish_sound_set_format (FishSound * fsound, int format)
 {
-  if (format == FISH_SOUND_VORBIS) {
-    fsound->codec = fish_sound_vorbis_codec ();
-  } else if (format == FISH_SOUND_SPEEX) {
-    fsound->codec = fish_sound_speex_codec ();
-  } else if (format == FISH_SOUND_FLAC) {
-    fsound->codec = fish_sound_flac_codec ();
-   } else {
+  const FishSoundCodec * codec;
+
+  codec = fish_sound_codec_lookup (format, fsound->mode == FISH_SOUND_ENCODE ?
+				   FISH_SOUND_CODEC_ENCODE :
+				   FISH_SOUND_CODEC_DECODE);
+  if (codec == NULL) return -1;
+
+  fsound->codec = codec;
+
+  if (codec->init && codec->init (fsound) == NULL) {
+    fsound->codec = NULL;
     return -1;
   }
 
-  if (fsound->codec && fsound->codec->init)
-    if (fsound->codec->init (fsound) == NULL) return -1;
-
   fsound->info.format = format;
 
   return format;
@@ -80,35 +107,38 @@ fish_sound_set_format (FishSound * fsound, int format)
 FishSound *
 fish_sound_new (int mode, FishSoundInfo * fsinfo)
 {
-  FishSound * fsound;
+  FishSound * fsound, * outer;
 
   if (!FS_DECODE && mode == FISH_SOUND_DECODE) return NULL;
 
   if (!FS_ENCODE && mode == FISH_SOUND_ENCODE) return NULL;
 
   if (mode == FISH_SOUND_ENCODE) {
-    if (fsinfo == NULL) {
+    if (fsinfo == NULL) return NULL;
+
+    if (fish_sound_codec_lookup (fsinfo->format,
+				 FISH_SOUND_CODEC_ENCODE) == NULL)
       return NULL;
-    } else {
-      if (!(HAVE_VORBIS && HAVE_VORBISENC)) {
-	if (fsinfo->format == FISH_SOUND_VORBIS) return NULL;
-      }
-      if (!HAVE_SPEEX) {
-	if (fsinfo->format == FISH_SOUND_SPEEX) return NULL;
-      }
-      if (!HAVE_FLAC) {
-        if (fsinfo->format == FISH_SOUND_FLAC) return NULL;
-      }
-    }
   } else if (mode != FISH_SOUND_DECODE) {
     return NULL;
   }
 
+  /* The handle accounts for its own memory, but cannot own the block
+   * holding it until that has been allocated */
+  outer = fish_sound_memory_enter (NULL);
   fsound = fs_malloc (sizeof (FishSound));
-  if (fsound == NULL) return NULL;
+  if (fsound == NULL) {
+    fish_sound_memory_leave (outer);
+    return NULL;
+  }
+
+  memset (&fsound->memory, 0, sizeof (fsound->memory));
+  fish_sound_memory_adopt (fsound, fsound);
+  fish_sound_memory_enter (fsound);
 
   fsound->mode = mode;
   fsound->interleave = 0;
+  fsound->realtime = 0;
   fsound->frameno = 0;
   fsound->next_granulepos = -1;
   fsound->next_eos = 0;
@@ -116,6 +146,19 @@ fish_sound_new (int mode, FishSoundInfo * fsinfo)
   fsound->codec_data = NULL;
   fsound->callback.encoded = NULL;
   fsound->user_data = NULL;
+  fsound->async = NULL;
+  memset (&fsound->stats, 0, sizeof (FishSoundStats));
+  fsound->trace = NULL;
+  fsound->log.callback = NULL;
+  fsound->log.user_data = NULL;
+  fsound->log.max_per_second = FISH_SOUND_LOG_RATE_DEFAULT;
+  fsound->log.count = 0;
+  fsound->log.window = 0.0;
+  fsound->comments_lazy = 0;
+  fsound->comment_filter.max_value_length = 0;
+  fsound->comment_filter.filter = NULL;
+  fsound->comment_filter.stream = NULL;
+  fsound->comment_filter.user_data = NULL;
 
   fish_sound_comments_init (fsound);
 
@@ -129,21 +172,36 @@ fish_sound_new (int mode, FishSoundInfo * fsinfo)
     fsound->info.format = fsinfo->format;
 
     if (fish_sound_set_format (fsound, fsinfo->format) == -1) {
+      fish_sound_comments_free (fsound);
+      fish_sound_memory_leave (outer);
       fs_free (fsound);
       return NULL;
     }
   }
 
+  fish_sound_memory_leave (outer);
+
+  FS_PROBE3 (new, fsound, mode, fsound->info.format);
+
   return fsound;
 }
 
 long
 fish_sound_flush (FishSound * fsound)
 {
+  FishSoundStatsCall call;
+
   if (fsound == NULL) return -1;
 
-  if (fsound->codec && fsound->codec->flush)
-    return fsound->codec->flush (fsound);
+  FS_PROBE2 (flush, fsound, fsound->info.format);
+
+  if (fsound->async)
+    return fish_sound_async_flush (fsound);
+
+  if (fsound->codec && fsound->codec->flush) {
+    fish_sound_stats_begin (fsound, &call, 0);
+    return fish_sound_stats_end (fsound, &call, fsound->codec->flush (fsound));
+  }
 
   return 0;
 }
@@ -153,6 +211,9 @@ fish_sound_reset (FishSound * fsound)
 {
   if (fsound == NULL) return -1;
 
+  if (fsound->async)
+    fish_sound_async_sync (fsound);
+
   if (fsound->codec && fsound->codec->reset)
     return fsound->codec->reset (fsound);
 
@@ -162,28 +223,36 @@ fish_sound_reset (FishSound * fsound)
 FishSound *
 fish_sound_delete (FishSound * fsound)
 {
+  FishSound * outer;
+
   if (fsound == NULL) return NULL;
 
+  FS_PROBE1 (delete, fsound);
+
+  outer = fish_sound_memory_enter (fsound);
+
+  fish_sound_async_stop (fsound);
+
   if (fsound->codec && fsound->codec->del)
     fsound->codec->del (fsound);
 
-  fs_free (fsound->codec);
-
   fish_sound_comments_free (fsound);
 
+  if (fsound->trace) fs_free (fsound->trace);
+
+  fish_sound_memory_leave (outer);
+
   fs_free (fsound);
 
   return NULL;
 }
 
-int
-fish_sound_command (FishSound * fsound, int command, void * data, int datasize)
+static int
+fs_command (FishSound * fsound, int command, void * data, int datasize)
 {
   FishSoundInfo * fsinfo = (FishSoundInfo *)data;
   int * pi = (int *)data;
 
-  if (fsound == NULL) return -1;
-
   switch (command) {
   case FISH_SOUND_GET_INFO:
     memcpy (fsinfo, &fsound->info, sizeof (FishSoundInfo));
@@ -194,7 +263,50 @@ fish_sound_command (FishSound * fsound, int command, void * data, int datasize)
   case FISH_SOUND_SET_INTERLEAVE:
     fsound->interleave = (*pi ? 1 : 0);
     break;
+  case FISH_SOUND_GET_REALTIME:
+    *pi = fsound->realtime;
+    break;
+  case FISH_SOUND_SET_REALTIME:
+    if (fsound->async)
+      fish_sound_async_sync (fsound);
+    fsound->realtime = (*pi ? 1 : 0);
+    /* Allow the codec to size its buffers, if the headers are known */
+    if (fsound->codec && fsound->codec->command)
+      return fsound->codec->command (fsound, command, data, datasize);
+    break;
+  case FISH_SOUND_GET_ENCODE_ASYNC:
+  case FISH_SOUND_SET_ENCODE_ASYNC:
+    return fish_sound_async_command (fsound, command, data, datasize);
+  case FISH_SOUND_GET_STATS:
+  case FISH_SOUND_RESET_STATS:
+  case FISH_SOUND_GET_MEMORY:
+    /* The encoder thread updates the statistics while it is busy */
+    if (fsound->async)
+      fish_sound_async_sync (fsound);
+    return fish_sound_stats_command (fsound, command, data, datasize);
+  case FISH_SOUND_GET_LATENCY:
+  case FISH_SOUND_GET_PENDING_FRAMES:
+    if (data == NULL || datasize < (int)sizeof (long))
+      return FISH_SOUND_ERR_INVALID;
+    /* Left as 0 by codecs which do not buffer audio */
+    *(long *)data = 0;
+    /* Frames queued for the encoder thread are pending too; wait for them
+     * to reach the codec */
+    if (fsound->async)
+      fish_sound_async_sync (fsound);
+    if (fsound->codec && fsound->codec->command)
+      return fsound->codec->command (fsound, command, data, datasize);
+    break;
+  case FISH_SOUND_GET_COMMENTS_LAZY:
+    *pi = fsound->comments_lazy;
+    break;
+  case FISH_SOUND_SET_COMMENTS_LAZY:
+    fsound->comments_lazy = (*pi ? 1 : 0);
+    break;
   default:
+    /* Wait for the encoder thread to become idle before using the codec */
+    if (fsound->async)
+      fish_sound_async_sync (fsound);
     if (fsound->codec && fsound->codec->command)
       return fsound->codec->command (fsound, command, data, datasize);
     break;
@@ -203,6 +315,24 @@ fish_sound_command (FishSound * fsound, int command, void * data, int datasize)
   return 0;
 }
 
+int
+fish_sound_command (FishSound * fsound, int command, void * data, int datasize)
+{
+  FishSound * outer;
+  int ret;
+
+  if (fsound == NULL) return -1;
+
+  FS_PROBE3 (command, fsound, command, fsound->info.format);
+
+  /* Commands may allocate, eg. to start an encoder thread */
+  outer = fish_sound_memory_enter (fsound);
+  ret = fs_command (fsound, command, data, datasize);
+  fish_sound_memory_leave (outer);
+
+  return ret;
+}
+
 int
 fish_sound_get_interleave (FishSound * fsound)
 {
@@ -228,6 +358,9 @@ fish_sound_get_frameno (FishSound * fsound)
 {
   if (fsound == NULL) return -1L;
 
+  if (fsound->async)
+    return fish_sound_async_get_frameno (fsound);
+
   return fsound->frameno;
 }
 
@@ -247,6 +380,10 @@ fish_sound_prepare_truncation (FishSound * fsound, long next_granulepos,
 {
   if (fsound == NULL) return -1;
 
+  if (fsound->async)
+    return fish_sound_async_prepare_truncation (fsound, next_granulepos,
+						next_eos);
+
   fsound->next_granulepos = next_granulepos;
   fsound->next_eos = next_eos;
 
@@ -46,8 +46,6 @@
 #include "convert.h"
 
 #define DEBUG_VERBOSE 2
-/* #define DEBUG */
-/* #define DEBUG_LEVEL DEBUG_VERBOSE */
 #include "debug.h"
 
 #if HAVE_FLAC
@@ -56,6 +54,10 @@
 
 #define BITS_PER_SAMPLE 24
 
+/* Length of the "fLaC" marker and STREAMINFO block, which follow the
+ * 9 byte Ogg FLAC mapping header in the first packet */
+#define FS_FLAC_STREAMINFO_BYTES 42
+
 typedef struct _FishSoundFlacInfo {
   FLAC__StreamDecoder *fsd;
   FLAC__StreamEncoder *fse;
@@ -67,14 +69,29 @@ typedef struct _FishSoundFlacInfo {
     unsigned char major, minor;
   } version;
   unsigned short header_packets;
+  int native; /* a native FLAC stream, rather than the Ogg FLAC mapping */
   void * ipcm;
+  long max_pcm; /* frames allocated in ipcm, and pcm_out (decode only) */
+  long max_blocksize; /* from STREAMINFO (decode only) */
 #if FS_DECODE
+  long max_framesize; /* from STREAMINFO, or 0 if unknown (decode only) */
+  long packet_bytes; /* size of the audio packet being decoded */
   float * pcm_out[8]; /* non-interleaved pcm, output (decode only);
                        * FLAC does max 8 channels */
+  /* Parsing of a native stream (decode only) */
+  int stage; /* FS_FLAC_NATIVE_* */
+  unsigned char block[4]; /* header of the metadata block being read */
+  long skip; /* bytes of the metadata block remaining to skip */
+  unsigned char * carry; /* input not yet parsed, from earlier calls */
+  long carry_length;
+  long carry_size;
+  long scan; /* offset in a frame from which to look for its end */
 #endif
 #if FS_ENCODE
   FLAC__StreamMetadata * enc_vc_metadata; /* FLAC metadata structure for
                                            * vorbiscomments (encode only) */
+  long frames_in; /* frames passed to libFLAC (encode only) */
+  long frames_out; /* frames in packets written by libFLAC (encode only) */
 #endif
 } FishSoundFlacInfo;
 
@@ -88,18 +105,176 @@ fish_sound_flac_identify (unsigned char * buf, long bytes)
     /* if only a short buffer was passed, do a weak identify */
     if (bytes == 8) return FISH_SOUND_FLAC;
 
-    /* otherwise, look for the fLaC header preceding STREAMINFO */
-    if (!strncmp ((char *)buf+9, "fLaC", 4)) {
+    /* otherwise, look for the fLaC header and a complete STREAMINFO */
+    if (bytes < 9 + FS_FLAC_STREAMINFO_BYTES ||
+        strncmp ((char *)buf+9, "fLaC", 4))
+      return FISH_SOUND_UNKNOWN;
+
+    if ((buf[13] & 0x7f) == FLAC__METADATA_TYPE_STREAMINFO)
       return FISH_SOUND_FLAC;
-    }
   }
 
   return FISH_SOUND_UNKNOWN;
 }
 
+static int
+fs_flac_native_identify (unsigned char * buf, long bytes)
+{
+  if (bytes < 8) return FISH_SOUND_UNKNOWN;
+
+  /* The "fLaC" marker must be followed by the 34 byte STREAMINFO block */
+  if (strncmp ((char *)buf, "fLaC", 4) ||
+      (buf[4] & 0x7f) != FLAC__METADATA_TYPE_STREAMINFO ||
+      buf[5] != 0 || buf[6] != 0 || buf[7] != 34)
+    return FISH_SOUND_UNKNOWN;
+
+  return FISH_SOUND_FLAC_NATIVE;
+}
+
+/* Number of frames converted per call to libFLAC when encoding */
+#define FS_FLAC_ENCODE_BLOCK 4096
+
+/* The block size libFLAC uses by default, reported as the encoder latency
+ * before the encoder has been set up */
+#define FS_FLAC_DEFAULT_BLOCKSIZE 4096
+
+/* Stages of parsing a native stream */
+#define FS_FLAC_NATIVE_MARKER 0   /* "fLaC" and STREAMINFO */
+#define FS_FLAC_NATIVE_BLOCK 1    /* header of a metadata block */
+#define FS_FLAC_NATIVE_COMMENTS 2 /* VORBIS_COMMENT block */
+#define FS_FLAC_NATIVE_SKIP 3     /* other metadata blocks */
+#define FS_FLAC_NATIVE_AUDIO 4    /* frames */
+
+/* Bytes appended to a carried frame at a time while looking for its end */
+#define FS_FLAC_CARRY_STEP 4096
+
+/* The shortest possible frame, and the largest frame size assumed when
+ * STREAMINFO does not give one */
+#define FS_FLAC_MIN_FRAMESIZE 10
+#define FS_FLAC_MAX_FRAMESIZE (1L<<21)
+
+/*
+ * Ensure the pcm buffers can hold at least 'frames' frames: for decoding,
+ * float output in ipcm (interleaved) and pcm_out (non-interleaved); for
+ * encoding, FLAC__int32 input in ipcm.
+ */
+static int
+fs_flac_alloc_pcm (FishSound * fsound, long frames)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+  int i, channels = fsound->info.channels;
+  void * ipcm;
+  size_t sample_size = sizeof (float);
+
+  if (frames <= fi->max_pcm) return 0;
+
+  if (fsound->mode == FISH_SOUND_ENCODE)
+    sample_size = sizeof (FLAC__int32);
+
+  if ((ipcm = fs_realloc (fi->ipcm, sample_size * channels * frames)) == NULL)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  fi->ipcm = ipcm;
+
+#if FS_DECODE
+  if (fsound->mode == FISH_SOUND_DECODE) {
+    for (i = 0; i < channels && i < 8; i++) {
+      if ((ipcm = fs_realloc (fi->pcm_out[i], sizeof(float) * frames)) == NULL)
+	return FISH_SOUND_ERR_OUT_OF_MEMORY;
+      fi->pcm_out[i] = ipcm;
+    }
+  }
+#endif
+
+  fi->max_pcm = frames;
+
+  return 0;
+}
+
+#if FS_DECODE
+/*
+ * Ensure the carry buffer of a native decoder can hold size bytes.
+ */
+static int
+fs_flac_carry_reserve (FishSound * fsound, long size)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+  unsigned char * carry;
+
+  if (size <= fi->carry_size) return 0;
+
+  size = MAX (size, 2 * fi->carry_size);
+  if ((carry = fs_realloc (fi->carry, size)) == NULL)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  fi->carry = carry;
+  fi->carry_size = size;
+
+  return 0;
+}
+#endif
+
+/*
+ * In real-time mode, size the pcm buffers for the largest block: when
+ * decoding, as given by STREAMINFO; when encoding, the block size used
+ * for conversion. A native decoder also sizes its carry buffer for the
+ * largest frame.
+ */
+static int
+fs_flac_realtime_alloc (FishSound * fsound)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+
+  if (!fsound->realtime) return 0;
+
+  if (fsound->mode == FISH_SOUND_ENCODE)
+    return fs_flac_alloc_pcm (fsound, FS_FLAC_ENCODE_BLOCK);
+
+#if FS_DECODE
+  if (fi->native && fi->stage == FS_FLAC_NATIVE_AUDIO &&
+      fs_flac_carry_reserve (fsound, 2 * FS_FLAC_CARRY_STEP +
+			     (fi->max_framesize > 0 ?
+			      fi->max_framesize : FS_FLAC_MAX_FRAMESIZE)) != 0)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+#endif
+
+  if (fi->max_blocksize > 0)
+    return fs_flac_alloc_pcm (fsound, fi->max_blocksize);
+
+  return 0;
+}
+
 static int
 fs_flac_command (FishSound * fsound, int command, void * data, int datasize)
 {
+  FishSoundFlacInfo *fi = fsound->codec_data;
+  long * pl = (long *)data;
+
+  switch (command) {
+  case FISH_SOUND_SET_REALTIME:
+    return fs_flac_realtime_alloc (fsound);
+  /* An Ogg FLAC decoder passes out each frame as soon as its packet is
+   * decoded, but a native decoder only knows a frame is complete once the
+   * next one starts, and libFLAC buffers a whole block of input before
+   * encoding it */
+  case FISH_SOUND_GET_LATENCY:
+    if (fsound->mode == FISH_SOUND_DECODE && fi->native)
+      *pl = fi->max_blocksize;
+#if FS_ENCODE
+    if (fsound->mode == FISH_SOUND_ENCODE)
+      *pl = fi->fse ? (long)FLAC__stream_encoder_get_blocksize (fi->fse) :
+	FS_FLAC_DEFAULT_BLOCKSIZE;
+#endif
+    break;
+#if FS_ENCODE
+  case FISH_SOUND_GET_PENDING_FRAMES:
+    if (fsound->mode == FISH_SOUND_ENCODE)
+      *pl = fi->frames_in - fi->frames_out;
+    break;
+#endif
+  default:
+    break;
+  }
+
   return 0;
 }
 
@@ -134,8 +309,7 @@ fs_flac_write_callback(const FLAC__StreamDecoder *decoder,
 {
   FishSound* fsound = (FishSound*)client_data;
   FishSoundFlacInfo* fi = (FishSoundFlacInfo *)fsound->codec_data;
-  int i, j, channels, blocksize, offset;
-  float * ipcm;
+  int channels, blocksize;
 
   channels = frame->header.channels;
   blocksize = frame->header.blocksize;
@@ -144,42 +318,29 @@ fs_flac_write_callback(const FLAC__StreamDecoder *decoder,
 
   fsound->frameno += blocksize;
 
+  FS_PROBE4 (codec__decode, fsound, FISH_SOUND_FLAC, fi->packet_bytes,
+	     blocksize);
+
   if (fsound->callback.decoded_float) {
     float norm = 1.0 / ((1 << (frame->header.bits_per_sample - 1)));
 
+    if (channels > fsound->info.channels)
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+    /* In real-time mode, the buffers have been sized from STREAMINFO, and
+     * a larger block is an error in the stream */
+    if (blocksize > fi->max_pcm &&
+        (fsound->realtime || fs_flac_alloc_pcm (fsound, blocksize) != 0))
+      return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
     if (fsound->interleave) {
-	FishSoundDecoded_FloatIlv dfi;
-	float* retpcm;
-
-        if ((ipcm = realloc(fi->ipcm, sizeof(float) * channels * blocksize)) == NULL)
-          return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-
-	fi->ipcm = ipcm;
-	retpcm = (float*) fi->ipcm;
-	for (i = 0; i < blocksize; i++) {
-	  offset = i * channels;
-	  for (j = 0; j < channels; j++)
-	    retpcm[offset + j] = buffer[j][i] * norm;
-	}
-	dfi = (FishSoundDecoded_FloatIlv)fsound->callback.decoded_float_ilv;
-	dfi (fsound, (float **)retpcm, blocksize, fsound->user_data);
-      } else {
-	FishSoundDecoded_Float df;
-        FLAC__int32 * s = (FLAC__int32 *)buffer; /* de-interleave source */
-	float *d; /* de-interleave dest */
-
-        for (j = 0; j < channels; j++) {
-          if ((ipcm = realloc(fi->pcm_out[j], sizeof(float) * blocksize)) == NULL)
-            return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
-	  fi->pcm_out[j] = ipcm;
-        }
-	for (i = 0; i < blocksize; i++)
-	  for (j = 0; j < channels; j++) {
-	    d = fi->pcm_out[j];
-	    d[i] = s[i*channels + j] * norm;
-	  }
-      	df = (FishSoundDecoded_Float)fsound->callback.decoded_float;
-	df (fsound, fi->pcm_out, blocksize, fsound->user_data);
+      _fs_interleave_from_s32 (buffer, (float *)fi->ipcm, blocksize,
+			       channels, norm);
+      fish_sound_dispatch_decoded_float_ilv (fsound, (float **)fi->ipcm,
+					     blocksize);
+    } else {
+      _fs_convert_from_s32 (buffer, fi->pcm_out, blocksize, channels, norm);
+      fish_sound_dispatch_decoded_float (fsound, fi->pcm_out, blocksize);
     }
   }
   return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
@@ -191,7 +352,7 @@ fs_flac_meta_callback(const FLAC__StreamDecoder *decoder,
                       void *client_data)
 {
   FishSound* fsound = (FishSound*)client_data;
-  /*  FishSoundFlacInfo* fi = (FishSoundFlacInfo *)fsound->codec_data; */
+  FishSoundFlacInfo* fi = (FishSoundFlacInfo *)fsound->codec_data;
   debug_printf(1, "IN");
 
   switch (metadata->type) {
@@ -201,6 +362,9 @@ fs_flac_meta_callback(const FLAC__StreamDecoder *decoder,
            metadata->data.stream_info.sample_rate);
     fsound->info.channels = metadata->data.stream_info.channels;
     fsound->info.samplerate = metadata->data.stream_info.sample_rate;
+    fi->max_blocksize = metadata->data.stream_info.max_blocksize;
+    fi->max_framesize = metadata->data.stream_info.max_framesize;
+    fs_flac_realtime_alloc (fsound);
     break;
   default:
     debug_printf(1, "not yet implemented type");
@@ -213,26 +377,21 @@ fs_flac_error_callback(const FLAC__StreamDecoder *decoder,
                        FLAC__StreamDecoderErrorStatus status,
                        void *client_data)
 {
-  debug_printf(1, "IN");
-  fprintf(stderr, "FLAC ERROR: %s\n", FLAC__StreamDecoderErrorStatusString[status]);
+  FishSound* fsound = (FishSound*)client_data;
+
+  /* libFLAC recovers from these by resynchronizing, so they do not cause
+   * the decode call to fail */
+  fs_log (fsound, FISH_SOUND_LOG_ERROR, FISH_SOUND_ERR_GENERIC,
+	  "FLAC decoder: %s", FLAC__StreamDecoderErrorStatusString[status]);
+  fish_sound_trace_event (fsound, FS_TRACE_ERROR, FISH_SOUND_ERR_GENERIC);
 }
 #endif
 #if FS_DECODE
 static void*
-fs_flac_decode_header (FishSound * fsound, unsigned char *buf, long bytes)
+fs_flac_decoder_new (FishSound * fsound)
 {
   FishSoundFlacInfo *fi = fsound->codec_data;
 
-  if (bytes < 9) return NULL;
-  if (buf[0] != 0x7f) return NULL;
-  if (strncmp((char *)buf+1, "FLAC", 4) != 0) return NULL;
-  fi->version.major = buf[5];
-  fi->version.minor = buf[6];
-  debug_printf(1, "Flac Ogg Mapping Version: %d.%d",
-         fi->version.major, fi->version.minor);
-  fi->header_packets = buf[7] << 8 | buf[8];
-  debug_printf(1, "Number of Header packets: %d", fi->header_packets);
-
   if ((fi->fsd = FLAC__stream_decoder_new()) == NULL) {
     debug_printf (1, "unable to create new stream_decoder");
     return NULL;
@@ -266,6 +425,444 @@ fs_flac_decode_header (FishSound * fsound, unsigned char *buf, long bytes)
   return fi->fsd;
 }
 
+static void*
+fs_flac_decode_header (FishSound * fsound, unsigned char *buf, long bytes)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+
+  if (bytes < 9) return NULL;
+  if (buf[0] != 0x7f) return NULL;
+  if (strncmp((char *)buf+1, "FLAC", 4) != 0) return NULL;
+  fi->version.major = buf[5];
+  fi->version.minor = buf[6];
+  debug_printf(1, "Flac Ogg Mapping Version: %d.%d",
+         fi->version.major, fi->version.minor);
+  fi->header_packets = buf[7] << 8 | buf[8];
+  debug_printf(1, "Number of Header packets: %d", fi->header_packets);
+
+  return fs_flac_decoder_new (fsound);
+}
+
+/*
+ * Buffer the "fLaC" marker and STREAMINFO block for libFLAC.
+ */
+static long
+fs_flac_decode_streaminfo (FishSound * fsound, unsigned char * buf,
+			   long bytes)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+
+  if ((fi->buffer = fs_malloc(sizeof(unsigned char)*bytes)) == NULL)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  memcpy(fi->buffer, buf, bytes);
+  fi->bufferlength = bytes;
+
+  return 0;
+}
+
+/*
+ * Handle a metadata block following STREAMINFO, given its header and
+ * body. libFLAC only reports STREAMINFO to fs_flac_meta_callback(), so
+ * the other blocks, which may be large, are not buffered for it; the
+ * comments are decoded here.
+ */
+static long
+fs_flac_decode_metadata (FishSound * fsound, unsigned char * header,
+			 unsigned char * body, long bytes)
+{
+  long len;
+
+  if ((header[0] & 0x7f) == FLAC__METADATA_TYPE_VORBIS_COMMENT) {
+    len = (header[1]<<16) + (header[2]<<8) + header[3];
+    debug_printf (1, "got vorbiscomments len %ld", len);
+
+    if (fish_sound_comments_decode (fsound, body, MIN (len, bytes)) == FISH_SOUND_ERR_OUT_OF_MEMORY)
+      return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  }
+
+  return 0;
+}
+
+/*
+ * Pass the buffered STREAMINFO to libFLAC, as the last metadata block.
+ */
+static long
+fs_flac_decode_metadata_end (FishSound * fsound)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+
+  fi->buffer[4] |= 0x80;
+
+  if (FLAC__stream_decoder_process_until_end_of_metadata(fi->fsd) == false)
+    return -1;
+
+  fs_free(fi->buffer);
+  fi->buffer = NULL;
+
+  fish_sound_trace_event (fsound, FS_TRACE_HEADERS, 0);
+
+  return 0;
+}
+
+static long
+fs_flac_decode_frame (FishSound * fsound, unsigned char * buf, long bytes)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+  FLAC__bool ret;
+
+  fi->buffer = buf;
+  fi->bufferlength = bytes;
+  fi->packet_bytes = bytes;
+  fs_realtime_begin (fsound);
+  ret = FLAC__stream_decoder_process_single(fi->fsd);
+  fs_realtime_end (fsound);
+  fi->buffer = NULL;
+  fi->bufferlength = 0;
+
+  return ret == false ? -1 : 0;
+}
+
+static long
+fs_flac_decode_error (FishSoundFlacInfo *fi)
+{
+  switch (FLAC__stream_decoder_get_state(fi->fsd)) {
+  case FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR:
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  default:
+    return FISH_SOUND_ERR_GENERIC;
+  }
+}
+
+/* CRC-16 of FLAC frames, polynomial x^16 + x^15 + x^2 + 1, by nibble */
+static const unsigned short fs_flac_crc16_table[16] = {
+  0x0000, 0x8005, 0x800f, 0x000a, 0x801b, 0x001e, 0x0014, 0x8011,
+  0x8033, 0x0036, 0x003c, 0x8039, 0x0028, 0x802d, 0x8027, 0x0022
+};
+
+static unsigned int
+fs_flac_crc16 (const unsigned char * buf, long len)
+{
+  unsigned int crc = 0;
+  long i;
+
+  for (i = 0; i < len; i++) {
+    crc = (crc << 4) ^ fs_flac_crc16_table[((crc >> 12) ^ (buf[i] >> 4)) & 0xf];
+    crc = (crc << 4) ^ fs_flac_crc16_table[((crc >> 12) ^ buf[i]) & 0xf];
+    crc &= 0xffff;
+  }
+
+  return crc;
+}
+
+/* CRC-8 of FLAC frame headers, polynomial x^8 + x^2 + x + 1 */
+static unsigned int
+fs_flac_crc8 (const unsigned char * buf, long len)
+{
+  unsigned int crc = 0;
+  long i;
+  int k;
+
+  for (i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (k = 0; k < 8; k++)
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) & 0xff : crc << 1;
+  }
+
+  return crc;
+}
+
+/*
+ * Check for a frame header at the start of buf.
+ * Returns its length, 0 if buf does not start with a valid header, or -1
+ * if more than len bytes are needed to tell.
+ */
+static int
+fs_flac_frame_header (const unsigned char * buf, long len)
+{
+  int i, n, length;
+
+  if (len < 5) return -1;
+
+  /* Sync code and blocking strategy; no reserved block size, sample rate,
+   * channel assignment or sample size */
+  if (buf[0] != 0xff || (buf[1] & 0xfe) != 0xf8) return 0;
+  if ((buf[2] >> 4) == 0 || (buf[2] & 0x0f) == 0x0f) return 0;
+  if ((buf[3] >> 4) > 10 || ((buf[3] >> 1) & 0x07) == 3 || (buf[3] & 1))
+    return 0;
+
+  /* The frame or sample number, UTF-8 coded: 0xxxxxxx, or 110xxxxx to
+   * 11111110 followed by continuation bytes */
+  for (n = 0; n < 8 && (buf[4] & (0x80 >> n)); n++);
+  if (n == 1 || n == 8) return 0;
+  length = 5 + (n > 0 ? n - 1 : 0);
+  if (len < length) return -1;
+  for (i = 5; i < length; i++) {
+    if ((buf[i] & 0xc0) != 0x80) return 0;
+  }
+
+  /* Block size and sample rate given at the end of the header */
+  switch (buf[2] >> 4) {
+  case 6: length += 1; break;
+  case 7: length += 2; break;
+  default: break;
+  }
+  switch (buf[2] & 0x0f) {
+  case 12: length += 1; break;
+  case 13: case 14: length += 2; break;
+  default: break;
+  }
+
+  if (len < length + 1) return -1;
+  if (fs_flac_crc8 (buf, length) != buf[length]) return 0;
+
+  return length + 1;
+}
+
+/*
+ * Find the end of the frame at the start of buf, searching from *scan. The
+ * end is the start of the next valid frame header, if the frame's CRC-16
+ * is correct, or if the frame is already longer than any frame could be.
+ * Returns the length of the frame, or 0 if its end is not within len
+ * bytes; in that case *scan is updated for a search with more data.
+ */
+static long
+fs_flac_frame_end (FishSoundFlacInfo * fi, const unsigned char * buf,
+		   long len, long * scan)
+{
+  const unsigned char * p;
+  long i, max_framesize;
+  int h;
+
+  max_framesize = fi->max_framesize > 0 ?
+    fi->max_framesize : FS_FLAC_MAX_FRAMESIZE;
+
+  for (i = MAX (*scan, FS_FLAC_MIN_FRAMESIZE); i < len - 1; i++) {
+    if ((p = memchr (buf + i, 0xff, len - 1 - i)) == NULL) {
+      i = len - 1;
+      break;
+    }
+    i = p - buf;
+
+    if ((buf[i+1] & 0xfe) != 0xf8) continue;
+
+    if ((h = fs_flac_frame_header (buf + i, len - i)) < 0) break;
+    if (h == 0) continue;
+
+    if (fs_flac_crc16 (buf, i - 2) == ((unsigned int)buf[i-2] << 8 | buf[i-1]) ||
+	i > max_framesize)
+      return i;
+  }
+
+  *scan = i;
+
+  return 0;
+}
+
+/*
+ * Ensure the carry buffer can hold size bytes of a frame. In real-time
+ * mode, it was sized from STREAMINFO, and a larger frame is an error.
+ */
+static int
+fs_flac_carry_frame (FishSound * fsound, long size)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+
+  if (fsound->realtime && size > fi->carry_size) {
+    fs_log (fsound, FISH_SOUND_LOG_ERROR, FISH_SOUND_ERR_OUT_OF_MEMORY,
+	    "FLAC decoder: frame larger than %ld bytes in real-time mode",
+	    fi->carry_size);
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  }
+
+  return fs_flac_carry_reserve (fsound, size);
+}
+
+/*
+ * Get the next need bytes of a native stream: in place if they are all
+ * in the input and no earlier input is carried over, otherwise gathered
+ * in the carry buffer. Returns 1 and sets *p once the bytes are
+ * available, or 0 if all the input has been carried over.
+ */
+static int
+fs_flac_native_take (FishSound * fsound, unsigned char ** buf, long * bytes,
+		     long need, unsigned char ** p)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+  long n;
+
+  if (fi->carry_length == 0 && *bytes >= need) {
+    *p = *buf;
+    *buf += need;
+    *bytes -= need;
+    return 1;
+  }
+
+  if (fs_flac_carry_reserve (fsound, need) != 0)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  n = MIN (need - fi->carry_length, *bytes);
+  memcpy (fi->carry + fi->carry_length, *buf, n);
+  fi->carry_length += n;
+  *buf += n;
+  *bytes -= n;
+
+  if (fi->carry_length < need) return 0;
+
+  /* The bytes are used before any more input is carried over */
+  fi->carry_length = 0;
+  *p = fi->carry;
+
+  return 1;
+}
+
+/*
+ * Parse the metadata of a native stream, which may be split at any point
+ * between calls. Returns 1 once all metadata has been handled.
+ */
+static long
+fs_flac_native_metadata (FishSound * fsound, unsigned char ** buf,
+			 long * bytes)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+  unsigned char * p;
+  long n, ret;
+
+  while (fi->stage != FS_FLAC_NATIVE_AUDIO) {
+    switch (fi->stage) {
+    case FS_FLAC_NATIVE_MARKER:
+      if ((ret = fs_flac_native_take (fsound, buf, bytes,
+				       FS_FLAC_STREAMINFO_BYTES, &p)) <= 0)
+	return ret;
+      if (fs_flac_native_identify (p, FS_FLAC_STREAMINFO_BYTES) !=
+	  FISH_SOUND_FLAC_NATIVE || fs_flac_decoder_new (fsound) == NULL)
+	return FISH_SOUND_ERR_GENERIC;
+      if ((ret = fs_flac_decode_streaminfo (fsound, p,
+					    FS_FLAC_STREAMINFO_BYTES)) != 0)
+	return ret;
+      fi->stage = (p[4] & 0x80) ? FS_FLAC_NATIVE_AUDIO : FS_FLAC_NATIVE_BLOCK;
+      break;
+    case FS_FLAC_NATIVE_BLOCK:
+      if ((ret = fs_flac_native_take (fsound, buf, bytes, 4, &p)) <= 0)
+	return ret;
+      memcpy (fi->block, p, 4);
+      fi->skip = (p[1]<<16) + (p[2]<<8) + p[3];
+      if ((p[0] & 0x7f) == FLAC__METADATA_TYPE_VORBIS_COMMENT)
+	fi->stage = FS_FLAC_NATIVE_COMMENTS;
+      else
+	fi->stage = FS_FLAC_NATIVE_SKIP;
+      break;
+    case FS_FLAC_NATIVE_COMMENTS:
+      if ((ret = fs_flac_native_take (fsound, buf, bytes, fi->skip,
+				       &p)) <= 0)
+	return ret;
+      if ((ret = fs_flac_decode_metadata (fsound, fi->block, p,
+					  fi->skip)) != 0)
+	return ret;
+      fi->stage = (fi->block[0] & 0x80) ?
+	FS_FLAC_NATIVE_AUDIO : FS_FLAC_NATIVE_BLOCK;
+      break;
+    case FS_FLAC_NATIVE_SKIP:
+      n = MIN (fi->skip, *bytes);
+      *buf += n;
+      *bytes -= n;
+      if ((fi->skip -= n) > 0) return 0;
+      fi->stage = (fi->block[0] & 0x80) ?
+	FS_FLAC_NATIVE_AUDIO : FS_FLAC_NATIVE_BLOCK;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (fs_flac_decode_metadata_end (fsound) != 0)
+    return fs_flac_decode_error (fi);
+
+  return 1;
+}
+
+/*
+ * Decode the frames of a native stream. Frames wholly within the input
+ * are decoded in place; only the start of a frame which continues in
+ * later input is carried over, together with as much of the following
+ * input as is needed to find its end.
+ */
+static long
+fs_flac_native_frames (FishSound * fsound, unsigned char * buf, long bytes)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+  long carried, end, n, ret = 0;
+
+  while (fi->carry_length > 0 && bytes > 0) {
+    carried = fi->carry_length;
+    n = MIN (bytes, FS_FLAC_CARRY_STEP);
+    if ((ret = fs_flac_carry_frame (fsound, carried + n)) != 0)
+      return ret;
+    memcpy (fi->carry + carried, buf, n);
+    fi->carry_length += n;
+
+    if ((end = fs_flac_frame_end (fi, fi->carry, fi->carry_length,
+				  &fi->scan)) == 0) {
+      buf += n;
+      bytes -= n;
+      continue;
+    }
+
+    ret = fs_flac_decode_frame (fsound, fi->carry, end);
+    fi->scan = 0;
+
+    if (end >= carried) {
+      /* The next frame starts in the input */
+      buf += end - carried;
+      bytes -= end - carried;
+      fi->carry_length = 0;
+    } else {
+      /* The next frame starts in the carried bytes */
+      memmove (fi->carry, fi->carry + end, carried - end);
+      fi->carry_length = carried - end;
+    }
+
+    if (ret != 0) return fs_flac_decode_error (fi);
+  }
+
+  while (bytes > 0 &&
+	 (end = fs_flac_frame_end (fi, buf, bytes, &fi->scan)) > 0) {
+    ret = fs_flac_decode_frame (fsound, buf, end);
+    fi->scan = 0;
+    buf += end;
+    bytes -= end;
+
+    if (ret != 0) return fs_flac_decode_error (fi);
+  }
+
+  if (bytes > 0) {
+    if ((ret = fs_flac_carry_frame (fsound, bytes)) != 0)
+      return ret;
+    memcpy (fi->carry, buf, bytes);
+    fi->carry_length = bytes;
+  }
+
+  return 0;
+}
+
+/*
+ * Decode part of a native stream. The input may be split at any point,
+ * and the last frame is decoded by fs_flac_flush().
+ */
+static long
+fs_flac_decode_native (FishSound * fsound, unsigned char * buf, long bytes)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+  long ret;
+
+  if (fi->stage != FS_FLAC_NATIVE_AUDIO) {
+    if ((ret = fs_flac_native_metadata (fsound, &buf, &bytes)) <= 0)
+      return ret;
+  }
+
+  return fs_flac_native_frames (fsound, buf, bytes);
+}
+
 static long
 fs_flac_decode (FishSound * fsound, unsigned char * buf, long bytes)
 {
@@ -273,68 +870,52 @@ fs_flac_decode (FishSound * fsound, unsigned char * buf, long bytes)
 
   debug_printf(DEBUG_VERBOSE, "IN, fi->packetno = %ld", fi->packetno);
 
+  if (fi->native)
+    return fs_flac_decode_native (fsound, buf, bytes);
+
   if (fi->packetno == 0) {
+    /* The packet must hold "fLaC" and the whole STREAMINFO block, to
+     * which the last-metadata-block flag is added for libFLAC */
+    if (bytes - 9 < FS_FLAC_STREAMINFO_BYTES ||
+        fs_flac_native_identify (buf+9, bytes-9) == FISH_SOUND_UNKNOWN) {
+      debug_printf(1, "Truncated or invalid STREAMINFO");
+      return FISH_SOUND_ERR_GENERIC;
+    }
     if (fs_flac_decode_header (fsound, buf, bytes) == NULL) {
       debug_printf(1, "Error reading header");
       return -1;
     }
-    if ((fi->buffer = fs_malloc(sizeof(unsigned char)*bytes)) == NULL)
+    if (fs_flac_decode_streaminfo (fsound, buf+9,
+                                   FS_FLAC_STREAMINFO_BYTES) != 0)
       return FISH_SOUND_ERR_OUT_OF_MEMORY;
 
-    memcpy(fi->buffer, buf+9, bytes-9);
-    fi->bufferlength = bytes-9;
+    if (fi->header_packets == 0 && fs_flac_decode_metadata_end (fsound) != 0)
+      goto dec_err;
   }
   else if (fi->packetno <= fi->header_packets){
-    unsigned char* tmp;
     debug_printf(1, "handling header (fi->header_packets = %d)",
                  fi->header_packets);
 
-#if 0
-    if (fi->packetno ==  1) fish_sound_comments_decode (fsound, buf, bytes);
-#endif
-
-    if ((buf[0] & 0x7) == 4) {
-      int len = (buf[1]<<16) + (buf[2]<<8) + buf[3];
-      debug_printf (1, "got vorbiscomments len %d", len);
-
-      if (fish_sound_comments_decode (fsound, buf+4, len) == FISH_SOUND_ERR_OUT_OF_MEMORY) {
-        fi->packetno++;
-        return FISH_SOUND_ERR_OUT_OF_MEMORY;
-      }
-    }
+    if (bytes < 4) goto dec_err;
 
-    if ((tmp = fs_malloc(sizeof(unsigned char)*(fi->bufferlength+bytes))) == NULL)
+    if (fs_flac_decode_metadata (fsound, buf, buf+4, bytes-4) != 0) {
+      fi->packetno++;
       return FISH_SOUND_ERR_OUT_OF_MEMORY;
-
-    memcpy(tmp, fi->buffer, fi->bufferlength);
-    memcpy(tmp+fi->bufferlength, buf, bytes);
-    fi->bufferlength += bytes;
-    fs_free(fi->buffer);
-    fi->buffer = tmp;
-    if (fi->packetno == fi->header_packets) {
-      if (FLAC__stream_decoder_process_until_end_of_metadata(fi->fsd) == false) {
-        goto dec_err;
-      }
-      fs_free(fi->buffer);
     }
+
+    if (fi->packetno == fi->header_packets &&
+	fs_flac_decode_metadata_end (fsound) != 0)
+      goto dec_err;
   } else {
-    fi->buffer = buf;
-    fi->bufferlength = bytes;
-    if (FLAC__stream_decoder_process_single(fi->fsd) == false) {
+    if (fs_flac_decode_frame (fsound, buf, bytes) != 0)
       goto dec_err;
-    }
   }
   fi->packetno++;
 
   return 0;
 
 dec_err:
-    switch (FLAC__stream_decoder_get_state(fi->fsd)) {
-    case FLAC__STREAM_DECODER_MEMORY_ALLOCATION_ERROR:
-      return FISH_SOUND_ERR_OUT_OF_MEMORY;
-    default:
-      return FISH_SOUND_ERR_GENERIC;
-    }
+  return fs_flac_decode_error (fi);
 }
 #else /* !FS_DECODE */
 
@@ -357,8 +938,15 @@ fs_flac_enc_write_callback(const FLAC__StreamEncoder *encoder,
   debug_printf(1, "bytes: %d, samples: %d", bytes, samples);
 
   if (fsound->callback.encoded) {
-    FishSoundEncoded encoded = (FishSoundEncoded) fsound->callback.encoded;
-    if (fi->packetno == 0 && fi->header <= 1) {
+    if (fi->native) {
+      /* A native stream is the bytes written by libFLAC, as they are */
+      if (samples > 0) {
+        fi->frames_out += samples;
+        fsound->frameno += samples;
+      }
+      fish_sound_dispatch_encoded (fsound, (unsigned char *)buffer,
+				   (long)bytes);
+    } else if (fi->packetno == 0 && fi->header <= 1) {
       if (fi->header == 0) {
         /* libFLAC has called us with data containing the normal fLaC header
          * and a STREAMINFO block. Prepend the FLAC Ogg mapping header,
@@ -398,13 +986,14 @@ fs_flac_enc_write_callback(const FLAC__StreamEncoder *encoder,
 	fi->buffer = tmp;
 	fi->bufferlength += bytes;
 	fi->header++;
-	encoded (fsound, (unsigned char *)fi->buffer, (long)fi->bufferlength,
-		 fsound->user_data);
+	fish_sound_dispatch_encoded (fsound, (unsigned char *)fi->buffer,
+				     (long)fi->bufferlength);
       }
     } else {
+      fi->frames_out += samples;
       fsound->frameno += samples;
-      encoded (fsound, (unsigned char *)buffer, (long)bytes,
-	       fsound->user_data);
+      fish_sound_dispatch_encoded (fsound, (unsigned char *)buffer,
+				   (long)bytes);
     }
   }
 
@@ -441,129 +1030,70 @@ fs_flac_enc_meta_callback(const FLAC__StreamEncoder *encoder,
 /* Create a local alias for an unwieldy type name */
 typedef FLAC__StreamMetadata_VorbisComment_Entry FLAC__VCEntry;
 
-static void
-fs_flac_metadata_free (FLAC__StreamMetadata * metadata)
-{
-  unsigned int i, length;
-  FLAC__VCEntry * comments;
-
-  if (metadata == NULL) return;
-
-  length = metadata->data.vorbis_comment.num_comments;
-  comments = metadata->data.vorbis_comment.comments;
-
-  for (i = 0; i < length; i++) {
-    fs_free (comments[i].entry);
-  }
-
-  fs_free (comments);
-  fs_free (metadata);
-
-  return;
-}
-
-static FLAC__byte *
-fs_flac_encode_vcentry (const FishSoundComment * comment)
+/* Read a little-endian 32 bit length from a vorbiscomment packet */
+static FLAC__uint32
+fs_flac_read_length (const unsigned char * buf)
 {
-  FLAC__byte * entry;
-  FLAC__uint32 length;
-  size_t name_len=0, value_len=0;
-
-  name_len = strlen(comment->name);
-  length = name_len + 1;
-
-  if (comment->value) {
-    value_len = strlen (comment->value);
-    length += value_len + 1;
-  }
-
-  if ((entry = fs_malloc (length)) == NULL)
-    return NULL;
-
-  /* We assume that comment->name, value are NUL terminated, as they were
-   * produced by our own comments.c */
-  strcpy ((char *)entry, comment->name);
-
-  if (comment->value) {
-    entry[name_len] = '=';
-    strcpy ((char *)&entry[name_len+1], comment->value);
-  }
-
-  entry[length-1] = '\0';
-
-  return entry;
+  return ((FLAC__uint32)buf[3] << 24) | ((FLAC__uint32)buf[2] << 16) |
+    ((FLAC__uint32)buf[1] << 8) | (FLAC__uint32)buf[0];
 }
 
+/*
+ * Build the VORBIS_COMMENT metadata block from the vorbiscomment packet
+ * cached by comments.c. The block is a single allocation holding the
+ * metadata, its entries, and a copy of the comment fields they point to,
+ * so it is released with fs_free().
+ */
 static FLAC__StreamMetadata *
 fs_flac_encode_vorbiscomments (FishSound * fsound)
 {
   FishSoundFlacInfo * fi = fsound->codec_data;
-  FLAC__StreamMetadata * metadata = NULL;
-  const FishSoundComment * comment;
-  unsigned int length=0, total_length;
-  int i=0;
+  FLAC__StreamMetadata * metadata;
   FLAC__VCEntry * comments;
+  const unsigned char * packet;
+  unsigned char * c;
+  long length, fields_length;
+  FLAC__uint32 vendor_length, i, num_comments;
 
-  /* libFLAC seems to require us to know the total length of the generated
-   * vorbiscomment packet, even though it will silently generate the
-   * vendor string. Hence, this value was determined by inspection for
-   * the version "reference libFLAC 1.1.2"
-   */
-  total_length = 40;
+  if ((packet = fish_sound_comments_packet (fsound, &length)) == NULL)
+    return NULL;
 
-  /* Count the number of comments */
-  for (comment = fish_sound_comment_first (fsound); comment;
-       comment = fish_sound_comment_next (fsound, comment)) {
-    length++;
-  }
+  /* The packet is [vendor_length] vendor [num_comments] fields framing */
+  vendor_length = fs_flac_read_length (packet);
+  num_comments = fs_flac_read_length (packet + 4 + vendor_length);
+  if (num_comments == 0) return NULL;
 
-  if (length == 0) return NULL;
+  fields_length = length - 8 - (long)vendor_length - 1;
 
-  if ((comments = (FLAC__VCEntry *)fs_malloc (sizeof(FLAC__VCEntry) * length)) == NULL)
-    goto encode_vc_oom;
-  
-  for (comment = fish_sound_comment_first (fsound); comment;
-       comment = fish_sound_comment_next (fsound, comment)) {
-    if ((comments[i].entry = fs_flac_encode_vcentry (comment)) == NULL) {
-    }
-    comments[i].length = strlen((char *)comments[i].entry);
+  metadata = fs_malloc (sizeof (*metadata) +
+			num_comments * sizeof (FLAC__VCEntry) +
+			(size_t)fields_length);
+  if (metadata == NULL) return NULL;
 
-    /* In the generated vorbiscomment data, each entry is preceded by a
-     * 32bit length specifier. */
-    total_length += 4 + comments[i].length;
-    i++;
-  }
+  comments = (FLAC__VCEntry *)(metadata + 1);
+  c = (unsigned char *)(comments + num_comments);
+  memcpy (c, packet + 8 + vendor_length, (size_t)fields_length);
 
-  if ((metadata = (FLAC__StreamMetadata *) fs_malloc (sizeof (*metadata))) == NULL)
-    goto encode_vc_oom;
+  for (i = 0; i < num_comments; i++) {
+    comments[i].length = fs_flac_read_length (c);
+    comments[i].entry = c + 4;
+    c += 4 + comments[i].length;
+  }
 
   metadata->type = FLAC__METADATA_TYPE_VORBIS_COMMENT;
   metadata->is_last = true;
-  metadata->length = total_length;
-  /* Don't bother setting the vendor_string, as libFLAC ignores it */
+  /* libFLAC writes its own vendor string, adjusting the block length by
+   * the difference from vendor_string.length */
+  metadata->length = 8 + fields_length;
   metadata->data.vorbis_comment.vendor_string.length = 0;
-  metadata->data.vorbis_comment.num_comments = length;
+  metadata->data.vorbis_comment.vendor_string.entry = NULL;
+  metadata->data.vorbis_comment.num_comments = num_comments;
   metadata->data.vorbis_comment.comments = comments;
 
   /* Remember the allocated metadata */
   fi->enc_vc_metadata = metadata;
 
   return metadata;
-
-encode_vc_oom:
-  if (metadata != NULL)
-    fs_free (metadata);
-
-  /* Unwind allocated comment entries */
-  for (i--; i >= 0; i--) {
-    if (comments[i].entry != NULL)
-      fs_free (comments[i].entry);
-  }
-
-  if (comments != NULL)
-    fs_free (comments);
-
-  return NULL;
 }
 
 static FishSound *
@@ -605,6 +1135,9 @@ fs_flac_enc_headers (FishSound * fsound)
 
 #endif
 
+  /* libFLAC writes the metadata blocks while initializing the encoder */
+  fish_sound_trace_event (fsound, FS_TRACE_HEADERS, 0);
+
   return fsound;
 }
 
@@ -616,35 +1149,15 @@ fs_flac_encode_fatal (FishSoundFlacInfo *fi, long err)
   return err;
 }
 
+/*
+ * Pass a block of converted audio in fi->ipcm to libFLAC.
+ */
 static long
-fs_flac_encode_f (FishSound * fsound, float * pcm[], long frames)
+fs_flac_encode_block (FishSound * fsound, long frames)
 {
   FishSoundFlacInfo *fi = fsound->codec_data;
-  FLAC__int32 *buffer, *ipcm;
-  float * p, norm = (1 << (BITS_PER_SAMPLE - 1));
-  long i;
-  int j, channels = fsound->info.channels;
-
-  debug_printf("IN, frames = %ld", frames);
-
-  if ((ipcm = realloc(fi->ipcm, sizeof(FLAC__int32) * channels * frames)) == NULL)
-    return FISH_SOUND_ERR_OUT_OF_MEMORY;
-
-  fi->ipcm = ipcm;
-  buffer = (FLAC__int32*) fi->ipcm;
-  for (i = 0; i < frames; i++) {
-    for (j = 0; j < channels; j++) {
-      p = pcm[j];
-      buffer[i*channels + j] = (FLAC__int32) (p[i] * norm);
-    }
-  }
 
-  if (fi->packetno == 0)
-    fs_flac_enc_headers (fsound);
-
-  /* We could have used FLAC__stream_encoder_process() and a more direct
-   * conversion loop above, rather than converting and interleaving. */
-  if (FLAC__stream_encoder_process_interleaved(fi->fse, buffer, frames) == false) {
+  if (FLAC__stream_encoder_process_interleaved(fi->fse, (FLAC__int32 *)fi->ipcm, frames) == false) {
     switch (FLAC__stream_encoder_get_state (fi->fse)) {
     case FLAC__STREAM_ENCODER_OK:
     case FLAC__STREAM_ENCODER_UNINITIALIZED:
@@ -656,6 +1169,52 @@ fs_flac_encode_f (FishSound * fsound, float * pcm[], long frames)
     }
   }
 
+  fi->frames_in += frames;
+
+  return frames;
+}
+
+/*
+ * Audio is converted to FLAC__int32 and passed to libFLAC in blocks of at
+ * most FS_FLAC_ENCODE_BLOCK frames, so that the conversion buffer has a
+ * fixed size regardless of the number of frames passed in.
+ */
+static long
+fs_flac_encode_f (FishSound * fsound, float * pcm[], long frames)
+{
+  FishSoundFlacInfo *fi = fsound->codec_data;
+  FLAC__int32 *buffer;
+  float norm = (1 << (BITS_PER_SAMPLE - 1));
+  long n, offset, ret;
+
+  debug_printf(1, "IN, frames = %ld", frames);
+
+  if (fs_flac_alloc_pcm (fsound, FS_FLAC_ENCODE_BLOCK) != 0)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  if (fi->packetno == 0)
+    fs_flac_enc_headers (fsound);
+
+  FS_PROBE3 (codec__encode, fsound, FISH_SOUND_FLAC, frames);
+
+  fs_realtime_begin (fsound);
+
+  buffer = (FLAC__int32*) fi->ipcm;
+  for (offset = 0; offset < frames; offset += n) {
+    n = MIN (FS_FLAC_ENCODE_BLOCK, frames - offset);
+    _fs_interleave_to_s32 (pcm, offset, buffer, n, fsound->info.channels,
+			   norm);
+
+    /* We could have used FLAC__stream_encoder_process() and a more direct
+     * conversion loop above, rather than converting and interleaving. */
+    if ((ret = fs_flac_encode_block (fsound, n)) < 0) {
+      fs_realtime_end (fsound);
+      return ret;
+    }
+  }
+
+  fs_realtime_end (fsound);
+
   fi->packetno++;
 
   return frames;
@@ -665,35 +1224,37 @@ static long
 fs_flac_encode_f_ilv (FishSound * fsound, float ** pcm, long frames)
 {
   FishSoundFlacInfo *fi = fsound->codec_data;
-  FLAC__int32 *buffer, *ipcm;
+  FLAC__int32 *buffer;
   float * p = (float*)pcm, norm = (1 << (BITS_PER_SAMPLE - 1));
-  long i, length = frames * fsound->info.channels;
+  long n, offset, length, ret;
 
   debug_printf(1, "IN, frames = %ld", frames);
 
-  if ((ipcm = realloc(fi->ipcm, sizeof(FLAC__int32)*fsound->info.channels*frames)) == NULL)
+  if (fs_flac_alloc_pcm (fsound, FS_FLAC_ENCODE_BLOCK) != 0)
     return FISH_SOUND_ERR_OUT_OF_MEMORY;
 
-  fi->ipcm = ipcm;
-  buffer = (FLAC__int32*) fi->ipcm;
-  for (i=0; i<length; i++)
-    buffer[i] = p[i] * norm;
-
   if (fi->packetno == 0)
     fs_flac_enc_headers (fsound);
 
-  if (FLAC__stream_encoder_process_interleaved(fi->fse, buffer, frames) == false) {
-    switch (FLAC__stream_encoder_get_state (fi->fse)) {
-    case FLAC__STREAM_ENCODER_OK:
-    case FLAC__STREAM_ENCODER_UNINITIALIZED:
-      break;
-    case FLAC__STREAM_ENCODER_MEMORY_ALLOCATION_ERROR:
-      return fs_flac_encode_fatal (fi, FISH_SOUND_ERR_OUT_OF_MEMORY);
-    default:
-      return fs_flac_encode_fatal (fi, FISH_SOUND_ERR_GENERIC);
+  FS_PROBE3 (codec__encode, fsound, FISH_SOUND_FLAC, frames);
+
+  fs_realtime_begin (fsound);
+
+  buffer = (FLAC__int32*) fi->ipcm;
+  for (offset = 0; offset < frames; offset += n) {
+    n = MIN (FS_FLAC_ENCODE_BLOCK, frames - offset);
+    length = n * fsound->info.channels;
+    _fs_convert_to_s32 (p, buffer, length, norm);
+    p += length;
+
+    if ((ret = fs_flac_encode_block (fsound, n)) < 0) {
+      fs_realtime_end (fsound);
+      return ret;
     }
   }
 
+  fs_realtime_end (fsound);
+
   fi->packetno++;
 
   return frames;
@@ -717,6 +1278,11 @@ fs_flac_delete (FishSound * fsound)
       FLAC__stream_decoder_finish(fi->fsd);
       FLAC__stream_decoder_delete(fi->fsd);
     }
+    /* Metadata buffered for libFLAC, if the headers were incomplete */
+    if (fi->buffer) fs_free (fi->buffer);
+#if FS_DECODE
+    if (fi->carry) fs_free (fi->carry);
+#endif
   } else if (fsound->mode == FISH_SOUND_ENCODE) {
     if (fi->fse) {
       FLAC__stream_encoder_finish(fi->fse);
@@ -735,7 +1301,7 @@ fs_flac_delete (FishSound * fsound)
   
 #if FS_ENCODE
   if (fi->enc_vc_metadata) {
-    fs_flac_metadata_free (fi->enc_vc_metadata);
+    fs_free (fi->enc_vc_metadata);
   }
 #endif
 
@@ -768,16 +1334,29 @@ static long
 fs_flac_flush (FishSound * fsound)
 {
   FishSoundFlacInfo * fi = (FishSoundFlacInfo *)fsound->codec_data;
+  long ret = 0;
+
+  debug_printf(1, "IN (%s)", fsound->mode == FISH_SOUND_DECODE ? "decode" : "encode");
 
-  debug_printf("IN (%s)", fsound->mode == FISH_SOUND_DECODE ? "decode" : "encode");
+  FS_PROBE2 (codec__flush, fsound, FISH_SOUND_FLAC);
 
   if (fsound->mode == FISH_SOUND_DECODE) {
-    FLAC__stream_decoder_finish(fi->fsd);
+#if FS_DECODE
+    /* The last frame of a native stream has no frame following it */
+    if (fi->native && fi->stage == FS_FLAC_NATIVE_AUDIO &&
+        fi->carry_length > 0) {
+      ret = fs_flac_decode_frame (fsound, fi->carry, fi->carry_length);
+      fi->carry_length = 0;
+      fi->scan = 0;
+      if (ret != 0) ret = fs_flac_decode_error (fi);
+    }
+#endif
+    if (fi->fsd) FLAC__stream_decoder_finish(fi->fsd);
   } else if (fsound->mode == FISH_SOUND_ENCODE) {
     FLAC__stream_encoder_finish(fi->fse);
   }
 
-  return 0;
+  return ret;
 }
 
 static FishSound *
@@ -794,14 +1373,29 @@ fs_flac_init (FishSound * fsound)
   fi->packetno = 0;
   fi->header = 0;
   fi->header_packets = 0;
+  fi->native = (fsound->codec->format.format == FISH_SOUND_FLAC_NATIVE);
 
   fi->ipcm = NULL;
+  fi->max_pcm = 0;
+  fi->max_blocksize = 0;
   for (i = 0; i < 8; i++) {
     fi->pcm_out[i] = NULL;
   }
 
+#if FS_DECODE
+  fi->max_framesize = 0;
+  fi->stage = FS_FLAC_NATIVE_MARKER;
+  fi->skip = 0;
+  fi->carry = NULL;
+  fi->carry_length = 0;
+  fi->carry_size = 0;
+  fi->scan = 0;
+#endif
+
 #if FS_ENCODE
   fi->enc_vc_metadata = NULL;
+  fi->frames_in = 0;
+  fi->frames_out = 0;
 #endif
 
   fsound->codec_data = fi;
@@ -809,29 +1403,39 @@ fs_flac_init (FishSound * fsound)
   return fsound;
 }
 
-FishSoundCodec *
+static const FishSoundCodec fs_flac_codec = {
+  {FISH_SOUND_FLAC, "Flac (Xiph.Org)", "ogg"},
+  FISH_SOUND_CODEC_DECODE | FISH_SOUND_CODEC_ENCODE,
+  "\177FLAC", 5,
+  fish_sound_flac_identify,
+  fs_flac_init, fs_flac_delete, fs_flac_reset, fs_flac_update,
+  fs_flac_command, fs_flac_decode,
+  fs_flac_encode_f_ilv, fs_flac_encode_f,
+  fs_flac_flush
+};
+
+/* A native stream uses the same codec, without the Ogg FLAC mapping */
+static const FishSoundCodec fs_flac_native_codec = {
+  {FISH_SOUND_FLAC_NATIVE, "Flac (Xiph.Org), native", "flac"},
+  FISH_SOUND_CODEC_DECODE | FISH_SOUND_CODEC_ENCODE,
+  "fLaC", 4,
+  fs_flac_native_identify,
+  fs_flac_init, fs_flac_delete, fs_flac_reset, fs_flac_update,
+  fs_flac_command, fs_flac_decode,
+  fs_flac_encode_f_ilv, fs_flac_encode_f,
+  fs_flac_flush
+};
+
+const FishSoundCodec *
 fish_sound_flac_codec (void)
 {
-  FishSoundCodec * codec;
-
-  codec = (FishSoundCodec *) fs_malloc (sizeof (FishSoundCodec));
-  if (codec == NULL) return NULL;
-
-  codec->format.format = FISH_SOUND_FLAC;
-  codec->format.name = "Flac (Xiph.Org)";
-  codec->format.extension = "ogg";
-
-  codec->init = fs_flac_init;
-  codec->del = fs_flac_delete;
-  codec->reset = fs_flac_reset;
-  codec->update = fs_flac_update;
-  codec->command = fs_flac_command;
-  codec->decode = fs_flac_decode;
-  codec->encode_f = fs_flac_encode_f;
-  codec->encode_f_ilv = fs_flac_encode_f_ilv;
-  codec->flush = fs_flac_flush;
+  return &fs_flac_codec;
+}
 
-  return codec;
+const FishSoundCodec *
+fish_sound_flac_native_codec (void)
+{
+  return &fs_flac_native_codec;
 }
 
 #else /* !HAVE_FLAC */
@@ -842,10 +1446,16 @@ fish_sound_flac_identify (unsigned char * buf, long bytes)
   return FISH_SOUND_UNKNOWN;
 }
 
-FishSoundCodec *
+const FishSoundCodec *
 fish_sound_flac_codec (void)
 {
   return NULL;
 }
 
+const FishSoundCodec *
+fish_sound_flac_native_codec (void)
+{
+  return NULL;
+}
+
 #endif
@@ -0,0 +1,147 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __FS_ATOMIC_H__
+#define __FS_ATOMIC_H__
+
+/*
+ * Loads and stores of size_t values shared between threads, with acquire
+ * and release ordering respectively; counters, which are updated
+ * atomically but impose no ordering; and reference counts.
+ *
+ * Builds without threads, on compilers providing neither, use plain
+ * operations: asynchronous encoding and parallel decoding are not built
+ * for them, and a PCM ring must be used from a single thread.
+ */
+
+#include <stddef.h>
+
+#include "fs_compat.h"
+
+#if defined (__clang__) || \
+  (defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+
+#define fs_atomic_load(p) __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define fs_atomic_store(p,v) __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+
+/* Add to or subtract from a counter, returning its new value */
+#define fs_atomic_add(p,v) __atomic_add_fetch ((p), (v), __ATOMIC_RELAXED)
+#define fs_atomic_sub(p,v) __atomic_sub_fetch ((p), (v), __ATOMIC_RELAXED)
+
+/* Drop a reference, returning the number remaining. The thread dropping
+ * the last reference sees all writes made before the others were dropped */
+#define fs_atomic_unref(p) __atomic_sub_fetch ((p), 1, __ATOMIC_ACQ_REL)
+
+/* Raise a counter to at least v */
+static inline void
+fs_atomic_max (size_t * p, size_t v)
+{
+  size_t cur = __atomic_load_n (p, __ATOMIC_RELAXED);
+
+  while (cur < v &&
+	 !__atomic_compare_exchange_n (p, &cur, v, 1, __ATOMIC_RELAXED,
+				       __ATOMIC_RELAXED));
+}
+
+#elif defined (_WIN32) && !defined (__SYMBIAN32__)
+
+#include <windows.h>
+
+static inline size_t
+fs_atomic_load (size_t * p)
+{
+  size_t v = *(volatile size_t *)p;
+  MemoryBarrier ();
+  return v;
+}
+
+static inline void
+fs_atomic_store (size_t * p, size_t v)
+{
+  MemoryBarrier ();
+  *(volatile size_t *)p = v;
+}
+
+static inline size_t
+fs_atomic_add (size_t * p, size_t v)
+{
+#ifdef _WIN64
+  return (size_t)InterlockedExchangeAdd64 ((LONG64 *)p, (LONG64)v) + v;
+#else
+  return (size_t)InterlockedExchangeAdd ((LONG *)p, (LONG)v) + v;
+#endif
+}
+
+static inline size_t
+fs_atomic_sub (size_t * p, size_t v)
+{
+  return fs_atomic_add (p, (size_t)0 - v);
+}
+
+/* Interlocked operations are full barriers */
+#define fs_atomic_unref(p) fs_atomic_sub ((p), 1)
+
+static inline void
+fs_atomic_max (size_t * p, size_t v)
+{
+  size_t cur = *(volatile size_t *)p;
+
+  while (cur < v) {
+    void * prev = InterlockedCompareExchangePointer ((PVOID *)p, (PVOID)v,
+						     (PVOID)cur);
+    if ((size_t)prev == cur) break;
+    cur = (size_t)prev;
+  }
+}
+
+#elif !HAVE_PTHREAD
+
+#define fs_atomic_load(p) (*(p))
+#define fs_atomic_store(p,v) (*(p) = (v))
+#define fs_atomic_add(p,v) (*(p) += (v))
+#define fs_atomic_sub(p,v) (*(p) -= (v))
+#define fs_atomic_unref(p) (--*(p))
+
+static inline void
+fs_atomic_max (size_t * p, size_t v)
+{
+  if (*p < v) *p = v;
+}
+
+#else
+#error "No atomic operations available for a threaded build"
+#endif
+
+/* Cache line size, for separating data written by different threads */
+#define FS_CACHELINE 64
+
+#endif /* __FS_ATOMIC_H__ */
@@ -43,15 +43,36 @@
 #endif /* ! __SYMBIAN32__ */
 #endif
 
+/* Thread-local storage */
+#if defined (_WIN32) && !defined (__SYMBIAN32__)
+#define FS_THREAD_LOCAL __declspec(thread)
+#elif defined (__GNUC__)
+#define FS_THREAD_LOCAL __thread
+#elif !HAVE_PTHREAD
+#define FS_THREAD_LOCAL
+#else
+#error "No thread-local storage available for a threaded build"
+#endif
+
 /* malloc/realloc/free macros */
+#include <stddef.h>
+
+/* Allocators which count allocations in the statistics of the FishSound*
+ * handle being processed by the calling thread, and account the memory
+ * to that handle until it is freed. Memory from these must be released
+ * with fs_free, and never passed to free() or to a codec library. */
+void * fs_stats_malloc (size_t size);
+void * fs_stats_realloc (void * ptr, size_t size);
+void fs_stats_free (void * ptr);
+
 #ifndef fs_malloc
-#define fs_malloc malloc
+#define fs_malloc fs_stats_malloc
 #endif
 
 #ifndef fs_realloc
-#define fs_realloc realloc
+#define fs_realloc fs_stats_realloc
 #endif
 
 #ifndef fs_free
-#define fs_free free
+#define fs_free fs_stats_free
 #endif
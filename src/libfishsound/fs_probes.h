@@ -0,0 +1,89 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __FS_PROBES_H__
+#define __FS_PROBES_H__
+
+/*
+ * USDT static tracepoints, for use with perf, bpftrace, SystemTap or
+ * DTrace on a running process. A probe is a single nop instruction until
+ * a tracer attaches to it. The provider name is "libfishsound", eg.
+ *
+ *   perf probe -x libfishsound.so sdt_libfishsound:decode__return
+ *   bpftrace -e 'usdt:libfishsound.so:libfishsound:decode__return
+ *                { @frames = sum(arg3); }'
+ *
+ * Probes and their arguments:
+ *
+ *   new (fsound, mode, format)             handle created
+ *   delete (fsound)                        handle being deleted
+ *   command (fsound, command, format)      fish_sound_command() called
+ *   decode__entry (fsound, format, bytes)  fish_sound_decode() of a packet
+ *   decode__return (fsound, format, ret, frames)
+ *                                          frames delivered by that call
+ *   encode__entry (fsound, format, frames) encode or flush of some frames
+ *   encode__return (fsound, format, ret, bytes)
+ *                                          bytes of packets produced
+ *   flush (fsound, format)                 fish_sound_flush() called
+ *   codec__decode (fsound, format, bytes, frames)
+ *                                          a codec decoded a block of frames
+ *                                          from a packet of some bytes
+ *   codec__encode (fsound, format, frames) a codec was given frames
+ *   codec__flush (fsound, format)          a codec is flushing
+ *
+ * When encoding asynchronously, the encode and codec probes fire in the
+ * encoder thread.
+ */
+
+#if FS_SDT
+
+#include <sys/sdt.h>
+
+#define FS_PROBE1(name,a) \
+  DTRACE_PROBE1 (libfishsound, name, a)
+#define FS_PROBE2(name,a,b) \
+  DTRACE_PROBE2 (libfishsound, name, a, b)
+#define FS_PROBE3(name,a,b,c) \
+  DTRACE_PROBE3 (libfishsound, name, a, b, c)
+#define FS_PROBE4(name,a,b,c,d) \
+  DTRACE_PROBE4 (libfishsound, name, a, b, c, d)
+
+#else
+
+#define FS_PROBE1(name,a) ((void)0)
+#define FS_PROBE2(name,a,b) ((void)0)
+#define FS_PROBE3(name,a,b,c) ((void)0)
+#define FS_PROBE4(name,a,b,c,d) ((void)0)
+
+#endif /* FS_SDT */
+
+#endif /* __FS_PROBES_H__ */
@@ -0,0 +1,184 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fs_compat.h"
+#include "fs_atomic.h"
+
+#undef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+typedef struct _FishSoundRing FishSoundRing;
+
+/*
+ * The indices written by the producer and the consumer are padded onto
+ * separate cache lines, away from the read-only fields, so that the two
+ * threads do not contend for the same line.
+ */
+struct _FishSoundRing {
+  size_t elem_size;
+  size_t mask;
+  unsigned char * data;
+  char pad[FS_CACHELINE];
+
+  /* Written by the producer only */
+  size_t head;
+  char pad_head[FS_CACHELINE - sizeof (size_t)];
+
+  /* Written by the consumer only */
+  size_t tail;
+  char pad_tail[FS_CACHELINE - sizeof (size_t)];
+};
+
+FishSoundRing *
+fs_ring_new (size_t elem_size, size_t nelems)
+{
+  FishSoundRing * ring;
+  size_t n = 1;
+
+  if (elem_size == 0 || nelems == 0) return NULL;
+
+  while (n < nelems) {
+    if (n > ((size_t)-1) / 2) return NULL;
+    n *= 2;
+  }
+
+  if (n > ((size_t)-1) / elem_size) return NULL;
+
+  ring = fs_malloc (sizeof (FishSoundRing));
+  if (ring == NULL) return NULL;
+
+  ring->data = fs_malloc (elem_size * n);
+  if (ring->data == NULL) {
+    fs_free (ring);
+    return NULL;
+  }
+
+  ring->elem_size = elem_size;
+  ring->mask = n - 1;
+  ring->head = 0;
+  ring->tail = 0;
+
+  return ring;
+}
+
+void
+fs_ring_delete (FishSoundRing * ring)
+{
+  if (ring == NULL) return;
+
+  fs_free (ring->data);
+  fs_free (ring);
+}
+
+void *
+fs_ring_write_ptr (FishSoundRing * ring)
+{
+  size_t head = ring->head;
+
+  if (head - fs_atomic_load (&ring->tail) > ring->mask) return NULL;
+
+  return ring->data + (head & ring->mask) * ring->elem_size;
+}
+
+void
+fs_ring_write_commit (FishSoundRing * ring)
+{
+  fs_atomic_store (&ring->head, ring->head + 1);
+}
+
+void *
+fs_ring_read_ptr (FishSoundRing * ring)
+{
+  size_t tail = ring->tail;
+
+  if (fs_atomic_load (&ring->head) == tail) return NULL;
+
+  return ring->data + (tail & ring->mask) * ring->elem_size;
+}
+
+void
+fs_ring_read_commit (FishSoundRing * ring)
+{
+  fs_atomic_store (&ring->tail, ring->tail + 1);
+}
+
+size_t
+fs_ring_write_contig (FishSoundRing * ring, void ** ptr)
+{
+  size_t head = ring->head, offset = head & ring->mask;
+  size_t space = ring->mask + 1 - (head - fs_atomic_load (&ring->tail));
+
+  *ptr = ring->data + offset * ring->elem_size;
+
+  return MIN (space, ring->mask + 1 - offset);
+}
+
+void
+fs_ring_write_advance (FishSoundRing * ring, size_t n)
+{
+  fs_atomic_store (&ring->head, ring->head + n);
+}
+
+size_t
+fs_ring_read_contig (FishSoundRing * ring, void ** ptr)
+{
+  size_t tail = ring->tail, offset = tail & ring->mask;
+  size_t count = fs_atomic_load (&ring->head) - tail;
+
+  *ptr = ring->data + offset * ring->elem_size;
+
+  return MIN (count, ring->mask + 1 - offset);
+}
+
+void
+fs_ring_read_advance (FishSoundRing * ring, size_t n)
+{
+  fs_atomic_store (&ring->tail, ring->tail + n);
+}
+
+size_t
+fs_ring_count (FishSoundRing * ring)
+{
+  return fs_atomic_load (&ring->head) - fs_atomic_load (&ring->tail);
+}
+
+size_t
+fs_ring_capacity (FishSoundRing * ring)
+{
+  return ring->mask + 1;
+}
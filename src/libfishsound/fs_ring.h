@@ -0,0 +1,128 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __FS_RING_H__
+#define __FS_RING_H__
+
+#include <stddef.h>
+
+/*
+ * A bounded single-producer, single-consumer ring of fixed size elements.
+ * The producer and consumer may run in different threads without locking;
+ * no memory is allocated after fs_ring_new().
+ */
+
+typedef void FishSoundRing;
+
+/**
+ * Create a new ring.
+ * \param elem_size The size in bytes of each element
+ * \param nelems The minimum number of elements the ring can hold. This is
+ * rounded up to a power of two.
+ * \retval NULL on failure (out of memory, or invalid size)
+ */
+FishSoundRing *
+fs_ring_new (size_t elem_size, size_t nelems);
+
+void
+fs_ring_delete (FishSoundRing * ring);
+
+/**
+ * Get the next free element for writing. Only the producer may call this.
+ * \retval NULL if the ring is full
+ */
+void *
+fs_ring_write_ptr (FishSoundRing * ring);
+
+/**
+ * Make the element returned by fs_ring_write_ptr() available to the reader.
+ */
+void
+fs_ring_write_commit (FishSoundRing * ring);
+
+/**
+ * Get the oldest unread element. Only the consumer may call this.
+ * \retval NULL if the ring is empty
+ */
+void *
+fs_ring_read_ptr (FishSoundRing * ring);
+
+/**
+ * Release the element returned by fs_ring_read_ptr() for reuse.
+ */
+void
+fs_ring_read_commit (FishSoundRing * ring);
+
+/**
+ * Get the contiguous free elements at the write position, for writing
+ * several elements at once. Only the producer may call this.
+ * \param ptr Returns the first free element
+ * \returns The number of contiguous free elements
+ */
+size_t
+fs_ring_write_contig (FishSoundRing * ring, void ** ptr);
+
+/**
+ * Make \a n elements written after fs_ring_write_contig() available to
+ * the reader.
+ */
+void
+fs_ring_write_advance (FishSoundRing * ring, size_t n);
+
+/**
+ * Get the contiguous unread elements at the read position, for reading
+ * several elements at once. Only the consumer may call this.
+ * \param ptr Returns the first unread element
+ * \returns The number of contiguous unread elements
+ */
+size_t
+fs_ring_read_contig (FishSoundRing * ring, void ** ptr);
+
+/**
+ * Release \a n elements read after fs_ring_read_contig() for reuse.
+ */
+void
+fs_ring_read_advance (FishSoundRing * ring, size_t n);
+
+/**
+ * The number of elements currently in the ring.
+ */
+size_t
+fs_ring_count (FishSoundRing * ring);
+
+/**
+ * The maximum number of elements the ring can hold.
+ */
+size_t
+fs_ring_capacity (FishSoundRing * ring);
+
+#endif /* __FS_RING_H__ */
@@ -102,6 +102,18 @@ fs_vector_nth (FishSoundVector * vector, int n)
   return vector->data[n];
 }
 
+void *
+fs_vector_set_nth (FishSoundVector * vector, int n, void * data)
+{
+  if (vector == NULL) return NULL;
+
+  if (n < 0 || n >= vector->nr_elements) return NULL;
+
+  vector->data[n] = data;
+
+  return vector;
+}
+
 int
 fs_vector_find_index (FishSoundVector * vector, const void * data)
 {
@@ -235,3 +247,43 @@ fs_vector_remove (FishSoundVector * vector, void * data)
 
   return vector;
 }
+
+FishSoundVector *
+fs_vector_compact (FishSoundVector * vector)
+{
+  int i, j;
+  void * new_elements;
+  int new_max_elements;
+
+  if (vector == NULL) return NULL;
+
+  for (i = 0, j = 0; i < vector->nr_elements; i++) {
+    if (vector->data[i] != NULL)
+      vector->data[j++] = vector->data[i];
+  }
+
+  vector->nr_elements = j;
+
+  if (vector->nr_elements == 0) {
+    fs_vector_clear (vector);
+    return vector;
+  }
+
+  new_max_elements = vector->max_elements;
+  while (vector->nr_elements < new_max_elements/2)
+    new_max_elements /= 2;
+
+  if (new_max_elements < vector->max_elements) {
+    new_elements =
+      fs_realloc (vector->data, (size_t)new_max_elements * sizeof (void *));
+
+    /* The old, larger allocation is still valid */
+    if (new_elements == NULL)
+      return vector;
+
+    vector->max_elements = new_max_elements;
+    vector->data = new_elements;
+  }
+
+  return vector;
+}
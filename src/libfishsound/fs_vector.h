@@ -47,6 +47,15 @@ fs_vector_delete (FishSoundVector * vector);
 void *
 fs_vector_nth (FishSoundVector * vector, int n);
 
+/**
+ * Replace the nth element of a vector. Setting an element to NULL leaves
+ * a tombstone, to be removed by fs_vector_compact().
+ * \retval \a vector on success
+ * \retval NULL \a n is out of range
+ */
+void *
+fs_vector_set_nth (FishSoundVector * vector, int n, void * data);
+
 int
 fs_vector_find_index (FishSoundVector * vector, const void * data);
 
@@ -77,4 +86,12 @@ fs_vector_insert (FishSoundVector * vector, void * data);
 FishSoundVector *
 fs_vector_remove (FishSoundVector * vector, void * data);
 
+/**
+ * Remove all NULL elements of a vector in a single pass, preserving
+ * the order of the remaining elements.
+ * \retval \a vector
+ */
+FishSoundVector *
+fs_vector_compact (FishSoundVector * vector);
+
 #endif /* __FS_VECTOR_H__ */
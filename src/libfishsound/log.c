@@ -0,0 +1,141 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include "private.h"
+
+#define FS_LOG_MAXLINE 1024
+
+int fs_log_level = FISH_SOUND_LOG_ERROR;
+
+static const char * level_names[] = {
+  "none", "error", "warning", "info", "debug", "verbose"
+};
+
+int
+fish_sound_set_log (FishSound * fsound, FishSoundLog log, int max_per_second,
+		    void * user_data)
+{
+  if (fsound == NULL) return FISH_SOUND_ERR_BAD;
+
+  if (max_per_second < 0) return FISH_SOUND_ERR_INVALID;
+
+  /* The encoder thread may be logging */
+  if (fsound->async)
+    fish_sound_async_sync (fsound);
+
+  fsound->log.callback = log;
+  fsound->log.user_data = user_data;
+  fsound->log.max_per_second = max_per_second;
+  fsound->log.count = 0;
+  fsound->log.window = 0.0;
+
+  return 0;
+}
+
+int
+fish_sound_set_log_level (int level)
+{
+  int previous = fs_log_level;
+
+  if (level < FISH_SOUND_LOG_NONE || level > FISH_SOUND_LOG_VERBOSE)
+    return FISH_SOUND_ERR_INVALID;
+
+  fs_log_level = level;
+
+  return previous;
+}
+
+int
+fish_sound_get_log_level (void)
+{
+  return fs_log_level;
+}
+
+void
+fish_sound_log (FishSound * fsound, int level, int error,
+		const char * fmt, ...)
+{
+  char message[FS_LOG_MAXLINE];
+  va_list ap;
+  double now;
+
+  /* Drop messages over the limit before doing any work to format them */
+  if (fsound->log.max_per_second > 0) {
+    now = fish_sound_stats_now ();
+    if (now - fsound->log.window >= 1.0) {
+      fsound->log.window = now;
+      fsound->log.count = 0;
+    }
+
+    if (fsound->log.count >= fsound->log.max_per_second) {
+      fsound->stats.log_suppressed++;
+      return;
+    }
+
+    fsound->log.count++;
+  }
+
+  va_start (ap, fmt);
+  vsnprintf (message, FS_LOG_MAXLINE, fmt, ap);
+  va_end (ap);
+
+  if (fsound->log.callback) {
+    fsound->log.callback (fsound, level, error, message,
+			  fsound->log.user_data);
+  } else {
+    fprintf (stderr, "libfishsound: %s: %s\n", level_names[level], message);
+  }
+}
+
+void
+fish_sound_log_debug (const char * func, int line, const char * fmt, ...)
+{
+  char message[FS_LOG_MAXLINE];
+  va_list ap;
+  int errno_save = errno;
+
+  va_start (ap, fmt);
+  vsnprintf (message, FS_LOG_MAXLINE, fmt, ap);
+  va_end (ap);
+
+  fflush (stdout); /* in case stdout and stderr are the same */
+  fprintf (stderr, "%s():%d: %s\n", func, line, message);
+
+  errno = errno_save;
+}
@@ -0,0 +1,414 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * parallel.c
+ *
+ * Decoding of a complete stream using several threads.
+ *
+ * The audio packets of the stream are split into contiguous ranges, and
+ * each range is decoded by its own decoder. Each decoder is first fed the
+ * stream's header packets, then enough "preroll" packets preceding its
+ * range to bring it into the same state as a sequential decoder would be
+ * in at that point. PCM produced by the preroll packets is discarded.
+ *
+ * For Vorbis, a single preroll packet suffices: the PCM output for a packet
+ * is the overlap of its block with that of the previous packet only. FLAC
+ * frames are independent, so no preroll is required. Speex decoder state
+ * depends on the entire history of the stream, so a Speex stream cannot be
+ * split without changing the output, and is always decoded sequentially.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "private.h"
+
+#include "debug.h"
+
+/* Number of frames per call when delivering buffered PCM */
+#define FS_PARALLEL_BLOCK 4096
+
+/* Minimum number of audio packets in each range */
+#define FS_PARALLEL_MIN_PACKETS 64
+
+#if FS_DECODE
+
+typedef struct _FishSoundRange FishSoundRange;
+
+struct _FishSoundRange {
+  FishSoundPacket * packets;
+  long nheaders; /* packets [0, nheaders) are stream headers */
+  long preroll;  /* packets [preroll, start) are decoded and discarded */
+  long start;    /* packets [start, end) are decoded and kept */
+  long end;
+
+  FishSound * fsound;
+  int discard;
+
+  /* Buffered interleaved PCM output of this range */
+  float * pcm;
+  long frames;
+  long max_frames;
+
+  long err;
+
+  /* The caller's callback, for a range decoded directly to it, and the
+   * FISH_SOUND_STOP_* value it returned, if any */
+  FishSoundDecoded_FloatIlv decoded;
+  void * user_data;
+  int stop;
+
+#if HAVE_PTHREAD
+  int started;
+  pthread_t thread;
+#endif
+};
+
+#if HAVE_PTHREAD
+
+/*
+ * Number of packets preceding a range which must be decoded to reproduce
+ * the state of a sequential decoder, or -1 if that is not possible.
+ */
+static int
+fs_parallel_preroll (int format)
+{
+  switch (format) {
+  case FISH_SOUND_VORBIS:
+    return 1;
+  case FISH_SOUND_FLAC:
+  case FISH_SOUND_PCM:
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+static long
+fs_parallel_header_packets (int format, FishSoundPacket * first)
+{
+  switch (format) {
+  case FISH_SOUND_VORBIS:
+    /* identification, comment and setup headers */
+    return 3;
+  case FISH_SOUND_FLAC:
+    /* The Ogg FLAC mapping header gives the number of following
+     * metadata packets as a 16 bit big-endian value at offset 7 */
+    if (first->bytes < 9) return -1;
+    return 1 + ((first->packet[7] << 8) | first->packet[8]);
+  case FISH_SOUND_PCM:
+    /* The Ogg PCM header and comments are followed by the number of extra
+     * headers given as a 32 bit big-endian value at offset 24 */
+    if (first->bytes < 28) return -1;
+    return 2 + (long)fs_read_be32 (&first->packet[24]);
+  default:
+    return -1;
+  }
+}
+
+#endif /* HAVE_PTHREAD */
+
+static int
+fs_range_collect (FishSound * fsound, float ** pcm, long frames,
+                  void * user_data)
+{
+  FishSoundRange * range = (FishSoundRange *)user_data;
+  int channels = fsound->info.channels;
+  float * new_pcm;
+  long new_max;
+
+  if (range->discard) return FISH_SOUND_CONTINUE;
+
+  if (range->frames + frames > range->max_frames) {
+    new_max = range->max_frames ? range->max_frames * 2 : FS_PARALLEL_BLOCK;
+    while (new_max < range->frames + frames) new_max *= 2;
+
+    new_pcm = fs_realloc (range->pcm,
+                          sizeof (float) * (size_t)new_max * channels);
+    if (new_pcm == NULL) {
+      range->err = FISH_SOUND_ERR_OUT_OF_MEMORY;
+      return FISH_SOUND_STOP_ERR;
+    }
+
+    range->pcm = new_pcm;
+    range->max_frames = new_max;
+  }
+
+  memcpy (range->pcm + range->frames * channels, pcm,
+          sizeof (float) * frames * channels);
+  range->frames += frames;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+/*
+ * Pass PCM of the first range to the caller, remembering if it asks to
+ * stop: the codecs do not act on the callback's return value.
+ */
+static int
+fs_range_direct (FishSound * fsound, float ** pcm, long frames,
+                 void * user_data)
+{
+  FishSoundRange * range = (FishSoundRange *)user_data;
+  int ret;
+
+  if (range->stop != FISH_SOUND_CONTINUE) return range->stop;
+
+  ret = range->decoded (fsound, pcm, frames, range->user_data);
+  if (ret != FISH_SOUND_CONTINUE) range->stop = ret;
+
+  return ret;
+}
+
+static void
+fs_range_decode_packet (FishSoundRange * range, long i)
+{
+  FishSoundPacket * p = &range->packets[i];
+
+  fish_sound_prepare_truncation (range->fsound, p->granulepos, p->eos);
+  fish_sound_decode (range->fsound, p->packet, p->bytes);
+}
+
+static void *
+fs_range_decode (void * data)
+{
+  FishSoundRange * range = (FishSoundRange *)data;
+  long i;
+
+  for (i = 0; i < range->nheaders; i++)
+    fs_range_decode_packet (range, i);
+
+  range->discard = 1;
+  for (i = range->preroll; i < range->start; i++)
+    fs_range_decode_packet (range, i);
+
+  range->discard = 0;
+  for (i = range->start; i < range->end && range->err == 0 &&
+         range->stop == FISH_SOUND_CONTINUE; i++)
+    fs_range_decode_packet (range, i);
+
+  return NULL;
+}
+
+static long
+fs_range_deliver (FishSoundRange * range, long frameno,
+                  FishSoundDecoded_FloatIlv decoded, void * user_data)
+{
+  int channels = range->fsound->info.channels;
+  long offset, frames;
+  int ret;
+
+  for (offset = 0; offset < range->frames; offset += frames) {
+    frames = MIN (FS_PARALLEL_BLOCK, range->frames - offset);
+    range->fsound->frameno = frameno + offset + frames;
+    ret = decoded (range->fsound, (float **)(range->pcm + offset * channels),
+                   frames, user_data);
+    if (ret != FISH_SOUND_CONTINUE) {
+      range->stop = ret;
+      return -1;
+    }
+  }
+
+  return range->frames;
+}
+
+#endif /* FS_DECODE */
+
+long
+fish_sound_decode_parallel (FishSoundPacket * packets, long npackets,
+                            int nthreads, FishSoundDecoded_FloatIlv decoded,
+                            void * user_data)
+{
+#if FS_DECODE
+  FishSoundRange * ranges;
+  long nheaders = 0, i, r, nranges = 1;
+  long total_bytes = 0, accum_bytes = 0, frameno = 0, ret = 0, n;
+  int format, preroll = -1, stopped = 0;
+
+  if (packets == NULL || decoded == NULL) return FISH_SOUND_ERR_BAD;
+
+  if (npackets <= 0) return 0;
+
+  format = fish_sound_identify (packets[0].packet, packets[0].bytes);
+  if (format < 0) return format;
+  if (format == FISH_SOUND_UNKNOWN) return FISH_SOUND_ERR_INVALID;
+
+#if HAVE_PTHREAD
+  preroll = fs_parallel_preroll (format);
+  if (preroll >= 0)
+    nheaders = fs_parallel_header_packets (format, &packets[0]);
+
+  if (nheaders <= 0 || nheaders >= npackets) {
+    /* Unable to locate the audio packets; decode sequentially */
+    nheaders = 0;
+  } else if (nthreads > 1) {
+    nranges = MIN ((long)nthreads,
+                   (npackets - nheaders) / FS_PARALLEL_MIN_PACKETS);
+    if (nranges < 1) nranges = 1;
+  }
+#endif
+
+  debug_printf (1, "decoding %ld packets in %ld ranges", npackets, nranges);
+
+  ranges = fs_malloc (sizeof (FishSoundRange) * nranges);
+  if (ranges == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  /* Split the audio packets into ranges of roughly equal byte size */
+  for (i = nheaders; i < npackets; i++)
+    total_bytes += packets[i].bytes;
+
+  i = nheaders;
+  for (r = 0; r < nranges; r++) {
+    ranges[r].packets = packets;
+    ranges[r].nheaders = (r == 0) ? 0 : nheaders;
+    ranges[r].start = (r == 0) ? 0 : i;
+    ranges[r].preroll = MAX (nheaders, ranges[r].start - preroll);
+
+    if (r == nranges - 1) {
+      i = npackets;
+    } else {
+      while (i < npackets - 1 &&
+             accum_bytes < total_bytes / nranges * (r + 1)) {
+        accum_bytes += packets[i].bytes;
+        i++;
+      }
+      /* Start the next range after a packet carrying a granulepos (ie. at
+       * an Ogg page boundary), so that its preroll establishes the stream
+       * position required for end-of-stream truncation */
+      while (i < npackets - 1 && packets[i-1].granulepos == -1) {
+        accum_bytes += packets[i].bytes;
+        i++;
+      }
+    }
+    ranges[r].end = i;
+
+    ranges[r].discard = 0;
+    ranges[r].pcm = NULL;
+    ranges[r].frames = 0;
+    ranges[r].max_frames = 0;
+    ranges[r].err = 0;
+    ranges[r].decoded = decoded;
+    ranges[r].user_data = user_data;
+    ranges[r].stop = FISH_SOUND_CONTINUE;
+
+    ranges[r].fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+    if (ranges[r].fsound == NULL) {
+      ret = FISH_SOUND_ERR_OUT_OF_MEMORY;
+      nranges = r;
+      goto cleanup;
+    }
+    fish_sound_set_interleave (ranges[r].fsound, 1);
+
+    /* The first range is decoded in this thread, and its PCM is passed
+     * directly to the caller. All other ranges are buffered. */
+    if (r == 0) {
+      fish_sound_set_decoded_float_ilv (ranges[r].fsound, fs_range_direct,
+                                        &ranges[r]);
+    } else {
+      fish_sound_set_decoded_float_ilv (ranges[r].fsound, fs_range_collect,
+                                        &ranges[r]);
+    }
+
+#if HAVE_PTHREAD
+    ranges[r].started = 0;
+    if (r > 0 && pthread_create (&ranges[r].thread, NULL, fs_range_decode,
+                                 &ranges[r]) == 0) {
+      ranges[r].started = 1;
+    }
+#endif
+  }
+
+  fs_range_decode (&ranges[0]);
+  frameno = fish_sound_get_frameno (ranges[0].fsound);
+
+  /* Honour a request to stop from the first range, as for later ranges,
+   * without delivering any of their PCM */
+  if (ranges[0].stop != FISH_SOUND_CONTINUE) {
+    stopped = 1;
+    if (ranges[0].stop == FISH_SOUND_STOP_ERR) ret = FISH_SOUND_STOP_ERR;
+  }
+
+  for (r = 1; r < nranges; r++) {
+#if HAVE_PTHREAD
+    if (ranges[r].started) {
+      pthread_join (ranges[r].thread, NULL);
+      ranges[r].started = 0;
+    } else
+#endif
+    {
+      /* Unable to start a thread for this range */
+      fs_range_decode (&ranges[r]);
+    }
+
+    if (!stopped && ranges[r].err != 0) {
+      ret = ranges[r].err;
+      stopped = 1;
+    }
+
+    if (!stopped) {
+      n = fs_range_deliver (&ranges[r], frameno, decoded, user_data);
+      if (n < 0) {
+        stopped = 1;
+        if (ranges[r].stop == FISH_SOUND_STOP_ERR)
+          ret = FISH_SOUND_STOP_ERR;
+      } else {
+        frameno += n;
+      }
+    }
+  }
+
+  if (ret == 0) ret = frameno;
+
+ cleanup:
+  for (r = 0; r < nranges; r++) {
+#if HAVE_PTHREAD
+    if (ranges[r].started) pthread_join (ranges[r].thread, NULL);
+#endif
+    /* The PCM was allocated in a callback of the range's handle, and is
+     * accounted to it, so free it first */
+    if (ranges[r].pcm) fs_free (ranges[r].pcm);
+    fish_sound_delete (ranges[r].fsound);
+  }
+  fs_free (ranges);
+
+  return ret;
+#else
+  return FISH_SOUND_ERR_DISABLED;
+#endif
+}
@@ -0,0 +1,656 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Uncompressed PCM, in the Ogg PCM mapping documented in:
+ * http://wiki.xiph.org/OggPCM
+ *
+ * A stream consists of a header giving the sample format, a comment
+ * packet, any extra header packets, then packets of interleaved samples.
+ * Audio already in the layout FishSound uses, 32 bit float in native byte
+ * order, is passed between the caller and the packets without copying.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "private.h"
+
+#include "debug.h"
+
+#define FS_PCM_HEADER_BYTES 28
+
+/* Maximum number of frames per encoded packet, and per decoded callback
+ * when audio is converted */
+#define FS_PCM_BLOCK 4096
+
+#define FS_PCM_VENDOR "libfishsound " VERSION
+
+/* The FishSoundPCMFormats differ only in their lowest bit between little-
+ * and big-endian versions */
+#define FS_PCM_BIG_ENDIAN(format) ((format) & 1)
+
+#if WORDS_BIGENDIAN
+#define FS_PCM_NATIVE_BIG_ENDIAN 1
+#define FS_PCM_FLOAT32_NATIVE FISH_SOUND_PCM_FLOAT32_BE
+#else
+#define FS_PCM_NATIVE_BIG_ENDIAN 0
+#define FS_PCM_FLOAT32_NATIVE FISH_SOUND_PCM_FLOAT32_LE
+#endif
+
+/* Whether packet data can be read in place as floats */
+#if HAVE_UINTPTR_T
+#define FS_PCM_FLOAT_ALIGNED(p) (((uintptr_t)(p) % sizeof (float)) == 0)
+#else
+#define FS_PCM_FLOAT_ALIGNED(p) 0
+#endif
+
+typedef struct _FishSoundPCMInfo {
+  unsigned long packetno;
+  int format;
+  int sample_bytes;
+  unsigned long extra_headers;
+  long max_frames; /* frames held by pcm (decode only) */
+  float * ipcm; /* interleaved pcm, output (decode only) */
+  float ** pcm; /* non-interleaved pcm in ipcm, output (decode only) */
+  unsigned char * packet; /* converted audio, output (encode only) */
+} FishSoundPCMInfo;
+
+static int
+fs_pcm_sample_bytes (unsigned long format)
+{
+  switch (format) {
+  case FISH_SOUND_PCM_S16_LE:
+  case FISH_SOUND_PCM_S16_BE:
+    return 2;
+  case FISH_SOUND_PCM_S24_LE:
+  case FISH_SOUND_PCM_S24_BE:
+    return 3;
+  case FISH_SOUND_PCM_S32_LE:
+  case FISH_SOUND_PCM_S32_BE:
+  case FISH_SOUND_PCM_FLOAT32_LE:
+  case FISH_SOUND_PCM_FLOAT32_BE:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+int
+fish_sound_pcm_identify (unsigned char * buf, long bytes)
+{
+  unsigned long samplerate;
+
+  if (bytes < 8) return FISH_SOUND_UNKNOWN;
+
+  if (memcmp (buf, "PCM     ", 8)) return FISH_SOUND_UNKNOWN;
+
+  /* if only a short buffer was passed, do a weak identify */
+  if (bytes == 8) return FISH_SOUND_PCM;
+
+  /* otherwise, check the header: a major version of 0, a supported sample
+   * format, and a non-zero sample rate and number of channels */
+  if (bytes < FS_PCM_HEADER_BYTES) return FISH_SOUND_UNKNOWN;
+
+  if (buf[8] != 0 || buf[9] != 0) return FISH_SOUND_UNKNOWN;
+
+  if (fs_pcm_sample_bytes (fs_read_be32 (&buf[12])) == 0)
+    return FISH_SOUND_UNKNOWN;
+
+  samplerate = fs_read_be32 (&buf[16]);
+  if (samplerate == 0 || samplerate > 0x7fffffffUL)
+    return FISH_SOUND_UNKNOWN;
+
+  if (buf[21] == 0) return FISH_SOUND_UNKNOWN;
+
+  return FISH_SOUND_PCM;
+}
+
+static int
+fs_pcm_command (FishSound * fsound, int command, void * data, int datasize)
+{
+  FishSoundPCMInfo * fp = (FishSoundPCMInfo *)fsound->codec_data;
+  int * pi = (int *)data;
+
+  switch (command) {
+  case FISH_SOUND_GET_PCM_FORMAT:
+    if (data == NULL || datasize < (int)sizeof (int))
+      return FISH_SOUND_ERR_INVALID;
+    /* Not known until the header has been decoded */
+    if (fp->format == 0) return FISH_SOUND_ERR_INVALID;
+    *pi = fp->format;
+    break;
+  case FISH_SOUND_SET_PCM_FORMAT:
+    if (data == NULL || datasize < (int)sizeof (int))
+      return FISH_SOUND_ERR_INVALID;
+    /* The format is written in the header, before the first audio */
+    if (fsound->mode != FISH_SOUND_ENCODE || fp->packetno > 0)
+      return FISH_SOUND_ERR_INVALID;
+    if (fs_pcm_sample_bytes ((unsigned long)*pi) == 0)
+      return FISH_SOUND_ERR_INVALID;
+    fp->format = *pi;
+    fp->sample_bytes = fs_pcm_sample_bytes ((unsigned long)*pi);
+    break;
+  default:
+    break;
+  }
+
+  return 0;
+}
+
+#if FS_DECODE
+/* Read an unsigned integer of width bytes */
+static inline unsigned long
+fs_pcm_read (const unsigned char * s, int width, int big_endian)
+{
+  unsigned long u = 0;
+  int k;
+
+  if (big_endian) {
+    for (k = 0; k < width; k++) u = (u << 8) | s[k];
+  } else {
+    for (k = width; k > 0; k--) u = (u << 8) | s[k-1];
+  }
+
+  return u;
+}
+
+/*
+ * Convert n samples, at intervals of stride bytes from s, to float.
+ */
+static void
+fs_pcm_to_float (int format, const unsigned char * s, long stride,
+		 float * d, long n)
+{
+  int big_endian = FS_PCM_BIG_ENDIAN (format);
+  unsigned char b[4];
+  unsigned long u;
+  long i;
+
+  switch (format) {
+  case FISH_SOUND_PCM_S16_LE:
+  case FISH_SOUND_PCM_S16_BE:
+    for (i = 0; i < n; i++, s += stride) {
+      u = fs_pcm_read (s, 2, big_endian);
+      d[i] = (float)((long)(u ^ 0x8000UL) - 0x8000L) * (1.0f / 32768.0f);
+    }
+    break;
+  case FISH_SOUND_PCM_S24_LE:
+  case FISH_SOUND_PCM_S24_BE:
+    for (i = 0; i < n; i++, s += stride) {
+      u = fs_pcm_read (s, 3, big_endian);
+      d[i] = (float)((long)(u ^ 0x800000UL) - 0x800000L) *
+	(1.0f / 8388608.0f);
+    }
+    break;
+  case FISH_SOUND_PCM_S32_LE:
+  case FISH_SOUND_PCM_S32_BE:
+    for (i = 0; i < n; i++, s += stride) {
+      u = fs_pcm_read (s, 4, big_endian);
+      d[i] = (float)(((double)(u ^ 0x80000000UL) - 2147483648.0) *
+		     (1.0 / 2147483648.0));
+    }
+    break;
+  case FISH_SOUND_PCM_FLOAT32_LE:
+  case FISH_SOUND_PCM_FLOAT32_BE:
+    for (i = 0; i < n; i++, s += stride) {
+      if (big_endian == FS_PCM_NATIVE_BIG_ENDIAN) {
+	memcpy (&d[i], s, 4);
+      } else {
+	b[0] = s[3]; b[1] = s[2]; b[2] = s[1]; b[3] = s[0];
+	memcpy (&d[i], b, 4);
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static int
+fs_pcm_decode_header (FishSound * fsound, unsigned char * buf, long bytes)
+{
+  FishSoundPCMInfo * fp = (FishSoundPCMInfo *)fsound->codec_data;
+  int c, channels;
+  long max_frames;
+  void * pcm;
+
+  if (bytes < FS_PCM_HEADER_BYTES ||
+      fish_sound_pcm_identify (buf, bytes) != FISH_SOUND_PCM)
+    return FISH_SOUND_ERR_GENERIC;
+
+  fp->format = (int)fs_read_be32 (&buf[12]);
+  fp->sample_bytes = fs_pcm_sample_bytes (fp->format);
+  fp->extra_headers = fs_read_be32 (&buf[24]);
+
+  channels = buf[21];
+  fsound->info.samplerate = (int)fs_read_be32 (&buf[16]);
+  fsound->info.channels = channels;
+
+  debug_printf (1, "pcm: format 0x%02x, %d channels, %d Hz", fp->format,
+		channels, fsound->info.samplerate);
+
+  /* Converted audio is delivered in blocks no larger than the packets of
+   * the stream, if the header gives their maximum size */
+  max_frames = (buf[22] << 8) | buf[23];
+  if (max_frames == 0 || max_frames > FS_PCM_BLOCK)
+    max_frames = FS_PCM_BLOCK;
+
+  /* The output buffers are sized here, so that no allocation is needed
+   * while decoding audio: channel pointers, then the samples */
+  pcm = fs_malloc (channels * (sizeof (float *) +
+			       max_frames * sizeof (float)));
+  if (pcm == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  fp->pcm = (float **)pcm;
+  fp->ipcm = (float *)(fp->pcm + channels);
+  for (c = 0; c < channels; c++)
+    fp->pcm[c] = fp->ipcm + c * max_frames;
+  fp->max_frames = max_frames;
+
+  return 0;
+}
+
+static void
+fs_pcm_decode_audio (FishSound * fsound, unsigned char * buf, long bytes)
+{
+  FishSoundPCMInfo * fp = (FishSoundPCMInfo *)fsound->codec_data;
+  int c, channels = fsound->info.channels;
+  long frame_bytes = channels * fp->sample_bytes;
+  long frames = bytes / frame_bytes, offset, n;
+  unsigned char * s;
+  float * mono[1];
+
+  if (bytes % frame_bytes != 0)
+    fs_log (fsound, FISH_SOUND_LOG_WARNING, FISH_SOUND_ERR_GENERIC,
+	    "PCM decoder: packet %lu of %ld bytes is not a whole number of "
+	    "frames", fp->packetno, bytes);
+
+  if (frames == 0) return;
+
+  FS_PROBE4 (codec__decode, fsound, FISH_SOUND_PCM, bytes, frames);
+
+  if (fsound->callback.decoded_float == NULL) {
+    fsound->frameno += frames;
+    return;
+  }
+
+  /* Hand out the packet itself if it is already in the requested layout */
+  if (fp->format == FS_PCM_FLOAT32_NATIVE && FS_PCM_FLOAT_ALIGNED (buf)) {
+    if (fsound->interleave) {
+      fsound->frameno += frames;
+      fish_sound_dispatch_decoded_float_ilv (fsound, (float **)buf, frames);
+      return;
+    } else if (channels == 1) {
+      mono[0] = (float *)buf;
+      fsound->frameno += frames;
+      fish_sound_dispatch_decoded_float (fsound, mono, frames);
+      return;
+    }
+  }
+
+  for (offset = 0; offset < frames; offset += n) {
+    n = MIN (fp->max_frames, frames - offset);
+    s = buf + offset * frame_bytes;
+
+    if (fsound->interleave) {
+      fs_pcm_to_float (fp->format, s, fp->sample_bytes, fp->ipcm,
+		       n * channels);
+    } else {
+      for (c = 0; c < channels; c++)
+	fs_pcm_to_float (fp->format, s + c * fp->sample_bytes, frame_bytes,
+			 fp->pcm[c], n);
+    }
+
+    fsound->frameno += n;
+
+    if (fsound->interleave)
+      fish_sound_dispatch_decoded_float_ilv (fsound, (float **)fp->ipcm, n);
+    else
+      fish_sound_dispatch_decoded_float (fsound, fp->pcm, n);
+  }
+}
+
+static long
+fs_pcm_decode (FishSound * fsound, unsigned char * buf, long bytes)
+{
+  FishSoundPCMInfo * fp = (FishSoundPCMInfo *)fsound->codec_data;
+  int ret;
+
+  if (fp->packetno == 0) {
+    if ((ret = fs_pcm_decode_header (fsound, buf, bytes)) != 0)
+      return ret;
+  } else if (fp->packetno == 1) {
+    /* Comments */
+    if (fish_sound_comments_decode (fsound, buf, bytes) == FISH_SOUND_ERR_OUT_OF_MEMORY) {
+      fp->packetno++;
+      return FISH_SOUND_ERR_OUT_OF_MEMORY;
+    }
+  } else if (fp->packetno <= 1 + fp->extra_headers) {
+    /* Unknown extra headers */
+  } else {
+    fs_realtime_begin (fsound);
+    fs_pcm_decode_audio (fsound, buf, bytes);
+    fs_realtime_end (fsound);
+  }
+
+  if (fp->packetno == 1 + fp->extra_headers)
+    fish_sound_trace_event (fsound, FS_TRACE_HEADERS, 0);
+
+  fp->packetno++;
+
+  return 0;
+}
+#else /* !FS_DECODE */
+
+#define fs_pcm_decode NULL
+
+#endif
+
+
+#if FS_ENCODE
+/* Write an unsigned integer of width bytes */
+static inline void
+fs_pcm_write (unsigned char * d, unsigned long u, int width, int big_endian)
+{
+  int k;
+
+  if (big_endian) {
+    for (k = width; k > 0; k--, u >>= 8) d[k-1] = u & 0xff;
+  } else {
+    for (k = 0; k < width; k++, u >>= 8) d[k] = u & 0xff;
+  }
+}
+
+/* Scale a sample to the range [-scale, scale-1], clipping */
+static inline long
+fs_pcm_quantize (float x, double scale)
+{
+  double v = x * scale;
+
+  if (v >= scale - 1) return (long)(scale - 1);
+  if (v >= -scale) return (long)v;
+  return (long)-scale;
+}
+
+/*
+ * Convert n float samples from s, to intervals of stride bytes from d.
+ */
+static void
+fs_pcm_from_float (int format, const float * s, unsigned char * d,
+		   long stride, long n)
+{
+  int big_endian = FS_PCM_BIG_ENDIAN (format);
+  unsigned char b[4];
+  unsigned long u;
+  long i;
+
+  switch (format) {
+  case FISH_SOUND_PCM_S16_LE:
+  case FISH_SOUND_PCM_S16_BE:
+    for (i = 0; i < n; i++, d += stride) {
+      u = (unsigned long)fs_pcm_quantize (s[i], 32768.0);
+      fs_pcm_write (d, u, 2, big_endian);
+    }
+    break;
+  case FISH_SOUND_PCM_S24_LE:
+  case FISH_SOUND_PCM_S24_BE:
+    for (i = 0; i < n; i++, d += stride) {
+      u = (unsigned long)fs_pcm_quantize (s[i], 8388608.0);
+      fs_pcm_write (d, u, 3, big_endian);
+    }
+    break;
+  case FISH_SOUND_PCM_S32_LE:
+  case FISH_SOUND_PCM_S32_BE:
+    for (i = 0; i < n; i++, d += stride) {
+      u = (unsigned long)fs_pcm_quantize (s[i], 2147483648.0);
+      fs_pcm_write (d, u, 4, big_endian);
+    }
+    break;
+  case FISH_SOUND_PCM_FLOAT32_LE:
+  case FISH_SOUND_PCM_FLOAT32_BE:
+    for (i = 0; i < n; i++, d += stride) {
+      if (big_endian == FS_PCM_NATIVE_BIG_ENDIAN) {
+	memcpy (d, &s[i], 4);
+      } else {
+	memcpy (b, &s[i], 4);
+	d[0] = b[3]; d[1] = b[2]; d[2] = b[1]; d[3] = b[0];
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static void
+fs_pcm_encoded (FishSound * fsound, unsigned char * buf, long bytes,
+		long frames)
+{
+  FishSoundPCMInfo * fp = (FishSoundPCMInfo *)fsound->codec_data;
+
+  fsound->frameno += frames;
+
+  if (fsound->callback.encoded)
+    fish_sound_dispatch_encoded (fsound, buf, bytes);
+
+  fp->packetno++;
+}
+
+static int
+fs_pcm_enc_headers (FishSound * fsound)
+{
+  FishSoundPCMInfo * fp = (FishSoundPCMInfo *)fsound->codec_data;
+  unsigned char header[FS_PCM_HEADER_BYTES];
+  const unsigned char * comments;
+  long comments_bytes;
+  int channels = fsound->info.channels;
+
+  if (fish_sound_comment_set_vendor (fsound, FS_PCM_VENDOR) == FISH_SOUND_ERR_OUT_OF_MEMORY)
+    return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  comments = fish_sound_comments_packet (fsound, &comments_bytes);
+  if (comments == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  /* Audio passed through unconverted needs no buffer, unless it must be
+   * interleaved */
+  if (fp->format != FS_PCM_FLOAT32_NATIVE || channels > 1) {
+    fp->packet = fs_malloc (FS_PCM_BLOCK * channels * fp->sample_bytes);
+    if (fp->packet == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  }
+
+  memcpy (header, "PCM     ", 8);
+  fs_pcm_write (&header[8], 0, 2, 1);     /* Version major */
+  fs_pcm_write (&header[10], 0, 2, 1);    /* Version minor */
+  fs_pcm_write (&header[12], fp->format, 4, 1);
+  fs_pcm_write (&header[16], fsound->info.samplerate, 4, 1);
+  header[20] = fp->sample_bytes * 8;      /* Significant bits */
+  header[21] = channels;
+  fs_pcm_write (&header[22], FS_PCM_BLOCK, 2, 1); /* Max frames/packet */
+  fs_pcm_write (&header[24], 0, 4, 1);    /* Nr. extra header packets */
+
+  fs_pcm_encoded (fsound, header, FS_PCM_HEADER_BYTES, 0);
+  fs_pcm_encoded (fsound, (unsigned char *)comments, comments_bytes, 0);
+
+  fish_sound_trace_event (fsound, FS_TRACE_HEADERS, 0);
+
+  return 0;
+}
+
+static long
+fs_pcm_encode_f_ilv (FishSound * fsound, float ** pcm, long frames)
+{
+  FishSoundPCMInfo * fp = (FishSoundPCMInfo *)fsound->codec_data;
+  int channels = fsound->info.channels;
+  float * p = (float *)pcm;
+  long offset, n;
+  int ret;
+
+  if (fp->packetno == 0 && (ret = fs_pcm_enc_headers (fsound)) != 0)
+    return ret;
+
+  FS_PROBE3 (codec__encode, fsound, FISH_SOUND_PCM, frames);
+
+  fs_realtime_begin (fsound);
+
+  for (offset = 0; offset < frames; offset += n) {
+    n = MIN (FS_PCM_BLOCK, frames - offset);
+
+    if (fp->format == FS_PCM_FLOAT32_NATIVE) {
+      /* The caller's audio is already in the layout of a packet */
+      fs_pcm_encoded (fsound, (unsigned char *)(p + offset * channels),
+		      n * channels * (long)sizeof (float), n);
+    } else {
+      fs_pcm_from_float (fp->format, p + offset * channels, fp->packet,
+			 fp->sample_bytes, n * channels);
+      fs_pcm_encoded (fsound, fp->packet, n * channels * fp->sample_bytes, n);
+    }
+  }
+
+  fs_realtime_end (fsound);
+
+  return frames;
+}
+
+static long
+fs_pcm_encode_f (FishSound * fsound, float * pcm[], long frames)
+{
+  FishSoundPCMInfo * fp = (FishSoundPCMInfo *)fsound->codec_data;
+  int c, channels = fsound->info.channels;
+  long frame_bytes, offset, n;
+  int ret;
+
+  if (fp->packetno == 0 && (ret = fs_pcm_enc_headers (fsound)) != 0)
+    return ret;
+
+  FS_PROBE3 (codec__encode, fsound, FISH_SOUND_PCM, frames);
+
+  fs_realtime_begin (fsound);
+
+  frame_bytes = channels * fp->sample_bytes;
+
+  for (offset = 0; offset < frames; offset += n) {
+    n = MIN (FS_PCM_BLOCK, frames - offset);
+
+    if (fp->format == FS_PCM_FLOAT32_NATIVE && channels == 1) {
+      fs_pcm_encoded (fsound, (unsigned char *)(pcm[0] + offset),
+		      n * (long)sizeof (float), n);
+    } else {
+      for (c = 0; c < channels; c++)
+	fs_pcm_from_float (fp->format, pcm[c] + offset,
+			   fp->packet + c * fp->sample_bytes, frame_bytes, n);
+      fs_pcm_encoded (fsound, fp->packet, n * frame_bytes, n);
+    }
+  }
+
+  fs_realtime_end (fsound);
+
+  return frames;
+}
+#else /* !FS_ENCODE */
+
+#define fs_pcm_encode_f NULL
+#define fs_pcm_encode_f_ilv NULL
+
+#endif
+
+
+static FishSound *
+fs_pcm_delete (FishSound * fsound)
+{
+  FishSoundPCMInfo * fp = (FishSoundPCMInfo *)fsound->codec_data;
+
+  if (fp->pcm) fs_free (fp->pcm);
+  if (fp->packet) fs_free (fp->packet);
+
+  fs_free (fp);
+  fsound->codec_data = NULL;
+
+  return fsound;
+}
+
+static FishSound *
+fs_pcm_init (FishSound * fsound)
+{
+  FishSoundPCMInfo * fp;
+
+  /* The header has a single byte for the number of channels */
+  if (fsound->mode == FISH_SOUND_ENCODE &&
+      (fsound->info.channels < 1 || fsound->info.channels > 255 ||
+       fsound->info.samplerate < 1))
+    return NULL;
+
+  fp = fs_malloc (sizeof (FishSoundPCMInfo));
+  if (fp == NULL) return NULL;
+
+  fp->packetno = 0;
+  fp->format = 0;
+  fp->sample_bytes = 0;
+  fp->extra_headers = 0;
+  fp->max_frames = 0;
+  fp->ipcm = NULL;
+  fp->pcm = NULL;
+  fp->packet = NULL;
+
+  if (fsound->mode == FISH_SOUND_ENCODE) {
+    fp->format = FS_PCM_FLOAT32_NATIVE;
+    fp->sample_bytes = sizeof (float);
+  }
+
+  fsound->codec_data = fp;
+
+  return fsound;
+}
+
+static const FishSoundCodec fs_pcm_codec = {
+  {FISH_SOUND_PCM, "PCM (Ogg PCM mapping)", "oga"},
+  FISH_SOUND_CODEC_DECODE | FISH_SOUND_CODEC_ENCODE,
+  "PCM     ", 8,
+  fish_sound_pcm_identify,
+  fs_pcm_init, fs_pcm_delete, NULL, NULL,
+  fs_pcm_command, fs_pcm_decode,
+  fs_pcm_encode_f_ilv, fs_pcm_encode_f,
+  NULL
+};
+
+const FishSoundCodec *
+fish_sound_pcm_codec (void)
+{
+  return &fs_pcm_codec;
+}
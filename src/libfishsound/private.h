@@ -36,6 +36,8 @@
 #include <stdlib.h>
 
 #include "fs_compat.h"
+#include "debug.h"
+#include "fs_probes.h"
 #include "fs_vector.h"
 
 #include <fishsound/constants.h>
@@ -43,11 +45,29 @@
 #undef MIN
 #define MIN(a,b) (((a)<(b))?(a):(b))
 
+#undef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+/* Read an unsigned 32 bit little-endian integer from a byte buffer */
+#define fs_read_le32(p) ((unsigned long)(p)[0] |                   \
+			 ((unsigned long)(p)[1] << 8) |            \
+			 ((unsigned long)(p)[2] << 16) |           \
+			 ((unsigned long)(p)[3] << 24))
+
+/* Read an unsigned 32 bit big-endian integer from a byte buffer */
+#define fs_read_be32(p) (((unsigned long)(p)[0] << 24) |           \
+			 ((unsigned long)(p)[1] << 16) |           \
+			 ((unsigned long)(p)[2] << 8) |            \
+			 (unsigned long)(p)[3])
+
 typedef struct _FishSound FishSound;
 typedef struct _FishSoundInfo FishSoundInfo;
 typedef struct _FishSoundCodec FishSoundCodec;
 typedef struct _FishSoundFormat FishSoundFormat;
 typedef struct _FishSoundComment FishSoundComment;
+typedef struct _FishSoundCommentIter FishSoundCommentIter;
+typedef struct _FishSoundAsync FishSoundAsync;
+typedef struct _FishSoundPCMRing FishSoundPCMRing;
 
 typedef int         (*FSCodecIdentify) (unsigned char * buf, long bytes);
 typedef FishSound * (*FSCodecInit) (FishSound * fsound);
@@ -66,6 +86,10 @@ typedef long        (*FSCodecFlush) (FishSound * fsound);
 
 #include <fishsound/decode.h>
 #include <fishsound/encode.h>
+#include <fishsound/ring.h>
+#include <fishsound/stats.h>
+#include <fishsound/trace.h>
+#include <fishsound/log.h>
 
 struct _FishSoundFormat {
   int format;
@@ -73,8 +97,17 @@ struct _FishSoundFormat {
   const char * extension;
 };
 
+/* As declared in <fishsound/codec.h> */
+#define FISH_SOUND_CODEC_DECODE 0x01
+#define FISH_SOUND_CODEC_ENCODE 0x02
+#define FISH_SOUND_CODEC_SIGNATURE_MAX 8
+
 struct _FishSoundCodec {
   struct _FishSoundFormat format;
+  int flags;
+  const char * signature;
+  int signature_length;
+  FSCodecIdentify identify;
   FSCodecInit init;
   FSCodecDelete del;
   FSCodecReset reset;
@@ -97,6 +130,72 @@ struct _FishSoundComment {
   char * value;
 };
 
+struct _FishSoundCommentIter {
+  FishSound * fsound;
+  const char * name;
+  int index;
+};
+
+#define FISH_SOUND_COMMENT_CHUNK_SIZE 65536
+
+typedef int (*FishSoundCommentFilter) (FishSound * fsound, const char * name,
+				       long value_length, void * user_data);
+typedef int (*FishSoundCommentStream) (FishSound * fsound, const char * name,
+				       const unsigned char * data, long bytes,
+				       long offset, long value_length,
+				       void * user_data);
+
+/*
+ * A bucket of the comment name index, an open-addressed hash table keyed
+ * by case-folded comment name. Comments sharing a name are chained in
+ * vector order through FishSoundCommentIndex.next.
+ */
+typedef struct {
+  const char * name; /* name of the first comment in the chain, or NULL */
+  unsigned int hash;
+  int first;
+  int last;
+} FishSoundCommentBucket;
+
+/*
+ * A decoded comment packet, allocated as a single block: the struct,
+ * nr_comments FishSoundComments, then a copy of the fields they point to.
+ */
+typedef struct _FishSoundCommentArena FishSoundCommentArena;
+
+struct _FishSoundCommentArena {
+  FishSoundCommentArena * next; /* The next packet decoded */
+  FishSoundComment * comments;
+  int nr_comments;
+  int nr_parsed;                /* Comments split and indexed so far */
+  char * cursor;                /* The field of the next comment to parse */
+};
+
+typedef struct {
+  FishSoundCommentBucket * buckets;
+  int nr_buckets;    /* A power of two, or 0 */
+  int nr_names;
+  int * next;        /* Index of the next comment with the same name, or -1 */
+  int max_next;
+} FishSoundCommentIndex;
+
+/*
+ * An immutable set of comments shared by encoders, allocated as a single
+ * block: the struct, nr_comments FishSoundComments, the vorbiscomment
+ * packet following the vendor string, then the names and values. The
+ * vector and index are allocated separately and never modified once the
+ * set is built.
+ */
+typedef struct _FishSoundCommentSet FishSoundCommentSet;
+
+struct _FishSoundCommentSet {
+  size_t refcount;
+  FishSoundVector * comments;
+  FishSoundCommentIndex index;
+  unsigned char * fields;       /* Comment count, fields and framing bit */
+  long fields_length;
+};
+
 union FishSoundCallback {
   FishSoundDecoded_Float decoded_float;
   FishSoundDecoded_FloatIlv decoded_float_ilv;
@@ -113,6 +212,9 @@ struct _FishSound {
   /** Interleave boolean */
   int interleave;
 
+  /** Real-time mode boolean: no allocation after the stream headers */
+  int realtime;
+
   /**
    * Current frameno.
    */
@@ -134,7 +236,7 @@ struct _FishSound {
   int next_eos;
 
   /** The codec class structure */
-  FishSoundCodec * codec;
+  const FishSoundCodec * codec;
 
   /** codec specific data */
   void * codec_data;
@@ -148,20 +250,209 @@ struct _FishSound {
   /** The comments */
   char * vendor;
   FishSoundVector * comments;
+
+  /** Index of the comment last returned by fish_sound_comment_*() */
+  int comment_cursor;
+
+  /** Index of comments by name */
+  FishSoundCommentIndex comment_index;
+
+  /** Shared comments, or NULL. While set, comments and comment_index
+   * are borrowed from it and copied before any modification */
+  FishSoundCommentSet * comment_set;
+
+  /** Storage of decoded comments */
+  FishSoundCommentArena * comment_arenas;
+
+  /** Set if decoded comments are not yet parsed */
+  int comments_pending;
+
+  /** Defer parsing decoded comments until they are accessed */
+  int comments_lazy;
+
+  /** Selection of decoded comments, from fish_sound_comment_set_filter() */
+  struct {
+    long max_value_length;
+    FishSoundCommentFilter filter;
+    FishSoundCommentStream stream;
+    void * user_data;
+  } comment_filter;
+
+  /** Cached vorbiscomment packet, or NULL if not yet built */
+  unsigned char * comment_packet;
+  long comment_packet_length;
+
+  /** Asynchronous encode state, or NULL if encoding synchronously */
+  FishSoundAsync * async;
+
+  /** Statistics, as returned by FISH_SOUND_GET_STATS */
+  FishSoundStats stats;
+
+  /** Memory accounting, as returned by FISH_SOUND_GET_MEMORY */
+  struct {
+    long bytes;
+    long peak_bytes;
+    long blocks;
+  } memory;
+
+  /** Trace hooks, or NULL if tracing is disabled */
+  FishSoundTraceHooks * trace;
+
+  /** Log callback and rate limit, set with fish_sound_set_log() */
+  struct {
+    FishSoundLog callback;
+    void * user_data;
+    int max_per_second;
+    int count; /* messages logged since window */
+    double window; /* start of the current second */
+  } log;
 };
 
 int fish_sound_identify (unsigned char * buf, long bytes);
 int fish_sound_set_format (FishSound * fsound, int format);  
 
-/* Format specific interfaces */
+/* handle management, as declared in <fishsound/fishsound.h> */
+FishSound * fish_sound_new (int mode, FishSoundInfo * fsinfo);
+FishSound * fish_sound_delete (FishSound * fsound);
+int fish_sound_set_interleave (FishSound * fsound, int interleave);
+long fish_sound_get_frameno (FishSound * fsound);
+int fish_sound_prepare_truncation (FishSound * fsound, long next_granulepos,
+				   int next_eos);
+
+/* codec registry, as declared in <fishsound/codec.h> */
+int fish_sound_codec_register (const FishSoundCodec * codec, int priority);
+int fish_sound_codec_unregister (int format);
+int fish_sound_codec_set_priority (int format, int priority);
+void * fish_sound_codec_get_data (FishSound * fsound);
+int fish_sound_codec_set_data (FishSound * fsound, void * data);
+int fish_sound_codec_set_info (FishSound * fsound, int samplerate,
+			       int channels);
+int fish_sound_codec_decoded (FishSound * fsound, float ** pcm, long frames);
+int fish_sound_codec_encoded (FishSound * fsound, unsigned char * buf,
+			      long bytes, long frameno);
+
+/**
+ * Find the registered codec for a format.
+ * \param format The format
+ * \param flags The FISH_SOUND_CODEC_* capabilities required
+ * \returns The codec, or NULL if none is registered with \a flags
+ */
+const FishSoundCodec * fish_sound_codec_lookup (int format, int flags);
+
+/* Format specific interfaces: the built-in codecs, or NULL if disabled */
 int fish_sound_vorbis_identify (unsigned char * buf, long bytes);
-FishSoundCodec * fish_sound_vorbis_codec (void);
+const FishSoundCodec * fish_sound_vorbis_codec (void);
 
 int fish_sound_speex_identify (unsigned char * buf, long bytes);
-FishSoundCodec * fish_sound_speex_codec (void);
+const FishSoundCodec * fish_sound_speex_codec (void);
 
 int fish_sound_flac_identify (unsigned char * buf, long bytes);
-FishSoundCodec * fish_sound_flac_codec (void);
+const FishSoundCodec * fish_sound_flac_codec (void);
+const FishSoundCodec * fish_sound_flac_native_codec (void);
+
+int fish_sound_pcm_identify (unsigned char * buf, long bytes);
+const FishSoundCodec * fish_sound_pcm_codec (void);
+
+/* real-time mode: mark code paths in which no allocation may occur */
+#if FS_REALTIME_CHECKS
+void fs_realtime_begin (FishSound * fsound);
+void fs_realtime_end (FishSound * fsound);
+int fs_realtime_suspend (void);
+void fs_realtime_resume (int depth);
+void fs_realtime_check (const char * func);
+#else
+#define fs_realtime_begin(fsound) ((void)0)
+#define fs_realtime_end(fsound) ((void)0)
+#define fs_realtime_suspend() (0)
+#define fs_realtime_resume(depth) ((void)(depth))
+#endif
+
+/* statistics */
+typedef struct {
+  FishSound * outer;         /* handle being counted before this call */
+  FishSound * outer_owner;   /* owner of allocations before this call */
+  double start;              /* time at start of call */
+  double callback_seconds;   /* callback time at start of call */
+  long frames;               /* frames count at start of call */
+  long bytes_out;            /* bytes_out count at start of call */
+} FishSoundStatsCall;
+
+double fish_sound_stats_now (void);
+void fish_sound_stats_begin (FishSound * fsound, FishSoundStatsCall * call,
+			     long size);
+long fish_sound_stats_end (FishSound * fsound, FishSoundStatsCall * call,
+			   long ret);
+int fish_sound_stats_command (FishSound * fsound, int command, void * data,
+			      int datasize);
+int fish_sound_dispatch_decoded_float (FishSound * fsound, float * pcm[],
+				       long frames);
+int fish_sound_dispatch_decoded_float_ilv (FishSound * fsound, float ** pcm,
+					   long frames);
+int fish_sound_dispatch_encoded (FishSound * fsound, unsigned char * buf,
+				 long bytes);
+
+/* memory accounting: allocations made by this thread are accounted to
+ * the handle passed to fish_sound_memory_enter(), or to no handle if it
+ * is NULL, until the previous owner is restored by
+ * fish_sound_memory_leave() */
+FishSound * fish_sound_memory_enter (FishSound * fsound);
+void fish_sound_memory_leave (FishSound * outer);
+void fish_sound_memory_adopt (FishSound * fsound, void * ptr);
+
+/* tracing */
+typedef enum {
+  FS_TRACE_DECODE_BEGIN,
+  FS_TRACE_DECODE_END,
+  FS_TRACE_ENCODE_BEGIN,
+  FS_TRACE_ENCODE_END,
+  FS_TRACE_CALLBACK_BEGIN,
+  FS_TRACE_CALLBACK_END,
+  FS_TRACE_HEADERS,
+  FS_TRACE_ERROR
+} FishSoundTraceEvent;
+
+void fish_sound_trace (FishSound * fsound, FishSoundTraceEvent event,
+		       double timestamp, long value);
+
+/* Call a trace hook if any are installed, taking a timestamp only if so */
+#define fish_sound_trace_event(fsound,event,value)                      \
+  do {                                                                  \
+    if ((fsound)->trace != NULL)                                        \
+      fish_sound_trace ((fsound), (event), fish_sound_stats_now (),     \
+                        (value));                                       \
+  } while (0)
+
+/* logging */
+void fish_sound_log (FishSound * fsound, int level, int error,
+		     const char * fmt, ...) FS_PRINTF_FORMAT (4, 5);
+
+/* Count an error or warning in the statistics, and log it if the log level
+ * allows; the arguments are not evaluated otherwise */
+#define fs_log(fsound,level,error,...)                                  \
+  do {                                                                  \
+    if ((level) == FISH_SOUND_LOG_ERROR)                                \
+      (fsound)->stats.log_errors++;                                     \
+    else if ((level) == FISH_SOUND_LOG_WARNING)                         \
+      (fsound)->stats.log_warnings++;                                   \
+    if ((level) <= fs_log_level)                                        \
+      fish_sound_log ((fsound), (level), (error), __VA_ARGS__);         \
+  } while (0)
+
+/* encoding */
+long fish_sound_encode_direct (FishSound * fsound, float ** pcm, long frames,
+			       int interleave);
+
+/* asynchronous encoding */
+int fish_sound_async_command (FishSound * fsound, int command, void * data,
+			      int datasize);
+int fish_sound_async_stop (FishSound * fsound);
+int fish_sound_async_sync (FishSound * fsound);
+long fish_sound_async_encode (FishSound * fsound, float ** pcm, long frames,
+			      int interleave);
+long fish_sound_async_flush (FishSound * fsound);
+int fish_sound_async_prepare_truncation (FishSound * fsound,
+					 long next_granulepos, int next_eos);
+long fish_sound_async_get_frameno (FishSound * fsound);
 
 /* comments */
 int fish_sound_comments_init (FishSound * fsound);
@@ -171,6 +462,18 @@ int fish_sound_comments_decode (FishSound * fsound, unsigned char * buf,
 long fish_sound_comments_encode (FishSound * fsound, unsigned char * buf,
 				 long length);
 
+/**
+ * Retrieve the vorbiscomment packet for the comments and vendor string of
+ * an encoder, including the framing bit. The packet is built with its
+ * exact length and cached until the comments or vendor string change.
+ * \param fsound A FishSound* handle
+ * \param length Returns the length of the packet in bytes
+ * \returns The packet, owned by \a fsound
+ * \retval NULL Out of memory
+ */
+const unsigned char *
+fish_sound_comments_packet (FishSound * fsound, long * length);
+
 /**
  * Set the vendor string.
  * \param fsound A FishSound* handle (created with FISH_SOUND_ENCODE)
@@ -186,4 +489,8 @@ const FishSoundComment * fish_sound_comment_first (FishSound * fsound);
 const FishSoundComment *
 fish_sound_comment_next (FishSound * fsound, const FishSoundComment * comment);
 
+FishSoundCommentSet *
+fish_sound_comment_set_ref (FishSoundCommentSet * set);
+int fish_sound_comment_set_unref (FishSoundCommentSet * set);
+
 #endif /* __FISH_SOUND_PRIVATE_H__ */
@@ -0,0 +1,248 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "private.h"
+#include "fs_atomic.h"
+#include "fs_ring.h"
+
+struct _FishSoundPCMRing {
+  FishSoundRing * ring;
+  int channels;
+  int format;
+  size_t sample_size;
+
+  /* Written by the producer only */
+  size_t overruns;
+  char pad_overruns[FS_CACHELINE - sizeof (size_t)];
+
+  /* Written by the consumer only */
+  size_t underruns;
+  char pad_underruns[FS_CACHELINE - sizeof (size_t)];
+};
+
+FishSoundPCMRing *
+fish_sound_pcm_ring_new (int channels, long frames, int format)
+{
+  FishSoundPCMRing * ring;
+  FishSound * outer;
+  size_t sample_size;
+
+  if (channels <= 0 || frames <= 0) return NULL;
+
+  switch (format) {
+  case FISH_SOUND_RING_FLOAT:
+    sample_size = sizeof (float);
+    break;
+  case FISH_SOUND_RING_S16:
+    sample_size = sizeof (short);
+    break;
+  default:
+    return NULL;
+  }
+
+  /* A ring is not owned by any handle, even if created in a callback */
+  outer = fish_sound_memory_enter (NULL);
+
+  ring = fs_malloc (sizeof (FishSoundPCMRing));
+  if (ring != NULL) {
+    ring->ring = fs_ring_new (sample_size * channels, frames);
+    if (ring->ring == NULL) {
+      fs_free (ring);
+      ring = NULL;
+    }
+  }
+
+  fish_sound_memory_leave (outer);
+
+  if (ring == NULL) return NULL;
+
+  ring->channels = channels;
+  ring->format = format;
+  ring->sample_size = sample_size;
+  ring->overruns = 0;
+  ring->underruns = 0;
+
+  return ring;
+}
+
+int
+fish_sound_pcm_ring_delete (FishSoundPCMRing * ring)
+{
+  if (ring == NULL) return FISH_SOUND_ERR_BAD;
+
+  fs_ring_delete (ring->ring);
+  fs_free (ring);
+
+  return 0;
+}
+
+static void
+fs_pcm_ring_convert_s16 (short * dest, float * src, long samples)
+{
+  float v;
+  long i;
+
+  for (i = 0; i < samples; i++) {
+    v = src[i] * 32767.0F;
+    if (v > 32767.0F) v = 32767.0F;
+    else if (v < -32768.0F) v = -32768.0F;
+    dest[i] = (short)(v >= 0.0F ? v + 0.5F : v - 0.5F);
+  }
+}
+
+long
+fish_sound_pcm_ring_write_float_ilv (FishSoundPCMRing * ring, float * pcm,
+				     long frames)
+{
+  void * dest;
+  long written = 0, n;
+
+  if (ring == NULL) return FISH_SOUND_ERR_BAD;
+
+  while (written < frames) {
+    n = (long) fs_ring_write_contig (ring->ring, &dest);
+    if (n == 0) break;
+
+    n = MIN (n, frames - written);
+
+    if (ring->format == FISH_SOUND_RING_S16) {
+      fs_pcm_ring_convert_s16 ((short *)dest, pcm + written * ring->channels,
+			       n * ring->channels);
+    } else {
+      memcpy (dest, pcm + written * ring->channels,
+	      sizeof (float) * n * ring->channels);
+    }
+
+    fs_ring_write_advance (ring->ring, n);
+    written += n;
+  }
+
+  if (written < frames)
+    fs_atomic_store (&ring->overruns, ring->overruns + 1);
+
+  return written;
+}
+
+long
+fish_sound_pcm_ring_read (FishSoundPCMRing * ring, void * buf, long frames)
+{
+  unsigned char * d = (unsigned char *)buf;
+  size_t frame_size;
+  void * src;
+  long nread = 0, n;
+
+  if (ring == NULL) return FISH_SOUND_ERR_BAD;
+
+  frame_size = ring->sample_size * ring->channels;
+
+  while (nread < frames) {
+    n = (long) fs_ring_read_contig (ring->ring, &src);
+    if (n == 0) break;
+
+    n = MIN (n, frames - nread);
+    memcpy (d + nread * frame_size, src, n * frame_size);
+
+    fs_ring_read_advance (ring->ring, n);
+    nread += n;
+  }
+
+  if (nread < frames) {
+    memset (d + nread * frame_size, 0, (frames - nread) * frame_size);
+    fs_atomic_store (&ring->underruns, ring->underruns + 1);
+  }
+
+  return nread;
+}
+
+long
+fish_sound_pcm_ring_available (FishSoundPCMRing * ring)
+{
+  if (ring == NULL) return FISH_SOUND_ERR_BAD;
+
+  return (long) fs_ring_count (ring->ring);
+}
+
+long
+fish_sound_pcm_ring_space (FishSoundPCMRing * ring)
+{
+  if (ring == NULL) return FISH_SOUND_ERR_BAD;
+
+  return (long) (fs_ring_capacity (ring->ring) - fs_ring_count (ring->ring));
+}
+
+long
+fish_sound_pcm_ring_underruns (FishSoundPCMRing * ring)
+{
+  if (ring == NULL) return FISH_SOUND_ERR_BAD;
+
+  return (long) fs_atomic_load (&ring->underruns);
+}
+
+long
+fish_sound_pcm_ring_overruns (FishSoundPCMRing * ring)
+{
+  if (ring == NULL) return FISH_SOUND_ERR_BAD;
+
+  return (long) fs_atomic_load (&ring->overruns);
+}
+
+#if FS_DECODE
+static int
+fs_pcm_ring_decoded (FishSound * fsound, float ** pcm, long frames,
+		     void * user_data)
+{
+  FishSoundPCMRing * ring = (FishSoundPCMRing *)user_data;
+
+  if (fsound->info.channels != ring->channels) return FISH_SOUND_STOP_ERR;
+
+  fish_sound_pcm_ring_write_float_ilv (ring, (float *)pcm, frames);
+
+  return FISH_SOUND_CONTINUE;
+}
+#endif
+
+int
+fish_sound_set_decoded_pcm_ring (FishSound * fsound, FishSoundPCMRing * ring)
+{
+  if (fsound == NULL || ring == NULL) return FISH_SOUND_ERR_BAD;
+
+#if FS_DECODE
+  return fish_sound_set_decoded_float_ilv (fsound, fs_pcm_ring_decoded, ring);
+#else
+  return FISH_SOUND_ERR_DISABLED;
+#endif
+}
@@ -45,7 +45,6 @@
 #include "private.h"
 #include "convert.h"
 
-/*#define DEBUG*/
 #include "debug.h"
 
 #if HAVE_SPEEX
@@ -86,6 +85,7 @@ typedef struct _FishSoundSpeexInfo {
   SpeexBits bits;
   int frame_size;
   int nframes;
+  int lookahead; /* encoder delay beyond the end of each frame */
   int extra_headers;
   SpeexStereoState stereo;
   int pcm_len; /* nr frames in pcm */
@@ -97,28 +97,49 @@ typedef struct _FishSoundSpeexInfo {
 int
 fish_sound_speex_identify (unsigned char * buf, long bytes)
 {
-  SpeexHeader * header;
-
   if (bytes < 8) return FISH_SOUND_UNKNOWN;
 
-  if (!strncmp ((char *)buf, "Speex   ", 8)) {
-    /* if only a short buffer was passed, do a weak identify */
-    if (bytes == 8) return FISH_SOUND_SPEEX;
+  if (strncmp ((char *)buf, "Speex   ", 8)) return FISH_SOUND_UNKNOWN;
 
-    /* otherwise, assume the buffer is an entire initial header and
-     * feed it to speex_packet_to_header() */
-    if ((header = speex_packet_to_header ((char *)buf, (int)bytes)) != NULL) {
-      fs_free(header);
-      return FISH_SOUND_SPEEX;
-    }
-  }
+  /* if only a short buffer was passed, do a weak identify */
+  if (bytes == 8) return FISH_SOUND_SPEEX;
 
-  return FISH_SOUND_UNKNOWN;
+  /* otherwise, assume the buffer is an entire initial header and check
+   * it as speex_packet_to_header() would: it must be complete, and the
+   * little-endian mode field at offset 40 must be valid */
+  if (bytes < (long)sizeof (SpeexHeader)) return FISH_SOUND_UNKNOWN;
+
+  if (fs_read_le32 (&buf[40]) >= SPEEX_NB_MODES) return FISH_SOUND_UNKNOWN;
+
+  return FISH_SOUND_SPEEX;
 }
 
 static int
 fs_speex_command (FishSound * fsound, int command, void * data, int datasize)
 {
+  FishSoundSpeexInfo * fss = (FishSoundSpeexInfo *)fsound->codec_data;
+  FishSoundSpeexEnc * fse;
+  long * pl = (long *)data;
+
+  /* A decoder passes out each frame as soon as its packet is decoded */
+  if (fsound->mode != FISH_SOUND_ENCODE)
+    return 0;
+
+  fse = (FishSoundSpeexEnc *)fss->enc;
+
+  switch (command) {
+  case FISH_SOUND_GET_LATENCY:
+    /* The frame size is known once the encoder has been set up */
+    if (fss->frame_size > 0)
+      *pl = fss->frame_size * fss->nframes + fss->lookahead;
+    break;
+  case FISH_SOUND_GET_PENDING_FRAMES:
+    *pl = fse->frame_offset * fss->frame_size + fse->pcm_offset;
+    break;
+  default:
+    break;
+  }
+
   return 0;
 }
 
@@ -208,24 +229,15 @@ process_header(unsigned char * buf, long bytes, int enh_enabled,
   if (*channels == -1)
     *channels = header->nb_channels;
 
-  debug_printf (1, "Decoding %d Hz audio using %s mode",
-                *rate, mode->modeName);
-
-#ifdef DEBUG
-  if (*channels==1)
-      fprintf (stderr, " (mono");
-   else
-      fprintf (stderr, " (stereo");
-
-  if (header->vbr)
-    fprintf (stderr, " (VBR)\n");
-  else
-    fprintf(stderr, "\n");
-#endif
+  debug_printf (1, "Decoding %d Hz audio using %s mode (%s%s)",
+                *rate, mode->modeName,
+                header->nb_channels == 1 ? "mono" : "stereo",
+                header->vbr ? ", VBR" : "");
 
   *extra_headers = header->extra_headers;
 
-  fs_free(header);
+  /* Allocated by libspeex, not fs_malloc */
+  free (header);
 
   return st;
 }
@@ -250,17 +262,15 @@ static inline int
 fs_speex_float_dispatch (FishSound * fsound)
 {
   FishSoundSpeexInfo * fss = (FishSoundSpeexInfo *)fsound->codec_data;
-  FishSoundDecoded_FloatIlv df;
-  FishSoundDecoded_Float dfi;
   int retval;
 
   if (fsound->interleave) {
-    dfi = (FishSoundDecoded_FloatIlv)fsound->callback.decoded_float_ilv;
-    retval = dfi (fsound, (float **)fss->ipcm, fss->frame_size,
-                  fsound->user_data);
+    retval = fish_sound_dispatch_decoded_float_ilv (fsound,
+						    (float **)fss->ipcm,
+						    fss->frame_size);
   } else {
-    df = (FishSoundDecoded_Float)fsound->callback.decoded_float;
-    retval = df (fsound, fss->pcm, fss->frame_size, fsound->user_data);
+    retval = fish_sound_dispatch_decoded_float (fsound, fss->pcm,
+						fss->frame_size);
   }
   
   return retval;
@@ -274,7 +284,7 @@ fs_speex_decode (FishSound * fsound, unsigned char * buf, long bytes)
   int rate = 0;
   int channels = -1;
   int forceMode = -1;
-  int i, j;
+  int i;
 
   if (fss->packetno == 0) {
     fss->st = process_header (buf, bytes, enh_enabled,
@@ -340,34 +350,44 @@ fs_speex_decode (FishSound * fsound, unsigned char * buf, long bytes)
   } else if (fss->packetno <= 1+fss->extra_headers) {
     /* Unknown extra headers */
   } else {
+    fs_realtime_begin (fsound);
+
     speex_bits_read_from (&fss->bits, (char *)buf, (int)bytes);
 
     for (i = 0; i < fss->nframes; i++) {
       /* Decode frame */
-      speex_decode (fss->st, &fss->bits, fss->ipcm);
+      if (speex_decode (fss->st, &fss->bits, fss->ipcm) == -2)
+	fs_log (fsound, FISH_SOUND_LOG_WARNING, FISH_SOUND_ERR_GENERIC,
+		"Speex decoder: corrupt frame %d of packet %d", i,
+		fss->packetno);
 
       if (fsound->info.channels == 2) {
 	speex_decode_stereo (fss->ipcm, fss->frame_size, &fss->stereo);
 	if (fsound->interleave) {
-	  for (j = 0; j < fss->frame_size * fsound->info.channels; j++) {
-	    fss->ipcm[j] /= 32767.0;
-	  }
+	  _fs_scale (fss->ipcm, fss->ipcm, fss->frame_size * 2,
+		     (float)(1/32767.0));
 	} else {
 	  _fs_deinterleave ((float **)fss->ipcm, fss->pcm,
 			    fss->frame_size, 2, (float)(1/32767.0));
 	}
       } else {
-	for (j = 0; j < fss->frame_size; j++) {
-	  fss->ipcm[j] /= 32767.0;
-	}
+	_fs_scale (fss->ipcm, fss->ipcm, fss->frame_size, (float)(1/32767.0));
       }
 
       fsound->frameno += fss->frame_size;
 
+      FS_PROBE4 (codec__decode, fsound, FISH_SOUND_SPEEX, bytes,
+		 fss->frame_size);
+
       fs_speex_float_dispatch (fsound);
     }
+
+    fs_realtime_end (fsound);
   }
 
+  if (fss->packetno == 1 + fss->extra_headers)
+    fish_sound_trace_event (fsound, FS_TRACE_HEADERS, 0);
+
   fss->packetno++;
 
   return 0;
@@ -387,8 +407,10 @@ fs_speex_enc_headers (FishSound * fsound)
   int modeID;
   SpeexMode * mode = NULL;
   SpeexHeader header;
-  unsigned char * header_buf = NULL, * comments_buf = NULL;
-  int header_bytes, comments_bytes=0;
+  unsigned char * header_buf = NULL;
+  const unsigned char * comments_buf = NULL;
+  int header_bytes;
+  long comments_bytes = 0;
   size_t buflen;
 
   modeID = 1;
@@ -410,7 +432,8 @@ fs_speex_enc_headers (FishSound * fsound)
   if (fsound->callback.encoded) {
     char vendor_string[128];
 
-    /* Allocate and create header */
+    /* Allocate and create header; libspeex allocates this, so it is
+     * released with free() rather than fs_free() */
     header_buf = (unsigned char *) speex_header_to_packet (&header, &header_bytes);
     if (header_buf == NULL) {
       return NULL;
@@ -419,13 +442,12 @@ fs_speex_enc_headers (FishSound * fsound)
     /* Allocate and create comments */
     snprintf (vendor_string, 128, VENDOR_FORMAT, header.speex_version);
     if (fish_sound_comment_set_vendor (fsound, vendor_string) == FISH_SOUND_ERR_OUT_OF_MEMORY) {
-      fs_free (header_buf);
+      free (header_buf);
       return NULL;
     }
-    comments_bytes = fish_sound_comments_encode (fsound, NULL, 0);
-    comments_buf = fs_malloc (comments_bytes);
+    comments_buf = fish_sound_comments_packet (fsound, &comments_bytes);
     if (comments_buf == NULL) {
-      fs_free (header_buf);
+      free (header_buf);
       return NULL;
     }
   }
@@ -434,36 +456,36 @@ fs_speex_enc_headers (FishSound * fsound)
 		     &fsound->info.samplerate);
 
   speex_encoder_ctl (fss->st, SPEEX_GET_FRAME_SIZE, &fss->frame_size);
+  speex_encoder_ctl (fss->st, SPEEX_GET_LOOKAHEAD, &fss->lookahead);
 
-  debug_printf (1, "got frame size %d", fss->frame_size);
+  debug_printf (1, "got frame size %d, lookahead %d", fss->frame_size,
+		fss->lookahead);
 
   /* XXX: set VBR etc. */
 
   buflen = fss->frame_size * fsound->info.channels * sizeof (float);
   fss->ipcm = fs_malloc (buflen);
   if (fss->ipcm == NULL) {
-    if (comments_buf) fs_free (comments_buf);
-    if (header_buf) fs_free (header_buf);
+    if (header_buf) free (header_buf);
     return NULL;
   }
   memset (fss->ipcm, 0, buflen);
 
   /* Allocations succeeded, actually call encoded callback for headers */
   if (fsound->callback.encoded) {
-    FishSoundEncoded encoded = (FishSoundEncoded)fsound->callback.encoded;
-
     /* header */
-    encoded (fsound, header_buf, (long)header_bytes, fsound->user_data);
+    fish_sound_dispatch_encoded (fsound, header_buf, (long)header_bytes);
     fss->packetno++;
-    fs_free (header_buf);
+    free (header_buf);
 
     /* comments */
-    comments_bytes = fish_sound_comments_encode (fsound, comments_buf, comments_bytes);
-    encoded (fsound, comments_buf, (long)comments_bytes, fsound->user_data);
+    fish_sound_dispatch_encoded (fsound, (unsigned char *)comments_buf,
+				 comments_bytes);
     fss->packetno++;
-    fs_free (comments_buf);
   }
 
+  fish_sound_trace_event (fsound, FS_TRACE_HEADERS, 0);
+
   return fsound;
 }
 
@@ -479,10 +501,8 @@ fs_speex_encode_write (FishSound * fsound)
   speex_bits_reset (&fss->bits);
 
   if (fsound->callback.encoded) {
-    FishSoundEncoded encoded = (FishSoundEncoded)fsound->callback.encoded;
-
-    encoded (fsound, (unsigned char *)fse->cbits, (long)bytes,
-	     fsound->user_data);
+    fish_sound_dispatch_encoded (fsound, (unsigned char *)fse->cbits,
+				 (long)bytes);
   }
 
   return bytes;
@@ -519,21 +539,24 @@ fs_speex_encode_f_ilv (FishSound * fsound, float ** pcm, long frames)
   FishSoundSpeexInfo * fss = (FishSoundSpeexInfo *)fsound->codec_data;
   FishSoundSpeexEnc * fse = (FishSoundSpeexEnc *)fss->enc;
   long remaining = frames, len, nencoded = 0;
-  int j, start, end;
+  int start, end;
   int channels = fsound->info.channels;
   float * p = (float *)pcm;
 
   if (fss->packetno == 0)
     fs_speex_enc_headers (fsound);
 
+  FS_PROBE3 (codec__encode, fsound, FISH_SOUND_SPEEX, frames);
+
+  fs_realtime_begin (fsound);
+
   while (remaining > 0) {
     len = MIN (remaining, fss->frame_size - fse->pcm_offset);
 
     start = fse->pcm_offset * channels;
     end = (len + fse->pcm_offset) * channels;
-    for (j = start; j < end; j++) {
-      fss->ipcm[j] = *p++ * (float)32767.0;
-    }
+    _fs_scale (p, &fss->ipcm[start], end - start, (float)32767.0);
+    p += end - start;
 
     fse->pcm_offset += len;
 
@@ -544,6 +567,8 @@ fs_speex_encode_f_ilv (FishSound * fsound, float ** pcm, long frames)
     remaining -= len;
   }
 
+  fs_realtime_end (fsound);
+
   return frames - remaining;
 }
 
@@ -553,11 +578,15 @@ fs_speex_encode_f (FishSound * fsound, float * pcm[], long frames)
   FishSoundSpeexInfo * fss = (FishSoundSpeexInfo *)fsound->codec_data;
   FishSoundSpeexEnc * fse = (FishSoundSpeexEnc *)fss->enc;
   long remaining = frames, len, n = 0, nencoded = 0;
-  int j, start;
+  int start;
 
   if (fss->packetno == 0)
     fs_speex_enc_headers (fsound);
 
+  FS_PROBE3 (codec__encode, fsound, FISH_SOUND_SPEEX, frames);
+
+  fs_realtime_begin (fsound);
+
   while (remaining > 0) {
     len = MIN (remaining, fss->frame_size - fse->pcm_offset);
 
@@ -569,9 +598,7 @@ fs_speex_encode_f (FishSound * fsound, float * pcm[], long frames)
       _fs_interleave (fss->pcm, (float **)&fss->ipcm[start*2],
 		      len, 2, 32767.0);
     } else {
-      for (j = 0; j < len; j++) {
-	fss->ipcm[start + j] = fss->pcm[0][j] * (float)32767.0;
-      }
+      _fs_scale (fss->pcm[0], &fss->ipcm[start], len, (float)32767.0);
     }
 
     fse->pcm_offset += len;
@@ -584,6 +611,8 @@ fs_speex_encode_f (FishSound * fsound, float * pcm[], long frames)
     n += len;
   }
 
+  fs_realtime_end (fsound);
+
   return frames - remaining;
 }
 
@@ -597,6 +626,8 @@ fs_speex_flush (FishSound * fsound)
   if (fsound->mode != FISH_SOUND_ENCODE)
     return 0;
 
+  FS_PROBE2 (codec__flush, fsound, FISH_SOUND_SPEEX);
+
   if (fse->pcm_offset > 0) {
     nencoded += fs_speex_encode_block (fsound);
   }
@@ -636,29 +667,23 @@ fs_speex_reset (FishSound * fsound)
   return 0;
 }
 
+/*
+ * Set up the output buffers for a change of interleave. The buffer sizes
+ * depend only on the stream header, so buffers are allocated only if they
+ * do not already exist, and are kept until the handle is deleted. This
+ * function is also called before the header has been decoded, in which
+ * case the buffers are allocated when it is.
+ */
 static int
 fs_speex_update (FishSound * fsound, int interleave)
 {
   FishSoundSpeexInfo * fss = (FishSoundSpeexInfo *)fsound->codec_data;
   size_t pcm_size = sizeof (float);
-  float *ipcm_new, *pcm0, *pcm1;
-
-  ipcm_new = (float *)fs_realloc (fss->ipcm,
-		  pcm_size * fss->frame_size * fsound->info.channels);
-  if (ipcm_new == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
-
-  fss->ipcm = ipcm_new;
-
-  if (interleave) {
-    /* if transitioning from non-interleave to interleave,
-       free non-ilv buffers */
-    if (!fsound->interleave && fsound->info.channels == 2) {
-      if (fss->pcm[0]) fs_free (fss->pcm[0]);
-      if (fss->pcm[1]) fs_free (fss->pcm[1]);
-      fss->pcm[0] = NULL;
-      fss->pcm[1] = NULL;
-    }
-  } else {
+
+  /* The encoder reads directly from the caller's buffers */
+  if (fsound->mode != FISH_SOUND_DECODE || fss->ipcm == NULL) return 0;
+
+  if (!interleave) {
     if (fsound->info.channels == 1) {
       fss->pcm[0] = (float *) fss->ipcm;
     } else if (fsound->info.channels == 2) {
@@ -671,19 +696,15 @@ fs_speex_update (FishSound * fsound, int interleave)
         return FISH_SOUND_ERR_GENERIC;
 #endif
 
-      pcm0 = fs_realloc (fss->pcm[0], pcm_size * fss->frame_size);
-      if (pcm0 == NULL) {
-        return FISH_SOUND_ERR_OUT_OF_MEMORY;
+      if (fss->pcm[0] == NULL) {
+        fss->pcm[0] = fs_malloc (pcm_size * fss->frame_size);
+        if (fss->pcm[0] == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
       }
 
-      pcm1 = fs_realloc (fss->pcm[1], pcm_size * fss->frame_size);
-      if (pcm1 == NULL) {
-        fs_free (pcm0);
-        return FISH_SOUND_ERR_OUT_OF_MEMORY;
+      if (fss->pcm[1] == NULL) {
+        fss->pcm[1] = fs_malloc (pcm_size * fss->frame_size);
+        if (fss->pcm[1] == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
       }
-
-      fss->pcm[0] = pcm0;
-      fss->pcm[1] = pcm1;
     }
   }
 
@@ -721,6 +742,7 @@ fs_speex_init (FishSound * fsound)
   fss->st = NULL;
   fss->frame_size = 0;
   fss->nframes = 1;
+  fss->lookahead = 0;
   fss->pcm_len = 0;
   fss->ipcm = NULL;
   fss->pcm[0] = NULL;
@@ -759,29 +781,21 @@ fs_speex_delete (FishSound * fsound)
   return fsound;
 }
 
-FishSoundCodec *
+static const FishSoundCodec fs_speex_codec = {
+  {FISH_SOUND_SPEEX, "Speex (Xiph.Org)", "spx"},
+  FISH_SOUND_CODEC_DECODE | FISH_SOUND_CODEC_ENCODE,
+  "Speex   ", 8,
+  fish_sound_speex_identify,
+  fs_speex_init, fs_speex_delete, fs_speex_reset, fs_speex_update,
+  fs_speex_command, fs_speex_decode,
+  fs_speex_encode_f_ilv, fs_speex_encode_f,
+  fs_speex_flush
+};
+
+const FishSoundCodec *
 fish_sound_speex_codec (void)
 {
-  FishSoundCodec * codec;
-
-  codec = (FishSoundCodec *) fs_malloc (sizeof (FishSoundCodec));
-  if (codec == NULL) return NULL;
-
-  codec->format.format = FISH_SOUND_SPEEX;
-  codec->format.name = "Speex (Xiph.Org)";
-  codec->format.extension = "spx";
-
-  codec->init = fs_speex_init;
-  codec->del = fs_speex_delete;
-  codec->reset = fs_speex_reset;
-  codec->update = fs_speex_update;
-  codec->command = fs_speex_command;
-  codec->decode = fs_speex_decode;
-  codec->encode_f = fs_speex_encode_f;
-  codec->encode_f_ilv = fs_speex_encode_f_ilv;
-  codec->flush = fs_speex_flush;
-
-  return codec;
+  return &fs_speex_codec;
 }
 
 #else /* !HAVE_SPEEX */
@@ -792,7 +806,7 @@ fish_sound_speex_identify (unsigned char * buf, long bytes)
   return FISH_SOUND_UNKNOWN;
 }
 
-FishSoundCodec *
+const FishSoundCodec *
 fish_sound_speex_codec (void)
 {
   return NULL;
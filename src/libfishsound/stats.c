@@ -0,0 +1,457 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif HAVE_CLOCK_GETTIME
+#include <time.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "private.h"
+#include "fs_atomic.h"
+
+/*
+ * Per-handle statistics. The public entry points for decode, encode and
+ * flush bracket their work with fish_sound_stats_begin() and
+ * fish_sound_stats_end(), and the codecs call the user's callbacks through
+ * the fish_sound_dispatch_*() functions, so that time spent in the codec
+ * can be separated from time spent in callbacks.
+ */
+
+/* The handle whose allocations are being counted in this thread */
+static FS_THREAD_LOCAL FishSound * fs_stats_current = NULL;
+
+/*
+ * Memory accounting. Every block from fs_malloc and fs_realloc is
+ * prefixed by a header recording its size and the handle it is accounted
+ * to, so that fs_free can account for it in whichever thread and context
+ * it is called. The header is padded to 16 bytes to preserve the
+ * alignment of the block returned by malloc.
+ */
+typedef union {
+  struct {
+    size_t size;
+    FishSound * owner;
+  } h;
+  double align[2];
+} FishSoundAllocHeader;
+
+/* The handle to which this thread's allocations are accounted */
+static FS_THREAD_LOCAL FishSound * fs_memory_owner = NULL;
+
+/* Bytes allocated by libfishsound in this process */
+static size_t fs_memory_bytes = 0;
+static size_t fs_memory_peak_bytes = 0;
+
+double
+fish_sound_stats_now (void)
+{
+#ifdef _WIN32
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER count;
+
+  if (freq.QuadPart == 0) QueryPerformanceFrequency (&freq);
+  QueryPerformanceCounter (&count);
+
+  return (double)count.QuadPart / (double)freq.QuadPart;
+#elif HAVE_CLOCK_GETTIME
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+#else
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+#endif
+}
+
+static int
+fs_stats_bucket (double seconds)
+{
+  unsigned long us;
+  int bucket = 0;
+
+  if (seconds <= 0.0) return 0;
+
+  /* Avoid overflowing the conversion for very long calls */
+  if (seconds >= 4096.0) return FISH_SOUND_STATS_HISTOGRAM_SIZE - 1;
+
+  us = (unsigned long)(seconds * 1000000.0);
+  while (us > 0 && bucket < FISH_SOUND_STATS_HISTOGRAM_SIZE - 1) {
+    us >>= 1;
+    bucket++;
+  }
+
+  return bucket;
+}
+
+/*
+ * Begin a call to decode a packet of 'size' bytes, or to encode 'size'
+ * frames.
+ */
+void
+fish_sound_stats_begin (FishSound * fsound, FishSoundStatsCall * call,
+			long size)
+{
+  call->outer = fs_stats_current;
+  fs_stats_current = fsound;
+  call->outer_owner = fish_sound_memory_enter (fsound);
+
+  if (fsound->mode == FISH_SOUND_DECODE) {
+    FS_PROBE3 (decode__entry, fsound, fsound->info.format, size);
+    fsound->stats.packets_in++;
+    fsound->stats.bytes_in += size;
+  } else {
+    FS_PROBE3 (encode__entry, fsound, fsound->info.format, size);
+    fsound->stats.frames += size;
+  }
+
+  call->frames = fsound->stats.frames;
+  call->bytes_out = fsound->stats.bytes_out;
+  call->callback_seconds = fsound->stats.callback_seconds;
+  call->start = fish_sound_stats_now ();
+
+  if (fsound->trace)
+    fish_sound_trace (fsound, fsound->mode == FISH_SOUND_DECODE ?
+		      FS_TRACE_DECODE_BEGIN : FS_TRACE_ENCODE_BEGIN,
+		      call->start, size);
+}
+
+long
+fish_sound_stats_end (FishSound * fsound, FishSoundStatsCall * call, long ret)
+{
+  FishSoundStats * stats = &fsound->stats;
+  double now, elapsed;
+
+  now = fish_sound_stats_now ();
+  elapsed = now - call->start -
+    (stats->callback_seconds - call->callback_seconds);
+
+  stats->codec_seconds += elapsed;
+  stats->histogram[fs_stats_bucket (elapsed)]++;
+
+  if (ret < 0) {
+    if (-ret < FISH_SOUND_STATS_ERRORS)
+      stats->errors[-ret]++;
+    else
+      stats->errors[0]++;
+
+    if (fsound->trace)
+      fish_sound_trace (fsound, FS_TRACE_ERROR, now, ret);
+  }
+
+  if (fsound->trace)
+    fish_sound_trace (fsound, fsound->mode == FISH_SOUND_DECODE ?
+		      FS_TRACE_DECODE_END : FS_TRACE_ENCODE_END, now, ret);
+
+  if (fsound->mode == FISH_SOUND_DECODE) {
+    FS_PROBE4 (decode__return, fsound, fsound->info.format, ret,
+	       stats->frames - call->frames);
+  } else {
+    FS_PROBE4 (encode__return, fsound, fsound->info.format, ret,
+	       stats->bytes_out - call->bytes_out);
+  }
+
+  fs_stats_current = call->outer;
+  fish_sound_memory_leave (call->outer_owner);
+
+  return ret;
+}
+
+int
+fish_sound_stats_command (FishSound * fsound, int command, void * data,
+			  int datasize)
+{
+  FishSoundMemory * memory;
+
+  switch (command) {
+  case FISH_SOUND_GET_STATS:
+    if (data == NULL || datasize < (int)sizeof (FishSoundStats))
+      return FISH_SOUND_ERR_INVALID;
+    memcpy (data, &fsound->stats, sizeof (FishSoundStats));
+    break;
+  case FISH_SOUND_RESET_STATS:
+    memset (&fsound->stats, 0, sizeof (FishSoundStats));
+    break;
+  case FISH_SOUND_GET_MEMORY:
+    if (data == NULL || datasize < (int)sizeof (FishSoundMemory))
+      return FISH_SOUND_ERR_INVALID;
+    memory = (FishSoundMemory *)data;
+    memory->bytes = fsound->memory.bytes;
+    memory->peak_bytes = fsound->memory.peak_bytes;
+    memory->blocks = fsound->memory.blocks;
+    memory->process_bytes = (long)fs_atomic_load (&fs_memory_bytes);
+    memory->process_peak_bytes = (long)fs_atomic_load (&fs_memory_peak_bytes);
+    break;
+  default:
+    return FISH_SOUND_ERR_INVALID;
+  }
+
+  return 0;
+}
+
+int
+fish_sound_dispatch_decoded_float (FishSound * fsound, float * pcm[],
+				   long frames)
+{
+  FishSoundDecoded_Float df;
+  double start, end;
+  int realtime, ret;
+
+  df = (FishSoundDecoded_Float)fsound->callback.decoded_float;
+
+  start = fish_sound_stats_now ();
+  if (fsound->trace)
+    fish_sound_trace (fsound, FS_TRACE_CALLBACK_BEGIN, start, frames);
+
+  realtime = fs_realtime_suspend ();
+  ret = df (fsound, pcm, frames, fsound->user_data);
+  fs_realtime_resume (realtime);
+
+  end = fish_sound_stats_now ();
+  if (fsound->trace)
+    fish_sound_trace (fsound, FS_TRACE_CALLBACK_END, end, ret);
+  fsound->stats.callback_seconds += end - start;
+
+  fsound->stats.callbacks++;
+  fsound->stats.frames += frames;
+
+  return ret;
+}
+
+int
+fish_sound_dispatch_decoded_float_ilv (FishSound * fsound, float ** pcm,
+				       long frames)
+{
+  FishSoundDecoded_FloatIlv dfi;
+  double start, end;
+  int realtime, ret;
+
+  dfi = (FishSoundDecoded_FloatIlv)fsound->callback.decoded_float_ilv;
+
+  start = fish_sound_stats_now ();
+  if (fsound->trace)
+    fish_sound_trace (fsound, FS_TRACE_CALLBACK_BEGIN, start, frames);
+
+  realtime = fs_realtime_suspend ();
+  ret = dfi (fsound, pcm, frames, fsound->user_data);
+  fs_realtime_resume (realtime);
+
+  end = fish_sound_stats_now ();
+  if (fsound->trace)
+    fish_sound_trace (fsound, FS_TRACE_CALLBACK_END, end, ret);
+  fsound->stats.callback_seconds += end - start;
+
+  fsound->stats.callbacks++;
+  fsound->stats.frames += frames;
+
+  return ret;
+}
+
+int
+fish_sound_dispatch_encoded (FishSound * fsound, unsigned char * buf,
+			     long bytes)
+{
+  FishSoundEncoded encoded;
+  double start, end;
+  int realtime, ret;
+
+  encoded = (FishSoundEncoded)fsound->callback.encoded;
+
+  start = fish_sound_stats_now ();
+  if (fsound->trace)
+    fish_sound_trace (fsound, FS_TRACE_CALLBACK_BEGIN, start, bytes);
+
+  realtime = fs_realtime_suspend ();
+  ret = encoded (fsound, buf, bytes, fsound->user_data);
+  fs_realtime_resume (realtime);
+
+  end = fish_sound_stats_now ();
+  if (fsound->trace)
+    fish_sound_trace (fsound, FS_TRACE_CALLBACK_END, end, ret);
+  fsound->stats.callback_seconds += end - start;
+
+  fsound->stats.callbacks++;
+  fsound->stats.packets_out++;
+  fsound->stats.bytes_out += bytes;
+
+  return ret;
+}
+
+/* Memory accounting */
+
+FishSound *
+fish_sound_memory_enter (FishSound * fsound)
+{
+  FishSound * outer = fs_memory_owner;
+
+  fs_memory_owner = fsound;
+
+  return outer;
+}
+
+void
+fish_sound_memory_leave (FishSound * outer)
+{
+  fs_memory_owner = outer;
+}
+
+static void
+fs_memory_account (FishSound * owner, long bytes, long blocks)
+{
+  size_t total;
+
+  if (bytes >= 0) {
+    total = fs_atomic_add (&fs_memory_bytes, (size_t)bytes);
+    fs_atomic_max (&fs_memory_peak_bytes, total);
+  } else {
+    fs_atomic_sub (&fs_memory_bytes, (size_t)-bytes);
+  }
+
+  if (owner) {
+    owner->memory.bytes += bytes;
+    owner->memory.blocks += blocks;
+    if (owner->memory.bytes > owner->memory.peak_bytes)
+      owner->memory.peak_bytes = owner->memory.bytes;
+  }
+}
+
+/*
+ * Account a block to fsound, rather than to the owner at the time it was
+ * allocated. This is used for the handle itself, which must be allocated
+ * before it can own anything.
+ */
+void
+fish_sound_memory_adopt (FishSound * fsound, void * ptr)
+{
+  FishSoundAllocHeader * header = (FishSoundAllocHeader *)ptr - 1;
+
+  fs_memory_account (header->h.owner, -(long)header->h.size, -1);
+  header->h.owner = fsound;
+  fs_memory_account (fsound, (long)header->h.size, 1);
+}
+
+/* Allocators, as used via fs_malloc, fs_realloc and fs_free */
+
+void *
+fs_stats_malloc (size_t size)
+{
+  FishSound * fsound = fs_stats_current;
+  FishSoundAllocHeader * header;
+
+#if FS_REALTIME_CHECKS
+  fs_realtime_check ("malloc");
+#endif
+
+  if (size > (size_t)-1 - sizeof (FishSoundAllocHeader))
+    return NULL;
+
+  if ((header = malloc (sizeof (FishSoundAllocHeader) + size)) == NULL)
+    return NULL;
+
+  if (fsound) {
+    fsound->stats.allocations++;
+    fsound->stats.allocated_bytes += (long)size;
+  }
+
+  header->h.size = size;
+  header->h.owner = fs_memory_owner;
+  fs_memory_account (header->h.owner, (long)size, 1);
+
+  return header + 1;
+}
+
+void *
+fs_stats_realloc (void * ptr, size_t size)
+{
+  FishSound * fsound = fs_stats_current;
+  FishSoundAllocHeader * header;
+  size_t old_size;
+
+  if (ptr == NULL)
+    return fs_stats_malloc (size);
+
+#if FS_REALTIME_CHECKS
+  fs_realtime_check ("realloc");
+#endif
+
+  if (size > (size_t)-1 - sizeof (FishSoundAllocHeader))
+    return NULL;
+
+  header = (FishSoundAllocHeader *)ptr - 1;
+  old_size = header->h.size;
+
+  /* On failure the original block, and its accounting, are unchanged */
+  if ((header = realloc (header, sizeof (FishSoundAllocHeader) + size))
+      == NULL)
+    return NULL;
+
+  if (fsound) {
+    fsound->stats.allocations++;
+    fsound->stats.allocated_bytes += (long)size;
+  }
+
+  /* The block stays with the handle it was allocated for */
+  header->h.size = size;
+  fs_memory_account (header->h.owner, (long)size - (long)old_size, 0);
+
+  return header + 1;
+}
+
+void
+fs_stats_free (void * ptr)
+{
+  FishSoundAllocHeader * header;
+
+#if FS_REALTIME_CHECKS
+  fs_realtime_check ("free");
+#endif
+
+  if (ptr == NULL) return;
+
+  header = (FishSoundAllocHeader *)ptr - 1;
+  fs_memory_account (header->h.owner, -(long)header->h.size, -1);
+
+  free (header);
+}
@@ -0,0 +1,104 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+
+int
+fish_sound_set_trace_hooks (FishSound * fsound,
+			    const FishSoundTraceHooks * hooks)
+{
+  FishSoundTraceHooks * trace;
+  FishSound * outer;
+
+  if (fsound == NULL) return FISH_SOUND_ERR_BAD;
+
+  /* The encoder thread may be calling the current hooks */
+  if (fsound->async)
+    fish_sound_async_sync (fsound);
+
+  if (hooks == NULL) {
+    if (fsound->trace) fs_free (fsound->trace);
+    fsound->trace = NULL;
+    return 0;
+  }
+
+  if ((trace = fsound->trace) == NULL) {
+    outer = fish_sound_memory_enter (fsound);
+    trace = fs_malloc (sizeof (FishSoundTraceHooks));
+    fish_sound_memory_leave (outer);
+    if (trace == NULL)
+      return FISH_SOUND_ERR_OUT_OF_MEMORY;
+  }
+
+  memcpy (trace, hooks, sizeof (FishSoundTraceHooks));
+  fsound->trace = trace;
+
+  return 0;
+}
+
+void
+fish_sound_trace (FishSound * fsound, FishSoundTraceEvent event,
+		  double timestamp, long value)
+{
+  FishSoundTraceHooks * trace = fsound->trace;
+  FishSoundTraceHook hook = NULL;
+  long packetno;
+
+  switch (event) {
+  case FS_TRACE_DECODE_BEGIN: hook = trace->decode_begin; break;
+  case FS_TRACE_DECODE_END: hook = trace->decode_end; break;
+  case FS_TRACE_ENCODE_BEGIN: hook = trace->encode_begin; break;
+  case FS_TRACE_ENCODE_END: hook = trace->encode_end; break;
+  case FS_TRACE_CALLBACK_BEGIN: hook = trace->callback_begin; break;
+  case FS_TRACE_CALLBACK_END: hook = trace->callback_end; break;
+  case FS_TRACE_HEADERS: hook = trace->headers; break;
+  case FS_TRACE_ERROR: hook = trace->error; break;
+  default: break;
+  }
+
+  if (hook == NULL) return;
+
+  /* Packets are counted in the statistics as they are processed */
+  if (fsound->mode == FISH_SOUND_DECODE)
+    packetno = fsound->stats.packets_in - 1;
+  else
+    packetno = fsound->stats.packets_out;
+
+  hook (fsound, fsound->info.format, packetno, timestamp, value,
+	trace->user_data);
+}
@@ -41,7 +41,6 @@
 #include "private.h"
 #include "convert.h"
 
-/*#define DEBUG*/
 #include "debug.h"
 
 #if HAVE_VORBIS
@@ -59,49 +58,109 @@ typedef struct _FishSoundVorbisInfo {
   float ** pcm; /** ongoing pcm working space for decoder (stateful) */
   float * ipcm; /** interleaved pcm for interfacing with user */
   long max_pcm;
+  long frames_in; /** frames passed to the encoder */
+  long frames_out; /** granulepos of the last packet encoded */
 } FishSoundVorbisInfo;
 
+/* Length of the Vorbis identification header */
+#define FS_VORBIS_ID_HEADER_SIZE 30
+
 int
 fish_sound_vorbis_identify (unsigned char * buf, long bytes)
 {
-  struct vorbis_info vi;
-  struct vorbis_comment vc;
-  ogg_packet op;
-  int ret, id = FISH_SOUND_UNKNOWN;
+  int blocksize_0, blocksize_1;
 
-  if (!strncmp ((char *)&buf[1], "vorbis", 6)) {
-    /* if only a short buffer was passed, do a weak identify */
-    if (bytes == 8) return FISH_SOUND_VORBIS;
+  if (bytes < 8) return FISH_SOUND_UNKNOWN;
 
-    /* otherwise, assume the buffer is an entire initial header and
-     * feed it to vorbis_synthesis_headerin() */
+  if (buf[0] != 0x01 || strncmp ((char *)&buf[1], "vorbis", 6))
+    return FISH_SOUND_UNKNOWN;
 
-    vorbis_info_init (&vi);
-    vorbis_comment_init (&vc);
+  /* if only a short buffer was passed, do a weak identify */
+  if (bytes == 8) return FISH_SOUND_VORBIS;
 
-    op.packet = buf;
-    op.bytes = bytes;
-    op.b_o_s = 1;
-    op.e_o_s = 0;
-    op.granulepos = 0;
-    op.packetno = 0;
+  /* otherwise, assume the buffer is an entire identification header and
+   * check its fields as vorbis_synthesis_headerin() would */
+  if (bytes < FS_VORBIS_ID_HEADER_SIZE) return FISH_SOUND_UNKNOWN;
 
-    if ((ret = vorbis_synthesis_headerin (&vi, &vc, &op)) == 0) {
-      if (vi.rate != 0) id = FISH_SOUND_VORBIS;
-    } else {
-      debug_printf (1, "vorbis_synthesis_headerin returned %d", ret);
-    }
+  /* vorbis_version, audio_channels, audio_sample_rate */
+  if (fs_read_le32 (&buf[7]) != 0 || buf[11] == 0 ||
+      fs_read_le32 (&buf[12]) == 0)
+    return FISH_SOUND_UNKNOWN;
 
-    vorbis_info_clear (&vi);
-  }
+  /* blocksize_0 <= blocksize_1, as powers of two from 64 to 8192 */
+  blocksize_0 = buf[28] & 0x0f;
+  blocksize_1 = buf[28] >> 4;
+  if (blocksize_0 < 6 || blocksize_1 < blocksize_0 || blocksize_1 > 13)
+    return FISH_SOUND_UNKNOWN;
 
-  return id;
+  /* framing_flag */
+  if ((buf[29] & 0x01) == 0) return FISH_SOUND_UNKNOWN;
+
+  return FISH_SOUND_VORBIS;
+}
+
+/*
+ * Ensure the interleaved output buffer can hold at least 'samples' frames.
+ */
+static int
+fs_vorbis_alloc_ipcm (FishSound * fsound, long samples)
+{
+  FishSoundVorbisInfo * fsv = (FishSoundVorbisInfo *)fsound->codec_data;
+  float * pcm_new;
+
+  if (samples <= fsv->max_pcm) return 0;
+
+  pcm_new = fs_realloc (fsv->ipcm,
+			sizeof(float) * samples * fsound->info.channels);
+  if (pcm_new == NULL) return FISH_SOUND_ERR_OUT_OF_MEMORY;
+
+  fsv->ipcm = pcm_new;
+  fsv->max_pcm = samples;
+
+  return 0;
+}
+
+/*
+ * In real-time mode, size the output buffer for the largest block that
+ * can be returned, once the setup header has been decoded.
+ */
+static int
+fs_vorbis_realtime_alloc (FishSound * fsound)
+{
+  FishSoundVorbisInfo * fsv = (FishSoundVorbisInfo *)fsound->codec_data;
+
+  if (!fsound->realtime || fsound->mode != FISH_SOUND_DECODE ||
+      fsv->packetno < 3)
+    return 0;
+
+  return fs_vorbis_alloc_ipcm (fsound, vorbis_info_blocksize (&fsv->vi, 1));
 }
 
 static int
 fs_vorbis_command (FishSound * fsound, int command, void * data,
 		   int datasize)
 {
+  FishSoundVorbisInfo * fsv = (FishSoundVorbisInfo *)fsound->codec_data;
+  long * pl = (long *)data;
+
+  switch (command) {
+  case FISH_SOUND_SET_REALTIME:
+    return fs_vorbis_realtime_alloc (fsound);
+  case FISH_SOUND_GET_LATENCY:
+    /* The encoder holds back the overlap of each window with the next, and
+     * looks ahead to decide on block switching: up to one long block. The
+     * decoder passes out audio as soon as a packet completes it. */
+    if (fsound->mode == FISH_SOUND_ENCODE)
+      *pl = vorbis_info_blocksize (&fsv->vi, 1);
+    break;
+  case FISH_SOUND_GET_PENDING_FRAMES:
+    if (fsound->mode == FISH_SOUND_ENCODE)
+      *pl = fsv->frames_in - fsv->frames_out;
+    break;
+  default:
+    break;
+  }
+
   return 0;
 }
 
@@ -112,7 +171,6 @@ fs_vorbis_decode (FishSound * fsound, unsigned char * buf, long bytes)
   FishSoundVorbisInfo * fsv = (FishSoundVorbisInfo *)fsound->codec_data;
   ogg_packet op;
   long samples;
-  float * pcm_new;
   int ret;
 
   /* Make an ogg_packet structure to pass the data to libvorbis */
@@ -145,16 +203,33 @@ fs_vorbis_decode (FishSound * fsound, unsigned char * buf, long bytes)
     } else if (fsv->packetno == 2) {
       vorbis_synthesis_init (&fsv->vd, &fsv->vi);
       vorbis_block_init (&fsv->vd, &fsv->vb);
+
+      fish_sound_trace_event (fsound, FS_TRACE_HEADERS, 0);
+
+      if (fsound->realtime &&
+	  fs_vorbis_alloc_ipcm (fsound,
+				vorbis_info_blocksize (&fsv->vi, 1)) != 0) {
+	fsv->packetno++;
+	return FISH_SOUND_ERR_OUT_OF_MEMORY;
+      }
     }
   } else {
-    FishSoundDecoded_FloatIlv df;
-    FishSoundDecoded_Float dfi;
     int r;
+
+    fs_realtime_begin (fsound);
+
     if ((r = vorbis_synthesis (&fsv->vb, &op)) == 0) 
       vorbis_synthesis_blockin (&fsv->vd, &fsv->vb);
     
     if (r == OV_EBADPACKET) {
+      fs_realtime_end (fsound);
+      fs_log (fsound, FISH_SOUND_LOG_ERROR, FISH_SOUND_ERR_GENERIC,
+	      "Vorbis decoder: bad packet %d", fsv->packetno);
       return FISH_SOUND_ERR_GENERIC;
+    } else if (r != 0) {
+      fs_log (fsound, FISH_SOUND_LOG_WARNING, FISH_SOUND_ERR_GENERIC,
+	      "Vorbis decoder: skipped packet %d (error %d)", fsv->packetno,
+	      r);
     }
 
     while ((samples = vorbis_synthesis_pcmout (&fsv->vd, &fsv->pcm)) > 0) {
@@ -163,28 +238,28 @@ fs_vorbis_decode (FishSound * fsound, unsigned char * buf, long bytes)
       if (fsound->frameno != -1)
 	fsound->frameno += samples;
 
+      FS_PROBE4 (codec__decode, fsound, FISH_SOUND_VORBIS, bytes, samples);
+
       if (fsound->interleave) {
 	if (samples > fsv->max_pcm) {
-          pcm_new = realloc (fsv->ipcm, sizeof(float) * samples *
-			     fsound->info.channels);
-          if (pcm_new == NULL) {
-            /* Allocation failure; just truncate here, fail gracefully elsewhere */
-            samples = fsv->max_pcm;
-          } else {
-	    fsv->ipcm = pcm_new;
-	    fsv->max_pcm = samples;
-          }
+	  /* In real-time mode the buffer is already sized for the largest
+	   * block; otherwise on allocation failure, just truncate here and
+	   * fail gracefully elsewhere */
+	  if (fsound->realtime ||
+	      fs_vorbis_alloc_ipcm (fsound, samples) != 0)
+	    samples = fsv->max_pcm;
 	}
 	_fs_interleave (fsv->pcm, (float **)fsv->ipcm, samples,
 			fsound->info.channels, 1.0);
 
-	dfi = (FishSoundDecoded_FloatIlv)fsound->callback.decoded_float_ilv;
-	dfi (fsound, (float **)fsv->ipcm, samples, fsound->user_data);
+	fish_sound_dispatch_decoded_float_ilv (fsound, (float **)fsv->ipcm,
+					       samples);
       } else {
-	df = (FishSoundDecoded_Float)fsound->callback.decoded_float;
-	df (fsound, fsv->pcm, samples, fsound->user_data);
+	fish_sound_dispatch_decoded_float (fsound, fsv->pcm, samples);
       }
     }
+
+    fs_realtime_end (fsound);
   }
 
   if (fsound->next_granulepos != -1) {
@@ -208,7 +283,10 @@ static FishSound *
 fs_vorbis_enc_headers (FishSound * fsound)
 {
   FishSoundVorbisInfo * fsv = (FishSoundVorbisInfo *)fsound->codec_data;
-  const FishSoundComment * comment;
+  const unsigned char * comments;
+  unsigned char * packet;
+  char vendor[256];
+  long bytes, vendor_length;
   ogg_packet header;
   ogg_packet header_comm;
   ogg_packet header_code;
@@ -222,29 +300,47 @@ fs_vorbis_enc_headers (FishSound * fsound)
    * a time; libvorbis handles the additional Ogg bitstream constraints.
    */
 
-  /* Update the comments */
-  for (comment = fish_sound_comment_first (fsound); comment;
-       comment = fish_sound_comment_next (fsound, comment)) {
-    debug_printf (1, "%s = %s", comment->name, comment->value);
-    vorbis_comment_add_tag (&fsv->vc, comment->name, comment->value);
-  }
-
-  /* Generate the headers */
+  /* Generate the headers. libvorbis is given no comments: the comment
+   * header is replaced by the packet cached by comments.c, under the
+   * vendor string which libvorbis wrote */
   vorbis_analysis_headerout(&fsv->vd, &fsv->vc,
 			    &header, &header_comm, &header_code);
 
   /* Pass the generated headers to the user */
   if (fsound->callback.encoded) {
-    FishSoundEncoded encoded = (FishSoundEncoded)fsound->callback.encoded;
+    if (header_comm.bytes >= 11) {
+      vendor_length = ((long)header_comm.packet[10] << 24) |
+	((long)header_comm.packet[9] << 16) |
+	((long)header_comm.packet[8] << 8) | (long)header_comm.packet[7];
+      if (vendor_length > header_comm.bytes - 11)
+	vendor_length = header_comm.bytes - 11;
+      snprintf (vendor, sizeof (vendor), "%.*s", (int)vendor_length,
+		(char *)&header_comm.packet[11]);
+      if (fish_sound_comment_set_vendor (fsound, vendor) != 0)
+	return NULL;
+    }
 
-    encoded (fsound, header.packet, header.bytes, fsound->user_data);
-    encoded (fsound, header_comm.packet, header_comm.bytes,
-	     fsound->user_data);
-    encoded (fsound, header_code.packet, header_code.bytes,
-	     fsound->user_data);
+    if ((comments = fish_sound_comments_packet (fsound, &bytes)) == NULL)
+      return NULL;
+
+    if ((packet = fs_malloc (7 + bytes)) == NULL)
+      return NULL;
+
+    /* Packet type 3 and the "vorbis" marker precede the comments */
+    memcpy (packet, header_comm.packet, 7);
+    memcpy (packet + 7, comments, bytes);
+
+    fish_sound_dispatch_encoded (fsound, header.packet, header.bytes);
+    fish_sound_dispatch_encoded (fsound, packet, 7 + bytes);
+    fish_sound_dispatch_encoded (fsound, header_code.packet,
+				 header_code.bytes);
     fsv->packetno = 3;
+
+    fs_free (packet);
   }
 
+  fish_sound_trace_event (fsound, FS_TRACE_HEADERS, 0);
+
   return fsound;
 }
 
@@ -255,19 +351,21 @@ fs_vorbis_encode_write (FishSound * fsound, long len)
   ogg_packet op;
 
   vorbis_analysis_wrote (&fsv->vd, len);
+  fsv->frames_in += len;
 
   while (vorbis_analysis_blockout (&fsv->vd, &fsv->vb) == 1) {
     vorbis_analysis (&fsv->vb, NULL);
     vorbis_bitrate_addblock (&fsv->vb);
 
     while (vorbis_bitrate_flushpacket (&fsv->vd, &op)) {
-      if (fsound->callback.encoded) {
-	FishSoundEncoded encoded = (FishSoundEncoded)fsound->callback.encoded;
+      if (op.granulepos != -1)
+	fsv->frames_out = op.granulepos;
 
+      if (fsound->callback.encoded) {
 	if (op.granulepos != -1)
 	  fsound->frameno = op.granulepos;
 
-	encoded (fsound, op.packet, op.bytes, fsound->user_data);
+	fish_sound_dispatch_encoded (fsound, op.packet, op.bytes);
 
 	fsv->packetno++;
       }
@@ -305,10 +403,15 @@ fs_vorbis_encode_f_ilv (FishSound * fsound, float ** pcm, long frames)
   }
 
   if (frames == 0) {
+    FS_PROBE2 (codec__flush, fsound, FISH_SOUND_VORBIS);
     fs_vorbis_finish (fsound);
     return 0;
   }
 
+  FS_PROBE3 (codec__encode, fsound, FISH_SOUND_VORBIS, frames);
+
+  fs_realtime_begin (fsound);
+
   while (remaining > 0) {
     len = MIN (1024, remaining);
 
@@ -331,6 +434,8 @@ fs_vorbis_encode_f_ilv (FishSound * fsound, float ** pcm, long frames)
   if (fsound->next_eos)
     fs_vorbis_finish (fsound);
 
+  fs_realtime_end (fsound);
+
   return 0;
 }
 
@@ -347,10 +452,15 @@ fs_vorbis_encode_f (FishSound * fsound, float * pcm[], long frames)
   }
 
   if (frames == 0) {
+    FS_PROBE2 (codec__flush, fsound, FISH_SOUND_VORBIS);
     fs_vorbis_finish (fsound);
     return 0;
   }
 
+  FS_PROBE3 (codec__encode, fsound, FISH_SOUND_VORBIS, frames);
+
+  fs_realtime_begin (fsound);
+
   while (remaining > 0) {
     len = MIN (1024, remaining);
 
@@ -375,6 +485,8 @@ fs_vorbis_encode_f (FishSound * fsound, float * pcm[], long frames)
   if (fsound->next_eos)
     fs_vorbis_finish (fsound);
 
+  fs_realtime_end (fsound);
+
   return 0;
 }
 
@@ -433,6 +545,8 @@ fs_vorbis_init (FishSound * fsound)
   fsv->pcm = NULL;
   fsv->ipcm = NULL;
   fsv->max_pcm = 0;
+  fsv->frames_in = 0;
+  fsv->frames_out = 0;
 
   fsound->codec_data = fsv;
 
@@ -469,29 +583,22 @@ fs_vorbis_delete (FishSound * fsound)
   return fsound;
 }
 
-FishSoundCodec *
+static const FishSoundCodec fs_vorbis_codec = {
+  {FISH_SOUND_VORBIS, "Vorbis (Xiph.Org)", "ogg"},
+  FISH_SOUND_CODEC_DECODE | (HAVE_VORBISENC ? FISH_SOUND_CODEC_ENCODE : 0),
+  "\001vorbis", 7,
+  fish_sound_vorbis_identify,
+  fs_vorbis_init, fs_vorbis_delete, fs_vorbis_reset,
+  NULL, /* update: XXX */
+  fs_vorbis_command, fs_vorbis_decode,
+  fs_vorbis_encode_f_ilv, fs_vorbis_encode_f,
+  NULL /* flush */
+};
+
+const FishSoundCodec *
 fish_sound_vorbis_codec (void)
 {
-  FishSoundCodec * codec;
-
-  codec = (FishSoundCodec *) fs_malloc (sizeof (FishSoundCodec));
-  if (codec == NULL) return NULL;
-
-  codec->format.format = FISH_SOUND_VORBIS;
-  codec->format.name = "Vorbis (Xiph.Org)";
-  codec->format.extension = "ogg";
-
-  codec->init = fs_vorbis_init;
-  codec->del = fs_vorbis_delete;
-  codec->reset = fs_vorbis_reset;
-  codec->update = NULL; /* XXX */
-  codec->command = fs_vorbis_command;
-  codec->decode = fs_vorbis_decode;
-  codec->encode_f = fs_vorbis_encode_f;
-  codec->encode_f_ilv = fs_vorbis_encode_f_ilv;
-  codec->flush = NULL;
-
-  return codec;
+  return &fs_vorbis_codec;
 }
 
 #else /* !HAVE_VORBIS */
@@ -502,7 +609,7 @@ fish_sound_vorbis_identify (unsigned char * buf, long bytes)
   return FISH_SOUND_UNKNOWN;
 }
 
-FishSoundCodec *
+const FishSoundCodec *
 fish_sound_vorbis_codec (void)
 {
   return NULL;
@@ -0,0 +1,273 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define FORMAT_PT FISH_SOUND_CODEC_USER
+#define FORMAT_PT2 (FISH_SOUND_CODEC_USER + 1)
+
+#define SAMPLERATE 8000
+#define BLOCKSIZE 64
+#define NBLOCKS 10
+
+/*
+ * A passthrough codec: a header packet of "FSPT" followed by the sample
+ * rate, then packets of mono float samples.
+ */
+
+static FishSound *
+pt_init (FishSound * fsound)
+{
+  long * packetno;
+
+  if ((packetno = calloc (1, sizeof (long))) == NULL) return NULL;
+  fish_sound_codec_set_data (fsound, packetno);
+
+  return fsound;
+}
+
+static FishSound *
+pt_delete (FishSound * fsound)
+{
+  free (fish_sound_codec_get_data (fsound));
+  return fsound;
+}
+
+static long
+pt_decode (FishSound * fsound, unsigned char * buf, long bytes)
+{
+  long * packetno = fish_sound_codec_get_data (fsound);
+  float samples[BLOCKSIZE], * pcm[1];
+  int samplerate;
+
+  if ((*packetno)++ == 0) {
+    memcpy (&samplerate, buf + 4, sizeof (int));
+    fish_sound_codec_set_info (fsound, samplerate, 1);
+    return 0;
+  }
+
+  if (bytes > (long)sizeof (samples)) FAIL ("Packet too long");
+  memcpy (samples, buf, bytes);
+  pcm[0] = samples;
+
+  return fish_sound_codec_decoded (fsound, pcm, bytes / sizeof (float));
+}
+
+static long
+pt_encode_f (FishSound * fsound, float * pcm[], long frames)
+{
+  long * packetno = fish_sound_codec_get_data (fsound);
+  FishSoundInfo fsinfo;
+  unsigned char header[8];
+
+  if ((*packetno)++ == 0) {
+    fish_sound_command (fsound, FISH_SOUND_GET_INFO, &fsinfo,
+			sizeof (FishSoundInfo));
+    memcpy (header, "FSPT", 4);
+    memcpy (header + 4, &fsinfo.samplerate, sizeof (int));
+    fish_sound_codec_encoded (fsound, header, 8, 0);
+  }
+
+  fish_sound_codec_encoded (fsound, (unsigned char *)pcm[0],
+			    frames * sizeof (float),
+			    fish_sound_get_frameno (fsound) + frames);
+
+  return frames;
+}
+
+static const FishSoundCodec pt_codec = {
+  {FORMAT_PT, "Passthrough", "pt"},
+  FISH_SOUND_CODEC_DECODE | FISH_SOUND_CODEC_ENCODE,
+  "FSPT", 4,
+  NULL,
+  pt_init, pt_delete, NULL, NULL, NULL, pt_decode,
+  NULL, pt_encode_f, NULL
+};
+
+/* A decoder with the same signature, which accepts only a header */
+static int
+pt2_identify (unsigned char * buf, long bytes)
+{
+  return bytes == 8 ? FORMAT_PT2 : FISH_SOUND_UNKNOWN;
+}
+
+static const FishSoundCodec pt2_codec = {
+  {FORMAT_PT2, "Passthrough header", "pt"},
+  FISH_SOUND_CODEC_DECODE,
+  "FSPT", 4,
+  pt2_identify,
+  NULL, NULL, NULL, NULL, NULL, NULL,
+  NULL, NULL, NULL
+};
+
+static const FishSoundCodec bad_codec = {
+  {FORMAT_PT2, "Bad signature", "bad"},
+  FISH_SOUND_CODEC_DECODE,
+  "BADSIGNATURE", 12,
+  NULL,
+  NULL, NULL, NULL, NULL, NULL, NULL,
+  NULL, NULL, NULL
+};
+
+#if FS_ENCODE && FS_DECODE
+static long nr_decoded = 0;
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  FishSound * decoder = (FishSound *)user_data;
+
+  fish_sound_decode (decoder, buf, bytes);
+
+  return 0;
+}
+
+static int
+decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  FishSoundInfo fsinfo;
+  long i;
+
+  fish_sound_command (fsound, FISH_SOUND_GET_INFO, &fsinfo,
+		      sizeof (FishSoundInfo));
+  if (fsinfo.format != FORMAT_PT || fsinfo.samplerate != SAMPLERATE)
+    FAIL ("Incorrect stream info decoded");
+
+  for (i = 0; i < frames; i++) {
+    if (pcm[0][i] != (float)(nr_decoded + i))
+      FAIL ("Incorrect sample decoded");
+  }
+  nr_decoded += frames;
+
+  if (fish_sound_get_frameno (fsound) != nr_decoded)
+    FAIL ("Incorrect frameno after decoding");
+
+  return 0;
+}
+#endif
+
+int
+main (int argc, char * argv[])
+{
+  unsigned char header[8] = {'F', 'S', 'P', 'T', 0, 0, 0, 0};
+#if FS_ENCODE && FS_DECODE
+  FishSound * encoder, * decoder;
+  FishSoundInfo fsinfo;
+  float samples[BLOCKSIZE], * pcm[1];
+  int i, j;
+#endif
+
+  INFO ("Registering invalid codecs");
+  if (fish_sound_codec_register (NULL, 0) != FISH_SOUND_ERR_BAD)
+    FAIL ("NULL codec registered");
+  if (fish_sound_codec_register (&bad_codec, 0) != FISH_SOUND_ERR_INVALID)
+    FAIL ("Codec with long signature registered");
+
+  INFO ("Identifying before registration");
+  if (fish_sound_identify (header, 8) != FISH_SOUND_UNKNOWN)
+    FAIL ("Unregistered codec identified");
+
+  INFO ("Registering passthrough codec");
+  if (fish_sound_codec_register (&pt_codec, 0) != 0)
+    FAIL ("Operation failed");
+  if (fish_sound_identify (header, 8) != FORMAT_PT)
+    FAIL ("Registered codec not identified");
+
+  INFO ("+ Registering codec with equal priority (expect first)");
+  if (fish_sound_codec_register (&pt2_codec, 0) != 0)
+    FAIL ("Operation failed");
+  if (fish_sound_identify (header, 8) != FORMAT_PT)
+    FAIL ("Codec order not kept for equal priority");
+
+  INFO ("+ Raising priority of second codec");
+  if (fish_sound_codec_set_priority (FORMAT_PT2, 10) != 0)
+    FAIL ("Operation failed");
+  if (fish_sound_identify (header, 8) != FORMAT_PT2)
+    FAIL ("Higher priority codec not identified");
+
+  INFO ("+ Falling back when identify fails");
+  if (fish_sound_identify (header, 12) != FORMAT_PT)
+    FAIL ("Lower priority codec not identified");
+
+  INFO ("+ Unregistering second codec");
+  if (fish_sound_codec_unregister (FORMAT_PT2) != 0)
+    FAIL ("Operation failed");
+  if (fish_sound_codec_unregister (FORMAT_PT2) != FISH_SOUND_ERR_INVALID)
+    FAIL ("Unregistered codec unregistered");
+  if (fish_sound_codec_set_priority (FORMAT_PT2, 0) != FISH_SOUND_ERR_INVALID)
+    FAIL ("Priority of unregistered codec set");
+  if (fish_sound_identify (header, 8) != FORMAT_PT)
+    FAIL ("Registered codec not identified");
+
+#if FS_ENCODE && FS_DECODE
+  INFO ("Encoding and decoding with passthrough codec");
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = 1;
+  fsinfo.format = FORMAT_PT;
+
+  decoder = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  encoder = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  if (encoder == NULL) FAIL ("Encoder not created");
+
+  fish_sound_set_encoded_callback (encoder, encoded, decoder);
+  fish_sound_set_decoded_float (decoder, decoded, NULL);
+
+  pcm[0] = samples;
+  for (i = 0; i < NBLOCKS; i++) {
+    for (j = 0; j < BLOCKSIZE; j++)
+      samples[j] = (float)(i * BLOCKSIZE + j);
+    fish_sound_encode_float (encoder, pcm, BLOCKSIZE);
+  }
+
+  if (nr_decoded != NBLOCKS * BLOCKSIZE)
+    FAIL ("Incorrect number of frames decoded");
+
+  fish_sound_delete (encoder);
+  fish_sound_delete (decoder);
+
+  INFO ("+ Creating encoder for a decode-only codec");
+  fish_sound_codec_register (&pt2_codec, 0);
+  fsinfo.format = FORMAT_PT2;
+  if (fish_sound_new (FISH_SOUND_ENCODE, &fsinfo) != NULL)
+    FAIL ("Encoder created for decode-only codec");
+#endif
+
+  exit (0);
+}
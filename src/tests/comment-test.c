@@ -46,15 +46,21 @@
 #define LICENSE "Creative Commons Attribution-ShareAlike"
 #define COMMENT "Unstructured comments are evil."
 
-static FishSound * fsound;
+#define NR_MANY 1000
+#define NR_NAMES 10
+
+static FishSound * fsound, * fsound2;
 
 int
 main (int argc, char * argv[])
 {
   FishSoundInfo fsinfo;
   const FishSoundComment * comment, * comment2;
-  FishSoundComment mycomment;
-  int err;
+  FishSoundComment mycomment, shared[3];
+  FishSoundCommentIter iter;
+  FishSoundCommentSet * set;
+  char name[16], value[16];
+  int err, n;
 
   fsinfo.samplerate = 16000;
   fsinfo.channels = 1;
@@ -66,8 +72,10 @@ main (int argc, char * argv[])
   fsinfo.format = FISH_SOUND_VORBIS;
 #elif HAVE_SPEEX
   fsinfo.format = FISH_SOUND_SPEEX;
-#else
+#elif HAVE_FLAC
   fsinfo.format = FISH_SOUND_FLAC;
+#else
+  fsinfo.format = FISH_SOUND_PCM;
 #endif
 
 #if FS_ENCODE
@@ -171,6 +179,56 @@ main (int argc, char * argv[])
   if (strcmp (comment->value, ARTIST2))
     FAIL ("Incorrect ARTIST2 value found");
 
+  INFO ("+ Iterating all comments (expect 6)");
+  if (fish_sound_comment_iter_init (fsound, &iter, NULL) != 0)
+    FAIL ("Iterator initialization failed");
+
+  for (n = 0; fish_sound_comment_iter_next (&iter) != NULL; n++);
+  if (n != 6)
+    FAIL ("Incorrect number of comments iterated");
+
+  INFO ("+ Iterating ARTIST comments (expect 2)");
+  fish_sound_comment_iter_init (fsound, &iter, "artist");
+
+  comment = fish_sound_comment_iter_next (&iter);
+  if (comment == NULL || strcmp (comment->value, ARTIST1))
+    FAIL ("Incorrect first ARTIST iterated");
+
+  comment = fish_sound_comment_iter_next (&iter);
+  if (comment == NULL || strcmp (comment->value, ARTIST2))
+    FAIL ("Incorrect second ARTIST iterated");
+
+  if (fish_sound_comment_iter_next (&iter) != NULL)
+    FAIL ("ARTIST iteration unterminated");
+
+  INFO ("+ Initializing iterator with invalid name");
+  if (fish_sound_comment_iter_init (fsound, &iter, "A=B") !=
+      FISH_SOUND_ERR_COMMENT_INVALID)
+    FAIL ("Invalid name accepted");
+
+  INFO ("+ Adding duplicate ARTIST2 byname");
+  err = fish_sound_comment_add_byname (fsound, "ARTIST", ARTIST2);
+  if (err < 0) FAIL ("Operation failed");
+
+  INFO ("+ Iterating duplicates with next (expect 7)");
+  n = 0;
+  for (comment = fish_sound_comment_first (fsound); comment != NULL;
+       comment = fish_sound_comment_next (fsound, comment)) {
+    if (++n > 7) FAIL ("Iteration of duplicates does not terminate");
+  }
+  if (n != 7)
+    FAIL ("Incorrect number of comments iterated");
+
+  INFO ("+ Iterating duplicates with next_byname (expect 3)");
+  n = 0;
+  for (comment = fish_sound_comment_first_byname (fsound, "ARTIST");
+       comment != NULL;
+       comment = fish_sound_comment_next_byname (fsound, comment)) {
+    if (++n > 3) FAIL ("Iteration of duplicates does not terminate");
+  }
+  if (n != 3)
+    FAIL ("Incorrect number of ARTIST comments iterated");
+
   INFO ("+ Removing LICENSE byname");
   err = fish_sound_comment_remove_byname (fsound, "LICENSE");
   if (err != 1) FAIL ("Operation failed");
@@ -193,8 +251,102 @@ main (int argc, char * argv[])
   if (comment != NULL)
     FAIL ("Removed comment incorrectly retrieved");
 
+  INFO ("+ Adding many comments with interleaved names");
+  for (n = 0; n < NR_MANY; n++) {
+    snprintf (name, sizeof (name), "TAG%d", n % NR_NAMES);
+    snprintf (value, sizeof (value), "%d", n);
+    err = fish_sound_comment_add_byname (fsound, name, value);
+    if (err < 0) FAIL ("Operation failed");
+  }
+
+  INFO ("+ Iterating one name among many (expect ordered values)");
+  fish_sound_comment_iter_init (fsound, &iter, "tag3");
+  for (n = 3; (comment = fish_sound_comment_iter_next (&iter)) != NULL;
+       n += NR_NAMES) {
+    if (atoi (comment->value) != n)
+      FAIL ("Incorrect value iterated");
+  }
+  if (n != NR_MANY + 3)
+    FAIL ("Incorrect number of comments iterated");
+
+  INFO ("+ Removing one name among many");
+  err = fish_sound_comment_remove_byname (fsound, "Tag3");
+  if (err != NR_MANY / NR_NAMES)
+    FAIL ("Incorrect number of comments removed");
+
+  if (fish_sound_comment_first_byname (fsound, "TAG3") != NULL)
+    FAIL ("Removed comment incorrectly retrieved");
+
+  INFO ("+ Retrieving remaining names after removal");
+  comment = fish_sound_comment_first_byname (fsound, "TAG4");
+  for (n = 4; comment != NULL; n += NR_NAMES) {
+    if (atoi (comment->value) != n)
+      FAIL ("Incorrect value retrieved");
+    comment = fish_sound_comment_next_byname (fsound, comment);
+  }
+  if (n != NR_MANY + 4)
+    FAIL ("Incorrect number of comments retrieved");
+
   INFO ("Deleting FishSound (encode)");
   fish_sound_delete (fsound);
+
+  INFO ("Creating comment set");
+  shared[0].name = "ARTIST"; shared[0].value = ARTIST1;
+  shared[1].name = "COPYRIGHT"; shared[1].value = COPYRIGHT;
+  shared[2].name = "ARTIST"; shared[2].value = ARTIST2;
+  set = fish_sound_comment_set_new (shared, 3);
+  if (set == NULL) FAIL ("Comment set creation failed");
+
+  INFO ("+ Creating comment set with invalid name");
+  mycomment.name = "A=B";
+  mycomment.value = ARTIST1;
+  if (fish_sound_comment_set_new (&mycomment, 1) != NULL)
+    FAIL ("Invalid name accepted");
+
+  INFO ("+ Attaching comment set to two encoders");
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fsound2 = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  if (fish_sound_comment_attach_set (fsound, set) != 0 ||
+      fish_sound_comment_attach_set (fsound2, set) != 0)
+    FAIL ("Operation failed");
+  fish_sound_comment_set_unref (set);
+
+  INFO ("+ Retrieving shared ARTIST comments (expect ARTIST1, ARTIST2)");
+  comment = fish_sound_comment_first_byname (fsound, "artist");
+  if (comment == NULL || strcmp (comment->value, ARTIST1))
+    FAIL ("Shared ARTIST1 not retrieved");
+  comment = fish_sound_comment_next_byname (fsound, comment);
+  if (comment == NULL || strcmp (comment->value, ARTIST2))
+    FAIL ("Shared ARTIST2 not retrieved");
+
+  INFO ("+ Adding LICENSE to one encoder");
+  err = fish_sound_comment_add_byname (fsound2, "LICENSE", LICENSE);
+  if (err < 0) FAIL ("Operation failed");
+
+  comment = fish_sound_comment_first_byname (fsound2, "LICENSE");
+  if (comment == NULL || strcmp (comment->value, LICENSE))
+    FAIL ("Added LICENSE not retrieved");
+
+  if (fish_sound_comment_first_byname (fsound, "LICENSE") != NULL)
+    FAIL ("Comment added to shared set");
+
+  INFO ("+ Removing ARTIST from the other encoder");
+  err = fish_sound_comment_remove_byname (fsound, "ARTIST");
+  if (err != 2) FAIL ("Incorrect number of comments removed");
+
+  comment = fish_sound_comment_first (fsound);
+  if (comment == NULL || strcmp (comment->name, "COPYRIGHT") ||
+      fish_sound_comment_next (fsound, comment) != NULL)
+    FAIL ("Incorrect comments after removal");
+
+  fish_sound_comment_iter_init (fsound2, &iter, "ARTIST");
+  for (n = 0; fish_sound_comment_iter_next (&iter) != NULL; n++);
+  if (n != 2)
+    FAIL ("Comments removed from shared set");
+
+  INFO ("Deleting FishSounds with comment sets");
+  fish_sound_delete (fsound);
+  fish_sound_delete (fsound2);
 #endif /* FS_ENCODE */
 
 #if FS_DECODE
@@ -210,7 +210,9 @@ fs_encdec_test (int samplerate, int channels, int format, int interleave,
   snprintf (msg, 128,
             "+ %2d channel %6d Hz %s, %d frame buffer (%s)",
             channels, samplerate,
-            format == FISH_SOUND_VORBIS ? "Vorbis" : (format == FISH_SOUND_FLAC ? "Flac" : "Speex"),
+            format == FISH_SOUND_VORBIS ? "Vorbis" :
+            (format == FISH_SOUND_FLAC ? "Flac" :
+             (format == FISH_SOUND_FLAC_NATIVE ? "native Flac" : "Speex")),
             blocksize,
             interleave ? "interleave" : "non-interleave");
   INFO (msg);
@@ -344,7 +346,8 @@ main (int argc, char * argv[])
            if (test_channels[c] <= 8) {
              fs_encdec_test (test_samplerates[s], test_channels[c],
                              FISH_SOUND_FLAC, 0, test_blocksizes[b]);
-              
+             fs_encdec_test (test_samplerates[s], test_channels[c],
+                             FISH_SOUND_FLAC_NATIVE, 0, test_blocksizes[b]);
            }
          }
         }
@@ -369,7 +372,8 @@ main (int argc, char * argv[])
             if (test_channels[c] <= 8) {
               fs_encdec_test (test_samplerates[s], test_channels[c],
                               FISH_SOUND_FLAC, 1, test_blocksizes[b]);
-              
+              fs_encdec_test (test_samplerates[s], test_channels[c],
+                              FISH_SOUND_FLAC_NATIVE, 1, test_blocksizes[b]);
             }
           }
         }
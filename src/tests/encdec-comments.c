@@ -47,16 +47,22 @@
 #define COPYRIGHT "Copyright (C) 2004. Some Rights Reserved."
 #define LICENSE "Creative Commons Attribute Share-Alike v1.0"
 
+#define NR_EXTRA 500
+
 typedef struct {
   FishSound * encoder;
   FishSound * decoder;
   float ** pcm;
+  char streamed[sizeof (LICENSE)];
+  long streamed_bytes;
 } FS_EncDec;
 
 static int
 decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
 {
   const FishSoundComment * comment;
+  FishSoundCommentIter iter;
+  int n;
 
   if (fsound == NULL)
     FAIL ("No Fish Found");
@@ -121,9 +127,73 @@ decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
   if (strcmp (comment->value, ARTIST2))
     FAIL ("Incorrect ARTIST2 value found");
 
+  INFO ("+ Counting EXTRA comments");
+  fish_sound_comment_iter_init (fsound, &iter, "EXTRA");
+  for (n = 0; (comment = fish_sound_comment_iter_next (&iter)) != NULL; n++) {
+    if (atoi (comment->value) != n)
+      FAIL ("Incorrect EXTRA value found");
+  }
+
+  if (n != NR_EXTRA)
+    FAIL ("Incorrect number of EXTRA comments found");
+
   return 0;
 }
 
+/* Decoded callback when EXTRA is filtered out and LICENSE is streamed */
+static int
+decoded_filtered (FishSound * fsound, float ** pcm, long frames,
+		  void * user_data)
+{
+  const FishSoundComment * comment;
+
+  comment = fish_sound_comment_first (fsound);
+  if (comment == NULL || strcmp (comment->value, ARTIST1))
+    FAIL ("ARTIST1 not retrieved after filtering");
+
+  comment = fish_sound_comment_next (fsound, comment);
+  if (comment == NULL || strcmp (comment->value, COPYRIGHT))
+    FAIL ("COPYRIGHT not retrieved after filtering");
+
+  comment = fish_sound_comment_next (fsound, comment);
+  if (comment == NULL || strcmp (comment->value, ARTIST2))
+    FAIL ("Streamed LICENSE stored");
+
+  if (fish_sound_comment_next (fsound, comment) != NULL)
+    FAIL ("Filtered EXTRA stored");
+
+  return 0;
+}
+
+static int
+filter (FishSound * fsound, const char * name, long value_length,
+	void * user_data)
+{
+  if (!strcmp (name, "EXTRA"))
+    return FISH_SOUND_COMMENT_SKIP;
+
+  return FISH_SOUND_COMMENT_KEEP;
+}
+
+static int
+stream (FishSound * fsound, const char * name, const unsigned char * data,
+	long bytes, long offset, long value_length, void * user_data)
+{
+  FS_EncDec * ed = (FS_EncDec *) user_data;
+
+  if (strcmp (name, "LICENSE"))
+    FAIL ("Unexpected comment streamed");
+
+  if (offset != ed->streamed_bytes ||
+      offset + bytes > (long)sizeof (ed->streamed) - 1)
+    FAIL ("Incorrect chunk of LICENSE streamed");
+
+  memcpy (ed->streamed + offset, data, bytes);
+  ed->streamed_bytes += bytes;
+
+  return FISH_SOUND_CONTINUE;
+}
+
 static int
 encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
 {
@@ -148,10 +218,11 @@ fs_fill_square (float * pcm, int length)
 }
 
 static FS_EncDec *
-fs_encdec_new (int format, int blocksize)
+fs_encdec_new (int format, int blocksize, int lazy)
 {
   FS_EncDec * ed;
   FishSoundInfo fsinfo;
+  int value = -1;
 
   ed = malloc (sizeof (FS_EncDec));
 
@@ -165,9 +236,19 @@ fs_encdec_new (int format, int blocksize)
   fish_sound_set_interleave (ed->encoder, 1);
   fish_sound_set_interleave (ed->decoder, 1);
 
+  fish_sound_command (ed->decoder, FISH_SOUND_SET_COMMENTS_LAZY, &lazy,
+		      sizeof (int));
+  fish_sound_command (ed->decoder, FISH_SOUND_GET_COMMENTS_LAZY, &value,
+		      sizeof (int));
+  if (value != lazy)
+    FAIL ("Lazy comment parsing not set");
+
   fish_sound_set_encoded_callback (ed->encoder, encoded, ed);
   fish_sound_set_decoded_callback (ed->decoder, decoded, ed);
   
+  memset (ed->streamed, 0, sizeof (ed->streamed));
+  ed->streamed_bytes = 0;
+
   ed->pcm = (float **) malloc (sizeof (float) * blocksize);
   fs_fill_square ((float *)ed->pcm, blocksize);
 
@@ -188,13 +269,23 @@ fs_encdec_delete (FS_EncDec * ed)
 }
 
 static int
-fs_encdec_comments_test (int format, int blocksize)
+fs_encdec_comments_test (int format, int blocksize, int lazy, int filtered)
 {
   FS_EncDec * ed;
   FishSoundComment mycomment;
-  int err;
+  char value[16];
+  int err, i;
   
-  ed = fs_encdec_new (format, blocksize);
+  ed = fs_encdec_new (format, blocksize, lazy);
+
+  if (filtered) {
+    INFO ("+ Filtering EXTRA and streaming LICENSE");
+    fish_sound_set_decoded_callback (ed->decoder, decoded_filtered, ed);
+    err = fish_sound_comment_set_filter (ed->decoder,
+					 (long)strlen (LICENSE) - 1,
+					 filter, stream, ed);
+    if (err < 0) FAIL ("Operation failed");
+  }
 
   INFO ("+ Adding ARTIST1 byname");
   err = fish_sound_comment_add_byname (ed->encoder, "ARTIST", ARTIST1);
@@ -214,32 +305,113 @@ fs_encdec_comments_test (int format, int blocksize)
   err = fish_sound_comment_add_byname (ed->encoder, "ARTIST", ARTIST2);
   if (err < 0) FAIL ("Operation failed");
 
+  INFO ("+ Adding EXTRA comments byname");
+  for (i = 0; i < NR_EXTRA; i++) {
+    snprintf (value, sizeof (value), "%d", i);
+    err = fish_sound_comment_add_byname (ed->encoder, "EXTRA", value);
+    if (err < 0) FAIL ("Operation failed");
+  }
+
   fish_sound_encode (ed->encoder, ed->pcm, blocksize);
 
   fish_sound_flush (ed->encoder);
   fish_sound_flush (ed->decoder);
 
+  if (filtered && strcmp (ed->streamed, LICENSE))
+    FAIL ("Incorrect LICENSE streamed");
+
   fs_encdec_delete (ed);
 
   return 0;
 }
 
+static int
+fs_encdec_shared_test (int format, int blocksize)
+{
+  FS_EncDec * ed[2];
+  FishSoundCommentSet * set;
+  FishSoundComment comments[4 + NR_EXTRA];
+  static char values[NR_EXTRA][16];
+  int err, i;
+
+  INFO ("+ Creating comment set");
+  comments[0].name = "ARTIST"; comments[0].value = ARTIST1;
+  comments[1].name = "COPYRIGHT"; comments[1].value = COPYRIGHT;
+  comments[2].name = "LICENSE"; comments[2].value = LICENSE;
+  comments[3].name = "ARTIST"; comments[3].value = ARTIST2;
+  for (i = 0; i < NR_EXTRA; i++) {
+    snprintf (values[i], sizeof (values[i]), "%d", i);
+    comments[4+i].name = "EXTRA";
+    comments[4+i].value = values[i];
+  }
+
+  set = fish_sound_comment_set_new (comments, 4 + NR_EXTRA);
+  if (set == NULL) FAIL ("Comment set creation failed");
+
+  INFO ("+ Attaching comment set to two encoders");
+  for (i = 0; i < 2; i++) {
+    ed[i] = fs_encdec_new (format, blocksize, 0);
+    err = fish_sound_comment_attach_set (ed[i]->encoder, set);
+    if (err < 0) FAIL ("Operation failed");
+  }
+
+  fish_sound_comment_set_unref (set);
+
+  for (i = 0; i < 2; i++) {
+    fish_sound_encode (ed[i]->encoder, ed[i]->pcm, blocksize);
+
+    fish_sound_flush (ed[i]->encoder);
+    fish_sound_flush (ed[i]->decoder);
+
+    fs_encdec_delete (ed[i]);
+  }
+
+  return 0;
+}
+
 int
 main (int argc, char * argv[])
 {
 #if HAVE_VORBIS
   INFO ("Testing encode/decode pipeline for comments: VORBIS");
-  fs_encdec_comments_test (FISH_SOUND_VORBIS, 2048);
+  fs_encdec_comments_test (FISH_SOUND_VORBIS, 2048, 0, 0);
+
+  INFO ("Testing encode/decode pipeline for lazy comments: VORBIS");
+  fs_encdec_comments_test (FISH_SOUND_VORBIS, 2048, 1, 0);
+
+  INFO ("Testing encode/decode pipeline for filtered comments: VORBIS");
+  fs_encdec_comments_test (FISH_SOUND_VORBIS, 2048, 0, 1);
+
+  INFO ("Testing encode/decode pipeline for shared comments: VORBIS");
+  fs_encdec_shared_test (FISH_SOUND_VORBIS, 2048);
 #endif
 
 #if HAVE_SPEEX
   INFO ("Testing encode/decode pipeline for comments: SPEEX");
-  fs_encdec_comments_test (FISH_SOUND_SPEEX, 2048);
+  fs_encdec_comments_test (FISH_SOUND_SPEEX, 2048, 0, 0);
+
+  INFO ("Testing encode/decode pipeline for lazy comments: SPEEX");
+  fs_encdec_comments_test (FISH_SOUND_SPEEX, 2048, 1, 0);
+
+  INFO ("Testing encode/decode pipeline for filtered comments: SPEEX");
+  fs_encdec_comments_test (FISH_SOUND_SPEEX, 2048, 0, 1);
+
+  INFO ("Testing encode/decode pipeline for shared comments: SPEEX");
+  fs_encdec_shared_test (FISH_SOUND_SPEEX, 2048);
 #endif
 
 #if HAVE_FLAC
   INFO ("Testing encode/decode pipeline for comments: FLAC");
-  fs_encdec_comments_test (FISH_SOUND_FLAC, 2048);
+  fs_encdec_comments_test (FISH_SOUND_FLAC, 2048, 0, 0);
+
+  INFO ("Testing encode/decode pipeline for lazy comments: FLAC");
+  fs_encdec_comments_test (FISH_SOUND_FLAC, 2048, 1, 0);
+
+  INFO ("Testing encode/decode pipeline for filtered comments: FLAC");
+  fs_encdec_comments_test (FISH_SOUND_FLAC, 2048, 0, 1);
+
+  INFO ("Testing encode/decode pipeline for shared comments: FLAC");
+  fs_encdec_shared_test (FISH_SOUND_FLAC, 2048);
 #endif
 
   exit (0);
@@ -0,0 +1,257 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define SAMPLERATE 44100
+#define CHANNELS 2
+#define BLOCKSIZE 1024
+#define SECONDS 20
+
+typedef struct {
+  float * pcm;
+  long frames;
+  long max_frames;
+} FS_PCMBuffer;
+
+static int
+decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  FS_PCMBuffer * buf = (FS_PCMBuffer *) user_data;
+
+  if (buf->frames + frames > buf->max_frames) {
+    while (buf->frames + frames > buf->max_frames)
+      buf->max_frames = buf->max_frames ? buf->max_frames * 2 : 4096;
+    buf->pcm = realloc (buf->pcm,
+                        sizeof (float) * CHANNELS * buf->max_frames);
+  }
+
+  memcpy (buf->pcm + buf->frames * CHANNELS, pcm,
+          sizeof (float) * CHANNELS * frames);
+  buf->frames += frames;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+typedef struct {
+  int stop; /* FISH_SOUND_STOP_* value to return from the first call */
+  long calls;
+  long frames;
+} FS_StopCount;
+
+static int
+decoded_stop (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  FS_StopCount * count = (FS_StopCount *) user_data;
+
+  count->calls++;
+  count->frames += frames;
+
+  return count->stop;
+}
+
+static void
+fs_encode_stream (int format, FS_PacketList * list)
+{
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  float * pcm;
+  long i, n, frames = 0;
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = CHANNELS;
+  fsinfo.format = format;
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_encoded_callback (fsound, fs_packets_encoded, list);
+
+  pcm = malloc (sizeof (float) * CHANNELS * BLOCKSIZE);
+
+  for (n = 0; n < SAMPLERATE * SECONDS / BLOCKSIZE; n++) {
+    for (i = 0; i < CHANNELS * BLOCKSIZE; i++)
+      pcm[i] = (float) ((frames * CHANNELS + i) % 201 - 100) / 200.0;
+    frames += BLOCKSIZE;
+    fish_sound_prepare_truncation (fsound, frames,
+                                   n == SAMPLERATE * SECONDS / BLOCKSIZE - 1);
+    fish_sound_encode (fsound, (float **)pcm, BLOCKSIZE);
+  }
+
+  fish_sound_flush (fsound);
+  fish_sound_delete (fsound);
+  free (pcm);
+
+  if (list->npackets > 0)
+    list->packets[list->npackets - 1].eos = 1;
+}
+
+static void
+fs_decode_sequential (FS_PacketList * list, FS_PCMBuffer * buf)
+{
+  FishSound * fsound;
+  long i;
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_decoded_float_ilv (fsound, decoded, buf);
+
+  for (i = 0; i < list->npackets; i++) {
+    fish_sound_prepare_truncation (fsound, list->packets[i].granulepos,
+                                   list->packets[i].eos);
+    fish_sound_decode (fsound, list->packets[i].packet,
+                       list->packets[i].bytes);
+  }
+
+  fish_sound_delete (fsound);
+}
+
+static void
+fs_parallel_test (int format, int nthreads)
+{
+  FS_PacketList list = {NULL, 0, 0, 0};
+  FS_PCMBuffer seq = {NULL, 0, 0}, par = {NULL, 0, 0};
+  char msg[128];
+  long i, ret;
+
+  snprintf (msg, 128, "+ %s, %d threads",
+            format == FISH_SOUND_VORBIS ? "Vorbis" :
+            (format == FISH_SOUND_FLAC ? "Flac" : "PCM"), nthreads);
+  INFO (msg);
+
+  fs_encode_stream (format, &list);
+  fs_decode_sequential (&list, &seq);
+
+  ret = fish_sound_decode_parallel (list.packets, list.npackets, nthreads,
+                                    decoded, &par);
+  if (ret < 0) {
+    snprintf (msg, 128, "fish_sound_decode_parallel returned %ld", ret);
+    FAIL (msg);
+  }
+
+  if (ret != par.frames) {
+    snprintf (msg, 128, "%ld frames returned, %ld frames delivered",
+              ret, par.frames);
+    FAIL (msg);
+  }
+
+  if (par.frames != seq.frames) {
+    snprintf (msg, 128, "%ld frames decoded sequentially, %ld in parallel",
+              seq.frames, par.frames);
+    FAIL (msg);
+  }
+
+  for (i = 0; i < seq.frames * CHANNELS; i++) {
+    if (seq.pcm[i] != par.pcm[i]) {
+      snprintf (msg, 128, "Sample %ld differs from sequential decode", i);
+      FAIL (msg);
+    }
+  }
+
+  fs_packets_free (&list);
+  free (seq.pcm);
+  free (par.pcm);
+}
+
+static void
+fs_parallel_stop_test (int format, int nthreads, int stop)
+{
+  FS_PacketList list = {NULL, 0, 0, 0};
+  FS_StopCount count;
+  char msg[128];
+  long ret;
+
+  snprintf (msg, 128, "+ Stopping with %s, %d threads",
+            stop == FISH_SOUND_STOP_OK ? "FISH_SOUND_STOP_OK" :
+            "FISH_SOUND_STOP_ERR", nthreads);
+  INFO (msg);
+
+  fs_encode_stream (format, &list);
+
+  count.stop = stop;
+  count.calls = 0;
+  count.frames = 0;
+
+  ret = fish_sound_decode_parallel (list.packets, list.npackets, nthreads,
+                                    decoded_stop, &count);
+
+  if (count.calls != 1) {
+    snprintf (msg, 128, "Callback called %ld times after stopping",
+              count.calls);
+    FAIL (msg);
+  }
+
+  if (stop == FISH_SOUND_STOP_ERR && ret != FISH_SOUND_STOP_ERR) {
+    snprintf (msg, 128, "fish_sound_decode_parallel returned %ld", ret);
+    FAIL (msg);
+  }
+
+  if (stop == FISH_SOUND_STOP_OK && ret != count.frames) {
+    snprintf (msg, 128, "%ld frames returned, %ld frames delivered",
+              ret, count.frames);
+    FAIL (msg);
+  }
+
+  fs_packets_free (&list);
+}
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing parallel decode against sequential decode");
+
+  if (HAVE_VORBIS) {
+    fs_parallel_test (FISH_SOUND_VORBIS, 1);
+    fs_parallel_test (FISH_SOUND_VORBIS, 4);
+  }
+
+  if (HAVE_FLAC) {
+    fs_parallel_test (FISH_SOUND_FLAC, 1);
+    fs_parallel_test (FISH_SOUND_FLAC, 4);
+  }
+
+  fs_parallel_test (FISH_SOUND_PCM, 1);
+  fs_parallel_test (FISH_SOUND_PCM, 4);
+
+  fs_parallel_stop_test (FISH_SOUND_PCM, 1, FISH_SOUND_STOP_OK);
+  fs_parallel_stop_test (FISH_SOUND_PCM, 4, FISH_SOUND_STOP_OK);
+  fs_parallel_stop_test (FISH_SOUND_PCM, 4, FISH_SOUND_STOP_ERR);
+
+  exit (0);
+}
@@ -0,0 +1,158 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define SAMPLERATE 16000
+#define CHANNELS 2
+#define BLOCKSIZE 1024
+#define ITER 64
+
+typedef struct {
+  long packets;
+  long bytes;
+  unsigned long checksum;
+} FS_EncodeResult;
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  FS_EncodeResult * result = (FS_EncodeResult *) user_data;
+  long i;
+
+  result->packets++;
+  result->bytes += bytes;
+  for (i = 0; i < bytes; i++)
+    result->checksum = result->checksum * 31 + buf[i];
+
+  return 0;
+}
+
+static void
+fs_encode (int format, int queue_depth, FS_EncodeResult * result)
+{
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  FishSoundEncodeAsync async;
+  float * pcm;
+  long i, n, ret;
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = CHANNELS;
+  fsinfo.format = format;
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_encoded_callback (fsound, encoded, result);
+
+  if (queue_depth > 0) {
+    async.queue_depth = queue_depth;
+    async.block_frames = BLOCKSIZE;
+    async.overflow = FISH_SOUND_ASYNC_BLOCK;
+    if (fish_sound_command (fsound, FISH_SOUND_SET_ENCODE_ASYNC, &async,
+                            sizeof (async)) != 0)
+      FAIL ("Unable to enable asynchronous encoding");
+  }
+
+  pcm = malloc (sizeof (float) * CHANNELS * BLOCKSIZE);
+
+  for (n = 0; n < ITER; n++) {
+    for (i = 0; i < CHANNELS * BLOCKSIZE; i++)
+      pcm[i] = (float) ((n * CHANNELS * BLOCKSIZE + i) % 101 - 50) / 100.0;
+    fish_sound_prepare_truncation (fsound, (n + 1) * BLOCKSIZE,
+                                   n == ITER - 1);
+    ret = fish_sound_encode_float_ilv (fsound, (float **)pcm, BLOCKSIZE);
+    if (ret != BLOCKSIZE)
+      FAIL ("Short count of frames accepted for encoding");
+  }
+
+  fish_sound_flush (fsound);
+
+  if (queue_depth > 0) {
+    fish_sound_command (fsound, FISH_SOUND_GET_ENCODE_ASYNC, &async,
+                        sizeof (async));
+    if (async.dropped_frames != 0)
+      FAIL ("Frames dropped with FISH_SOUND_ASYNC_BLOCK");
+  }
+
+  fish_sound_delete (fsound);
+  free (pcm);
+}
+
+static void
+fs_async_test (int format, const char * name)
+{
+  FS_EncodeResult sync = {0, 0, 0}, async = {0, 0, 0};
+  char msg[128];
+
+  snprintf (msg, 128, "+ %s", name);
+  INFO (msg);
+
+  fs_encode (format, 0, &sync);
+  fs_encode (format, 4, &async);
+
+  if (async.packets != sync.packets || async.bytes != sync.bytes) {
+    snprintf (msg, 128,
+              "Synchronous encode: %ld packets, %ld bytes; "
+              "asynchronous: %ld packets, %ld bytes",
+              sync.packets, sync.bytes, async.packets, async.bytes);
+    FAIL (msg);
+  }
+
+  if (async.checksum != sync.checksum)
+    FAIL ("Asynchronous encode output differs from synchronous encode");
+}
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing asynchronous encode against synchronous encode");
+
+  if (HAVE_VORBIS && HAVE_VORBISENC)
+    fs_async_test (FISH_SOUND_VORBIS, "Vorbis");
+
+  if (HAVE_SPEEX)
+    fs_async_test (FISH_SOUND_SPEEX, "Speex");
+
+  if (HAVE_FLAC)
+    fs_async_test (FISH_SOUND_FLAC, "Flac");
+
+  exit (0);
+}
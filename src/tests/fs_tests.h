@@ -34,6 +34,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
 
 #define INFO(str) \
   { printf ("----  %s ...\n", (str)); fflush (stdout); }
@@ -43,3 +46,48 @@
 
 #define FAIL(str) \
   { printf ("%s:%d: %s\n", __FILE__, __LINE__, (str)); fflush (stdout); exit(1); }
+
+/* Packets captured from an encoder, for decoding again */
+typedef struct {
+  FishSoundPacket * packets;
+  long npackets;
+  long max_packets;
+  long bytes; /* total of all packets */
+} FS_PacketList;
+
+/* A FishSoundEncoded callback appending a copy of each packet to the
+ * FS_PacketList given as user_data */
+static inline int
+fs_packets_encoded (FishSound * fsound, unsigned char * buf, long bytes,
+                    void * user_data)
+{
+  FS_PacketList * list = (FS_PacketList *) user_data;
+  FishSoundPacket * p;
+
+  if (list->npackets == list->max_packets) {
+    list->max_packets = list->max_packets ? list->max_packets * 2 : 256;
+    list->packets = realloc (list->packets,
+                             sizeof (FishSoundPacket) * list->max_packets);
+  }
+
+  p = &list->packets[list->npackets++];
+  p->packet = malloc (bytes);
+  memcpy (p->packet, buf, bytes);
+  p->bytes = bytes;
+  p->granulepos = fish_sound_get_frameno (fsound);
+  p->eos = 0;
+
+  list->bytes += bytes;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static inline void
+fs_packets_free (FS_PacketList * list)
+{
+  long i;
+
+  for (i = 0; i < list->npackets; i++)
+    free (list->packets[i].packet);
+  free (list->packets);
+}
@@ -0,0 +1,164 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+static unsigned char buf[128];
+
+/* Check that identifying each prefix of buf fails, and the whole succeeds */
+static void
+check_prefixes (long bytes, int format)
+{
+  long n;
+
+  for (n = 9; n < bytes; n++) {
+    if (fish_sound_identify (buf, n) != FISH_SOUND_UNKNOWN)
+      FAIL ("Truncated header identified");
+  }
+
+  if (fish_sound_identify (buf, bytes) != format)
+    FAIL ("Complete header not identified");
+}
+
+int
+main (int argc, char * argv[])
+{
+#if HAVE_FLAC
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  long n;
+#endif
+
+  INFO ("Identifying a short buffer");
+  memset (buf, 0, sizeof (buf));
+  if (fish_sound_identify (buf, 7) != FISH_SOUND_ERR_SHORT_IDENTIFY)
+    FAIL ("Short buffer not rejected");
+
+  INFO ("Identifying an unknown header");
+  memcpy (buf, "OggS\0\0\0\0", 8);
+  if (fish_sound_identify (buf, 8) != FISH_SOUND_UNKNOWN)
+    FAIL ("Unknown header identified");
+  if (fish_sound_identify (buf, sizeof (buf)) != FISH_SOUND_UNKNOWN)
+    FAIL ("Unknown header identified");
+
+#if HAVE_VORBIS
+  INFO ("Identifying a Vorbis identification header");
+  memset (buf, 0, sizeof (buf));
+  memcpy (buf, "\001vorbis", 7);
+  if (fish_sound_identify (buf, 8) != FISH_SOUND_VORBIS)
+    FAIL ("Vorbis signature not identified");
+
+  buf[11] = 2;                         /* audio_channels */
+  buf[12] = 0x44; buf[13] = 0xac;      /* audio_sample_rate 44100 */
+  buf[28] = 0xb8;                      /* blocksizes 256, 2048 */
+  buf[29] = 0x01;                      /* framing_flag */
+  check_prefixes (30, FISH_SOUND_VORBIS);
+
+  INFO ("+ Rejecting invalid blocksizes");
+  buf[28] = 0x8b;
+  if (fish_sound_identify (buf, 30) != FISH_SOUND_UNKNOWN)
+    FAIL ("Invalid Vorbis header identified");
+#endif
+
+#if HAVE_SPEEX
+  INFO ("Identifying a Speex header");
+  memset (buf, 0, sizeof (buf));
+  memcpy (buf, "Speex   ", 8);
+  if (fish_sound_identify (buf, 8) != FISH_SOUND_SPEEX)
+    FAIL ("Speex signature not identified");
+
+  buf[32] = 80;                        /* header_size */
+  buf[36] = 0x80; buf[37] = 0x3e;      /* rate 16000 */
+  buf[40] = 1;                         /* mode: wideband */
+  buf[48] = 1;                         /* nb_channels */
+  check_prefixes (80, FISH_SOUND_SPEEX);
+
+  INFO ("+ Rejecting an invalid mode");
+  buf[40] = 0xff; buf[41] = 0xff; buf[42] = 0xff; buf[43] = 0xff;
+  if (fish_sound_identify (buf, 80) != FISH_SOUND_UNKNOWN)
+    FAIL ("Invalid Speex header identified");
+#endif
+
+#if HAVE_FLAC
+  INFO ("Identifying an Ogg FLAC header");
+  memset (buf, 0, sizeof (buf));
+  memcpy (buf, "\177FLAC\001\000\000\001fLaC", 13);
+  if (fish_sound_identify (buf, 8) != FISH_SOUND_FLAC)
+    FAIL ("FLAC signature not identified");
+
+  buf[13] = 0x80;                      /* last block, STREAMINFO */
+  buf[16] = 34;                        /* STREAMINFO length */
+  check_prefixes (51, FISH_SOUND_FLAC);
+
+  INFO ("+ Rejecting a header without STREAMINFO");
+  buf[13] = 0x84;
+  if (fish_sound_identify (buf, 51) != FISH_SOUND_UNKNOWN)
+    FAIL ("Invalid FLAC header identified");
+
+  INFO ("+ Rejecting a truncated header when decoding");
+  buf[13] = 0x80;
+  for (n = 9; n < 51; n++) {
+    fsinfo.format = FISH_SOUND_FLAC;
+    fsinfo.samplerate = 0;
+    fsinfo.channels = 0;
+    fsound = fish_sound_new (FISH_SOUND_DECODE, &fsinfo);
+    if (fish_sound_decode (fsound, buf, n) != FISH_SOUND_ERR_GENERIC)
+      FAIL ("Truncated FLAC header decoded");
+    fish_sound_delete (fsound);
+  }
+
+  INFO ("Identifying a native FLAC stream");
+  memset (buf, 0, sizeof (buf));
+  memcpy (buf, "fLaC", 4);
+  buf[7] = 34;                         /* STREAMINFO length */
+  if (fish_sound_identify (buf, 8) != FISH_SOUND_FLAC_NATIVE)
+    FAIL ("Native FLAC stream not identified");
+  if (fish_sound_identify (buf, 42) != FISH_SOUND_FLAC_NATIVE)
+    FAIL ("Native FLAC stream not identified");
+
+  INFO ("+ Rejecting a stream without STREAMINFO");
+  buf[4] = 0x04;
+  if (fish_sound_identify (buf, 42) != FISH_SOUND_UNKNOWN)
+    FAIL ("Invalid native FLAC stream identified");
+#endif
+
+  exit (0);
+}
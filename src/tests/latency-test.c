@@ -0,0 +1,155 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define SAMPLERATE 16000
+#define CHANNELS 1
+#define BLOCKSIZE 160
+#define NBLOCKS 100
+
+static long
+get_long (FishSound * fsound, int command)
+{
+  long value = -1;
+
+  if (fish_sound_command (fsound, command, &value, sizeof (long)) != 0)
+    FAIL ("Command failed");
+
+  return value;
+}
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  return FISH_SOUND_CONTINUE;
+}
+
+static void
+test_decode (void)
+{
+  FishSound * fsound;
+  long dummy;
+
+  INFO ("+ Querying a decoder before the stream headers");
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+
+  if (get_long (fsound, FISH_SOUND_GET_LATENCY) != 0)
+    FAIL ("Latency known before the stream headers");
+
+  if (get_long (fsound, FISH_SOUND_GET_PENDING_FRAMES) != 0)
+    FAIL ("Frames pending in a decoder");
+
+  if (fish_sound_command (fsound, FISH_SOUND_GET_LATENCY, &dummy,
+                          sizeof (long) - 1) != FISH_SOUND_ERR_INVALID)
+    FAIL ("FISH_SOUND_GET_LATENCY accepted a short buffer");
+
+  fish_sound_delete (fsound);
+}
+
+static void
+test_encode (int format, const char * name)
+{
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  float pcm[BLOCKSIZE * CHANNELS];
+  long latency, pending, frames_in = 0;
+  char msg[128];
+  int i;
+
+  snprintf (msg, 128, "+ Querying latency of %s encoder", name);
+  INFO (msg);
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = CHANNELS;
+  fsinfo.format = format;
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_encoded_callback (fsound, encoded, NULL);
+
+  for (i = 0; i < BLOCKSIZE * CHANNELS; i++)
+    pcm[i] = (float)(i % 64) / 64.0;
+
+  for (i = 0; i < NBLOCKS; i++) {
+    frames_in += BLOCKSIZE;
+    fish_sound_prepare_truncation (fsound, frames_in, (i == NBLOCKS - 1));
+    fish_sound_encode_float_ilv (fsound, (float **)pcm, BLOCKSIZE);
+
+    pending = get_long (fsound, FISH_SOUND_GET_PENDING_FRAMES);
+    if (pending < 0 || pending > frames_in)
+      FAIL ("Pending frames out of range");
+  }
+
+  latency = get_long (fsound, FISH_SOUND_GET_LATENCY);
+  if (latency <= 0)
+    FAIL ("Encoder latency not known");
+
+  snprintf (msg, 128, "+ Flushing %s encoder", name);
+  INFO (msg);
+
+  fish_sound_flush (fsound);
+
+  if (get_long (fsound, FISH_SOUND_GET_PENDING_FRAMES) != 0)
+    FAIL ("Frames still pending after flush");
+
+  fish_sound_delete (fsound);
+}
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing FISH_SOUND_GET_LATENCY and FISH_SOUND_GET_PENDING_FRAMES");
+
+  if (FS_DECODE)
+    test_decode ();
+
+  if (FS_ENCODE) {
+    if (HAVE_VORBIS && HAVE_VORBISENC)
+      test_encode (FISH_SOUND_VORBIS, "Vorbis");
+    if (HAVE_SPEEX)
+      test_encode (FISH_SOUND_SPEEX, "Speex");
+    if (HAVE_FLAC)
+      test_encode (FISH_SOUND_FLAC, "Flac");
+  }
+
+  exit (0);
+}
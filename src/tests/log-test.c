@@ -0,0 +1,235 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define SAMPLERATE 16000
+#define CHANNELS 1
+#define BLOCKSIZE 1024
+#define NBLOCKS 32
+#define MAX_PER_SECOND 2
+
+typedef struct {
+  FishSound * encoder;
+  FishSound * decoder;
+  int format;
+  long messages;
+} FS_Corrupt;
+
+static void
+logged (FishSound * fsound, int level, int error, const char * message,
+	void * user_data)
+{
+  FS_Corrupt * c = (FS_Corrupt *)user_data;
+
+  if (message == NULL || message[0] == '\0')
+    FAIL ("Empty log message");
+
+  if (level > fish_sound_get_log_level ())
+    FAIL ("Message above the log level");
+
+  c->messages++;
+}
+
+static int
+decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  return FISH_SOUND_CONTINUE;
+}
+
+/* Pass the headers to the decoder intact, and damage each audio packet */
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  FS_Corrupt * c = (FS_Corrupt *)user_data;
+  unsigned char * copy;
+
+  if ((copy = malloc (bytes)) == NULL)
+    FAIL ("Out of memory");
+
+  memcpy (copy, buf, bytes);
+
+  if (fish_sound_get_frameno (fsound) > 0 && bytes >= 2) {
+    if (c->format == FISH_SOUND_VORBIS) {
+      /* Mark as a header packet, which vorbis_synthesis() rejects */
+      copy[0] |= 1;
+    } else {
+      /* Destroy the frame sync code */
+      copy[0] = copy[1] = 0;
+    }
+  }
+
+  fish_sound_decode (c->decoder, copy, bytes);
+  free (copy);
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static void
+test_api (void)
+{
+  FishSound * fsound;
+  int level;
+
+  INFO ("+ Setting the log level");
+
+  level = fish_sound_get_log_level ();
+  if (level != FISH_SOUND_LOG_ERROR)
+    FAIL ("Default log level is not FISH_SOUND_LOG_ERROR");
+
+  if (fish_sound_set_log_level (FISH_SOUND_LOG_VERBOSE + 1) !=
+      FISH_SOUND_ERR_INVALID)
+    FAIL ("Invalid log level accepted");
+
+  if (fish_sound_set_log_level (FISH_SOUND_LOG_WARNING) != level)
+    FAIL ("Previous log level not returned");
+
+  if (fish_sound_get_log_level () != FISH_SOUND_LOG_WARNING)
+    FAIL ("Log level not set");
+
+  fish_sound_set_log_level (level);
+
+  INFO ("+ Setting a log callback");
+
+  if (fish_sound_set_log (NULL, logged, 0, NULL) != FISH_SOUND_ERR_BAD)
+    FAIL ("Log callback set on NULL handle");
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+
+  if (fish_sound_set_log (fsound, logged, -1, NULL) !=
+      FISH_SOUND_ERR_INVALID)
+    FAIL ("Negative rate limit accepted");
+
+  if (fish_sound_set_log (fsound, logged, 0, NULL) != 0)
+    FAIL ("Log callback not set");
+
+  fish_sound_delete (fsound);
+}
+
+static void
+test_corrupt (int format, const char * name, int level)
+{
+  FS_Corrupt c;
+  FishSoundInfo fsinfo;
+  FishSoundStats stats;
+  float pcm[BLOCKSIZE * CHANNELS];
+  long reported;
+  char msg[128];
+  int i;
+
+  snprintf (msg, 128, "+ Decoding corrupt %s at log level %d", name, level);
+  INFO (msg);
+
+  fish_sound_set_log_level (level);
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = CHANNELS;
+  fsinfo.format = format;
+
+  c.format = format;
+  c.messages = 0;
+  c.encoder = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  c.decoder = fish_sound_new (FISH_SOUND_DECODE, NULL);
+
+  fish_sound_set_interleave (c.encoder, 1);
+  fish_sound_set_interleave (c.decoder, 1);
+  fish_sound_set_encoded_callback (c.encoder, encoded, &c);
+  fish_sound_set_decoded_float_ilv (c.decoder, decoded, NULL);
+  fish_sound_set_log (c.decoder, logged, MAX_PER_SECOND, &c);
+
+  for (i = 0; i < BLOCKSIZE * CHANNELS; i++)
+    pcm[i] = (float)((i % 37) - 18) / 40.0;
+
+  for (i = 0; i < NBLOCKS; i++) {
+    fish_sound_prepare_truncation (c.encoder, (long)(i + 1) * BLOCKSIZE,
+				   (i == NBLOCKS - 1));
+    fish_sound_encode_float_ilv (c.encoder, (float **)pcm, BLOCKSIZE);
+  }
+  fish_sound_flush (c.encoder);
+
+  if (fish_sound_command (c.decoder, FISH_SOUND_GET_STATS, &stats,
+			  sizeof (FishSoundStats)) != 0)
+    FAIL ("FISH_SOUND_GET_STATS failed");
+
+  reported = stats.log_errors;
+  if (level >= FISH_SOUND_LOG_WARNING)
+    reported += stats.log_warnings;
+
+  if (format == FISH_SOUND_VORBIS && stats.log_warnings == 0)
+    FAIL ("Corrupt Vorbis packets not counted");
+
+  if (level == FISH_SOUND_LOG_NONE) {
+    if (c.messages != 0 || stats.log_suppressed != 0)
+      FAIL ("Messages logged at FISH_SOUND_LOG_NONE");
+  } else if (c.messages + stats.log_suppressed != reported) {
+    FAIL ("Logged and suppressed messages do not add up");
+  }
+
+  fish_sound_delete (c.encoder);
+  fish_sound_delete (c.decoder);
+
+  fish_sound_set_log_level (FISH_SOUND_LOG_ERROR);
+}
+
+static void
+test_codec (int format, const char * name)
+{
+  test_corrupt (format, name, FISH_SOUND_LOG_NONE);
+  test_corrupt (format, name, FISH_SOUND_LOG_WARNING);
+}
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing error logging");
+
+  test_api ();
+
+  if (FS_DECODE && FS_ENCODE) {
+    if (HAVE_VORBIS && HAVE_VORBISENC)
+      test_codec (FISH_SOUND_VORBIS, "Vorbis");
+    if (HAVE_SPEEX)
+      test_codec (FISH_SOUND_SPEEX, "Speex");
+    if (HAVE_FLAC)
+      test_codec (FISH_SOUND_FLAC, "Flac");
+  }
+
+  exit (0);
+}
@@ -0,0 +1,236 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define NCOMMENTS 100
+
+static void
+get_memory (FishSound * fsound, FishSoundMemory * memory)
+{
+  if (fish_sound_command (fsound, FISH_SOUND_GET_MEMORY, memory,
+                          sizeof (FishSoundMemory)) != 0)
+    FAIL ("FISH_SOUND_GET_MEMORY failed");
+}
+
+static void
+test_handle (void)
+{
+  FishSound * fsound, * other;
+  FishSoundTraceHooks hooks;
+  FishSoundPCMRing * ring;
+  FishSoundMemory m0, m1, m2;
+
+  INFO ("+ Accounting memory of a handle");
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  get_memory (fsound, &m0);
+
+  if (m0.bytes <= 0 || m0.blocks <= 0)
+    FAIL ("Memory of a new handle not counted");
+
+  if (m0.peak_bytes < m0.bytes)
+    FAIL ("Peak is less than current usage");
+
+  if (m0.process_bytes < m0.bytes || m0.process_peak_bytes < m0.process_bytes)
+    FAIL ("Process usage is less than handle usage");
+
+  if (fish_sound_command (fsound, FISH_SOUND_GET_MEMORY, &m1,
+                          sizeof (FishSoundMemory) - 1) !=
+      FISH_SOUND_ERR_INVALID)
+    FAIL ("FISH_SOUND_GET_MEMORY accepted a short buffer");
+
+  INFO ("+ Accounting memory allocated by a command");
+
+  memset (&hooks, 0, sizeof (hooks));
+  fish_sound_set_trace_hooks (fsound, &hooks);
+  get_memory (fsound, &m1);
+
+  if (m1.bytes < m0.bytes + (long)sizeof (hooks) || m1.blocks != m0.blocks + 1)
+    FAIL ("Memory of trace hooks not counted");
+
+  fish_sound_set_trace_hooks (fsound, NULL);
+  get_memory (fsound, &m2);
+
+  if (m2.bytes != m0.bytes || m2.blocks != m0.blocks)
+    FAIL ("Freed memory of trace hooks still counted");
+
+  if (m2.peak_bytes != m1.bytes)
+    FAIL ("Peak does not include trace hooks");
+
+  INFO ("+ Separating the memory of handles");
+
+  other = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  get_memory (fsound, &m1);
+
+  if (m1.bytes != m0.bytes)
+    FAIL ("Memory of another handle counted");
+
+  if (m1.process_bytes <= m0.process_bytes)
+    FAIL ("Memory of another handle not counted in process usage");
+
+  fish_sound_delete (other);
+
+  ring = fish_sound_pcm_ring_new (2, 1024, FISH_SOUND_RING_FLOAT);
+  get_memory (fsound, &m1);
+
+  if (m1.bytes != m0.bytes)
+    FAIL ("Memory of a PCM ring counted in a handle");
+
+  if (m1.process_bytes < m0.process_bytes + 2 * 1024 * (long)sizeof (float))
+    FAIL ("Memory of a PCM ring not counted in process usage");
+
+  fish_sound_pcm_ring_delete (ring);
+  get_memory (fsound, &m1);
+
+  if (m1.process_bytes != m0.process_bytes)
+    FAIL ("Process usage not restored after deleting handle and ring");
+
+  fish_sound_delete (fsound);
+}
+
+static void
+test_comments (int format, const char * name)
+{
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  FishSoundMemory m0, m1;
+  char msg[128], value[32];
+  int i;
+
+  snprintf (msg, 128, "+ Accounting memory of %s comments", name);
+  INFO (msg);
+
+  fsinfo.samplerate = 16000;
+  fsinfo.channels = 1;
+  fsinfo.format = format;
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  get_memory (fsound, &m0);
+
+  for (i = 0; i < NCOMMENTS; i++) {
+    snprintf (value, 32, "Comment %d", i);
+    fish_sound_comment_add_byname (fsound, "COMMENT", value);
+  }
+
+  get_memory (fsound, &m1);
+
+  if (m1.bytes < m0.bytes + NCOMMENTS * (long)strlen ("Comment 0"))
+    FAIL ("Memory of comments not counted");
+
+  if (m1.blocks < m0.blocks + NCOMMENTS)
+    FAIL ("Blocks of comments not counted");
+
+  fish_sound_delete (fsound);
+}
+
+static FishSoundCommentSet * callback_set = NULL;
+
+static int
+encoded_set (FishSound * fsound, unsigned char * buf, long bytes,
+             void * user_data)
+{
+  FishSoundComment comment = {"TITLE", "Shared"};
+  FishSoundMemory m0, m1;
+
+  if (callback_set != NULL) return 0;
+
+  get_memory (fsound, &m0);
+  callback_set = fish_sound_comment_set_new (&comment, 1);
+  get_memory (fsound, &m1);
+
+  if (callback_set == NULL)
+    FAIL ("Comment set not created in a callback");
+
+  if (m1.bytes != m0.bytes || m1.blocks != m0.blocks)
+    FAIL ("Memory of a comment set counted in a handle");
+
+  return 0;
+}
+
+static void
+test_comment_set (void)
+{
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  float pcm[16];
+
+  INFO ("+ Separating the memory of a comment set from its creator");
+
+  fsinfo.samplerate = 16000;
+  fsinfo.channels = 1;
+  fsinfo.format = FISH_SOUND_PCM;
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_encoded_callback (fsound, encoded_set, NULL);
+
+  memset (pcm, 0, sizeof (pcm));
+  fish_sound_encode_float_ilv (fsound, (float **)pcm, 16);
+
+  if (callback_set == NULL)
+    FAIL ("Encoded callback not called");
+
+  /* The set outlives the handle in whose callback it was created */
+  fish_sound_delete (fsound);
+  fish_sound_comment_set_unref (callback_set);
+}
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing FISH_SOUND_GET_MEMORY");
+
+  if (FS_DECODE)
+    test_handle ();
+
+  if (FS_ENCODE) {
+    test_comment_set ();
+    if (HAVE_VORBIS && HAVE_VORBISENC)
+      test_comments (FISH_SOUND_VORBIS, "Vorbis");
+    if (HAVE_SPEEX)
+      test_comments (FISH_SOUND_SPEEX, "Speex");
+    if (HAVE_FLAC)
+      test_comments (FISH_SOUND_FLAC, "Flac");
+  }
+
+  exit (0);
+}
@@ -0,0 +1,443 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define SAMPLERATE 48000
+#define BLOCKSIZE 1000
+#define NBLOCKS 10
+
+typedef struct {
+  FishSound * encoder;
+  FishSound * decoder;
+  int interleave;
+  int channels;
+  int format;
+  float * pcm[2];
+  float * ipcm;
+  float tolerance;
+  long packetno;
+  long frames_in;
+  long frames_out;
+  unsigned char * packet; /* the packet being decoded */
+  int passthrough; /* packets and decoded audio were not copied */
+} FS_PCMTest;
+
+static const char *
+format_name (int format)
+{
+  switch (format) {
+  case FISH_SOUND_PCM_S16_LE: return "S16_LE";
+  case FISH_SOUND_PCM_S16_BE: return "S16_BE";
+  case FISH_SOUND_PCM_S24_LE: return "S24_LE";
+  case FISH_SOUND_PCM_S24_BE: return "S24_BE";
+  case FISH_SOUND_PCM_S32_LE: return "S32_LE";
+  case FISH_SOUND_PCM_S32_BE: return "S32_BE";
+  case FISH_SOUND_PCM_FLOAT32_LE: return "FLOAT32_LE";
+  case FISH_SOUND_PCM_FLOAT32_BE: return "FLOAT32_BE";
+  default: return "unknown";
+  }
+}
+
+/* The sample encoded for frame i of channel c, within [-1.0, 1.0) */
+static float
+sample (long i, int c)
+{
+  return (float)((i * 37 + c * 1001) % 2000 - 1000) / 1000.0f;
+}
+
+static void
+check_sample (FS_PCMTest * ft, float value, long i, int c)
+{
+  float diff = value - sample (i, c);
+
+  if (diff < -ft->tolerance || diff > ft->tolerance)
+    FAIL ("Incorrect sample decoded");
+}
+
+static int
+decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  FS_PCMTest * ft = (FS_PCMTest *)user_data;
+  long i;
+  int c;
+
+  if (ft->interleave) {
+    float * p = (float *)pcm;
+
+    if (p != (float *)ft->packet) ft->passthrough = 0;
+
+    for (i = 0; i < frames; i++)
+      for (c = 0; c < ft->channels; c++)
+	check_sample (ft, p[i * ft->channels + c], ft->frames_out + i, c);
+  } else {
+    if (pcm[0] != (float *)ft->packet) ft->passthrough = 0;
+
+    for (c = 0; c < ft->channels; c++)
+      for (i = 0; i < frames; i++)
+	check_sample (ft, pcm[c][i], ft->frames_out + i, c);
+  }
+
+  ft->frames_out += frames;
+
+  if (fish_sound_get_frameno (fsound) != ft->frames_out)
+    FAIL ("Incorrect frameno after decoding");
+
+  return 0;
+}
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  FS_PCMTest * ft = (FS_PCMTest *)user_data;
+  FishSoundInfo fsinfo;
+  unsigned char * packet;
+  int format;
+
+  if (ft->packetno == 0) {
+    if (fish_sound_identify (buf, 8) != FISH_SOUND_PCM)
+      FAIL ("Header not identified (weak)");
+    if (fish_sound_identify (buf, bytes) != FISH_SOUND_PCM)
+      FAIL ("Header not identified");
+  }
+
+  /* Audio in the default format is packetized from the caller's buffer */
+  if (ft->packetno >= 2 && (unsigned char *)ft->ipcm <= buf &&
+      buf < (unsigned char *)(ft->ipcm + BLOCKSIZE * ft->channels)) {
+    if (ft->format != FISH_SOUND_PCM_FLOAT32_LE &&
+	ft->format != FISH_SOUND_PCM_FLOAT32_BE)
+      FAIL ("Converted audio passed through");
+  } else if (ft->packetno >= 2 && ft->pcm[0] <= (float *)buf &&
+	     (float *)buf < ft->pcm[0] + BLOCKSIZE) {
+    if (ft->channels != 1) FAIL ("Non-interleaved audio passed through");
+  } else if (ft->packetno >= 2) {
+    ft->passthrough = 0;
+  }
+
+  /* Decode from a copy, which is suitably aligned for passing out */
+  if ((packet = malloc (bytes)) == NULL) FAIL ("Out of memory");
+  memcpy (packet, buf, bytes);
+  ft->packet = packet;
+  if (fish_sound_decode (ft->decoder, packet, bytes) != 0)
+    FAIL ("Decoding failed");
+  ft->packet = NULL;
+  free (packet);
+
+  if (ft->packetno == 0) {
+    fish_sound_command (ft->decoder, FISH_SOUND_GET_INFO, &fsinfo,
+			sizeof (FishSoundInfo));
+    if (fsinfo.format != FISH_SOUND_PCM || fsinfo.samplerate != SAMPLERATE ||
+	fsinfo.channels != ft->channels)
+      FAIL ("Incorrect stream info decoded");
+
+    if (fish_sound_command (ft->decoder, FISH_SOUND_GET_PCM_FORMAT, &format,
+			    sizeof (int)) != 0 || format != ft->format)
+      FAIL ("Incorrect sample format decoded");
+  }
+
+  ft->packetno++;
+
+  return 0;
+}
+
+static void
+fs_pcm_test (int format, int interleave, int channels)
+{
+  FS_PCMTest ft;
+  FishSoundInfo fsinfo;
+  char msg[128];
+  long i;
+  int b, c, f;
+
+  snprintf (msg, 128, "+ %d channel %s (%s)", channels, format_name (format),
+	    interleave ? "interleave" : "non-interleave");
+  INFO (msg);
+
+  memset (&ft, 0, sizeof (ft));
+  ft.interleave = interleave;
+  ft.channels = channels;
+  ft.format = format;
+  ft.passthrough = 1;
+
+  switch (format) {
+  case FISH_SOUND_PCM_S16_LE:
+  case FISH_SOUND_PCM_S16_BE:
+    ft.tolerance = 1.0f / 32768.0f;
+    break;
+  case FISH_SOUND_PCM_S24_LE:
+  case FISH_SOUND_PCM_S24_BE:
+    ft.tolerance = 1.0f / 8388608.0f;
+    break;
+  case FISH_SOUND_PCM_S32_LE:
+  case FISH_SOUND_PCM_S32_BE:
+    ft.tolerance = 1.0f / 16777216.0f;
+    break;
+  default:
+    ft.tolerance = 0.0f;
+    break;
+  }
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = channels;
+  fsinfo.format = FISH_SOUND_PCM;
+
+  ft.encoder = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  ft.decoder = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  if (ft.encoder == NULL || ft.decoder == NULL)
+    FAIL ("Handles not created");
+
+  if (fish_sound_command (ft.encoder, FISH_SOUND_SET_PCM_FORMAT, &format,
+			  sizeof (int)) != 0)
+    FAIL ("Sample format not set");
+
+  fish_sound_set_encoded_callback (ft.encoder, encoded, &ft);
+  if (interleave)
+    fish_sound_set_decoded_float_ilv (ft.decoder, decoded, &ft);
+  else
+    fish_sound_set_decoded_float (ft.decoder, decoded, &ft);
+
+  ft.ipcm = malloc (sizeof (float) * BLOCKSIZE * channels);
+  for (c = 0; c < channels; c++)
+    ft.pcm[c] = malloc (sizeof (float) * BLOCKSIZE);
+
+  for (b = 0; b < NBLOCKS; b++) {
+    for (i = 0; i < BLOCKSIZE; i++) {
+      for (c = 0; c < channels; c++) {
+	ft.ipcm[i * channels + c] = sample (ft.frames_in + i, c);
+	ft.pcm[c][i] = sample (ft.frames_in + i, c);
+      }
+    }
+
+    if (interleave)
+      fish_sound_encode_float_ilv (ft.encoder, (float **)ft.ipcm, BLOCKSIZE);
+    else
+      fish_sound_encode_float (ft.encoder, ft.pcm, BLOCKSIZE);
+
+    ft.frames_in += BLOCKSIZE;
+
+    if (fish_sound_get_frameno (ft.encoder) != ft.frames_in)
+      FAIL ("Incorrect frameno after encoding");
+  }
+
+  if (ft.frames_out != ft.frames_in)
+    FAIL ("Incorrect number of frames decoded");
+
+  if (fish_sound_command (ft.encoder, FISH_SOUND_SET_PCM_FORMAT, &format,
+			  sizeof (int)) != FISH_SOUND_ERR_INVALID)
+    FAIL ("Sample format set after encoding");
+
+  /* Native float, interleaved or mono, is never copied */
+  f = (format == FISH_SOUND_PCM_FLOAT32_LE ||
+       format == FISH_SOUND_PCM_FLOAT32_BE);
+  if (ft.passthrough && !f)
+    FAIL ("Converted audio not copied");
+
+  fish_sound_delete (ft.encoder);
+  fish_sound_delete (ft.decoder);
+
+  free (ft.ipcm);
+  for (c = 0; c < channels; c++)
+    free (ft.pcm[c]);
+}
+
+/* Encode one block in the default format and check that both directions
+ * pass the audio through without copying */
+static void
+fs_pcm_passthrough_test (int interleave, int channels)
+{
+  FS_PCMTest ft;
+  FishSoundInfo fsinfo;
+  char msg[128];
+  long i;
+  int c;
+
+  snprintf (msg, 128, "+ %d channel native float passthrough (%s)", channels,
+	    interleave ? "interleave" : "non-interleave");
+  INFO (msg);
+
+  memset (&ft, 0, sizeof (ft));
+  ft.interleave = interleave;
+  ft.channels = channels;
+  ft.passthrough = 1;
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = channels;
+  fsinfo.format = FISH_SOUND_PCM;
+
+  ft.encoder = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  ft.decoder = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  if (ft.encoder == NULL || ft.decoder == NULL)
+    FAIL ("Handles not created");
+
+  fish_sound_command (ft.encoder, FISH_SOUND_GET_PCM_FORMAT, &ft.format,
+		      sizeof (int));
+
+  fish_sound_set_encoded_callback (ft.encoder, encoded, &ft);
+  if (interleave)
+    fish_sound_set_decoded_float_ilv (ft.decoder, decoded, &ft);
+  else
+    fish_sound_set_decoded_float (ft.decoder, decoded, &ft);
+
+  ft.ipcm = malloc (sizeof (float) * BLOCKSIZE * channels);
+  for (c = 0; c < channels; c++)
+    ft.pcm[c] = malloc (sizeof (float) * BLOCKSIZE);
+
+  for (i = 0; i < BLOCKSIZE; i++) {
+    for (c = 0; c < channels; c++) {
+      ft.ipcm[i * channels + c] = sample (i, c);
+      ft.pcm[c][i] = sample (i, c);
+    }
+  }
+
+  if (interleave)
+    fish_sound_encode_float_ilv (ft.encoder, (float **)ft.ipcm, BLOCKSIZE);
+  else
+    fish_sound_encode_float (ft.encoder, ft.pcm, BLOCKSIZE);
+
+  if (ft.frames_out != BLOCKSIZE)
+    FAIL ("Incorrect number of frames decoded");
+
+  if (!ft.passthrough)
+    FAIL ("Audio copied");
+
+  fish_sound_delete (ft.encoder);
+  fish_sound_delete (ft.decoder);
+
+  free (ft.ipcm);
+  for (c = 0; c < channels; c++)
+    free (ft.pcm[c]);
+}
+
+static int
+clip_decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  float * p = (float *)pcm;
+
+  if (frames != 2 || p[0] != 32767.0f / 32768.0f || p[1] != -1.0f)
+    FAIL ("Out of range samples not clipped");
+
+  return 0;
+}
+
+static int
+clip_encoded (FishSound * fsound, unsigned char * buf, long bytes,
+	      void * user_data)
+{
+  fish_sound_decode ((FishSound *)user_data, buf, bytes);
+  return 0;
+}
+
+int
+main (int argc, char * argv[])
+{
+  int formats[] = {
+    FISH_SOUND_PCM_S16_LE, FISH_SOUND_PCM_S16_BE,
+    FISH_SOUND_PCM_S24_LE, FISH_SOUND_PCM_S24_BE,
+    FISH_SOUND_PCM_S32_LE, FISH_SOUND_PCM_S32_BE,
+    FISH_SOUND_PCM_FLOAT32_LE, FISH_SOUND_PCM_FLOAT32_BE,
+    0
+  };
+  unsigned char header[28] = {'P', 'C', 'M', ' ', ' ', ' ', ' ', ' ',
+			      0, 0, 0, 0, 0, 0, 0, 0x02, 0, 0, 0xac, 0x44,
+			      16, 2, 0, 0, 0, 0, 0, 0};
+  FishSound * encoder, * decoder;
+  FishSoundInfo fsinfo;
+  float samples[2] = {2.0f, -2.0f};
+  int i, format;
+
+  INFO ("Identifying Ogg PCM headers");
+  if (fish_sound_identify (header, 28) != FISH_SOUND_PCM)
+    FAIL ("Header not identified");
+  header[15] = 0x01; /* unsigned 8 bit */
+  if (fish_sound_identify (header, 28) != FISH_SOUND_UNKNOWN)
+    FAIL ("Unsupported sample format identified");
+  header[15] = 0x02;
+  header[8] = 1; /* major version */
+  if (fish_sound_identify (header, 28) != FISH_SOUND_UNKNOWN)
+    FAIL ("Unsupported version identified");
+  header[8] = 0;
+  header[21] = 0; /* channels */
+  if (fish_sound_identify (header, 28) != FISH_SOUND_UNKNOWN)
+    FAIL ("Header with no channels identified");
+  if (fish_sound_identify (header, 20) != FISH_SOUND_UNKNOWN)
+    FAIL ("Truncated header identified");
+
+  INFO ("Setting invalid sample format");
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = 1;
+  fsinfo.format = FISH_SOUND_PCM;
+  encoder = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  if (encoder == NULL) FAIL ("Encoder not created");
+  format = 0x01;
+  if (fish_sound_command (encoder, FISH_SOUND_SET_PCM_FORMAT, &format,
+			  sizeof (int)) != FISH_SOUND_ERR_INVALID)
+    FAIL ("Unsupported sample format set");
+
+  INFO ("Clipping out of range samples");
+  format = FISH_SOUND_PCM_S16_LE;
+  fish_sound_command (encoder, FISH_SOUND_SET_PCM_FORMAT, &format,
+		      sizeof (int));
+  decoder = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  fish_sound_set_encoded_callback (encoder, clip_encoded, decoder);
+  fish_sound_set_decoded_float_ilv (decoder, clip_decoded, NULL);
+  fish_sound_encode_float_ilv (encoder, (float **)samples, 2);
+  fish_sound_delete (encoder);
+  fish_sound_delete (decoder);
+
+  INFO ("Creating encoder with too many channels");
+  fsinfo.channels = 256;
+  if (fish_sound_new (FISH_SOUND_ENCODE, &fsinfo) != NULL)
+    FAIL ("Encoder created with 256 channels");
+
+  INFO ("Testing encode/decode pipeline for audio");
+  for (i = 0; formats[i] != 0; i++) {
+    fs_pcm_test (formats[i], 0, 1);
+    fs_pcm_test (formats[i], 0, 2);
+    fs_pcm_test (formats[i], 1, 1);
+    fs_pcm_test (formats[i], 1, 2);
+  }
+
+  INFO ("Testing passthrough of audio without copying");
+  fs_pcm_passthrough_test (1, 1);
+  fs_pcm_passthrough_test (1, 2);
+  fs_pcm_passthrough_test (0, 1);
+
+  exit (0);
+}
@@ -0,0 +1,360 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define SAMPLERATE 16000
+#define CHANNELS 2
+#define BLOCKSIZE 1024
+#define SECONDS 5
+
+/* Number of packets, or encode calls, to let the codec libraries settle
+ * before counting. libvorbis in particular sizes its per-block storage
+ * on the first few blocks it processes. */
+#define WARMUP 16
+
+/*
+ * Count heap calls by interposing on the C library allocator. This
+ * relies on the glibc __libc_* entry points; elsewhere the test only
+ * checks that real-time mode decodes correctly.
+ */
+static int counting = 0;
+static long nallocs = 0;
+
+#ifdef __GLIBC__
+#define COUNT_ALLOCS 1
+
+extern void * __libc_malloc (size_t size);
+extern void * __libc_calloc (size_t nmemb, size_t size);
+extern void * __libc_realloc (void * ptr, size_t size);
+extern void __libc_free (void * ptr);
+
+void *
+malloc (size_t size)
+{
+  if (counting) nallocs++;
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  if (counting) nallocs++;
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void * ptr, size_t size)
+{
+  if (counting) nallocs++;
+  return __libc_realloc (ptr, size);
+}
+
+void
+free (void * ptr)
+{
+  if (counting && ptr != NULL) nallocs++;
+  __libc_free (ptr);
+}
+#else
+#define COUNT_ALLOCS 0
+#endif
+
+static int
+encoded (FishSound * fsound, unsigned char * buf, long bytes, void * user_data)
+{
+  int was_counting = counting;
+  int ret;
+
+  /* Storing the packet is the test's business, not the library's */
+  counting = 0;
+  ret = fs_packets_encoded (fsound, buf, bytes, user_data);
+  counting = was_counting;
+
+  return ret;
+}
+
+static int
+decoded_ilv (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  long * total = (long *) user_data;
+
+  *total += frames;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static int
+decoded (FishSound * fsound, float * pcm[], long frames, void * user_data)
+{
+  long * total = (long *) user_data;
+
+  *total += frames;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static int
+encoded_count (FishSound * fsound, unsigned char * buf, long bytes,
+               void * user_data)
+{
+  long * total = (long *) user_data;
+
+  *total += bytes;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+/* Re-encode decoded audio with a second handle that is not in real-time
+ * mode */
+static int
+decoded_encode (FishSound * fsound, float ** pcm, long frames,
+                void * user_data)
+{
+  FishSound * encoder = (FishSound *) user_data;
+
+  fish_sound_encode (encoder, pcm, frames);
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static const char *
+format_name (int format)
+{
+  switch (format) {
+  case FISH_SOUND_VORBIS: return "Vorbis";
+  case FISH_SOUND_SPEEX: return "Speex";
+  case FISH_SOUND_FLAC: return "Flac";
+  case FISH_SOUND_PCM: return "PCM";
+  default: return "Unknown";
+  }
+}
+
+static void
+fs_encode_stream (int format, FS_PacketList * list)
+{
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  float * pcm;
+  long i, n, nblocks = SAMPLERATE * SECONDS / BLOCKSIZE;
+  int one = 1;
+  char msg[128];
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = CHANNELS;
+  fsinfo.format = format;
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_encoded_callback (fsound, encoded, list);
+
+  if (fish_sound_command (fsound, FISH_SOUND_SET_REALTIME, &one,
+                          sizeof (int)) != 0)
+    FAIL ("Could not set real-time mode for encoding");
+
+  pcm = malloc (sizeof (float) * CHANNELS * BLOCKSIZE);
+
+  nallocs = 0;
+
+  for (n = 0; n < nblocks; n++) {
+    for (i = 0; i < CHANNELS * BLOCKSIZE; i++)
+      pcm[i] = (float) ((n * BLOCKSIZE * CHANNELS + i) % 201 - 100) / 200.0;
+
+    counting = (n >= WARMUP);
+    fish_sound_encode (fsound, (float **)pcm, BLOCKSIZE);
+    counting = 0;
+  }
+
+  if (COUNT_ALLOCS && nallocs > 0) {
+    snprintf (msg, 128, "%s: %ld heap calls while encoding in real-time mode",
+              format_name (format), nallocs);
+    FAIL (msg);
+  }
+
+  fish_sound_flush (fsound);
+  fish_sound_delete (fsound);
+  free (pcm);
+}
+
+static void
+fs_realtime_test (int format, int interleave)
+{
+  FS_PacketList list = {NULL, 0, 0, 0};
+  FishSound * fsound;
+  long i, frames = 0;
+  int one = 1, realtime = 0;
+  char msg[128];
+
+  snprintf (msg, 128, "+ %s, %s", format_name (format),
+            interleave ? "interleaved" : "non-interleaved");
+  INFO (msg);
+
+  fs_encode_stream (format, &list);
+
+  if (list.npackets <= WARMUP) {
+    snprintf (msg, 128, "%s: only %ld packets encoded", format_name (format),
+              list.npackets);
+    FAIL (msg);
+  }
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  fish_sound_set_interleave (fsound, interleave);
+  if (interleave) {
+    fish_sound_set_decoded_float_ilv (fsound, decoded_ilv, &frames);
+  } else {
+    fish_sound_set_decoded_float (fsound, decoded, &frames);
+  }
+
+  if (fish_sound_command (fsound, FISH_SOUND_SET_REALTIME, &one,
+                          sizeof (int)) != 0)
+    FAIL ("Could not set real-time mode for decoding");
+
+  fish_sound_command (fsound, FISH_SOUND_GET_REALTIME, &realtime,
+                      sizeof (int));
+  if (realtime != 1)
+    FAIL ("Real-time mode not reported as set");
+
+  nallocs = 0;
+
+  for (i = 0; i < list.npackets; i++) {
+    counting = (i >= WARMUP);
+    fish_sound_decode (fsound, list.packets[i].packet,
+                       list.packets[i].bytes);
+    counting = 0;
+  }
+
+  if (COUNT_ALLOCS && nallocs > 0) {
+    snprintf (msg, 128, "%s: %ld heap calls while decoding in real-time mode",
+              format_name (format), nallocs);
+    FAIL (msg);
+  }
+
+  if (frames == 0) {
+    snprintf (msg, 128, "%s: no audio decoded", format_name (format));
+    FAIL (msg);
+  }
+
+  fish_sound_delete (fsound);
+
+  fs_packets_free (&list);
+}
+
+/*
+ * A real-time decoder feeding an encoder that is not in real-time mode:
+ * the encoder allocates from within the decoder's callback, which must
+ * not be treated as part of the decoder's real-time code path.
+ */
+static void
+fs_realtime_chain_test (int format)
+{
+  FS_PacketList list = {NULL, 0, 0, 0};
+  FishSound * decoder, * encoder;
+  FishSoundInfo fsinfo;
+  long i, bytes = 0;
+  int one = 1;
+  char msg[128];
+
+  snprintf (msg, 128, "+ %s, real-time decoder feeding an encoder",
+            format_name (format));
+  INFO (msg);
+
+  fs_encode_stream (format, &list);
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = CHANNELS;
+  fsinfo.format = FISH_SOUND_PCM;
+
+  encoder = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (encoder, 1);
+  fish_sound_set_encoded_callback (encoder, encoded_count, &bytes);
+
+  decoder = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  fish_sound_set_interleave (decoder, 1);
+  fish_sound_set_decoded_float_ilv (decoder, decoded_encode, encoder);
+
+  if (fish_sound_command (decoder, FISH_SOUND_SET_REALTIME, &one,
+                          sizeof (int)) != 0)
+    FAIL ("Could not set real-time mode for decoding");
+
+  for (i = 0; i < list.npackets; i++)
+    fish_sound_decode (decoder, list.packets[i].packet,
+                       list.packets[i].bytes);
+
+  fish_sound_flush (encoder);
+
+  if (bytes == 0) {
+    snprintf (msg, 128, "%s: no audio re-encoded", format_name (format));
+    FAIL (msg);
+  }
+
+  fish_sound_delete (decoder);
+  fish_sound_delete (encoder);
+
+  fs_packets_free (&list);
+}
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing for heap calls after the header phase in real-time mode");
+
+  if (!COUNT_ALLOCS)
+    INFO ("+ Allocator interposition not supported; not counting heap calls");
+
+  if (HAVE_VORBIS) {
+    fs_realtime_test (FISH_SOUND_VORBIS, 1);
+    fs_realtime_test (FISH_SOUND_VORBIS, 0);
+  }
+
+  if (HAVE_SPEEX) {
+    fs_realtime_test (FISH_SOUND_SPEEX, 1);
+    fs_realtime_test (FISH_SOUND_SPEEX, 0);
+  }
+
+  if (HAVE_FLAC) {
+    fs_realtime_test (FISH_SOUND_FLAC, 1);
+    fs_realtime_test (FISH_SOUND_FLAC, 0);
+  }
+
+  fs_realtime_chain_test (FISH_SOUND_PCM);
+
+  exit (0);
+}
@@ -0,0 +1,206 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define CHANNELS 2
+#define RING_FRAMES 256
+#define STREAM_FRAMES 1000000
+
+static void
+fs_ring_test_basic (void)
+{
+  FishSoundPCMRing * ring;
+  float in[CHANNELS * 300], out[CHANNELS * 300];
+  long i, n;
+
+  INFO ("+ Write, read and wraparound");
+
+  ring = fish_sound_pcm_ring_new (CHANNELS, RING_FRAMES, FISH_SOUND_RING_FLOAT);
+  if (ring == NULL) FAIL ("Unable to create ring");
+
+  if (fish_sound_pcm_ring_space (ring) != RING_FRAMES)
+    FAIL ("Incorrect space in new ring");
+
+  for (i = 0; i < CHANNELS * 300; i++)
+    in[i] = (float)i;
+
+  /* Move the read and write positions to the middle of the ring */
+  fish_sound_pcm_ring_write_float_ilv (ring, in, 200);
+  fish_sound_pcm_ring_read (ring, out, 200);
+
+  n = fish_sound_pcm_ring_write_float_ilv (ring, in, 200);
+  if (n != 200) FAIL ("Short write across end of ring");
+
+  if (fish_sound_pcm_ring_available (ring) != 200)
+    FAIL ("Incorrect count of available frames");
+
+  n = fish_sound_pcm_ring_read (ring, out, 200);
+  if (n != 200) FAIL ("Short read across end of ring");
+
+  if (memcmp (in, out, sizeof (float) * CHANNELS * 200))
+    FAIL ("Data read differs from data written");
+
+  if (fish_sound_pcm_ring_overruns (ring) != 0)
+    FAIL ("Overrun counted without overrun");
+
+  if (fish_sound_pcm_ring_underruns (ring) != 0)
+    FAIL ("Underrun counted without underrun");
+
+  INFO ("+ Overrun and underrun");
+
+  n = fish_sound_pcm_ring_write_float_ilv (ring, in, 300);
+  if (n != RING_FRAMES) FAIL ("Overrun did not fill ring");
+
+  if (fish_sound_pcm_ring_overruns (ring) != 1)
+    FAIL ("Overrun not counted");
+
+  fish_sound_pcm_ring_read (ring, out, RING_FRAMES - 10);
+  n = fish_sound_pcm_ring_read (ring, out, 20);
+  if (n != 10) FAIL ("Incorrect count of frames read on underrun");
+
+  for (i = CHANNELS * 10; i < CHANNELS * 20; i++)
+    if (out[i] != 0.0) FAIL ("Underrun not filled with silence");
+
+  if (fish_sound_pcm_ring_underruns (ring) != 1)
+    FAIL ("Underrun not counted");
+
+  fish_sound_pcm_ring_delete (ring);
+}
+
+static void
+fs_ring_test_s16 (void)
+{
+  FishSoundPCMRing * ring;
+  float in[4] = {0.0, 0.5, -1.0, 2.0};
+  short out[4], expected[4] = {0, 16384, -32767, 32767};
+  int i;
+
+  INFO ("+ Conversion to 16 bit integer");
+
+  ring = fish_sound_pcm_ring_new (1, 4, FISH_SOUND_RING_S16);
+  if (ring == NULL) FAIL ("Unable to create ring");
+
+  fish_sound_pcm_ring_write_float_ilv (ring, in, 4);
+  fish_sound_pcm_ring_read (ring, out, 4);
+
+  for (i = 0; i < 4; i++)
+    if (out[i] != expected[i]) FAIL ("Incorrect 16 bit conversion");
+
+  fish_sound_pcm_ring_delete (ring);
+}
+
+#if HAVE_PTHREAD
+static void *
+fs_ring_producer (void * data)
+{
+  FishSoundPCMRing * ring = (FishSoundPCMRing *)data;
+  float pcm[CHANNELS * 100];
+  long frameno = 0, i, n;
+
+  while (frameno < STREAM_FRAMES) {
+    n = 37 + frameno % 61;
+    if (n > STREAM_FRAMES - frameno) n = STREAM_FRAMES - frameno;
+    if (fish_sound_pcm_ring_space (ring) < n) continue;
+
+    for (i = 0; i < n * CHANNELS; i++)
+      pcm[i] = (float)(frameno + i / CHANNELS);
+    fish_sound_pcm_ring_write_float_ilv (ring, pcm, n);
+    frameno += n;
+  }
+
+  return NULL;
+}
+
+static void
+fs_ring_test_threads (void)
+{
+  FishSoundPCMRing * ring;
+  pthread_t thread;
+  float pcm[CHANNELS * 64];
+  long frameno = 0, i, n;
+
+  INFO ("+ Separate producer and consumer threads");
+
+  ring = fish_sound_pcm_ring_new (CHANNELS, RING_FRAMES, FISH_SOUND_RING_FLOAT);
+  if (ring == NULL) FAIL ("Unable to create ring");
+
+  pthread_create (&thread, NULL, fs_ring_producer, ring);
+
+  while (frameno < STREAM_FRAMES) {
+    n = fish_sound_pcm_ring_available (ring);
+    if (n == 0) continue;
+    if (n > 64) n = 64;
+
+    fish_sound_pcm_ring_read (ring, pcm, n);
+    for (i = 0; i < n * CHANNELS; i++)
+      if (pcm[i] != (float)(frameno + i / CHANNELS))
+        FAIL ("Frames received out of order");
+    frameno += n;
+  }
+
+  pthread_join (thread, NULL);
+
+  if (fish_sound_pcm_ring_overruns (ring) != 0 ||
+      fish_sound_pcm_ring_underruns (ring) != 0)
+    FAIL ("Overrun or underrun counted without overrun or underrun");
+
+  fish_sound_pcm_ring_delete (ring);
+}
+#endif
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing PCM ring buffer");
+
+  fs_ring_test_basic ();
+  fs_ring_test_s16 ();
+
+#if HAVE_PTHREAD
+  fs_ring_test_threads ();
+#endif
+
+  exit (0);
+}
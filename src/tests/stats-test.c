@@ -0,0 +1,228 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define SAMPLERATE 16000
+#define CHANNELS 2
+#define BLOCKSIZE 1024
+#define NBLOCKS 40
+
+typedef struct {
+  long frames;
+  long callbacks;
+} FS_StatsData;
+
+static int
+decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  FS_StatsData * sd = (FS_StatsData *) user_data;
+
+  sd->frames += frames;
+  sd->callbacks++;
+
+  return FISH_SOUND_CONTINUE;
+}
+
+static long
+histogram_total (FishSoundStats * stats)
+{
+  long total = 0;
+  int i;
+
+  for (i = 0; i < FISH_SOUND_STATS_HISTOGRAM_SIZE; i++)
+    total += stats->histogram[i];
+
+  return total;
+}
+
+static void
+get_stats (FishSound * fsound, FishSoundStats * stats)
+{
+  if (fish_sound_command (fsound, FISH_SOUND_GET_STATS, stats,
+                          sizeof (FishSoundStats)) != 0)
+    FAIL ("FISH_SOUND_GET_STATS failed");
+}
+
+static void
+test_errors (void)
+{
+  FishSound * fsound;
+  FishSoundStats stats;
+  unsigned char junk[16];
+
+  INFO ("+ Counting errors and calls");
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+
+  memset (junk, 0x55, sizeof (junk));
+  if (fish_sound_decode (fsound, junk, sizeof (junk)) != -1)
+    FAIL ("Unknown data was decoded");
+
+  get_stats (fsound, &stats);
+
+  if (stats.packets_in != 1 || stats.bytes_in != (long)sizeof (junk))
+    FAIL ("Packet passed to decode was not counted");
+
+  if (stats.errors[-FISH_SOUND_ERR_GENERIC] != 1)
+    FAIL ("Decode error was not counted");
+
+  if (histogram_total (&stats) != 1)
+    FAIL ("Histogram does not count one call");
+
+  if (stats.callbacks != 0 || stats.frames != 0)
+    FAIL ("Callbacks counted without decoding audio");
+
+  if (fish_sound_command (fsound, FISH_SOUND_GET_STATS, &stats,
+                          sizeof (FishSoundStats) - 1) !=
+      FISH_SOUND_ERR_INVALID)
+    FAIL ("FISH_SOUND_GET_STATS accepted a short buffer");
+
+  fish_sound_command (fsound, FISH_SOUND_RESET_STATS, NULL, 0);
+  get_stats (fsound, &stats);
+
+  if (stats.packets_in != 0 || stats.errors[-FISH_SOUND_ERR_GENERIC] != 0 ||
+      histogram_total (&stats) != 0)
+    FAIL ("FISH_SOUND_RESET_STATS did not clear the statistics");
+
+  fish_sound_delete (fsound);
+}
+
+static void
+test_encdec (int format, const char * name)
+{
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  FishSoundStats stats;
+  FS_PacketList enc = {NULL, 0, 0, 0};
+  FS_StatsData dec;
+  float * pcm;
+  long i;
+  char msg[128];
+
+  snprintf (msg, 128, "+ %s encode and decode", name);
+  INFO (msg);
+
+  memset (&dec, 0, sizeof (FS_StatsData));
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = CHANNELS;
+  fsinfo.format = format;
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_encoded_callback (fsound, fs_packets_encoded, &enc);
+
+  pcm = malloc (sizeof (float) * CHANNELS * BLOCKSIZE);
+  for (i = 0; i < CHANNELS * BLOCKSIZE; i++)
+    pcm[i] = (float) (i % 100 - 50) / 100.0;
+
+  for (i = 0; i < NBLOCKS; i++)
+    fish_sound_encode_float_ilv (fsound, (float **)pcm, BLOCKSIZE);
+  fish_sound_flush (fsound);
+
+  get_stats (fsound, &stats);
+
+  if (stats.frames != NBLOCKS * BLOCKSIZE)
+    FAIL ("Encoded frames not counted");
+
+  if (stats.packets_out != enc.npackets || stats.bytes_out != enc.bytes)
+    FAIL ("Encoded packets not counted");
+
+  if (stats.callbacks != enc.npackets)
+    FAIL ("Encoded callbacks not counted");
+
+  /* The first call generates the headers; calls made by fish_sound_new()
+   * are not included */
+  if (histogram_total (&stats) > NBLOCKS + 1)
+    FAIL ("Histogram counts too many calls");
+
+  if (stats.codec_seconds <= 0.0)
+    FAIL ("No time spent encoding");
+
+  fish_sound_delete (fsound);
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_decoded_float_ilv (fsound, decoded, &dec);
+
+  for (i = 0; i < enc.npackets; i++)
+    fish_sound_decode (fsound, enc.packets[i].packet, enc.packets[i].bytes);
+
+  get_stats (fsound, &stats);
+
+  if (stats.packets_in != enc.npackets || stats.bytes_in != enc.bytes)
+    FAIL ("Decoded packets not counted");
+
+  if (stats.frames != dec.frames || stats.callbacks != dec.callbacks)
+    FAIL ("Decoded frames not counted");
+
+  if (histogram_total (&stats) != enc.npackets)
+    FAIL ("Histogram does not count each packet");
+
+  if (stats.packets_out != 0 || stats.bytes_out != 0)
+    FAIL ("Encoded packets counted while decoding");
+
+  fish_sound_delete (fsound);
+
+  fs_packets_free (&enc);
+  free (pcm);
+}
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing FISH_SOUND_GET_STATS");
+
+  if (FS_DECODE)
+    test_errors ();
+
+  if (FS_ENCODE && FS_DECODE) {
+    if (HAVE_VORBIS && HAVE_VORBISENC)
+      test_encdec (FISH_SOUND_VORBIS, "Vorbis");
+    if (HAVE_SPEEX)
+      test_encdec (FISH_SOUND_SPEEX, "Speex");
+    if (HAVE_FLAC)
+      test_encdec (FISH_SOUND_FLAC, "Flac");
+  }
+
+  exit (0);
+}
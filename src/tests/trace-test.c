@@ -0,0 +1,250 @@
+/*
+   Copyright (C) 2003 Commonwealth Scientific and Industrial Research
+   Organisation (CSIRO) Australia
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   - Neither the name of CSIRO Australia nor the names of its
+   contributors may be used to endorse or promote products derived from
+   this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+   PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE ORGANISATION OR
+   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fishsound/fishsound.h>
+
+#include "fs_tests.h"
+
+#define SAMPLERATE 16000
+#define CHANNELS 1
+#define BLOCKSIZE 1024
+#define NBLOCKS 20
+
+enum {
+  DECODE_BEGIN, DECODE_END, ENCODE_BEGIN, ENCODE_END,
+  CALLBACK_BEGIN, CALLBACK_END, HEADERS, ERROR, NEVENTS
+};
+
+typedef struct {
+  long count[NEVENTS];
+  long depth;
+  long last_value;
+  double last_timestamp;
+  int backwards;
+} FS_TraceData;
+
+static void
+trace (FS_TraceData * td, int event, double timestamp, long value)
+{
+  td->count[event]++;
+  td->last_value = value;
+  if (timestamp < td->last_timestamp) td->backwards = 1;
+  td->last_timestamp = timestamp;
+}
+
+#define TRACE_HOOK(name, event)                                         \
+static void                                                             \
+name (FishSound * fsound, int codec, long packetno, double timestamp,   \
+      long value, void * user_data)                                     \
+{                                                                       \
+  trace ((FS_TraceData *)user_data, event, timestamp, value);           \
+}
+
+TRACE_HOOK (decode_begin, DECODE_BEGIN)
+TRACE_HOOK (decode_end, DECODE_END)
+TRACE_HOOK (encode_begin, ENCODE_BEGIN)
+TRACE_HOOK (encode_end, ENCODE_END)
+TRACE_HOOK (callback_begin, CALLBACK_BEGIN)
+TRACE_HOOK (callback_end, CALLBACK_END)
+TRACE_HOOK (headers, HEADERS)
+TRACE_HOOK (error, ERROR)
+
+static void
+set_hooks (FishSound * fsound, FS_TraceData * td)
+{
+  FishSoundTraceHooks hooks;
+
+  memset (td, 0, sizeof (FS_TraceData));
+
+  hooks.decode_begin = decode_begin;
+  hooks.decode_end = decode_end;
+  hooks.encode_begin = encode_begin;
+  hooks.encode_end = encode_end;
+  hooks.callback_begin = callback_begin;
+  hooks.callback_end = callback_end;
+  hooks.headers = headers;
+  hooks.error = error;
+  hooks.user_data = td;
+
+  if (fish_sound_set_trace_hooks (fsound, &hooks) != 0)
+    FAIL ("Could not set trace hooks");
+}
+
+static int
+decoded (FishSound * fsound, float ** pcm, long frames, void * user_data)
+{
+  return FISH_SOUND_CONTINUE;
+}
+
+static void
+test_errors (void)
+{
+  FishSound * fsound;
+  FS_TraceData td;
+  unsigned char junk[16];
+
+  INFO ("+ Tracing a decode error");
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  set_hooks (fsound, &td);
+
+  memset (junk, 0x55, sizeof (junk));
+  fish_sound_decode (fsound, junk, sizeof (junk));
+
+  if (td.count[DECODE_BEGIN] != 1 || td.count[DECODE_END] != 1)
+    FAIL ("Decode call not traced");
+
+  if (td.count[ERROR] != 1)
+    FAIL ("Decode error not traced");
+
+  if (td.last_value != -1)
+    FAIL ("Decode end not given the return value");
+
+  INFO ("+ Removing hooks");
+
+  fish_sound_set_trace_hooks (fsound, NULL);
+  fish_sound_decode (fsound, junk, sizeof (junk));
+
+  if (td.count[DECODE_BEGIN] != 1)
+    FAIL ("Hook called after removal");
+
+  fish_sound_delete (fsound);
+}
+
+static void
+test_encdec (int format, const char * name)
+{
+  FishSound * fsound;
+  FishSoundInfo fsinfo;
+  FishSoundStats stats;
+  FS_TraceData td;
+  FS_PacketList list = {NULL, 0, 0, 0};
+  float pcm[BLOCKSIZE];
+  long i;
+  char msg[128];
+
+  snprintf (msg, 128, "+ Tracing %s encode and decode", name);
+  INFO (msg);
+
+  for (i = 0; i < BLOCKSIZE; i++)
+    pcm[i] = (float) (i % 100 - 50) / 100.0;
+
+  fsinfo.samplerate = SAMPLERATE;
+  fsinfo.channels = CHANNELS;
+  fsinfo.format = format;
+
+  fsound = fish_sound_new (FISH_SOUND_ENCODE, &fsinfo);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_encoded_callback (fsound, fs_packets_encoded, &list);
+  set_hooks (fsound, &td);
+
+  for (i = 0; i < NBLOCKS; i++)
+    fish_sound_encode_float_ilv (fsound, (float **)pcm, BLOCKSIZE);
+  fish_sound_flush (fsound);
+
+  fish_sound_command (fsound, FISH_SOUND_GET_STATS, &stats,
+                      sizeof (FishSoundStats));
+
+  if (td.count[ENCODE_BEGIN] != NBLOCKS + 1 ||
+      td.count[ENCODE_END] != NBLOCKS + 1)
+    FAIL ("Encode calls not traced");
+
+  if (td.count[CALLBACK_BEGIN] != list.npackets ||
+      td.count[CALLBACK_END] != list.npackets ||
+      td.count[CALLBACK_BEGIN] != stats.callbacks)
+    FAIL ("Encoded callbacks not traced");
+
+  if (td.count[HEADERS] != 1)
+    FAIL ("Header completion not traced once while encoding");
+
+  if (td.count[ERROR] != 0 || td.backwards)
+    FAIL ("Unexpected trace while encoding");
+
+  fish_sound_delete (fsound);
+
+  fsound = fish_sound_new (FISH_SOUND_DECODE, NULL);
+  fish_sound_set_interleave (fsound, 1);
+  fish_sound_set_decoded_float_ilv (fsound, decoded, NULL);
+  set_hooks (fsound, &td);
+
+  for (i = 0; i < list.npackets; i++)
+    fish_sound_decode (fsound, list.packets[i].packet,
+                       list.packets[i].bytes);
+
+  fish_sound_command (fsound, FISH_SOUND_GET_STATS, &stats,
+                      sizeof (FishSoundStats));
+
+  if (td.count[DECODE_BEGIN] != list.npackets ||
+      td.count[DECODE_END] != list.npackets)
+    FAIL ("Decode calls not traced");
+
+  if (td.count[CALLBACK_BEGIN] != stats.callbacks ||
+      td.count[CALLBACK_END] != stats.callbacks)
+    FAIL ("Decoded callbacks not traced");
+
+  if (td.count[HEADERS] != 1)
+    FAIL ("Header completion not traced once while decoding");
+
+  if (td.count[ERROR] != 0 || td.backwards)
+    FAIL ("Unexpected trace while decoding");
+
+  fish_sound_delete (fsound);
+
+  fs_packets_free (&list);
+}
+
+int
+main (int argc, char * argv[])
+{
+  INFO ("Testing trace hooks");
+
+  if (FS_DECODE)
+    test_errors ();
+
+  if (FS_ENCODE && FS_DECODE) {
+    if (HAVE_VORBIS && HAVE_VORBISENC)
+      test_encdec (FISH_SOUND_VORBIS, "Vorbis");
+    if (HAVE_SPEEX)
+      test_encdec (FISH_SOUND_SPEEX, "Speex");
+    if (HAVE_FLAC)
+      test_encdec (FISH_SOUND_FLAC, "Flac");
+  }
+
+  exit (0);
+}